@@ -6,27 +6,75 @@
 
 #include "Set.hpp"
 #include <setsync/bloom/CountingBloomFilter.h>
+#include <setsync/bloom/BloomFilterChunkCodec.h>
 #include <typeinfo>
 #include <string.h>
 #include <iostream>
+#include <algorithm>
+#include <vector>
+#include <deque>
+#include <stdexcept>
 #ifdef HAVE_LEVELDB
 #include <setsync/storage/LevelDbStorage.h>
 #endif
+#ifdef HAVE_LMDB
+#include <setsync/storage/LmdbStorage.h>
+#endif
 #ifdef HAVE_DB_CXX_H
 #include <setsync/storage/BdbStorage.h>
+#endif
 #include <setsync/storage/MemStorage.h>
+#include <setsync/storage/EpochStorage.h>
 #define GIGABYTE 1024 * 1024 * 1024
-#endif
 #include <setsync/utils/bitset.h>
 #include <stdlib.h>
 
 namespace setsync {
 
+/**
+ * Adds all handled hashes to the given trie without rehashing the parents
+ */
+class TrieInsertHandler: public AbstractDiffHandler {
+private:
+	trie::Trie& trie_;
+public:
+	TrieInsertHandler(trie::Trie& trie) :
+		trie_(trie) {
+	}
+	virtual void handle(const unsigned char * hash, const std::size_t hashsize,
+			const bool existsLocally) {
+		_unused(hashsize);
+		_unused(existsLocally);
+		trie_.add(hash, false);
+	}
+};
+
+/**
+ * Adds all handled hashes to the given bloom filter. The counting bloom
+ * filter passes a hash once per position, so each hash is added once only.
+ */
+class BloomFilterInsertHandler: public AbstractDiffHandler {
+private:
+	bloom::AbstractBloomFilter& bf_;
+public:
+	BloomFilterInsertHandler(bloom::AbstractBloomFilter& bf) :
+		bf_(bf) {
+	}
+	virtual void handle(const unsigned char * hash, const std::size_t hashsize,
+			const bool existsLocally) {
+		_unused(hashsize);
+		_unused(existsLocally);
+		if (!bf_.contains(hash))
+			bf_.add(hash);
+	}
+};
+
 SynchronizationProcess::SynchronizationProcess(Set * set,
 		AbstractDiffHandler * handler) :
 	stat_(START), set_(set), handler_(handler), bloomfilterOut_pos(0),
-			bloomfilterIn_pos(0), bfOutIsFinished_(false), sentBytes_(0),
-			receivedBytes_(0) {
+			bloomfilterIn_pos(0), bfOutIsFinished_(false),
+			bfTransferType_(set->config_.getBloomFilter().getType()),
+			sentBytes_(0), receivedBytes_(0) {
 }
 
 SynchronizationProcess::~SynchronizationProcess() {
@@ -64,6 +112,18 @@ bool SynchronizationProcess::isAckOutputAvailable() const {
 
 std::size_t SynchronizationProcess::readNextBloomFilterChunk(
 		unsigned char * buffer, const std::size_t length) {
+	if (this->bfTransferType_
+			== config::Configuration::BloomFilterConfig::COMPRESSED) {
+		std::size_t covered;
+		std::size_t written = this->set_->bf_->getCompressedChunk(buffer,
+				length, this->bloomfilterOut_pos, &covered);
+		this->bloomfilterOut_pos += covered;
+		if (this->bloomfilterOut_pos >= this->set_->bf_->size()) {
+			bfOutIsFinished_ = true;
+		}
+		this->sentBytes_ += written;
+		return written;
+	}
 	std::size_t written = this->set_->bf_->getChunk(buffer, length,
 			this->bloomfilterOut_pos);
 	this->bloomfilterOut_pos += written;
@@ -77,11 +137,43 @@ std::size_t SynchronizationProcess::readNextBloomFilterChunk(
 void SynchronizationProcess::processBloomFilterChunk(
 		const unsigned char * buffer, const std::size_t length,
 		AbstractDiffHandler& handler) {
+	if (this->bfTransferType_
+			== config::Configuration::BloomFilterConfig::COMPRESSED) {
+		if (length > 0) {
+			bloomfilterIn_pos = this->set_->bf_->diffCompressed(buffer, length,
+					handler);
+		}
+		this->receivedBytes_ += length;
+		return;
+	}
 	this->set_->bf_->diff(buffer, length, bloomfilterIn_pos, handler);
 	bloomfilterIn_pos += length;
 	this->receivedBytes_ += length;
 }
 
+config::Configuration::BloomFilterConfig::BloomFilterType SynchronizationProcess::getBloomFilterTransferType() const {
+	return this->bfTransferType_;
+}
+
+void SynchronizationProcess::setBloomFilterTransferType(
+		const config::Configuration::BloomFilterConfig::BloomFilterType type) {
+	if (this->bloomfilterOut_pos > 0 || this->bloomfilterIn_pos > 0
+			|| this->bfOutIsFinished_) {
+		throw std::logic_error(
+				"The bloom filter transfer has already been started");
+	}
+	this->bfTransferType_ = type;
+}
+
+config::Configuration::BloomFilterConfig::BloomFilterType SynchronizationProcess::negotiateBloomFilterTransferType(
+		const config::Configuration::BloomFilterConfig::BloomFilterType remoteType) {
+	if (remoteType != this->bfTransferType_) {
+		setBloomFilterTransferType(
+				config::Configuration::BloomFilterConfig::NORMAL);
+	}
+	return this->bfTransferType_;
+}
+
 bool SynchronizationProcess::getRootHash(unsigned char * hash) {
 	return this->set_->trie_->getRoot(hash);
 }
@@ -157,8 +249,13 @@ size_t SynchronizationProcess::processSubTrie(const unsigned char * buffer,
 		const std::size_t length) {
 	std::size_t hashsize = this->set_->getHashFunction().getHashSize();
 	std::size_t entries = length / hashsize;
+	// All nodes of the subtrie are looked up at once
+	std::vector<trie::TrieNodeType> types(entries);
+	if (entries > 0) {
+		this->set_->trie_->containsAll(buffer, entries, &types[0]);
+	}
 	for (std::size_t i = 0; i < entries; i++) {
-		if (this->set_->trie_->contains(buffer + i * hashsize)) {
+		if (types[i] != trie::NOT_FOUND) {
 			this->pendingAcks_.push(false);
 		} else {
 			this->pendingAcks_.push(true);
@@ -176,15 +273,29 @@ void SynchronizationProcess::processAcks(const unsigned char * buffer,
 	if (numberOfAcks > this->sentHashes_.size()) {
 		throw "illegal input length";
 	}
+	// The acknowledged hashes are looked up at once
+	const std::size_t hashsize = this->set_->getHashFunction().getHashSize();
+	std::deque<crypto::CryptoHashContainer> sent;
+	std::vector<unsigned char> acked;
 	for (std::size_t i = 0; i < numberOfAcks; i++) {
+		sent.push_back(this->sentHashes_.front());
+		this->sentHashes_.pop();
 		if (BITTEST(buffer,i)) {
-			trie::TrieNodeType type = this->set_->trie_->contains(
-					this->sentHashes_.front().get());
+			acked.insert(acked.end(), sent[i].get(), sent[i].get() + hashsize);
+		}
+	}
+	std::vector<trie::TrieNodeType> types(acked.size() / hashsize);
+	if (!types.empty()) {
+		this->set_->trie_->containsAll(&acked[0], types.size(), &types[0]);
+	}
+	std::size_t ackedIndex = 0;
+	for (std::size_t i = 0; i < numberOfAcks; i++) {
+		if (BITTEST(buffer,i)) {
+			trie::TrieNodeType type = types[ackedIndex++];
 			if (type == trie::LEAF_NODE) {
-				handler.handle(this->sentHashes_.front().get(),
-						this->set_->getHashFunction().getHashSize(), true);
+				handler.handle(sent[i].get(), hashsize, true);
 			} else if (type == trie::INNER_NODE) {
-				this->pendingSubtries_.push(this->sentHashes_.front());
+				this->pendingSubtries_.push(sent[i]);
 			} else {
 				// THIS SHOULD NEVER HAPPEN, BUT IF MULTIPLE INSTANCES ARE SYNCING,
 				// THIS COULD HAPPEN AND IT RESTARTS THE TRIESYNC
@@ -200,7 +311,6 @@ void SynchronizationProcess::processAcks(const unsigned char * buffer,
 
 			}
 		}
-		this->sentHashes_.pop();
 	}
 	this->receivedBytes_ += (numberOfAcks + 7) / 8;
 }
@@ -249,11 +359,16 @@ std::size_t SynchronizationProcess::getMinTrieBuffer() const {
 }
 
 std::size_t SynchronizationProcess::getMinBFBuffer() const {
+	if (this->bfTransferType_
+			== config::Configuration::BloomFilterConfig::COMPRESSED) {
+		return std::max(this->set_->getMinSyncBFBuffer(),
+				bloom::BloomFilterChunkCodec::MIN_CHUNK_SIZE);
+	}
 	return this->set_->getMinSyncBFBuffer();
 }
 
 std::size_t SynchronizationProcess::getMinBuffer() const {
-	return this->set_->getMinSyncBuffer();
+	return std::max(getMinBFBuffer(), getMinTrieBuffer());
 }
 
 std::size_t Set::getMinSyncTrieBuffer() const {
@@ -286,7 +401,8 @@ std::size_t Set::getBFFunctionCount() const {
 Set::Set(const config::Configuration& config) :
 	hash_(config.getHashFunction()), config_(config), tempDir(NULL),
 			indexInUse_(false) {
-	if (config_.getPath().size() == 0) {
+	if (config_.getPath().size() == 0 && config_.getStorage().getType()
+			!= config::Configuration::StorageConfig::IN_MEMORY) {
 		tempDir = new utils::FileSystem::TemporaryDirectory("set_");
 	}
 #ifdef HAVE_DB_CXX_H
@@ -295,6 +411,9 @@ Set::Set(const config::Configuration& config) :
 	this->indexdb = NULL;
 	this->env_ = NULL;
 #endif
+	storage::AbstractKeyValueStorage * trieStorage = NULL;
+	storage::AbstractKeyValueStorage * bfStorage = NULL;
+	storage::AbstractKeyValueStorage * indexStorage = NULL;
 	switch (config_.getStorage().getType()) {
 #ifdef HAVE_LEVELDB
 	case config::Configuration::StorageConfig::LEVELDB: {
@@ -316,13 +435,59 @@ Set::Set(const config::Configuration& config) :
 			std::size_t cache = GIGABYTE * gbsize + size;
 			cachesize = cache / 2;
 		}
-		trieStorage_ = new storage::LevelDbStorage(triepath, cachesize);
+		// Epochs let clear() just skip the old entries
+		if (config_.getStorage().isShared()) {
+			// One database gets the whole cache
+			storage::AbstractKeyValueStorage * shared =
+					new storage::LevelDbStorage(path + "set", cachesize * 2);
+			backingStorages_.push_back(shared);
+			trieStorage = new storage::EpochStorage(*shared, "t");
+			bfStorage = new storage::EpochStorage(*shared, "b");
+			indexStorage = new storage::EpochStorage(*shared, "i");
+			break;
+		}
+		backingStorages_.push_back(
+				new storage::LevelDbStorage(triepath, cachesize));
+		trieStorage = new storage::EpochStorage(*backingStorages_.back());
 		std::string bfpath(path);
 		bfpath.append("bloom");
-		bfStorage_ = new storage::LevelDbStorage(bfpath, cachesize);
+		backingStorages_.push_back(
+				new storage::LevelDbStorage(bfpath, cachesize));
+		bfStorage = new storage::EpochStorage(*backingStorages_.back());
 		std::string indexpath(path);
 		indexpath.append("index");
-		indexStorage_ = new storage::LevelDbStorage(indexpath);
+		backingStorages_.push_back(new storage::LevelDbStorage(indexpath));
+		indexStorage = new storage::EpochStorage(*backingStorages_.back());
+	}
+		break;
+#endif
+#ifdef HAVE_LMDB
+	case config::Configuration::StorageConfig::LMDB: {
+		std::string path;
+		if (tempDir != NULL) {
+			path = tempDir->getPath();
+		} else {
+			path = config_.getPath();
+		}
+		if (path.size() > 0 && path.at(path.size() - 1) != '/') {
+			path = path.append("/");
+		}
+		// LMDB reads through the page cache, so there is no cache size
+		if (config_.getStorage().isShared()) {
+			storage::AbstractKeyValueStorage * shared =
+					new storage::LmdbStorage(path + "set");
+			backingStorages_.push_back(shared);
+			trieStorage = new storage::EpochStorage(*shared, "t");
+			bfStorage = new storage::EpochStorage(*shared, "b");
+			indexStorage = new storage::EpochStorage(*shared, "i");
+			break;
+		}
+		backingStorages_.push_back(new storage::LmdbStorage(path + "trie"));
+		trieStorage = new storage::EpochStorage(*backingStorages_.back());
+		backingStorages_.push_back(new storage::LmdbStorage(path + "bloom"));
+		bfStorage = new storage::EpochStorage(*backingStorages_.back());
+		backingStorages_.push_back(new storage::LmdbStorage(path + "index"));
+		indexStorage = new storage::EpochStorage(*backingStorages_.back());
 	}
 		break;
 #endif
@@ -349,54 +514,38 @@ Set::Set(const config::Configuration& config) :
 		this->bfdb->open(NULL, "set", "bf", DB_HASH, DB_CREATE, 0);
 		this->triedb->open(NULL, "set", "trie", DB_HASH, DB_CREATE, 0);
 		this->indexdb->open(NULL, "set", "in", DB_HASH, DB_CREATE, 0);
-		trieStorage_ = new storage::BdbStorage(this->triedb);
-		bfStorage_ = new storage::BdbStorage(this->bfdb);
-		indexStorage_ = new storage::BdbStorage(this->indexdb);
-	}
-		break;
-	case config::Configuration::StorageConfig::IN_MEMORY: {
-		std::string path;
-		if (tempDir == NULL)
-			tempDir = new utils::FileSystem::TemporaryDirectory("set_");
-		path = tempDir->getPath();
-		this->env_ = new DbEnv(0);
-		if (this->env_->open(path.c_str(), DB_INIT_MPOOL | DB_CREATE, 0) != 0) {
-			this->env_->close(0);
-			throw "Failed to open berkeley db database env";
-		}
-		uint64_t size = config_.getStorage().getByteCacheSize();
-		std::size_t gbsize = config_.getStorage().getGByteCacheSize();
-		if (!config_.getStorage().isCacheSizeGiven()) {
-			uint64_t maxElements = config_.getBloomFilter().getMaxElements();
-			size = maxElements * getHashFunction().getHashSize() * 40 + 1024
-					* 1024;
-			if (size > GIGABYTE) {
-				gbsize = size / GIGABYTE;
-				size = size % GIGABYTE;
-			}
-		}
-		std::size_t halfcache = size / 2;
-		std::size_t halfgbcache = gbsize / 2;
-		if (gbsize % 2 == 1) {
-			std::size_t remainder = GIGABYTE / 2;
-			halfcache += remainder;
-			if (halfcache > GIGABYTE) {
-				halfgbcache += halfcache / GIGABYTE;
-				halfcache = halfcache % GIGABYTE;
-			}
-		}
-		trieStorage_ = new storage::MemStorage(halfgbcache, halfcache);
-		bfStorage_ = new storage::MemStorage(halfgbcache, halfcache);
-		this->indexdb = new Db(this->env_, 0);
-		this->indexdb->open(NULL, "set", "in", DB_HASH, DB_CREATE, 0);
-		indexStorage_ = new storage::BdbStorage(this->indexdb);
+		trieStorage = new storage::BdbStorage(this->triedb);
+		bfStorage = new storage::BdbStorage(this->bfdb);
+		indexStorage = new storage::BdbStorage(this->indexdb);
 	}
 		break;
 #endif
+	case config::Configuration::StorageConfig::IN_MEMORY:
+		// A trie node record consists of 5 hashes and 2 bytes
+		trieStorage = new storage::MemStorage(
+				hash_.getHashSize() * 5 + 2 * sizeof(uint8_t));
+		bfStorage = new storage::MemStorage();
+		indexStorage = new storage::MemStorage();
+		break;
 	default:
 		throw "No storage type found!";
 	}
-	trie_ = new trie::KeyValueTrie(hash_, *trieStorage_);
+	// Counting is cheap enough to instrument the storages permanently
+	backingStorages_.push_back(trieStorage);
+	trieStorage_ = new storage::InstrumentedStorage(*trieStorage);
+	backingStorages_.push_back(bfStorage);
+	bfStorage_ = new storage::InstrumentedStorage(*bfStorage);
+	backingStorages_.push_back(indexStorage);
+	indexStorage_ = new storage::InstrumentedStorage(*indexStorage);
+	switch (config_.getTrie().getType()) {
+	case config::Configuration::TrieConfig::IN_MEMORY_TRIE:
+		trie_ = new trie::MemoryTrie(hash_);
+		break;
+	default:
+		trie_ = new trie::KeyValueTrie(hash_, *trieStorage_,
+				config_.getTrie().getCacheSize());
+		break;
+	}
 	const config::Configuration::BloomFilterConfig& bfconfig =
 			config_.getBloomFilter();
 	std::string path;
@@ -408,12 +557,34 @@ Set::Set(const config::Configuration& config) :
 	if (path.size() > 0 && path.at(path.size() - 1) != '/') {
 		path = path.append("/");
 	}
-	std::string bffile(path);
-	bffile.append("bloom.filter");
-	bf_ = new bloom::KeyValueCountingBloomFilter(hash_, *bfStorage_, bffile,
+	std::string bffile;
+	if (config_.getStorage().getType()
+			!= config::Configuration::StorageConfig::IN_MEMORY) {
+		// An in memory set keeps its bloom filter in memory, too
+		bffile = path + "bloom.filter";
+	}
+	bf_ = new bloom::ScalableBloomFilter(hash_, *bfStorage_, bffile,
 			bfconfig.getMaxElements(), bfconfig.isHardMaximum(),
-			bfconfig.falsePositiveRate);
+			bfconfig.falsePositiveRate, bfconfig.isScalable(),
+			bfconfig.getCheckpointInterval(),
+			bfconfig.getSegmentSize(), bfconfig.isPrefault(),
+			bfconfig.isHugePages());
 	index_ = new setsync::index::KeyValueIndex(hash_, *indexStorage_);
+	localFilter_ = NULL;
+	if (bfconfig.isBlockedLocalFilter()) {
+		// The local filter isn't persistent, so it is rebuilt from the bloom filter
+		localFilter_ = new bloom::BlockedBloomFilter(hash_,
+				bfconfig.getMaxElements(), false, bfconfig.falsePositiveRate);
+		BloomFilterInsertHandler handler(*localFilter_);
+		bf_->getAll(handler);
+	}
+	if (config_.getTrie().getType()
+			== config::Configuration::TrieConfig::IN_MEMORY_TRIE) {
+		// The trie isn't persistent, so it is rebuilt from the bloom filter
+		TrieInsertHandler handler(*trie_);
+		bf_->getAll(handler);
+		trie_->performHashing();
+	}
 	this->maxSize_ = bfconfig.getMaxElements();
 	this->hardMaximum_ = bfconfig.isHardMaximum();
 }
@@ -425,6 +596,9 @@ Set::~Set() {
 	if (this->bf_ != NULL) {
 		delete bf_;
 	}
+	if (this->localFilter_ != NULL) {
+		delete localFilter_;
+	}
 	if (this->trie_ != NULL) {
 		delete trie_;
 	}
@@ -437,6 +611,10 @@ Set::~Set() {
 	if (this->trieStorage_ != NULL) {
 		delete trieStorage_;
 	}
+	while (!this->backingStorages_.empty()) {
+		delete this->backingStorages_.back();
+		this->backingStorages_.pop_back();
+	}
 #ifdef HAVE_DB_CXX_H
 	if (this->triedb != NULL) {
 		this->triedb->close(0);
@@ -471,6 +649,20 @@ size_t Set::getMaximumSize() const {
 	return this->maxSize_;
 }
 
+SetStatistics Set::getStatistics() const {
+	SetStatistics statistics;
+	statistics.trie = this->trieStorage_->getStatistics();
+	statistics.bloomFilter = this->bfStorage_->getStatistics();
+	statistics.index = this->indexStorage_->getStatistics();
+	return statistics;
+}
+
+void Set::resetStatistics() {
+	this->trieStorage_->resetStatistics();
+	this->bfStorage_->resetStatistics();
+	this->indexStorage_->resetStatistics();
+}
+
 bool Set::erase(const char * str) {
 	unsigned char k[this->hash_.getHashSize()];
 	this->hash_(k, str);
@@ -520,11 +712,70 @@ bool Set::insert(const unsigned char * key) {
 	}
 	if (this->trie_->Trie::add(key)) {
 		this->bf_->add(key);
+		if (this->localFilter_ != NULL)
+			this->localFilter_->add(key);
 		return true;
 	}
 	return false;
 }
 
+/**
+ * Orders pointers to hashes of the given size by their binary value
+ */
+class HashPointerComparator {
+private:
+	std::size_t hashSize_;
+public:
+	HashPointerComparator(const std::size_t hashSize) :
+		hashSize_(hashSize) {
+	}
+	bool operator()(const unsigned char * a, const unsigned char * b) const {
+		return memcmp(a, b, hashSize_) < 0;
+	}
+};
+
+std::size_t Set::insertAll(const unsigned char * keys, const std::size_t count) {
+	if (count == 0)
+		return 0;
+	const std::size_t hashsize = this->hash_.getHashSize();
+	// Sorting the batch keeps neighboring keys on the same trie path
+	std::vector<const unsigned char *> sorted;
+	sorted.reserve(count);
+	for (std::size_t i = 0; i < count; i++) {
+		sorted.push_back(keys + i * hashsize);
+	}
+	std::sort(sorted.begin(), sorted.end(), HashPointerComparator(hashsize));
+	unsigned char * inserted = (unsigned char *) malloc(count * hashsize);
+	std::size_t numberOfInserted = 0;
+	try {
+		std::vector<const unsigned char *>::const_iterator iter;
+		for (iter = sorted.begin(); iter != sorted.end(); iter++) {
+			if (hardMaximum_ && this->trie_->getSize() >= maxSize_) {
+				break;
+			}
+			// Parents are only marked as dirty, they are rehashed once below
+			if (this->trie_->add(*iter, false)) {
+				memcpy(inserted + numberOfInserted * hashsize, *iter, hashsize);
+				numberOfInserted++;
+			}
+		}
+	} catch (...) {
+		// Keep trie and bloom filter consistent for all inserted keys
+		this->trie_->performHashing();
+		this->bf_->addAll(inserted, numberOfInserted);
+		if (this->localFilter_ != NULL)
+			this->localFilter_->addAll(inserted, numberOfInserted);
+		free(inserted);
+		throw;
+	}
+	this->trie_->performHashing();
+	this->bf_->addAll(inserted, numberOfInserted);
+	if (this->localFilter_ != NULL)
+		this->localFilter_->addAll(inserted, numberOfInserted);
+	free(inserted);
+	return numberOfInserted;
+}
+
 bool Set::insert(const void * data, const std::size_t length) {
 	unsigned char k[this->hash_.getHashSize()];
 	this->hash_(k, (const unsigned char *) data, length);
@@ -553,7 +804,14 @@ bool Set::find(const std::string& key) {
 }
 
 bool Set::find(const unsigned char * key) {
-	if (this->bf_->contains(key)) {
+	bool possiblyContained;
+	if (this->localFilter_ != NULL) {
+		// Only a single cache line has to be loaded for the check
+		possiblyContained = this->localFilter_->contains(key);
+	} else {
+		possiblyContained = this->bf_->contains(key);
+	}
+	if (possiblyContained) {
 		return this->trie_->contains(key) == trie::LEAF_NODE;
 	}
 	return false;
@@ -586,6 +844,8 @@ bool Set::get(const unsigned char * key, unsigned char ** value,
 void Set::clear() {
 	this->trie_->clear();
 	this->bf_->clear();
+	if (this->localFilter_ != NULL)
+		this->localFilter_->clear();
 	this->index_->clear();
 	this->indexInUse_ = false;
 }
@@ -630,6 +890,18 @@ SET_CONFIG set_create_config() {
 #endif
 	c.storage_cache_gbytes = 0;
 	c.storage_cache_bytes = 0;
+	c.trie = KEY_VALUE_TRIE;
+	c.trie_cache_bytes =
+			setsync::config::Configuration::TrieConfig::DEFAULT_CACHE_SIZE;
+	c.bf_blocked_local = false;
+	c.bf_transfer = BF_TRANSFER_NORMAL;
+	c.storage_shared = false;
+	c.bf_checkpoint_interval =
+			setsync::config::Configuration::BloomFilterConfig::DEFAULT_CHECKPOINT_INTERVAL;
+	c.bf_segment_size = 0;
+	c.bf_prefault = false;
+	c.bf_huge_pages = false;
+	c.bf_scalable = false;
 	return c;
 }
 
@@ -724,6 +996,43 @@ size_t set_max_size(SET *set) {
 	return cppset->getMaximumSize();
 }
 
+// Statistics
+static void set_copy_storage_stats(SET_STORAGE_STATS * stats,
+		const setsync::storage::StorageStatistics& statistics) {
+	stats->gets = statistics.gets;
+	stats->hits = statistics.hits;
+	stats->puts = statistics.puts;
+	stats->dels = statistics.dels;
+	stats->clears = statistics.clears;
+	stats->commits = statistics.commits;
+	stats->scans = statistics.scans;
+	stats->scanned_entries = statistics.scannedEntries;
+	stats->bytes_read = statistics.bytesRead;
+	stats->bytes_written = statistics.bytesWritten;
+	memset(stats->read_latency, 0, sizeof(stats->read_latency));
+	memset(stats->write_latency, 0, sizeof(stats->write_latency));
+	for (std::size_t i = 0; i < SET_STATS_LATENCY_BUCKETS && i
+			< setsync::storage::StorageStatistics::LATENCY_BUCKETS; i++) {
+		stats->read_latency[i] = statistics.readLatency[i];
+		stats->write_latency[i] = statistics.writeLatency[i];
+	}
+}
+
+int set_get_stats(SET *set, SET_STATS * stats) {
+	setsync::Set * cppset = static_cast<setsync::Set*> (set->set);
+	setsync::SetStatistics statistics = cppset->getStatistics();
+	set_copy_storage_stats(&stats->trie, statistics.trie);
+	set_copy_storage_stats(&stats->bf, statistics.bloomFilter);
+	set_copy_storage_stats(&stats->index, statistics.index);
+	return 0;
+}
+
+int set_reset_stats(SET *set) {
+	setsync::Set * cppset = static_cast<setsync::Set*> (set->set);
+	cppset->resetStatistics();
+	return 0;
+}
+
 // Lookup
 int set_find(SET *set, const unsigned char * key) {
 	setsync::Set * cppset = static_cast<setsync::Set*> (set->set);
@@ -757,6 +1066,30 @@ int set_insert_data(SET *set, const void* data, const size_t length) {
 	return cppset->insert(data, length);
 }
 
+size_t set_insert_batch(SET *set, const unsigned char * keys,
+		const size_t count) {
+	try {
+		setsync::Set * cppset = static_cast<setsync::Set*> (set->set);
+		return cppset->insertAll(keys, count);
+	} catch (std::exception& e) {
+		if (set->error == NULL) {
+			set->error = (void *) new std::string(e.what());
+		} else {
+			std::string * msg = static_cast<std::string *> (set->error);
+			msg->operator =(e.what());
+		}
+		return 0;
+	} catch (...) {
+		if (set->error == NULL) {
+			set->error = (void *) new std::string("unknown error");
+		} else {
+			std::string * msg = static_cast<std::string *> (set->error);
+			msg->operator =("unknown error");
+		}
+		return 0;
+	}
+}
+
 int set_erase(SET *set, const unsigned char * key) {
 	setsync::Set * cppset = static_cast<setsync::Set*> (set->set);
 	return cppset->erase(key);
@@ -955,6 +1288,48 @@ int set_sync_bf_process_chunk(SET_SYNC_HANDLE * handle,
 	return 0;
 }
 
+int set_sync_bf_get_transfer_type(SET_SYNC_HANDLE * handle) {
+	setsync::SynchronizationProcess * process =
+			static_cast<setsync::SynchronizationProcess*> (handle->process);
+	if (process->getBloomFilterTransferType()
+			== setsync::config::Configuration::BloomFilterConfig::COMPRESSED) {
+		return BF_TRANSFER_COMPRESSED;
+	}
+	return BF_TRANSFER_NORMAL;
+}
+
+int set_sync_bf_negotiate_transfer_type(SET_SYNC_HANDLE * handle,
+		const int remoteType) {
+	setsync::SynchronizationProcess * process =
+			static_cast<setsync::SynchronizationProcess*> (handle->process);
+	try {
+		setsync::config::Configuration::BloomFilterConfig::BloomFilterType
+				type = setsync::config::Configuration::BloomFilterConfig::NORMAL;
+		if (remoteType == BF_TRANSFER_COMPRESSED) {
+			type
+					= setsync::config::Configuration::BloomFilterConfig::COMPRESSED;
+		}
+		process->negotiateBloomFilterTransferType(type);
+		return set_sync_bf_get_transfer_type(handle);
+	} catch (std::exception& e) {
+		if (handle->error == NULL) {
+			handle->error = (void *) new std::string(e.what());
+		} else {
+			std::string * msg = static_cast<std::string *> (handle->error);
+			msg->operator =(e.what());
+		}
+		return -1;
+	} catch (...) {
+		if (handle->error == NULL) {
+			handle->error = (void *) new std::string("unknown error");
+		} else {
+			std::string * msg = static_cast<std::string *> (handle->error);
+			msg->operator =("unknown error");
+		}
+		return -1;
+	}
+}
+
 ssize_t set_sync_trie_get_subtrie(SET_SYNC_HANDLE * handle,
 		unsigned char * buffer, const size_t length) {
 	setsync::SynchronizationProcess * process =
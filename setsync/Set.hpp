@@ -11,14 +11,18 @@
 #include <stdint.h>
 #include <setsync/sync/Synchronization.h>
 #include <setsync/storage/KeyValueStorage.h>
-#include <setsync/bloom/KeyValueCountingBloomFilter.h>
+#include <setsync/storage/InstrumentedStorage.h>
+#include <setsync/bloom/ScalableBloomFilter.h>
+#include <setsync/bloom/BlockedBloomFilter.h>
 #include <setsync/index/KeyValueIndex.h>
 #include <setsync/trie/KeyValueTrie.h>
+#include <setsync/trie/MemoryTrie.h>
 #include <setsync/crypto/CryptoHash.h>
 #include <setsync/config/Configuration.h>
 #include <setsync/utils/FileSystem.h>
 #include <queue>
 #include <stack>
+#include <vector>
 
 #ifdef HAVE_DB_CXX_H
 #include <db_cxx.h>
@@ -43,6 +47,8 @@ private:
 	std::size_t bloomfilterOut_pos;
 	std::size_t bloomfilterIn_pos;
 	bool bfOutIsFinished_;
+	/// Transfer mode of the bloom filter chunks in both directions
+	config::Configuration::BloomFilterConfig::BloomFilterType bfTransferType_;
 	std::size_t sentBytes_;
 	std::size_t receivedBytes_;
 	std::queue<crypto::CryptoHashContainer> sentHashes_;
@@ -96,10 +102,42 @@ public:
 	virtual std::size_t readNextBloomFilterChunk(unsigned char * buffer,
 			const std::size_t length);
 	/**
+	 * Processes the next bloom filter chunk of the remote side and
+	 * passes all local hashes, which are missing remotely, to the handler
 	 *
+	 * \param buffer chunk, written by readNextBloomFilterChunk
+	 * \param length of the chunk
+	 * \param handler to be called for each different hash
 	 */
 	virtual void processBloomFilterChunk(const unsigned char * buffer,
 			const std::size_t length, AbstractDiffHandler& handler);
+	/**
+	 * \return the transfer type of the bloom filter chunks
+	 */
+	virtual config::Configuration::BloomFilterConfig::BloomFilterType
+	getBloomFilterTransferType() const;
+	/**
+	 * Sets the transfer type of the bloom filter chunks, which must be
+	 * the same on both sides. It can't be changed, after the first
+	 * chunk has been read or processed.
+	 *
+	 * \param type of the bloom filter chunks
+	 * \throws an Exception, if the bloom filter transfer has already started
+	 */
+	virtual void setBloomFilterTransferType(
+			const config::Configuration::BloomFilterConfig::BloomFilterType type);
+	/**
+	 * Agrees on a transfer type with the remote side. Both sides pass the
+	 * type proposed by the other side, which is returned by its
+	 * getBloomFilterTransferType(). COMPRESSED is only used, if both
+	 * sides proposed it.
+	 *
+	 * \param remoteType proposed by the remote side
+	 * \return the type used by both sides
+	 */
+	virtual config::Configuration::BloomFilterConfig::BloomFilterType
+	negotiateBloomFilterTransferType(
+			const config::Configuration::BloomFilterConfig::BloomFilterType remoteType);
 	/**
 	 * \return true, if the trie has a root and it has been written into hash
 	 */
@@ -156,6 +194,18 @@ public:
 	virtual std::size_t getMinBuffer() const;
 };
 
+/**
+ * I/O statistics of the storages of a set
+ */
+struct SetStatistics {
+	/// Statistics of the trie storage
+	storage::StorageStatistics trie;
+	/// Statistics of the bloom filter storage
+	storage::StorageStatistics bloomFilter;
+	/// Statistics of the index storage
+	storage::StorageStatistics index;
+};
+
 /**
  * Main class to use for a set, which should be synchronized
  * over a network or locally. It provides mechanisms to add, find
@@ -176,17 +226,22 @@ private:
 	/// The used configuration
 	const config::Configuration& config_;
 	/// A bloom filter instance of the set
-	bloom::KeyValueCountingBloomFilter * bf_;
+	bloom::ScalableBloomFilter * bf_;
+	/// Optional blocked bloom filter for local lookups, NULL if unused. Erased
+	/// keys are kept in it, which only costs an additional trie lookup.
+	bloom::BlockedBloomFilter * localFilter_;
 	/// A trie data structure of the set
-	trie::KeyValueTrie * trie_;
+	trie::Trie * trie_;
 	/// A storage in which binary data is saved, if it has been given
 	index::KeyValueIndex * index_;
 	/// Key value store for the bloom filter
-	setsync::storage::AbstractKeyValueStorage * bfStorage_;
-	/// Key value store for the trie data structure
-	setsync::storage::AbstractKeyValueStorage * trieStorage_;
+	setsync::storage::InstrumentedStorage * bfStorage_;
+	/// Key value store for the trie data structure, unused by a MemoryTrie
+	setsync::storage::InstrumentedStorage * trieStorage_;
 	/// Key value store for the binary data index
-	setsync::storage::AbstractKeyValueStorage * indexStorage_;
+	setsync::storage::InstrumentedStorage * indexStorage_;
+	/// Databases holding the other storages, deleted after them
+	std::vector<setsync::storage::AbstractKeyValueStorage *> backingStorages_;
 	/// If no directory is given, a temporary directory is created
 	utils::FileSystem::TemporaryDirectory * tempDir;
 	/// true if more than one binary element is available
@@ -241,6 +296,15 @@ public:
 	 * \return the maximum limit of the set
 	 */
 	size_t getMaximumSize() const;
+	/**
+	 * \return the I/O statistics of the storages since the creation of
+	 * this instance or the last resetStatistics()
+	 */
+	SetStatistics getStatistics() const;
+	/**
+	 * Sets the I/O statistics of all storages to 0
+	 */
+	void resetStatistics();
 	// Lookup for existence
 	virtual bool find(const unsigned char * key);
 	virtual bool find(const char * str);
@@ -301,6 +365,20 @@ public:
 	 * \return true on success
 	 */
 	virtual bool insert(const void * data, const std::size_t length);
+	/**
+	 * Adds count cryptographic keys, which are given as one continuous
+	 * array, to the set. The keys are sorted and inserted into the trie
+	 * without updating the parent hashes. All changed inner nodes are
+	 * rehashed once after the last insertion, which is much faster than
+	 * calling insert for each key. If the set has a hard maximum, the
+	 * insertion stops, when the maximum has been reached.
+	 *
+	 * \param keys array of count cryptographic keys
+	 * \param count of keys in the array
+	 * \return the number of keys, which have been newly added
+	 */
+	virtual std::size_t insertAll(const unsigned char * keys,
+			const std::size_t count);
 	/**
 	 * Removes the given key from the set. It also removes binary
 	 * data from the set, which has the same hash.
@@ -0,0 +1,189 @@
+/*
+ * BitArrayDiff.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "BitArrayDiff.h"
+#include <string.h>
+#include <stdint.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) \
+	|| (defined(__GNUC__) && (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))))
+#define SETSYNC_X86_SIMD
+#include <immintrin.h>
+#endif
+
+namespace setsync {
+namespace bloom {
+
+#ifdef SETSYNC_X86_SIMD
+__attribute__((target("sse2")))
+static std::size_t scanSSE2(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+	const __m128i zero = _mm_setzero_si128();
+	std::size_t i = start;
+	// 64 bytes per round, the differences are only located on a hit
+	for (; i + 64 <= length; i += 64) {
+		__m128i d0 = _mm_andnot_si128(
+				_mm_loadu_si128((const __m128i *) (remote + i)),
+				_mm_loadu_si128((const __m128i *) (local + i)));
+		__m128i d1 = _mm_andnot_si128(
+				_mm_loadu_si128((const __m128i *) (remote + i + 16)),
+				_mm_loadu_si128((const __m128i *) (local + i + 16)));
+		__m128i d2 = _mm_andnot_si128(
+				_mm_loadu_si128((const __m128i *) (remote + i + 32)),
+				_mm_loadu_si128((const __m128i *) (local + i + 32)));
+		__m128i d3 = _mm_andnot_si128(
+				_mm_loadu_si128((const __m128i *) (remote + i + 48)),
+				_mm_loadu_si128((const __m128i *) (local + i + 48)));
+		__m128i any = _mm_or_si128(_mm_or_si128(d0, d1), _mm_or_si128(d2, d3));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(any, zero)) == 0xFFFF)
+			continue;
+		break;
+	}
+	for (; i + 16 <= length; i += 16) {
+		__m128i d = _mm_andnot_si128(
+				_mm_loadu_si128((const __m128i *) (remote + i)),
+				_mm_loadu_si128((const __m128i *) (local + i)));
+		unsigned int zeros = _mm_movemask_epi8(_mm_cmpeq_epi8(d, zero));
+		if (zeros != 0xFFFF)
+			return i + __builtin_ctz(~zeros & 0xFFFF);
+	}
+	return BitArrayDiff::nextDifferenceScalar(local, remote, i, length);
+}
+
+__attribute__((target("avx2")))
+static std::size_t scanAVX2(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+	const __m256i zero = _mm256_setzero_si256();
+	std::size_t i = start;
+	for (; i + 64 <= length; i += 64) {
+		__m256i d0 = _mm256_andnot_si256(
+				_mm256_loadu_si256((const __m256i *) (remote + i)),
+				_mm256_loadu_si256((const __m256i *) (local + i)));
+		__m256i d1 = _mm256_andnot_si256(
+				_mm256_loadu_si256((const __m256i *) (remote + i + 32)),
+				_mm256_loadu_si256((const __m256i *) (local + i + 32)));
+		__m256i any = _mm256_or_si256(d0, d1);
+		if (_mm256_testz_si256(any, any))
+			continue;
+		break;
+	}
+	for (; i + 32 <= length; i += 32) {
+		__m256i d = _mm256_andnot_si256(
+				_mm256_loadu_si256((const __m256i *) (remote + i)),
+				_mm256_loadu_si256((const __m256i *) (local + i)));
+		unsigned int zeros = (unsigned int) _mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(d, zero));
+		if (zeros != 0xFFFFFFFFu)
+			return i + __builtin_ctz(~zeros);
+	}
+	return BitArrayDiff::nextDifferenceScalar(local, remote, i, length);
+}
+#endif
+
+std::size_t BitArrayDiff::nextDifferenceScalar(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+	std::size_t i = start;
+	uint64_t l;
+	uint64_t r;
+	for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+		memcpy(&l, local + i, sizeof(uint64_t));
+		memcpy(&r, remote + i, sizeof(uint64_t));
+		if ((l & ~r) != 0)
+			break;
+	}
+	for (; i < length; i++) {
+		if ((local[i] & ~remote[i]) != 0)
+			return i;
+	}
+	return length;
+}
+
+std::size_t BitArrayDiff::nextDifferenceSSE2(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+#ifdef SETSYNC_X86_SIMD
+	if (hasSSE2())
+		return scanSSE2(local, remote, start, length);
+#endif
+	return nextDifferenceScalar(local, remote, start, length);
+}
+
+std::size_t BitArrayDiff::nextDifferenceAVX2(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+#ifdef SETSYNC_X86_SIMD
+	if (hasAVX2())
+		return scanAVX2(local, remote, start, length);
+#endif
+	return nextDifferenceScalar(local, remote, start, length);
+}
+
+bool BitArrayDiff::hasSSE2() {
+#ifdef SETSYNC_X86_SIMD
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("sse2");
+#else
+	return false;
+#endif
+}
+
+bool BitArrayDiff::hasAVX2() {
+#ifdef SETSYNC_X86_SIMD
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+BitArrayDiff::ScanFunction BitArrayDiff::selectImplementation(const char ** name) {
+#ifdef SETSYNC_X86_SIMD
+	if (hasAVX2()) {
+		*name = "avx2";
+		return scanAVX2;
+	}
+	if (hasSSE2()) {
+		*name = "sse2";
+		return scanSSE2;
+	}
+#endif
+	*name = "scalar";
+	return nextDifferenceScalar;
+}
+
+const char * BitArrayDiff::implementationName_ = NULL;
+BitArrayDiff::ScanFunction BitArrayDiff::implementation_ = NULL;
+
+std::size_t BitArrayDiff::nextDifference(const unsigned char * local,
+		const unsigned char * remote, const std::size_t start,
+		const std::size_t length) {
+	if (implementation_ == NULL)
+		implementation_ = selectImplementation(&implementationName_);
+	return implementation_(local, remote, start, length);
+}
+
+unsigned int BitArrayDiff::lowestBit(const unsigned char byte) {
+#ifdef __GNUC__
+	return __builtin_ctz(byte);
+#else
+	unsigned int bit = 0;
+	while ((byte & (1 << bit)) == 0)
+		bit++;
+	return bit;
+#endif
+}
+
+const char * BitArrayDiff::getImplementation() {
+	if (implementation_ == NULL)
+		implementation_ = selectImplementation(&implementationName_);
+	return implementationName_;
+}
+
+}
+}
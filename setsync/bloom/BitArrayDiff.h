@@ -0,0 +1,96 @@
+/*
+ * BitArrayDiff.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef BITARRAYDIFF_H_
+#define BITARRAYDIFF_H_
+
+#include <cstddef>
+
+namespace setsync {
+namespace bloom {
+
+/**
+ * Searches two bit arrays for bits, which are only set in the local one
+ * (local & ~remote). The search skips identical parts of the arrays
+ * many bytes at a time. If the CPU supports it, SSE2 or AVX2 is used,
+ * otherwise a portable 64 bit word scan. The implementation is selected
+ * once at runtime.
+ */
+class BitArrayDiff {
+public:
+	/**
+	 * Signature of a scan implementation, see nextDifference()
+	 */
+	typedef std::size_t (*ScanFunction)(const unsigned char * local,
+			const unsigned char * remote, const std::size_t start,
+			const std::size_t length);
+	/**
+	 * Finds the next byte, which contains a bit, which is set in the
+	 * local array but not in the remote one.
+	 *
+	 * \param local bit array
+	 * \param remote bit array
+	 * \param start position of the first byte to check
+	 * \param length of both arrays in bytes
+	 * \return the position of the next differing byte or length, if there is none
+	 */
+	static std::size_t nextDifference(const unsigned char * local,
+			const unsigned char * remote, const std::size_t start,
+			const std::size_t length);
+	/**
+	 * \return the position of the lowest set bit of the given non zero byte
+	 */
+	static unsigned int lowestBit(const unsigned char byte);
+	/**
+	 * \return the name of the selected scan implementation
+	 */
+	static const char * getImplementation();
+	/**
+	 * Portable implementation of nextDifference()
+	 */
+	static std::size_t nextDifferenceScalar(const unsigned char * local,
+			const unsigned char * remote, const std::size_t start,
+			const std::size_t length);
+	/**
+	 * SSE2 implementation of nextDifference(), falls back to the
+	 * scalar one, if it is not compiled in
+	 */
+	static std::size_t nextDifferenceSSE2(const unsigned char * local,
+			const unsigned char * remote, const std::size_t start,
+			const std::size_t length);
+	/**
+	 * AVX2 implementation of nextDifference(), falls back to the
+	 * scalar one, if it is not compiled in
+	 */
+	static std::size_t nextDifferenceAVX2(const unsigned char * local,
+			const unsigned char * remote, const std::size_t start,
+			const std::size_t length);
+	/**
+	 * \return true, if the CPU is able to run nextDifferenceSSE2()
+	 */
+	static bool hasSSE2();
+	/**
+	 * \return true, if the CPU is able to run nextDifferenceAVX2()
+	 */
+	static bool hasAVX2();
+private:
+	/// The selected implementation, NULL until the first scan
+	static ScanFunction implementation_;
+	/// Name of the selected implementation
+	static const char * implementationName_;
+	/**
+	 * Selects the fastest implementation supported by the CPU
+	 *
+	 * \param name is set to the name of the selected implementation
+	 * \return the selected implementation
+	 */
+	static ScanFunction selectImplementation(const char ** name);
+};
+
+}
+}
+
+#endif /* BITARRAYDIFF_H_ */
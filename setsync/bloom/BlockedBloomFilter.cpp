@@ -0,0 +1,204 @@
+/*
+ * BlockedBloomFilter.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "BlockedBloomFilter.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include <typeinfo>
+#include <stdexcept>
+
+namespace setsync {
+namespace bloom {
+
+/// Number of bits of a block
+#define BLOCK_BITS (BlockedBloomFilter::BLOCK_SIZE * BYTESIZE)
+
+BlockedBloomFilter::BlockedBloomFilter(const crypto::CryptoHash& hash,
+		const uint64_t maxNumberOfElements, const bool hardMaximum,
+		const float falsePositiveRate) :
+	AbstractBloomFilter(hash) {
+	if (falsePositiveRate >= 1 || falsePositiveRate <= 0)
+		throw std::runtime_error("Wrong false positive rate");
+	if (hash.getHashSize() < 2 * sizeof(uint64_t))
+		throw std::runtime_error("Hash size too small for a blocked filter");
+	this->hashFunction_ = NULL;
+	this->hardMaximum_ = hardMaximum;
+	this->maxElements_ = maxNumberOfElements;
+	uint64_t bits = ceil(
+			(maxNumberOfElements * log(falsePositiveRate)) / log(
+					1.0 / (pow(2.0, log(2.0)))));
+	this->numberOfBlocks_ = (bits + BLOCK_BITS - 1) / BLOCK_BITS;
+	if (this->numberOfBlocks_ < 1)
+		this->numberOfBlocks_ = 1;
+	this->filterSize_ = this->numberOfBlocks_ * BLOCK_BITS;
+	this->functionCount_ = round(log(2.0) * bits / maxNumberOfElements);
+	if (this->functionCount_ < 1)
+		this->functionCount_ = 1;
+	void * memory;
+	if (posix_memalign(&memory, BLOCK_SIZE, this->numberOfBlocks_ * BLOCK_SIZE)
+			!= 0) {
+		throw std::runtime_error("Allocating the blocked bloom filter failed");
+	}
+	this->blocks_ = (unsigned char *) memory;
+	clear();
+}
+
+BlockedBloomFilter::~BlockedBloomFilter() {
+	free(this->blocks_);
+}
+
+unsigned char * BlockedBloomFilter::getBlock(const unsigned char * key) const {
+	uint64_t selector;
+	memcpy(&selector, key, sizeof(uint64_t));
+	return this->blocks_ + (selector % this->numberOfBlocks_) * BLOCK_SIZE;
+}
+
+void BlockedBloomFilter::getBitPositions(const unsigned char * key,
+		uint32_t& first, uint32_t& step) const {
+	uint64_t bits;
+	memcpy(&bits, key + sizeof(uint64_t), sizeof(uint64_t));
+	first = (uint32_t) bits;
+	// An odd step visits different bits for up to BLOCK_BITS functions
+	step = ((uint32_t) (bits >> 32)) | 1;
+}
+
+void BlockedBloomFilter::load(std::istream &in, const uint64_t numberOfElements) {
+	if (this->itemCount_ == 0) {
+		in.exceptions(in.exceptions() | std::istream::eofbit);
+		in.read((char*) this->blocks_, this->numberOfBlocks_ * BLOCK_SIZE);
+		this->itemCount_ = numberOfElements;
+	} else {
+		throw std::runtime_error("This bloom filter already has got elements");
+	}
+}
+
+uint64_t BlockedBloomFilter::save(std::ostream &out) {
+	out.write((char*) this->blocks_, this->numberOfBlocks_ * BLOCK_SIZE);
+	return this->itemCount_;
+}
+
+void BlockedBloomFilter::clear() {
+	memset(this->blocks_, 0x00, this->numberOfBlocks_ * BLOCK_SIZE);
+	this->itemCount_ = 0;
+}
+
+void BlockedBloomFilter::add(const unsigned char *key) {
+	if (this->hardMaximum_ && this->itemCount_ >= maxElements_)
+		throw std::runtime_error("Maximum of Elements reached, adding failed");
+	unsigned char * block = getBlock(key);
+	uint32_t pos;
+	uint32_t step;
+	getBitPositions(key, pos, step);
+	for (std::size_t i = 0; i < this->functionCount_; i++) {
+		uint32_t bit = pos % BLOCK_BITS;
+		block[bit / BYTESIZE] |= bit_mask[bit % BYTESIZE];
+		pos += step;
+	}
+	if (this->itemCount_ < std::numeric_limits<uint64_t>::max())
+		this->itemCount_++;
+}
+
+void BlockedBloomFilter::addAll(const unsigned char *keys,
+		const std::size_t count) {
+	if (this->hardMaximum_ && this->itemCount_ + count > maxElements_)
+		throw std::runtime_error("Maximum of Elements reached, adding failed");
+	for (std::size_t i = 0; i < count; i++) {
+		add(keys + i * this->cryptoHashFunction_.getHashSize());
+	}
+}
+
+bool BlockedBloomFilter::contains(const unsigned char *key) const {
+	const unsigned char * block = getBlock(key);
+	uint32_t pos;
+	uint32_t step;
+	getBitPositions(key, pos, step);
+	for (std::size_t i = 0; i < this->functionCount_; i++) {
+		uint32_t bit = pos % BLOCK_BITS;
+		if ((block[bit / BYTESIZE] & bit_mask[bit % BYTESIZE]) == 0)
+			return false;
+		pos += step;
+	}
+	return true;
+}
+
+std::size_t BlockedBloomFilter::containsAll(const unsigned char *keys,
+		const std::size_t count) const {
+	for (std::size_t i = 0; i < count; i++) {
+		if (!contains(keys + i * this->cryptoHashFunction_.getHashSize()))
+			return i;
+	}
+	return count;
+}
+
+bool BlockedBloomFilter::operator ==(const AbstractBloomFilter& filter) const {
+	try {
+		const BlockedBloomFilter& filter_ =
+				dynamic_cast<const BlockedBloomFilter&> (filter);
+		if (this->numberOfBlocks_ != filter_.numberOfBlocks_)
+			return false;
+		return memcmp(this->blocks_, filter_.blocks_,
+				this->numberOfBlocks_ * BLOCK_SIZE) == 0;
+	} catch (const std::bad_cast& e) {
+		return false;
+	}
+}
+
+bool BlockedBloomFilter::operator !=(const AbstractBloomFilter& filter) const {
+	try {
+		const BlockedBloomFilter& filter_ =
+				dynamic_cast<const BlockedBloomFilter&> (filter);
+		if (this->numberOfBlocks_ != filter_.numberOfBlocks_)
+			return true;
+		return memcmp(this->blocks_, filter_.blocks_,
+				this->numberOfBlocks_ * BLOCK_SIZE) != 0;
+	} catch (const std::bad_cast& e) {
+		return false;
+	}
+}
+
+AbstractBloomFilter& BlockedBloomFilter::operator &=(
+		const AbstractBloomFilter& filter) {
+	/* intersection */
+	const BlockedBloomFilter& filter_ =
+			dynamic_cast<const BlockedBloomFilter&> (filter);
+	if (this->numberOfBlocks_ == filter_.numberOfBlocks_) {
+		for (std::size_t i = 0; i < this->numberOfBlocks_ * BLOCK_SIZE; ++i) {
+			this->blocks_[i] &= filter_.blocks_[i];
+		}
+	}
+	return *this;
+}
+
+AbstractBloomFilter& BlockedBloomFilter::operator |=(
+		const AbstractBloomFilter& filter) {
+	/* union */
+	const BlockedBloomFilter& filter_ =
+			dynamic_cast<const BlockedBloomFilter&> (filter);
+	if (this->numberOfBlocks_ == filter_.numberOfBlocks_) {
+		for (std::size_t i = 0; i < this->numberOfBlocks_ * BLOCK_SIZE; ++i) {
+			this->blocks_[i] |= filter_.blocks_[i];
+		}
+	}
+	return *this;
+}
+
+AbstractBloomFilter& BlockedBloomFilter::operator ^=(
+		const AbstractBloomFilter& filter) {
+	/* difference */
+	const BlockedBloomFilter& filter_ =
+			dynamic_cast<const BlockedBloomFilter&> (filter);
+	if (this->numberOfBlocks_ == filter_.numberOfBlocks_) {
+		for (std::size_t i = 0; i < this->numberOfBlocks_ * BLOCK_SIZE; ++i) {
+			this->blocks_[i] ^= filter_.blocks_[i];
+		}
+	}
+	return *this;
+}
+
+}
+}
@@ -0,0 +1,122 @@
+/*
+ * BlockedBloomFilter.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef BLOCKEDBLOOMFILTER_H_
+#define BLOCKEDBLOOMFILTER_H_
+
+#include "BloomFilter.h"
+namespace setsync {
+namespace bloom {
+
+/**
+ * In-memory bloom filter, which keeps all bits of a key inside one block
+ * of the size of a cache line. The first 64 bits of the key select the
+ * block, the next 64 bits select the bits inside the block. So each
+ * add or contains touches only a single cache line, instead of
+ * numberOfFunctions() random positions of the whole filter. The false
+ * positive rate is a bit higher than the one of a classic bloom filter
+ * of the same size.
+ *
+ * The bit layout differs from the classic bloom filters, so this filter
+ * can't be compared with or synchronized against them.
+ */
+class BlockedBloomFilter: public virtual AbstractBloomFilter {
+	friend class BlockedBloomFilterTest;
+public:
+	/// Size of a block in bytes
+	static const std::size_t BLOCK_SIZE = 64;
+	/**
+	 * \param hash sets the used cryptographic hash function
+	 * \param maxNumberOfElements which should be represented by the bloom filter
+	 * \param hardMaximum ensures that the the maximum of storable entries will never be exceeded
+	 * \param falsePositiveRate can be set to any value ]0,1[.
+	 */
+	BlockedBloomFilter(const crypto::CryptoHash& hash,
+			const uint64_t maxNumberOfElements = 10000,
+			const bool hardMaximum = false,
+			const float falsePositiveRate = 0.001);
+	virtual ~BlockedBloomFilter();
+	/**
+	 * \param in inputstream to read the bloom filter from
+	 * \param numberOfElements saved in the loaded bloom filter
+	 */
+	virtual void load(std::istream &in, const uint64_t numberOfElements);
+	/**
+	 * \param out output stream where the bloom filter will be written to
+	 * \return number of elements in this bloom filter
+	 */
+	virtual uint64_t save(std::ostream &out);
+	/**
+	 * Resets the bloom filter
+	 */
+	virtual void clear();
+	/**
+	 * Adds a given hash key to the bloom filter
+	 * \param key which should be added
+	 * \throws an Exception, if the maximum is reached and hardMaximum has been set
+	 */
+	virtual void add(const unsigned char *key);
+	/**
+	 * \param keys to be added to the BloomFilter
+	 * \param count number of keys in the array
+	 * \throws an Exception, if the maximum is reached and hardMaximum has been set
+	 */
+	virtual void addAll(const unsigned char *keys, const std::size_t count);
+	/**
+	 * \param key a simple pointer to the stored key, which should be checked
+	 * \return true if the given key seems to have been inserted in past
+	 */
+	virtual bool contains(const unsigned char *key) const;
+	/**
+	 * \param keys a simple array of keys, which should be checked, if they are represented by the bloom filter
+	 * \param count the length of the keys array
+	 * \return the given count on containing all keys, otherwise the first failed position in the given key array
+	 */
+	virtual std::size_t containsAll(const unsigned char *keys,
+			const std::size_t count) const;
+	/**
+	 * Checks, if both BloomFilter have got exact the same bit array
+	 * \return true if the bloom filter bit array is the same
+	 */
+	virtual bool operator ==(const AbstractBloomFilter& filter) const;
+	/**
+	 * Checks, if there is a difference between the bit arrays
+	 * \return true if there is minimal 1 bit difference between the bit arrays
+	 */
+	virtual bool operator !=(const AbstractBloomFilter& filter) const;
+	/**
+	 * \return the intersection between both bloom filter
+	 */
+	virtual AbstractBloomFilter& operator &=(const AbstractBloomFilter& filter);
+	/**
+	 * \return the union of both bloom filter
+	 */
+	virtual AbstractBloomFilter& operator |=(const AbstractBloomFilter& filter);
+	/**
+	 * \return the difference between the both bloom filter
+	 */
+	virtual AbstractBloomFilter& operator ^=(const AbstractBloomFilter& filter);
+protected:
+	/// The blocks of the filter, aligned to BLOCK_SIZE
+	unsigned char * blocks_;
+	/// Number of blocks of the filter
+	uint64_t numberOfBlocks_;
+	/**
+	 * \return the block of the given key
+	 */
+	unsigned char * getBlock(const unsigned char * key) const;
+	/**
+	 * Calculates the first and the step value of the bit positions of
+	 * the given key inside its block
+	 */
+	void getBitPositions(const unsigned char * key, uint32_t& first,
+			uint32_t& step) const;
+};
+
+}
+}
+
+#endif /* BLOCKEDBLOOMFILTER_H_ */
@@ -0,0 +1,260 @@
+/*
+ * BloomFilterChunkCodec.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "BloomFilterChunkCodec.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+namespace setsync {
+namespace bloom {
+
+/// Largest supported Rice parameter
+#define MAX_PARAMETER 62
+
+const std::size_t BloomFilterChunkCodec::HEADER_SIZE;
+const std::size_t BloomFilterChunkCodec::MIN_CHUNK_SIZE;
+const std::size_t BloomFilterChunkCodec::DEFAULT_WINDOW_SIZE;
+
+static void writeUInt(unsigned char * buffer, uint64_t value,
+		const std::size_t bytes) {
+	for (std::size_t i = 0; i < bytes; i++) {
+		buffer[i] = (unsigned char) (value & 0xFF);
+		value >>= 8;
+	}
+}
+
+static uint64_t readUInt(const unsigned char * buffer, const std::size_t bytes) {
+	uint64_t value = 0;
+	for (std::size_t i = bytes; i > 0; i--) {
+		value = (value << 8) | buffer[i - 1];
+	}
+	return value;
+}
+
+/**
+ * Writes single bits into a zeroed buffer, lowest bit of a byte first
+ */
+class BitWriter {
+private:
+	unsigned char * buffer_;
+	uint64_t position_;
+public:
+	BitWriter(unsigned char * buffer) :
+		buffer_(buffer), position_(0) {
+	}
+	void write(const bool bit) {
+		if (bit)
+			buffer_[position_ / 8] |= (unsigned char) (1 << (position_ % 8));
+		position_++;
+	}
+	void writeRice(const uint64_t value, const unsigned int parameter) {
+		for (uint64_t q = value >> parameter; q > 0; q--)
+			write(true);
+		write(false);
+		for (unsigned int i = 0; i < parameter; i++)
+			write(((value >> i) & 1) != 0);
+	}
+	uint64_t position() const {
+		return position_;
+	}
+};
+
+/**
+ * Reads the bits written by a BitWriter
+ */
+class BitReader {
+private:
+	const unsigned char * buffer_;
+	uint64_t position_;
+	uint64_t size_;
+public:
+	BitReader(const unsigned char * buffer, const std::size_t length) :
+		buffer_(buffer), position_(0), size_((uint64_t) length * 8) {
+	}
+	bool read() {
+		if (position_ >= size_)
+			throw std::runtime_error("Truncated bloom filter chunk");
+		bool bit = (buffer_[position_ / 8] & (1 << (position_ % 8))) != 0;
+		position_++;
+		return bit;
+	}
+	uint64_t readRice(const unsigned int parameter) {
+		uint64_t q = 0;
+		while (read())
+			q++;
+		// A quotient, which overflows when shifted, is never a valid gap
+		if (q > (std::numeric_limits<uint64_t>::max() >> parameter))
+			throw std::runtime_error("Malformed bloom filter chunk");
+		uint64_t value = 0;
+		for (unsigned int i = 0; i < parameter; i++) {
+			if (read())
+				value |= ((uint64_t) 1) << i;
+		}
+		return (q << parameter) | value;
+	}
+};
+
+static uint64_t riceSize(const uint64_t value, const unsigned int parameter) {
+	return (value >> parameter) + 1 + parameter;
+}
+
+unsigned int BloomFilterChunkCodec::optimalParameter(const uint64_t setBits,
+		const uint64_t totalBits) {
+	if (setBits == 0 || setBits >= totalBits)
+		return 0;
+	// Golomb parameter of a geometric distribution, rounded to a power of 2
+	double golomb = log(2.0) * totalBits / setBits;
+	if (golomb <= 1)
+		return 0;
+	unsigned int parameter = (unsigned int) floor(log(golomb) / log(2.0));
+	return std::min(parameter, (unsigned int) MAX_PARAMETER);
+}
+
+std::size_t BloomFilterChunkCodec::encode(const unsigned char * bits,
+		const std::size_t size, const std::size_t offset,
+		const unsigned int parameter, unsigned char * buffer,
+		const std::size_t length, std::size_t * covered) {
+	if (length < MIN_CHUNK_SIZE)
+		throw std::runtime_error("Buffer too small for a bloom filter chunk");
+	if (parameter > MAX_PARAMETER)
+		throw std::runtime_error("Rice parameter too large");
+	if (offset >= size) {
+		*covered = 0;
+		return 0;
+	}
+	const std::size_t end = offset + std::min(size - offset,
+			(std::size_t) std::numeric_limits<uint32_t>::max());
+	const uint64_t payloadBits = (uint64_t) (length - HEADER_SIZE) * 8;
+	unsigned char * payload = buffer + HEADER_SIZE;
+	memset(payload, 0, length - HEADER_SIZE);
+	BitWriter writer(payload);
+	// Position of the first bit, which hasn't been encoded yet
+	uint64_t next = (uint64_t) offset * 8;
+	uint64_t count = 0;
+	std::size_t i = offset;
+	while (i < end) {
+		// Empty regions cost nothing but a longer gap
+		uint64_t word;
+		while (i + sizeof(uint64_t) <= end) {
+			memcpy(&word, bits + i, sizeof(uint64_t));
+			if (word != 0)
+				break;
+			i += sizeof(uint64_t);
+		}
+		while (i < end && bits[i] == 0)
+			i++;
+		if (i == end)
+			break;
+		uint64_t cost = 0;
+		uint64_t last = next;
+		for (unsigned int j = 0; j < 8; j++) {
+			if (bits[i] & (1 << j)) {
+				uint64_t pos = (uint64_t) i * 8 + j;
+				cost += riceSize(pos - last, parameter);
+				last = pos + 1;
+			}
+		}
+		if (writer.position() + cost > payloadBits)
+			break;
+		for (unsigned int j = 0; j < 8; j++) {
+			if (bits[i] & (1 << j)) {
+				uint64_t pos = (uint64_t) i * 8 + j;
+				writer.writeRice(pos - next, parameter);
+				next = pos + 1;
+				count++;
+			}
+		}
+		i++;
+	}
+	std::size_t riceCovered = i - offset;
+	std::size_t riceLength = HEADER_SIZE + (writer.position() + 7) / 8;
+	std::size_t rawCovered = std::min(end - offset, length - HEADER_SIZE);
+	if (riceCovered > rawCovered || (riceCovered == rawCovered && riceLength
+			<= HEADER_SIZE + rawCovered)) {
+		buffer[0] = RICE;
+		buffer[1] = (unsigned char) parameter;
+		writeUInt(buffer + 2, offset, 8);
+		writeUInt(buffer + 10, riceCovered, 4);
+		writeUInt(buffer + 14, count, 4);
+		*covered = riceCovered;
+		return riceLength;
+	}
+	buffer[0] = RAW;
+	buffer[1] = 0;
+	writeUInt(buffer + 2, offset, 8);
+	writeUInt(buffer + 10, rawCovered, 4);
+	writeUInt(buffer + 14, 0, 4);
+	memcpy(payload, bits + offset, rawCovered);
+	*covered = rawCovered;
+	return HEADER_SIZE + rawCovered;
+}
+
+std::size_t BloomFilterChunkCodec::decode(const unsigned char * chunk,
+		const std::size_t length, WindowHandler& handler,
+		const std::size_t windowSize) {
+	if (length < HEADER_SIZE)
+		throw std::runtime_error("Truncated bloom filter chunk");
+	const unsigned int parameter = chunk[1];
+	const std::size_t offset = readUInt(chunk + 2, 8);
+	const std::size_t covered = readUInt(chunk + 10, 4);
+	const uint64_t count = readUInt(chunk + 14, 4);
+	const unsigned char * payload = chunk + HEADER_SIZE;
+	// The header comes from the peer, so the covered bits must not wrap
+	if (offset > std::numeric_limits<std::size_t>::max() - covered
+			|| offset + covered > std::numeric_limits<uint64_t>::max() / 8)
+		throw std::runtime_error("Malformed bloom filter chunk");
+	const std::size_t end = offset + covered;
+	if (chunk[0] == RAW) {
+		if (length - HEADER_SIZE < covered)
+			throw std::runtime_error("Truncated bloom filter chunk");
+		if (covered > 0)
+			handler.handle(payload, covered, offset);
+		return end;
+	}
+	if (chunk[0] != RICE || parameter > MAX_PARAMETER || windowSize == 0)
+		throw std::runtime_error("Unknown bloom filter chunk format");
+	BitReader reader(payload, length - HEADER_SIZE);
+	std::vector<unsigned char> window(std::min(windowSize, covered) + 1, 0);
+	std::size_t windowStart = offset;
+	std::size_t windowLength = std::min(windowSize, end - windowStart);
+	uint64_t next = (uint64_t) offset * 8;
+	for (uint64_t k = 0; k < count; k++) {
+		const uint64_t gap = reader.readRice(parameter);
+		// Checked before the addition, so the position can't wrap around
+		if (gap >= (uint64_t) end * 8 - next)
+			throw std::runtime_error("Malformed bloom filter chunk");
+		uint64_t pos = next + gap;
+		next = pos + 1;
+		while (pos / 8 >= windowStart + windowLength) {
+			handler.handle(&window[0], windowLength, windowStart);
+			memset(&window[0], 0, windowLength);
+			windowStart += windowLength;
+			windowLength = std::min(windowSize, end - windowStart);
+		}
+		window[pos / 8 - windowStart] |= (unsigned char) (1 << (pos % 8));
+	}
+	while (windowStart < end) {
+		handler.handle(&window[0], windowLength, windowStart);
+		memset(&window[0], 0, windowLength);
+		windowStart += windowLength;
+		windowLength = std::min(windowSize, end - windowStart);
+	}
+	return end;
+}
+
+void BloomFilterChunkCodec::relocate(unsigned char * chunk,
+		const std::size_t length, const std::size_t offset) {
+	if (length < HEADER_SIZE)
+		throw std::runtime_error("Truncated bloom filter chunk");
+	writeUInt(chunk + 2, offset, 8);
+}
+
+}
+}
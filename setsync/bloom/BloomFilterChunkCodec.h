@@ -0,0 +1,119 @@
+/*
+ * BloomFilterChunkCodec.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef BLOOMFILTERCHUNKCODEC_H_
+#define BLOOMFILTERCHUNKCODEC_H_
+
+#include <cstddef>
+#include <stdint.h>
+
+namespace setsync {
+namespace bloom {
+
+/**
+ * Encodes and decodes bloom filter chunks for the compressed transfer
+ * mode. Each chunk is self-describing: it starts with a header, which
+ * carries the byte offset and the number of bytes of the bloom filter
+ * covered by the chunk. The set bits of the covered region are encoded as
+ * Golomb-Rice coded gaps between them. If that doesn't cover more bytes
+ * of the filter than copying them, the chunk contains the raw bytes.
+ *
+ * Header layout (little endian):
+ * - 1 byte format (RAW or RICE)
+ * - 1 byte Rice parameter
+ * - 8 bytes offset of the first covered byte
+ * - 4 bytes number of covered bytes
+ * - 4 bytes number of encoded set bits
+ */
+class BloomFilterChunkCodec {
+public:
+	/// Size of a chunk header in bytes
+	static const std::size_t HEADER_SIZE = 18;
+	/// Smallest buffer, which is able to hold a chunk covering one byte
+	static const std::size_t MIN_CHUNK_SIZE = HEADER_SIZE + 1;
+	/// Size of the windows passed to the WindowHandler by decode()
+	static const std::size_t DEFAULT_WINDOW_SIZE = 65536;
+	/**
+	 * Format of the chunk payload
+	 */
+	enum Format {
+		RAW = 0, RICE = 1
+	};
+	/**
+	 * Receives the decoded bloom filter bytes of a chunk
+	 */
+	class WindowHandler {
+	public:
+		virtual ~WindowHandler() {
+		}
+		/**
+		 * \param bits decoded bloom filter bytes
+		 * \param length number of decoded bytes
+		 * \param offset of the decoded bytes in the bloom filter
+		 */
+		virtual void handle(const unsigned char * bits,
+				const std::size_t length, const std::size_t offset) = 0;
+	};
+	/**
+	 * Calculates the Rice parameter, which fits best for a bit array of
+	 * the given density
+	 *
+	 * \param setBits number of set bits (an estimation is sufficient)
+	 * \param totalBits size of the bit array in bits
+	 * \return the Rice parameter
+	 */
+	static unsigned int optimalParameter(const uint64_t setBits,
+			const uint64_t totalBits);
+	/**
+	 * Encodes as many bytes of the bit array as possible into the buffer,
+	 * starting at the given offset.
+	 *
+	 * \param bits bit array to be encoded
+	 * \param size of the bit array in bytes
+	 * \param offset of the first byte to be encoded
+	 * \param parameter Rice parameter, see optimalParameter()
+	 * \param buffer where the chunk is written to
+	 * \param length of the buffer, at least MIN_CHUNK_SIZE
+	 * \param covered is set to the number of encoded bytes of the bit array
+	 * \return the size of the written chunk
+	 * \throws an Exception, if the buffer is smaller than MIN_CHUNK_SIZE
+	 */
+	static std::size_t encode(const unsigned char * bits,
+			const std::size_t size, const std::size_t offset,
+			const unsigned int parameter, unsigned char * buffer,
+			const std::size_t length, std::size_t * covered);
+	/**
+	 * Decodes the given chunk and passes the covered bloom filter bytes
+	 * window by window to the given handler, so even a chunk covering a
+	 * large empty region needs a bounded amount of memory only.
+	 *
+	 * \param chunk to be decoded
+	 * \param length of the chunk
+	 * \param handler to be called for each decoded window
+	 * \param windowSize maximum number of bytes passed at once to the handler
+	 * \return the offset of the first byte behind the covered region
+	 * \throws an Exception, if the chunk is malformed
+	 */
+	static std::size_t decode(const unsigned char * chunk,
+			const std::size_t length, WindowHandler& handler,
+			const std::size_t windowSize = DEFAULT_WINDOW_SIZE);
+	/**
+	 * Changes the offset in the header of an encoded chunk, so a chunk of
+	 * a part of a bloom filter could be sent as part of a larger one.
+	 *
+	 * \param chunk to be changed
+	 * \param length of the chunk
+	 * \param offset of the first covered byte in the larger bloom filter
+	 * \throws an Exception, if the chunk is shorter than a header
+	 */
+	static void relocate(unsigned char * chunk, const std::size_t length,
+			const std::size_t offset);
+};
+
+}
+}
+
+#endif /* BLOOMFILTERCHUNKCODEC_H_ */
@@ -23,6 +23,14 @@ public:
 	 * \return true on successful remove
 	 */
 	virtual bool remove(const unsigned char * key) = 0;
+	/**
+	 * Removes all given crypto keys from the BloomFilter
+	 * \param keys to be removed
+	 * \param count number of keys in the array
+	 * \return the number of successfully removed keys
+	 */
+	virtual std::size_t removeAll(const unsigned char * keys,
+			const std::size_t count) = 0;
 	/**
 	 * Hash the given string and remove the hash from the BloomFilter
 	 * \param string to be hashed and removed
@@ -25,6 +25,7 @@
 
 #include "HashFunction.h"
 #include <setsync/crypto/CryptoHash.h>
+#include <string.h>
 namespace setsync {
 
 namespace bloom {
@@ -63,6 +64,32 @@ public:
 	 * \return max value of std::size_t
 	 */
 	virtual std::size_t count() const;
+	/**
+	 * Calculates the results of the first count functions for the given
+	 * input modulo the given modulus. The results are the same as
+	 * hash(input, hashsize, i) % modulus for i in [0,count), but this method
+	 * isn't virtual and is inlined, so the bloom filters can compute all
+	 * positions of a key without a virtual call per function.
+	 *
+	 * \param input pointer to the input hash key with the length hashsize
+	 * \param count number of functions to be calculated
+	 * \param modulus of the results, which is the size of a bloom filter
+	 * \param results array with space for count results
+	 * \throws an exception, if the hashsize is too small
+	 */
+	inline void positions(const unsigned char * input, const std::size_t count,
+			const uint64_t modulus, uint64_t * results) const {
+		if (hashsize_ < sizeof(uint64_t) * 2)
+			throw "Must be implemented";
+		uint64_t f1;
+		uint64_t f2;
+		memcpy(&f1, input, sizeof(uint64_t));
+		memcpy(&f2, input + sizeof(uint64_t), sizeof(uint64_t));
+		for (std::size_t i = 0; i < count; i++) {
+			f1 += f2;
+			results[i] = f1 % modulus;
+		}
+	}
 protected:
 	/// Size of the given hash key in bytes
 	const std::size_t hashsize_;
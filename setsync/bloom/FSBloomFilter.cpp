@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <stdio.h>
 #include <typeinfo>
 #include <algorithm>
@@ -18,36 +19,69 @@
 #include <stdexcept>
 #include <setsync/utils/OutputFunctions.h>
 #include <unistd.h>
+#include <fcntl.h>
 
 #ifndef BYTESIZE
 #define BYTESIZE 8
 #endif
 
+#ifdef __GNUC__
+#define PREFETCH_READ(addr) __builtin_prefetch((addr), 0)
+#define PREFETCH_WRITE(addr) __builtin_prefetch((addr), 1)
+#else
+#define PREFETCH_READ(addr)
+#define PREFETCH_WRITE(addr)
+#endif
+
 #define _unused(x) ((void)x)
 namespace setsync {
 namespace bloom {
 
+const std::size_t FSBloomFilter::BATCH_SIZE = 16;
+
+/// Identifies the trailer of a bloom filter file
+#define TRAILER_MAGIC 0x544C494642535346ULL
+/// Version of the trailer layout
+#define TRAILER_VERSION 2
+/// State of a trailer of a file, which is in use or hasn't been closed
+#define TRAILER_OPEN 0
+/// State of a trailer of a properly closed file
+#define TRAILER_CLOSED 1
+/// State of a trailer of a file in use, whose bits have been synced
+#define TRAILER_CHECKPOINT 2
+
+/**
+ * Trailer behind the bits of a bloom filter file
+ */
+struct FileTrailer {
+	uint64_t magic;
+	uint32_t version;
+	uint32_t state;
+	uint64_t filterSize;
+	uint64_t functionCount;
+	uint64_t itemCount;
+	uint64_t generation;
+	uint64_t sequence;
+	uint64_t checksum;
+};
+
 FSBloomFilter::FSBloomFilter(const crypto::CryptoHash& hash, const char * file,
 		const uint64_t maxNumberOfElements, const bool hardMaximum,
-		const float falsePositiveRate) :
-	AbstractBloomFilter(hash), filehandler_(NULL) {
-	if (file != NULL) {
-		// If file at the file path exists, just open it
-		filehandler_ = fopen(file, "r+");
-		// If file doesn't exist, try to create a new one
-		if (filehandler_ == NULL) {
-			filehandler_ = fopen(file, "w+");
-		}
-		// If creating a new one also failed, print out message and try to create temp file later
-		if (filehandler_ == NULL) {
-			std::cerr << "Fail on opening given file: " << file << std::endl;
-			std::cerr << "Trying to open and use temporary file instead!"
-					<< std::endl;
-		}
-	}
+		const float falsePositiveRate, const uint64_t segmentSize,
+		const bool prefault, const bool hugePages) :
+	AbstractBloomFilter(hash), fileLoaded_(false), fileCheckpointed_(false),
+			fileGeneration_(0), checkpointSequence_(0), segmentSize_(0) {
 	init(falsePositiveRate, hardMaximum, maxNumberOfElements);
-	this->hashFunction_ = new DoubleHashingScheme(
+	mapSegments(file, segmentSize, prefault, hugePages);
+	if (!loadTrailer()) {
+		zeroBits();
+		this->itemCount_ = 0;
+	}
+	// The content isn't trusted after a crash, until the file is closed
+	writeTrailer(TRAILER_OPEN, 0);
+	this->doubleHashing_ = new DoubleHashingScheme(
 			this->cryptoHashFunction_.getHashSize());
+	this->hashFunction_ = this->doubleHashing_;
 }
 
 void FSBloomFilter::init(const float falsePositiveRate, const bool hardMaximum,
@@ -74,32 +108,241 @@ void FSBloomFilter::init(const float falsePositiveRate, const bool hardMaximum,
 	if (this->functionCount_ < 1)
 		this->functionCount_ = 1;
 	this->mmapLength_ = (this->filterSize_ + (BYTESIZE - 1)) / BYTESIZE;
-	if (this->filehandler_ == NULL)
-		this->filehandler_ = tmpfile();
-	if (this->filehandler_ == NULL) {
+	if (this->mmapLength_ > std::numeric_limits<std::size_t>::max()
+			- sizeof(FileTrailer)) {
+		throw std::runtime_error(
+				"The bloom filter doesn't fit into the address space!");
+	}
+}
+
+FILE * FSBloomFilter::openSegment(const char * file,
+		const std::size_t index) const {
+	FILE * segment = NULL;
+	if (file != NULL) {
+		std::stringstream path;
+		path << file;
+		if (index > 0)
+			path << "." << index;
+		// If file at the file path exists, just open it
+		segment = fopen(path.str().c_str(), "r+");
+		// If file doesn't exist, try to create a new one
+		if (segment == NULL) {
+			segment = fopen(path.str().c_str(), "w+");
+		}
+		// If creating a new one also failed, print out message and try to create temp file later
+		if (segment == NULL) {
+			std::cerr << "Fail on opening given file: " << path.str()
+					<< std::endl;
+			std::cerr << "Trying to open and use temporary file instead!"
+					<< std::endl;
+		}
+	}
+	if (segment == NULL)
+		segment = tmpfile();
+	if (segment == NULL) {
 		std::cout << "TEMP File fail!" << std::endl;
 		throw std::runtime_error("TEMP File fail!");
 	}
-	int fd = fileno(this->filehandler_);
-	lseek(fd, this->mmapLength_ - 1, SEEK_SET);
-	ssize_t filesize = write(fd, "", 1);
-	if (filesize == -1) {
-		std::cout << "writing to bloom filter file failed!" << std::endl;
-		throw std::runtime_error("writing to bloom filter file failed!");
+	return segment;
+}
+
+void FSBloomFilter::mapSegments(const char * file, const uint64_t segmentSize,
+		const bool prefault, const bool hugePages) {
+	const std::size_t length = this->mmapLength_ + sizeof(FileTrailer);
+	const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+	// Each segment has to start at a page boundary of the mapping
+	this->segmentSize_ = length;
+	if (segmentSize > 0 && segmentSize < length) {
+		this->segmentSize_ = (segmentSize + pageSize - 1) / pageSize
+				* pageSize;
 	}
-	this->bitArray_ = (unsigned char *) mmap(NULL, this->mmapLength_,
-			PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
-	if (this->bitArray_ == NULL) {
+	// The addresses of all segments are reserved first, so they are
+	// mapped behind each other
+	void * base = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+			-1, 0);
+	if (base == MAP_FAILED) {
 		std::cout << "MMAP failed!" << std::endl;
 		throw std::runtime_error("MMAP failed!");
 	}
-	//	madvise(this->bitArray_, this->mmapLength_, MADV_SEQUENTIAL);
+	this->bitArray_ = (unsigned char *) base;
+	int flags = MAP_SHARED | MAP_FIXED;
+#ifdef MAP_POPULATE
+	if (prefault)
+		flags |= MAP_POPULATE;
+#else
+	_unused(prefault);
+#endif
+	try {
+		for (std::size_t offset = 0; offset < length; offset
+				+= this->segmentSize_) {
+			const std::size_t segmentLength = std::min(length - offset,
+					(std::size_t) this->segmentSize_);
+			this->segments_.push_back(
+					openSegment(file, this->segments_.size()));
+			int fd = fileno(this->segments_.back());
+			struct stat status;
+			// An existing file is only extended, so its content is kept. The
+			// trailer is only found again, if the segments keep their sizes.
+			if (fstat(fd, &status) == -1 || ((std::size_t) status.st_size
+					< segmentLength && ftruncate(fd, segmentLength) == -1)) {
+				std::cout << "writing to bloom filter file failed!"
+						<< std::endl;
+				throw std::runtime_error(
+						"writing to bloom filter file failed!");
+			}
+			if (mmap(this->bitArray_ + offset, segmentLength,
+					PROT_READ | PROT_WRITE, flags, fd, 0) == MAP_FAILED) {
+				std::cout << "MMAP failed!" << std::endl;
+				throw std::runtime_error("MMAP failed!");
+			}
+		}
+	} catch (...) {
+		munmap(base, length);
+		for (std::size_t i = 0; i < this->segments_.size(); i++) {
+			fclose(this->segments_[i]);
+		}
+		this->segments_.clear();
+		throw;
+	}
+#ifdef MADV_HUGEPAGE
+	// Only a hint, which is ignored by file systems without huge pages
+	if (hugePages)
+		madvise(this->bitArray_, length, MADV_HUGEPAGE);
+#else
+	_unused(hugePages);
+#endif
+}
+
+void FSBloomFilter::zeroBits() {
+#ifdef FALLOC_FL_PUNCH_HOLE
+	// Punching the bits out of the files zeroes them without writing each
+	// page, which matters for filters of several gigabytes. The trailer
+	// is kept.
+	bool punched = true;
+	for (std::size_t i = 0; i < this->segments_.size() && punched; i++) {
+		const uint64_t offset = i * this->segmentSize_;
+		if (offset >= this->mmapLength_)
+			break;
+		const uint64_t length = std::min(this->segmentSize_,
+				this->mmapLength_ - offset);
+		punched = fallocate(fileno(this->segments_[i]),
+				FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, 0, length) == 0;
+	}
+	if (punched)
+		return;
+#endif
+	// The file system doesn't support holes
 	memset(this->bitArray_, 0x00, this->mmapLength_);
-	this->itemCount_ = 0;
+}
+
+bool FSBloomFilter::loadTrailer() {
+	FileTrailer trailer;
+	memcpy(&trailer, this->bitArray_ + this->mmapLength_, sizeof(FileTrailer));
+	if (trailer.magic != TRAILER_MAGIC || trailer.version != TRAILER_VERSION
+			|| trailer.filterSize != this->filterSize_
+			|| trailer.functionCount != this->functionCount_) {
+		return false;
+	}
+	if (trailer.state == TRAILER_CHECKPOINT) {
+		// The bits could have changed after the checkpoint, so there is
+		// no checksum. Only the subclass knows, how to bring them up to date.
+		this->itemCount_ = trailer.itemCount;
+		this->fileGeneration_ = trailer.generation;
+		this->checkpointSequence_ = trailer.sequence;
+		this->fileCheckpointed_ = true;
+		return true;
+	}
+	if (trailer.state != TRAILER_CLOSED) {
+		return false;
+	}
+	this->itemCount_ = trailer.itemCount;
+	this->fileGeneration_ = trailer.generation;
+	if (trailer.checksum != checksum()) {
+		this->itemCount_ = 0;
+		this->fileGeneration_ = 0;
+		return false;
+	}
+	this->fileLoaded_ = true;
+	return true;
+}
+
+void FSBloomFilter::writeTrailer(const uint32_t state, const uint64_t sequence) {
+	FileTrailer trailer;
+	memset(&trailer, 0, sizeof(FileTrailer));
+	trailer.magic = TRAILER_MAGIC;
+	trailer.version = TRAILER_VERSION;
+	trailer.state = state;
+	trailer.filterSize = this->filterSize_;
+	trailer.functionCount = this->functionCount_;
+	trailer.itemCount = this->itemCount_;
+	trailer.generation = this->fileGeneration_;
+	trailer.sequence = sequence;
+	// The bits are only read once more on closing
+	trailer.checksum = (state == TRAILER_CLOSED) ? checksum() : 0;
+	memcpy(this->bitArray_ + this->mmapLength_, &trailer, sizeof(FileTrailer));
+}
+
+void FSBloomFilter::checkpoint(const uint64_t sequence) {
+	const std::size_t pageSize = sysconf(_SC_PAGESIZE);
+	const std::size_t trailerPage = this->mmapLength_ / pageSize * pageSize;
+	const std::size_t length = this->mmapLength_ + sizeof(FileTrailer);
+	// The bits have to be on disk, before the trailer refers to them
+	if (msync(this->bitArray_, length, MS_SYNC) == -1) {
+		throw std::runtime_error("syncing the bloom filter file failed!");
+	}
+	writeTrailer(TRAILER_CHECKPOINT, sequence);
+	if (msync(this->bitArray_ + trailerPage, length - trailerPage, MS_SYNC)
+			== -1) {
+		throw std::runtime_error("syncing the bloom filter file failed!");
+	}
+}
+
+uint64_t FSBloomFilter::checksum() const {
+	// Fletcher like sums over 64 bit words, which are fast to compute
+	uint64_t sum1 = this->itemCount_;
+	uint64_t sum2 = this->fileGeneration_;
+	std::size_t i = 0;
+	uint64_t word;
+	for (; i + sizeof(uint64_t) <= this->mmapLength_; i += sizeof(uint64_t)) {
+		memcpy(&word, this->bitArray_ + i, sizeof(uint64_t));
+		sum1 += word;
+		sum2 += sum1;
+	}
+	for (; i < this->mmapLength_; i++) {
+		sum1 += this->bitArray_[i];
+		sum2 += sum1;
+	}
+	return sum1 ^ (sum2 * 0x9E3779B97F4A7C15ULL);
+}
+
+bool FSBloomFilter::isFileLoaded() const {
+	return this->fileLoaded_;
+}
+
+uint64_t FSBloomFilter::getFileGeneration() const {
+	return this->fileGeneration_;
+}
+
+void FSBloomFilter::setFileGeneration(const uint64_t generation) {
+	this->fileGeneration_ = generation;
+}
+
+bool FSBloomFilter::isFileCheckpointed() const {
+	return this->fileCheckpointed_;
+}
+
+uint64_t FSBloomFilter::getCheckpointSequence() const {
+	return this->checkpointSequence_;
+}
+
+std::size_t FSBloomFilter::numberOfSegments() const {
+	return this->segments_.size();
 }
 
 FSBloomFilter::~FSBloomFilter() {
-	int ret = munmap(this->bitArray_, this->mmapLength_);
+	writeTrailer(TRAILER_CLOSED, 0);
+	// All segments are unmapped at once
+	int ret = munmap(this->bitArray_, this->mmapLength_ + sizeof(FileTrailer));
 #ifdef DEBUG
 	if(ret==-1) {
 		throw "THIS SHOULD NEVER EVER HAPPEN!!!! OTHERWISE, THIS CLASS IS WRONG!!!";
@@ -107,14 +350,16 @@ FSBloomFilter::~FSBloomFilter() {
 #else
 	_unused(ret);
 #endif
-	ret = fclose(this->filehandler_);
+	for (std::size_t i = 0; i < this->segments_.size(); i++) {
+		ret = fclose(this->segments_[i]);
 #ifdef DEBUG
-	if(ret!=0) {
-		throw "closing file failed, this shouldn't happen, but it is not important";
-	}
+		if(ret!=0) {
+			throw "closing file failed, this shouldn't happen, but it is not important";
+		}
 #else
-	_unused(ret);
+		_unused(ret);
 #endif
+	}
 	delete this->hashFunction_;
 }
 
@@ -134,20 +379,19 @@ uint64_t FSBloomFilter::save(std::ostream &out) {
 	return this->itemCount_;
 }
 void FSBloomFilter::clear() {
-	memset(this->bitArray_, 0x00, this->mmapLength_);
+	zeroBits();
 	this->itemCount_ = 0;
 }
 
 void FSBloomFilter::add(const unsigned char *key) {
 	if (this->hardMaximum_ && this->itemCount_ >= maxElements_)
 		throw std::runtime_error("Maximum of Elements reached, adding failed");
-	std::size_t bit_index = 0;
-	std::size_t bit = 0;
+	uint64_t positions[this->functionCount_];
+	this->doubleHashing_->positions(key, this->functionCount_,
+			this->filterSize_, positions);
 	for (std::size_t i = 0; i < this->functionCount_; i++) {
-		uint64_t pos = this->hashFunction_->operator ()(key,
-				this->cryptoHashFunction_.getHashSize(), i) % this->filterSize_;
-		compute_indices(pos, bit_index, bit);
-		this->bitArray_[bit_index] |= bit_mask[bit];
+		this->bitArray_[positions[i] / BYTESIZE]
+				|= bit_mask[positions[i] % BYTESIZE];
 	}
 	if (this->itemCount_ < std::numeric_limits<uint64_t>::max())
 		this->itemCount_++;
@@ -156,23 +400,24 @@ void FSBloomFilter::add(const unsigned char *key) {
 void FSBloomFilter::addAll(const unsigned char* keys, const std::size_t count) {
 	if (this->hardMaximum_ && this->itemCount_ + count > maxElements_)
 		throw std::runtime_error("Maximum of Elements reached, adding failed");
-	uint64_t hashes[count * this->functionCount_];
-	for (std::size_t i = 0; i < count; i++) {
-		for (std::size_t j = 0; j < this->functionCount_; j++) {
-			hashes[i * this->functionCount_ + j]
-					= this->hashFunction_->operator ()(
-							keys
-									+ (this->cryptoHashFunction_.getHashSize()
-											* i),
-							this->cryptoHashFunction_.getHashSize(), j);
+	const std::size_t hashsize = this->cryptoHashFunction_.getHashSize();
+	uint64_t positions[BATCH_SIZE * this->functionCount_];
+	for (std::size_t start = 0; start < count; start += BATCH_SIZE) {
+		std::size_t keysInBatch = std::min(BATCH_SIZE, count - start);
+		std::size_t probes = keysInBatch * this->functionCount_;
+		for (std::size_t i = 0; i < keysInBatch; i++) {
+			uint64_t * keyPositions = positions + i * this->functionCount_;
+			this->doubleHashing_->positions(keys + (start + i) * hashsize,
+					this->functionCount_, this->filterSize_, keyPositions);
+			// Load the bytes while the positions of the next key are calculated
+			for (std::size_t j = 0; j < this->functionCount_; j++) {
+				PREFETCH_WRITE(this->bitArray_ + keyPositions[j] / BYTESIZE);
+			}
+		}
+		for (std::size_t i = 0; i < probes; i++) {
+			this->bitArray_[positions[i] / BYTESIZE]
+					|= bit_mask[positions[i] % BYTESIZE];
 		}
-	}
-	std::sort(hashes, hashes + (count * this->functionCount_));
-	std::size_t bit_index = 0;
-	std::size_t bit = 0;
-	for (std::size_t i = 0; i < count * this->functionCount_; i++) {
-		compute_indices(hashes[i], bit_index, bit);
-		this->bitArray_[bit_index] |= bit_mask[bit];
 	}
 	if (this->itemCount_ + count < std::numeric_limits<uint64_t>::max()) {
 		this->itemCount_ += count;
@@ -182,14 +427,12 @@ void FSBloomFilter::addAll(const unsigned char* keys, const std::size_t count) {
 }
 
 bool FSBloomFilter::contains(const unsigned char *key) const {
-	std::size_t bit_index = 0;
-	std::size_t bit = 0;
-
+	uint64_t positions[this->functionCount_];
+	this->doubleHashing_->positions(key, this->functionCount_,
+			this->filterSize_, positions);
 	for (std::size_t i = 0; i < this->functionCount_; i++) {
-		uint64_t pos = this->hashFunction_->operator ()(key,
-				this->cryptoHashFunction_.getHashSize(), i) % this->filterSize_;
-		compute_indices(pos, bit_index, bit);
-		if ((this->bitArray_[bit_index] & bit_mask[bit]) != bit_mask[bit]) {
+		if ((this->bitArray_[positions[i] / BYTESIZE]
+				& bit_mask[positions[i] % BYTESIZE]) == 0) {
 			return false;
 		}
 	}
@@ -198,28 +441,28 @@ bool FSBloomFilter::contains(const unsigned char *key) const {
 
 std::size_t FSBloomFilter::containsAll(const unsigned char *keys,
 		const std::size_t count) const {
-	uint64_t hashes[count * this->functionCount_];
-	for (std::size_t i = 0; i < count; i++) {
-		for (std::size_t j = 0; j < this->functionCount_; j++) {
-			hashes[i * this->functionCount_ + j]
-					= this->hashFunction_->operator ()(
-							keys
-									+ (this->cryptoHashFunction_.getHashSize()
-											* i),
-							this->cryptoHashFunction_.getHashSize(), j)
-							% this->filterSize_;
+	const std::size_t hashsize = this->cryptoHashFunction_.getHashSize();
+	uint64_t positions[BATCH_SIZE * this->functionCount_];
+	for (std::size_t start = 0; start < count; start += BATCH_SIZE) {
+		std::size_t keysInBatch = std::min(BATCH_SIZE, count - start);
+		std::size_t probes = keysInBatch * this->functionCount_;
+		for (std::size_t i = 0; i < keysInBatch; i++) {
+			uint64_t * keyPositions = positions + i * this->functionCount_;
+			this->doubleHashing_->positions(keys + (start + i) * hashsize,
+					this->functionCount_, this->filterSize_, keyPositions);
+			// Load the bytes while the positions of the next key are calculated
+			for (std::size_t j = 0; j < this->functionCount_; j++) {
+				PREFETCH_READ(this->bitArray_ + keyPositions[j] / BYTESIZE);
+			}
 		}
-	}
-	std::sort(hashes, hashes + (count * this->functionCount_));
-	std::size_t bit_index = 0;
-	std::size_t bit = 0;
-	for (std::size_t i = 0; i < count * this->functionCount_; i++) {
-		compute_indices(hashes[i], bit_index, bit);
-		if ((this->bitArray_[bit_index] & bit_mask[bit]) != bit_mask[bit]) {
-			return i == 0 ? 1 : i;
+		for (std::size_t i = 0; i < probes; i++) {
+			if ((this->bitArray_[positions[i] / BYTESIZE]
+					& bit_mask[positions[i] % BYTESIZE]) == 0) {
+				return start + i / this->functionCount_;
+			}
 		}
 	}
-	return true;
+	return count;
 }
 
 void FSBloomFilter::compute_indices(const uint64_t hash,
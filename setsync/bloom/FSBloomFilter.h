@@ -8,6 +8,9 @@
 #define FSBLOOMFILTER_H_
 
 #include "BloomFilter.h"
+#include "DoubleHashingScheme.h"
+#include <vector>
+#include <stdio.h>
 namespace setsync {
 namespace bloom {
 
@@ -15,17 +18,38 @@ class FSBloomFilter: public virtual bloom::AbstractBloomFilter {
 	friend class FSBloomFilterTest;
 public:
 	/**
+	 * If the given file has been closed properly by a filter with the
+	 * same parameters, its bits and number of elements are loaded.
+	 * The bits of a file, which has been checkpointed by a subclass, are
+	 * kept, too. Otherwise the filter starts empty.
+	 *
+	 * Large filters can be split into segments of segmentSize bytes,
+	 * each one stored in its own file. The first segment is stored in
+	 * the given file, segment i in the file with the suffix ".i". All
+	 * segments are mapped to consecutive addresses, so the bits are
+	 * still addressed as a single array.
 	 *
 	 * \param hash sets the used cryptographic hash function
 	 * \param file sets the path to a file to be used to contain the bloom filter, if NULL, a temporary file will be used
 	 * \param maxNumberOfElements which should be represented by the bloom filter
 	 * \param hardMaximum ensures that the the maximum of storable entries will never be exceeded
 	 * \param falsePositiveRate can be set to any value ]0,1[.
+	 * \param segmentSize maximum number of bytes of a single file, it is
+	 * rounded up to a multiple of the page size. If 0, the filter is
+	 * stored in a single file.
+	 * \param prefault if true, all pages are read in on opening, so the
+	 * first lookups don't wait for the disk
+	 * \param hugePages if true, huge pages are requested for the mapping,
+	 * where the file system supports them. Lookups in large filters cause
+	 * less TLB misses, but each change dirties a whole huge page, which
+	 * has to be written back.
 	 */
 	FSBloomFilter(const crypto::CryptoHash& hash, const char * file = NULL,
 			const uint64_t maxNumberOfElements = 10000,
 			const bool hardMaximum = false,
-			const float falsePositiveRate = 0.001);
+			const float falsePositiveRate = 0.001,
+			const uint64_t segmentSize = 0, const bool prefault = false,
+			const bool hugePages = false);
 	virtual ~FSBloomFilter();
 	/**
 	 * \param in inputstream to read the bloom filter from
@@ -49,6 +73,10 @@ public:
 	 */
 	virtual void add(const unsigned char *key);
 	/**
+	 * Adds the keys in blocks of BATCH_SIZE keys. The positions of all
+	 * keys of a block are calculated and prefetched first, before the
+	 * bits are set.
+	 *
 	 * \param keys to be added to the BloomFilter
 	 * \param count number of keys in the array
 	 * \throws an Exception, if the maximum is reached and hardMaximum has been set
@@ -60,9 +88,13 @@ public:
 	 */
 	virtual bool contains(const unsigned char *key) const;
 	/**
+	 * Checks the keys in blocks of BATCH_SIZE keys. The positions of all
+	 * keys of a block are calculated and prefetched first, before the
+	 * bits are tested.
+	 *
 	 * \param keys a simple array of keys, which should be checked, if they are represented by the bloom filter
 	 * \param count the length of the keys array
-	 * \return the given count on containing all keys, otherwise 0
+	 * \return the given count on containing all keys, otherwise the first failed position in the given key array
 	 */
 	virtual std::size_t containsAll(const unsigned char *keys,
 			const std::size_t count) const;
@@ -93,16 +125,122 @@ public:
 	 */
 	virtual std::string toString();
 protected:
+	/// Number of keys, whose positions are calculated and prefetched at once
+	static const std::size_t BATCH_SIZE;
+	/// The hash function of this filter, used without virtual calls
+	DoubleHashingScheme * doubleHashing_;
 	/// Help function to get the right positions inside the byte array of the bloom filter
 	void compute_indices(const uint64_t hash, std::size_t& bit_index,
 			std::size_t& bit) const;
 	/// The bloom filter memory mapped storage
 	unsigned char * bitArray_;
-	FILE * filehandler_;
-	unsigned int mmapLength_;
+	/// Number of bytes of the bits, the trailer is stored behind them
+	uint64_t mmapLength_;
+	/**
+	 * \return the number of files, the bits are stored in
+	 */
+	std::size_t numberOfSegments() const;
+	/**
+	 * \return true, if the bits have been loaded from the file
+	 */
+	bool isFileLoaded() const;
+	/**
+	 * \return the generation stored in the loaded file, 0 if nothing
+	 * has been loaded
+	 */
+	uint64_t getFileGeneration() const;
+	/**
+	 * Sets the generation, which is stored in the file on closing. It
+	 * lets a subclass recognize, if the file belongs to its other data.
+	 */
+	void setFileGeneration(const uint64_t generation);
+	/**
+	 * \return true, if the file hasn't been closed, but its bits have
+	 * been kept, because they have been checkpointed. The bits of all
+	 * changes after the checkpoint may or may not be set, so the
+	 * subclass has to restore them.
+	 */
+	bool isFileCheckpointed() const;
+	/**
+	 * \return the sequence number passed to the checkpoint of the loaded
+	 * file, 0 if it hasn't been checkpointed
+	 */
+	uint64_t getCheckpointSequence() const;
+	/**
+	 * Writes the bits to disk and marks the file as checkpointed. If the
+	 * filter isn't closed properly, the next opening keeps the bits and
+	 * passes the sequence number to the subclass. The bits may be
+	 * changed during the checkpoint.
+	 *
+	 * \param sequence number of the first change of the subclass, which
+	 * could be missing in the synced bits
+	 * \throws std::runtime_error, if the file couldn't be synced
+	 */
+	void checkpoint(const uint64_t sequence);
 private:
+	/// true, if the bits have been loaded from the file
+	bool fileLoaded_;
+	/// true, if the bits of a checkpointed file have been kept
+	bool fileCheckpointed_;
+	/// Generation of the file content
+	uint64_t fileGeneration_;
+	/// Sequence number of the checkpoint of the loaded file
+	uint64_t checkpointSequence_;
+	/// Files of the segments, the first one is the given file
+	std::vector<FILE *> segments_;
+	/// Number of bytes of each segment, the last one could be shorter
+	uint64_t segmentSize_;
 	void init(const float falsePositiveRate, const bool hardMaximum,
 			const uint64_t numberOfElements);
+	/**
+	 * Opens the files of all segments and maps them behind each other
+	 *
+	 * \param file path of the first segment, if NULL, temporary files
+	 * are used
+	 * \param segmentSize requested size of the segments, 0 for a single one
+	 * \param prefault if true, all pages are read in
+	 * \param hugePages if true, huge pages are requested
+	 * \throws std::runtime_error, if a file couldn't be extended or mapped
+	 */
+	void mapSegments(const char * file, const uint64_t segmentSize,
+			const bool prefault, const bool hugePages);
+	/**
+	 * Opens the file of a segment or creates it, if it doesn't exist.
+	 * If that fails, a temporary file is used.
+	 *
+	 * \param file path of the first segment, if NULL, a temporary file
+	 * is used
+	 * \param index of the segment
+	 * \throws std::runtime_error, if no file could be opened
+	 */
+	FILE * openSegment(const char * file, const std::size_t index) const;
+	/**
+	 * Sets all bits to zero, the trailer is kept
+	 */
+	void zeroBits();
+	/**
+	 * Loads the number of elements and the generation from the trailer
+	 * behind the bits. The trailer is only accepted, if the file has been
+	 * written with the same parameters and either it has been closed
+	 * properly and the bits match the checksum, or it has been
+	 * checkpointed.
+	 *
+	 * \return true, if the trailer has been accepted
+	 */
+	bool loadTrailer();
+	/**
+	 * Writes the trailer behind the bits
+	 *
+	 * \param state of the file, only the bits of a properly closed or
+	 * a checkpointed file are trusted on the next opening
+	 * \param sequence number of the checkpoint
+	 */
+	void writeTrailer(const uint32_t state, const uint64_t sequence);
+	/**
+	 * \return the checksum of the bits, the number of elements and the
+	 * generation
+	 */
+	uint64_t checksum() const;
 };
 
 
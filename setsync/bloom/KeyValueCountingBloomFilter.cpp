@@ -5,27 +5,399 @@
  */
 
 #include "KeyValueCountingBloomFilter.h"
+#include "BitArrayDiff.h"
+#include "BloomFilterChunkCodec.h"
 #include <setsync/utils/bitset.h>
 #include <stdlib.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
 namespace setsync {
 namespace bloom {
 
 const char KeyValueCountingBloomFilter::sizeKey[] = "bfsize";
+const char KeyValueCountingBloomFilter::versionKey[] = "bfversion";
+const char KeyValueCountingBloomFilter::generationKey[] = "bfgeneration";
+const std::size_t KeyValueCountingBloomFilter::STORAGE_BATCH_SIZE = 4096;
+const std::size_t KeyValueCountingBloomFilter::MULTI_GET_SIZE = 64;
+const uint64_t KeyValueCountingBloomFilter::BUCKET_SIZE = 64;
+const std::size_t KeyValueCountingBloomFilter::BUCKET_KEY_SIZE = 1
+		+ sizeof(uint64_t);
+const uint32_t KeyValueCountingBloomFilter::LAYOUT_VERSION = 2;
+const std::size_t KeyValueCountingBloomFilter::MAX_REBUILD_THREADS = 16;
+const uint64_t KeyValueCountingBloomFilter::PARALLEL_REBUILD_BUCKETS = 16384;
+
+/// First byte of the storage key of a bucket record
+#define BUCKET_PREFIX 'B'
+/// First byte of the storage key of a journal record
+#define JOURNAL_PREFIX 'J'
+
+/**
+ * Locks a mutex for the lifetime of the object
+ */
+class MutexLock {
+private:
+	pthread_mutex_t& mutex_;
+	MutexLock(const MutexLock&);
+	MutexLock& operator=(const MutexLock&);
+public:
+	MutexLock(pthread_mutex_t& mutex) :
+		mutex_(mutex) {
+		pthread_mutex_lock(&this->mutex_);
+	}
+	~MutexLock() {
+		pthread_mutex_unlock(&this->mutex_);
+	}
+};
+
+/**
+ * A range of buckets, which is rebuilt by one thread
+ */
+struct RebuildTask {
+	/// The rebuilt filter
+	KeyValueCountingBloomFilter * filter;
+	/// Iterator over the bucket records of the range
+	setsync::storage::AbstractKeyValueIterator * iter;
+	/// true, if reading the range has failed
+	bool failed;
+	/// Message of the failure
+	std::string error;
+};
 
 KeyValueCountingBloomFilter::KeyValueCountingBloomFilter(
 		const crypto::CryptoHash& hash,
 		setsync::storage::AbstractKeyValueStorage& storage,
 		const std::string& file, const uint64_t maxNumberOfElements,
-		const bool hardMaximum, const float falsePositiveRate) :
+		const bool hardMaximum, const float falsePositiveRate,
+		const unsigned int checkpointInterval, const uint64_t segmentSize,
+		const bool prefault, const bool hugePages,
+		const std::size_t rebuildThreads) :
 			AbstractBloomFilter(hash),
 			CountingBloomFilter(hash),
 			FSBloomFilter(hash, (file.size() == 0) ? NULL : file.c_str(),
-					maxNumberOfElements, hardMaximum, falsePositiveRate),
+					maxNumberOfElements, hardMaximum, falsePositiveRate,
+					segmentSize, prefault, hugePages),
+			journaled_(file.size() > 0), journalSequence_(0),
+			journalStart_(0), checkpointedSequence_(0),
+			checkpointInterval_(checkpointInterval), stopping_(false),
+			threadStarted_(false), rebuildThreads_(rebuildThreads),
 			storage_(storage) {
+	pthread_mutex_init(&this->mutex_, NULL);
+	pthread_mutex_init(&this->checkpointMutex_, NULL);
+	pthread_cond_init(&this->stopCondition_, NULL);
+	uint32_t version = 1;
+	uint32_t storedVersion;
+	std::size_t valuesize;
+	if (this->storage_.getInto((unsigned char *) versionKey,
+			strlen(versionKey), (unsigned char *) &storedVersion,
+			sizeof(uint32_t), &valuesize) && valuesize == sizeof(uint32_t))
+		version = storedVersion;
+	if (version > LAYOUT_VERSION)
+		throw std::runtime_error("Unknown bloom filter storage layout");
+	if (version < LAYOUT_VERSION)
+		upgradeStorage();
+	uint64_t generation = 0;
+	bool generationFound = this->storage_.getInto(
+			(unsigned char *) generationKey, strlen(generationKey),
+			(unsigned char *) &generation, sizeof(uint64_t), &valuesize)
+			&& valuesize == sizeof(uint64_t);
+	if (!generationFound)
+		generation = 0;
+	// The file is only trusted, if it has been closed or checkpointed
+	// together with the storage the last time, otherwise the bits are rebuilt
+	if (version < LAYOUT_VERSION || !generationFound
+			|| getFileGeneration() != generation) {
+		rebuild();
+	} else if (isFileCheckpointed()) {
+		replayJournal(getCheckpointSequence());
+	} else if (!isFileLoaded()) {
+		rebuild();
+	}
+	loadSize();
+	// A file of an older generation doesn't match the storage anymore
+	setFileGeneration(generation + 1);
+	storeGeneration();
+	if (this->journaled_) {
+		// After a crash, the recovery starts at this checkpoint
+		FSBloomFilter::checkpoint(0);
+		clearJournal();
+		if (this->checkpointInterval_ > 0) {
+			if (pthread_create(&this->checkpointThread_, NULL, checkpointLoop,
+					this) != 0)
+				throw std::runtime_error("Starting the checkpoint thread failed");
+			this->threadStarted_ = true;
+		}
+	}
+}
+
+void KeyValueCountingBloomFilter::rebuild() {
+	FSBloomFilter::clear();
+	const uint64_t buckets = (this->filterSize_ + BUCKET_SIZE - 1)
+			/ BUCKET_SIZE;
+	std::size_t threads = 1;
+	if (buckets >= PARALLEL_REBUILD_BUCKETS
+			&& this->storage_.isConcurrentlyReadable()) {
+		threads = this->rebuildThreads_;
+		if (threads == 0) {
+			const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+			threads = cores > 1 ? (std::size_t) cores : 1;
+		}
+		threads = std::min(threads, MAX_REBUILD_THREADS);
+	}
+	if (threads > 1) {
+		// Ranges of unordered storages would be filtered from a full scan each
+		setsync::storage::AbstractKeyValueIterator * probe =
+				storage_.createIterator();
+		if (!probe->isOrdered())
+			threads = 1;
+		delete probe;
+	}
 	/*
-	 * Loading all set bloom filter bits from db
+	 * Loading all set bloom filter bits from db. The buckets are split
+	 * into one range per thread, so the threads set disjoint bytes. The
+	 * iterators are created and deleted by this thread.
 	 */
-	// Cursor to read sequentially the db
+	std::vector<RebuildTask> tasks(threads);
+	unsigned char first[BUCKET_KEY_SIZE];
+	unsigned char last[BUCKET_KEY_SIZE];
+	for (std::size_t t = 0; t < threads; t++) {
+		tasks[t].filter = this;
+		tasks[t].failed = false;
+		if (threads == 1) {
+			const unsigned char prefix = BUCKET_PREFIX;
+			tasks[t].iter = storage_.createPrefixIterator(&prefix, 1);
+		} else {
+			bucketKey(buckets * t / threads, first);
+			bucketKey(buckets * (t + 1) / threads, last);
+			tasks[t].iter = storage_.createRangeIterator(first,
+					BUCKET_KEY_SIZE, last, BUCKET_KEY_SIZE);
+		}
+	}
+	std::vector<pthread_t> workers(threads);
+	std::vector<bool> started(threads, false);
+	for (std::size_t t = 1; t < threads; t++)
+		started[t] = pthread_create(&workers[t], NULL, rebuildWorker,
+				&tasks[t]) == 0;
+	// This thread takes the first range and those of failed threads
+	rebuildWorker(&tasks[0]);
+	for (std::size_t t = 1; t < threads; t++) {
+		if (started[t])
+			pthread_join(workers[t], NULL);
+		else
+			rebuildWorker(&tasks[t]);
+	}
+	for (std::size_t t = 0; t < threads; t++)
+		delete tasks[t].iter;
+	for (std::size_t t = 0; t < threads; t++) {
+		if (tasks[t].failed)
+			throw std::runtime_error("Rebuilding the bloom filter failed: "
+					+ tasks[t].error);
+	}
+}
+
+void * KeyValueCountingBloomFilter::rebuildWorker(void * task) {
+	RebuildTask * range = (RebuildTask *) task;
+	try {
+		range->filter->rebuildRange(range->iter);
+	} catch (const std::exception& e) {
+		range->failed = true;
+		range->error = e.what();
+	} catch (...) {
+		range->failed = true;
+		range->error = "unknown error";
+	}
+	return NULL;
+}
+
+void KeyValueCountingBloomFilter::rebuildRange(
+		setsync::storage::AbstractKeyValueIterator * iter) {
+	const std::size_t entrySize = 1 + this->cryptoHashFunction_.getHashSize();
+	unsigned char key[BUCKET_KEY_SIZE];
+	std::string record;
+	while (iter->valid()) {
+		if (iter->keySize() == BUCKET_KEY_SIZE) {
+			iter->key(key);
+			record.resize(iter->valueSize());
+			if (record.size() > 0)
+				iter->value((unsigned char *) &record[0]);
+			uint64_t bucket = 0;
+			for (std::size_t i = 1; i < BUCKET_KEY_SIZE; i++)
+				bucket = (bucket << 8) | key[i];
+			for (std::size_t i = 0; i + entrySize <= record.size(); i
+					+= entrySize) {
+				uint64_t pos = bucket * BUCKET_SIZE + (unsigned char) record[i];
+				if (pos < this->filterSize_)
+					BITSET(this->bitArray_, pos);
+			}
+		}
+		iter->next();
+	}
+}
+
+void KeyValueCountingBloomFilter::replayJournal(const uint64_t sequence) {
+	// Collect the buckets changed since the checkpoint
+	std::vector<uint64_t> buckets;
+	const unsigned char prefix = JOURNAL_PREFIX;
+	setsync::storage::AbstractKeyValueIterator * iter =
+			storage_.createPrefixIterator(&prefix, 1);
+	unsigned char key[BUCKET_KEY_SIZE];
+	std::string record;
+	while (iter->valid()) {
+		if (iter->keySize() == BUCKET_KEY_SIZE) {
+			iter->key(key);
+			uint64_t current = 0;
+			for (std::size_t i = 1; i < BUCKET_KEY_SIZE; i++)
+				current = (current << 8) | key[i];
+			if (current >= sequence) {
+				record.resize(iter->valueSize());
+				if (record.size() > 0)
+					iter->value((unsigned char *) &record[0]);
+				for (std::size_t i = 0; i + sizeof(uint64_t) <= record.size(); i
+						+= sizeof(uint64_t)) {
+					uint64_t bucket;
+					memcpy(&bucket, record.data() + i, sizeof(uint64_t));
+					buckets.push_back(bucket);
+				}
+			}
+		}
+		iter->next();
+	}
+	delete iter;
+	std::sort(buckets.begin(), buckets.end());
+	buckets.erase(std::unique(buckets.begin(), buckets.end()), buckets.end());
+	std::vector<std::string> records;
+	for (std::size_t offset = 0; offset < buckets.size(); offset
+			+= MULTI_GET_SIZE) {
+		const std::vector<uint64_t> block(buckets.begin() + offset,
+				buckets.begin() + std::min(buckets.size(), offset
+						+ MULTI_GET_SIZE));
+		readBuckets(block, records);
+		for (std::size_t i = 0; i < block.size(); i++)
+			restoreBucket(block[i], records[i]);
+	}
+}
+
+void KeyValueCountingBloomFilter::restoreBucket(const uint64_t bucket,
+		const std::string& record) {
+	const std::size_t entrySize = 1 + this->cryptoHashFunction_.getHashSize();
+	const uint64_t first = bucket * BUCKET_SIZE;
+	for (uint64_t pos = first; pos < first + BUCKET_SIZE && pos
+			< this->filterSize_; pos++)
+		BITCLEAR(this->bitArray_, pos);
+	for (std::size_t i = 0; i + entrySize <= record.size(); i += entrySize) {
+		const uint64_t pos = first + (unsigned char) record[i];
+		if (pos < this->filterSize_)
+			BITSET(this->bitArray_, pos);
+	}
+}
+
+void KeyValueCountingBloomFilter::loadSize() {
+	uint64_t size;
+	std::size_t valuesize;
+	if (this->storage_.getInto((unsigned char *) sizeKey, strlen(sizeKey),
+			(unsigned char *) &size, sizeof(uint64_t), &valuesize)
+			&& valuesize == sizeof(uint64_t)) {
+		this->itemCount_ = size;
+	} else {
+		this->itemCount_ = 0;
+	}
+}
+
+void KeyValueCountingBloomFilter::journalKey(const uint64_t sequence,
+		unsigned char * key) {
+	bucketKey(sequence, key);
+	key[0] = JOURNAL_PREFIX;
+}
+
+void KeyValueCountingBloomFilter::deleteJournal(const uint64_t first,
+		const uint64_t last) {
+	unsigned char key[BUCKET_KEY_SIZE];
+	for (uint64_t sequence = first; sequence < last; sequence++) {
+		journalKey(sequence, key);
+		this->storage_.del(key, BUCKET_KEY_SIZE);
+	}
+}
+
+void KeyValueCountingBloomFilter::clearJournal() {
+	std::vector<std::string> keys;
+	const unsigned char prefix = JOURNAL_PREFIX;
+	setsync::storage::AbstractKeyValueIterator * iter =
+			storage_.createPrefixIterator(&prefix, 1);
+	std::string key;
+	while (iter->valid()) {
+		key.resize(iter->keySize());
+		iter->key((unsigned char *) &key[0]);
+		keys.push_back(key);
+		iter->next();
+	}
+	delete iter;
+	setsync::storage::StorageBatch batch(this->storage_);
+	for (std::size_t i = 0; i < keys.size(); i++)
+		this->storage_.del((const unsigned char *) keys[i].data(),
+				keys[i].size());
+	batch.commit();
+	this->journalSequence_ = 0;
+	this->journalStart_ = 0;
+	this->checkpointedSequence_ = 0;
+}
+
+void KeyValueCountingBloomFilter::checkpoint() {
+	if (!this->journaled_)
+		return;
+	MutexLock checkpointLock(this->checkpointMutex_);
+	uint64_t sequence;
+	{
+		MutexLock lock(this->mutex_);
+		sequence = this->journalSequence_;
+		if (sequence == this->checkpointedSequence_)
+			return;
+	}
+	// Changes during the syncing are journaled from this sequence on
+	FSBloomFilter::checkpoint(sequence);
+	MutexLock lock(this->mutex_);
+	this->checkpointedSequence_ = sequence;
+}
+
+void * KeyValueCountingBloomFilter::checkpointLoop(void * filter) {
+	KeyValueCountingBloomFilter * bf = (KeyValueCountingBloomFilter *) filter;
+	pthread_mutex_lock(&bf->mutex_);
+	while (!bf->stopping_) {
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += bf->checkpointInterval_;
+		if (pthread_cond_timedwait(&bf->stopCondition_, &bf->mutex_,
+				&deadline) != ETIMEDOUT)
+			continue;
+		pthread_mutex_unlock(&bf->mutex_);
+		try {
+			bf->checkpoint();
+		} catch (...) {
+			// A failed checkpoint is tried again after the next interval
+		}
+		pthread_mutex_lock(&bf->mutex_);
+	}
+	pthread_mutex_unlock(&bf->mutex_);
+	return NULL;
+}
+
+void KeyValueCountingBloomFilter::stopCheckpoints() {
+	if (!this->threadStarted_)
+		return;
+	pthread_mutex_lock(&this->mutex_);
+	this->stopping_ = true;
+	pthread_cond_signal(&this->stopCondition_);
+	pthread_mutex_unlock(&this->mutex_);
+	pthread_join(this->checkpointThread_, NULL);
+	this->threadStarted_ = false;
+}
+
+void KeyValueCountingBloomFilter::upgradeStorage() {
+	// Collect the positions first, the storage is changed afterwards
+	std::vector<uint64_t> positions;
 	setsync::storage::AbstractKeyValueIterator * iter =
 			storage_.createIterator();
 	iter->seekToFirst();
@@ -33,61 +405,244 @@ KeyValueCountingBloomFilter::KeyValueCountingBloomFilter(
 	while (iter->valid()) {
 		if (iter->keySize() == sizeof(uint64_t)) {
 			iter->key((unsigned char *) &pos);
-			std::size_t bit_index = 0;
-			std::size_t bit = 0;
-			compute_indices(pos, bit_index, bit);
-			// Sets the found bit to the filter
-			this->bitArray_[bit_index] |= bit_mask[bit];
-		} else if (iter->keySize() == strlen(sizeKey)) {
-			uint64_t * size;
-			size_t valuesize;
-			if (this->storage_.get((unsigned char *) sizeKey, strlen(sizeKey),
-					(unsigned char **) &size, &valuesize)) {
-				if (valuesize == sizeof(uint64_t)) {
-					this->itemCount_ = *size;
-				}
-				delete size;
-			}
+			positions.push_back(pos);
 		}
 		iter->next();
 	}
 	delete iter;
+	std::sort(positions.begin(), positions.end());
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	std::string value;
+	std::size_t i = 0;
+	while (i < positions.size()) {
+		// Converts up to STORAGE_BATCH_SIZE positions in one batch, but
+		// never splits a bucket
+		std::vector<std::pair<uint64_t, std::string> > records;
+		std::size_t first = i;
+		while (i < positions.size() && (i - first < STORAGE_BATCH_SIZE
+				|| positions[i] / BUCKET_SIZE == positions[i - 1] / BUCKET_SIZE)) {
+			const uint64_t bucket = positions[i] / BUCKET_SIZE;
+			std::string record;
+			// An interrupted upgrade could have written the bucket already
+			readBucket(bucket, record);
+			for (; i < positions.size() && positions[i] / BUCKET_SIZE
+					== bucket; i++) {
+				if (!readRecord((unsigned char *) &positions[i],
+						sizeof(uint64_t), value))
+					continue;
+				for (std::size_t j = 0; j + hashSize <= value.size(); j
+						+= hashSize) {
+					insertEntry(record, positions[i] % BUCKET_SIZE,
+							(const unsigned char *) value.data() + j);
+				}
+			}
+			records.push_back(std::make_pair(bucket, record));
+		}
+		setsync::storage::StorageBatch batch(this->storage_);
+		putRecords(records);
+		for (std::size_t p = first; p < i; p++) {
+			this->storage_.del((unsigned char *) &positions[p],
+					sizeof(uint64_t));
+		}
+		batch.commit();
+	}
+	this->storage_.put((unsigned char *) versionKey, strlen(versionKey),
+			(const unsigned char *) &LAYOUT_VERSION, sizeof(uint32_t));
+}
+
+void KeyValueCountingBloomFilter::bucketKey(const uint64_t bucket,
+		unsigned char * key) {
+	key[0] = BUCKET_PREFIX;
+	for (std::size_t i = 1; i < BUCKET_KEY_SIZE; i++)
+		key[i] = (unsigned char) (bucket >> (8 * (BUCKET_KEY_SIZE - 1 - i)));
+}
+
+bool KeyValueCountingBloomFilter::readRecord(const unsigned char * key,
+		const std::size_t length, std::string& record) const {
+	std::size_t valuesize;
+	record.resize(record.capacity());
+	if (!this->storage_.getInto(key, length, (unsigned char *) &record[0],
+			record.size(), &valuesize)) {
+		record.clear();
+		return false;
+	}
+	if (valuesize > record.size()) {
+		// Retry with a buffer, which is large enough
+		record.resize(valuesize);
+		if (!this->storage_.getInto(key, length,
+				(unsigned char *) &record[0], record.size(), &valuesize)
+				|| valuesize > record.size()) {
+			record.clear();
+			return false;
+		}
+	}
+	record.resize(valuesize);
+	return true;
+}
+
+bool KeyValueCountingBloomFilter::readBucket(const uint64_t bucket,
+		std::string& record) const {
+	unsigned char key[BUCKET_KEY_SIZE];
+	bucketKey(bucket, key);
+	return readRecord(key, BUCKET_KEY_SIZE, record);
+}
+
+void KeyValueCountingBloomFilter::readBuckets(
+		const std::vector<uint64_t>& buckets,
+		std::vector<std::string>& records) const {
+	const std::size_t count = buckets.size();
+	records.resize(count);
+	if (count == 0)
+		return;
+	// Space for one entry per position, larger records are read again
+	const std::size_t stride = BUCKET_SIZE * (1
+			+ this->cryptoHashFunction_.getHashSize());
+	std::vector<unsigned char> keys(count * BUCKET_KEY_SIZE);
+	for (std::size_t i = 0; i < count; i++)
+		bucketKey(buckets[i], &keys[i * BUCKET_KEY_SIZE]);
+	std::vector<unsigned char> values(count * stride);
+	std::vector<std::size_t> valueSizes(count);
+	bool found[count];
+	this->storage_.multiGet(&keys[0], BUCKET_KEY_SIZE, count, &values[0],
+			stride, &valueSizes[0], found);
+	for (std::size_t i = 0; i < count; i++) {
+		if (!found[i]) {
+			records[i].clear();
+		} else if (valueSizes[i] <= stride) {
+			records[i].assign((const char *) &values[i * stride], valueSizes[i]);
+		} else {
+			readBucket(buckets[i], records[i]);
+		}
+	}
+}
+
+bool KeyValueCountingBloomFilter::insertEntry(std::string& record,
+		const std::size_t offset, const unsigned char * hash) const {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	const std::size_t entrySize = 1 + hashSize;
+	std::size_t i = 0;
+	for (; i + entrySize <= record.size(); i += entrySize) {
+		const std::size_t current = (unsigned char) record[i];
+		if (current > offset)
+			break;
+		if (current == offset && memcmp(record.data() + i + 1, hash, hashSize)
+				== 0)
+			return false;
+	}
+	std::string entry(1, (char) offset);
+	entry.append((const char *) hash, hashSize);
+	record.insert(i, entry);
+	return true;
+}
+
+bool KeyValueCountingBloomFilter::removeEntry(std::string& record,
+		const std::size_t offset, const unsigned char * hash) const {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	const std::size_t entrySize = 1 + hashSize;
+	for (std::size_t i = 0; i + entrySize <= record.size(); i += entrySize) {
+		const std::size_t current = (unsigned char) record[i];
+		if (current > offset)
+			break;
+		if (current == offset && memcmp(record.data() + i + 1, hash, hashSize)
+				== 0) {
+			record.erase(i, entrySize);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool KeyValueCountingBloomFilter::hasEntry(const std::string& record,
+		const std::size_t offset) const {
+	const std::size_t entrySize = 1 + this->cryptoHashFunction_.getHashSize();
+	for (std::size_t i = 0; i + entrySize <= record.size(); i += entrySize) {
+		const std::size_t current = (unsigned char) record[i];
+		if (current >= offset)
+			return current == offset;
+	}
+	return false;
 }
 
 KeyValueCountingBloomFilter::~KeyValueCountingBloomFilter() {
-	if (this->itemCount_ > 0) {
-		this->storage_.put((unsigned char*) sizeKey, strlen(sizeKey),
-				(unsigned char*) &itemCount_, sizeof(uint64_t));
+	stopCheckpoints();
+	if (this->journaled_) {
+		try {
+			checkpoint();
+			// The checkpoint covers all journal records
+			setsync::storage::StorageBatch batch(this->storage_);
+			deleteJournal(this->journalStart_, this->journalSequence_);
+			batch.commit();
+		} catch (...) {
+			// The journal is replayed on the next opening
+		}
 	}
+	pthread_cond_destroy(&this->stopCondition_);
+	pthread_mutex_destroy(&this->checkpointMutex_);
+	pthread_mutex_destroy(&this->mutex_);
 }
 void KeyValueCountingBloomFilter::diff(const unsigned char * externalBF,
 		const std::size_t length, const std::size_t offset,
 		setsync::AbstractDiffHandler& handler) const {
 	if (length + offset > this->mmapLength_)
 		throw "";
-	for (std::size_t i = 0; i < length; ++i) {
-		for (unsigned short j = 0; j < 8; j++) {
-			if (!BITTEST(externalBF+i,j) && BITTEST(this->bitArray_+i+offset,j)) {
-				// Loaded position in the bloom filter
-				uint64_t pos = (offset + i) * 8 + j;
-				if (pos > this->filterSize_)
-					continue;
-				// Buffer
-				unsigned char * resultbuffer;
-				std::size_t resultSize;
-				if (storage_.get((unsigned char*) &pos, sizeof(uint64_t),
-						&resultbuffer, &resultSize)) {
-					int numberOfResults = resultSize
-							/ this->cryptoHashFunction_.getHashSize();
-					unsigned char * pos = resultbuffer;
-					for (int k = 0; k < numberOfResults; k++) {
-						handler(pos, this->cryptoHashFunction_.getHashSize(),
-								true);
-						pos += this->cryptoHashFunction_.getHashSize();
-					}
-					free(resultbuffer);
+	const unsigned char * local = this->bitArray_ + offset;
+	// Differing positions are collected, until they cover MULTI_GET_SIZE
+	// buckets, whose records are read at once
+	std::vector<uint64_t> positions;
+	std::size_t buckets = 0;
+	std::size_t i = BitArrayDiff::nextDifference(local, externalBF, 0, length);
+	while (i < length) {
+		unsigned char difference = local[i] & ~externalBF[i];
+		while (difference != 0) {
+			unsigned int j = BitArrayDiff::lowestBit(difference);
+			difference &= difference - 1;
+			// Loaded position in the bloom filter
+			uint64_t pos = (offset + i) * 8 + j;
+			if (pos >= this->filterSize_)
+				continue;
+			// Differences are found in ascending order, so neighbouring
+			// positions share a bucket
+			if (positions.empty() || pos / BUCKET_SIZE != positions.back()
+					/ BUCKET_SIZE) {
+				if (buckets == MULTI_GET_SIZE) {
+					diffPositions(positions, handler);
+					positions.clear();
+					buckets = 0;
 				}
+				buckets++;
 			}
+			positions.push_back(pos);
+		}
+		i = BitArrayDiff::nextDifference(local, externalBF, i + 1, length);
+	}
+	diffPositions(positions, handler);
+}
+
+void KeyValueCountingBloomFilter::diffPositions(
+		const std::vector<uint64_t>& positions,
+		setsync::AbstractDiffHandler& handler) const {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	const std::size_t entrySize = 1 + hashSize;
+	std::vector<uint64_t> buckets;
+	for (std::size_t i = 0; i < positions.size(); i++) {
+		if (buckets.empty() || buckets.back() != positions[i] / BUCKET_SIZE)
+			buckets.push_back(positions[i] / BUCKET_SIZE);
+	}
+	std::vector<std::string> records;
+	readBuckets(buckets, records);
+	std::size_t b = 0;
+	for (std::size_t i = 0; i < positions.size(); i++) {
+		if (positions[i] / BUCKET_SIZE != buckets[b])
+			b++;
+		const std::string& record = records[b];
+		const std::size_t offset = positions[i] % BUCKET_SIZE;
+		for (std::size_t k = 0; k + entrySize <= record.size(); k += entrySize) {
+			const std::size_t current = (unsigned char) record[k];
+			if (current > offset)
+				break;
+			if (current == offset)
+				handler((const unsigned char *) record.data() + k + 1,
+						hashSize, true);
 		}
 	}
 }
@@ -102,124 +657,288 @@ std::size_t KeyValueCountingBloomFilter::getChunk(unsigned char * buffer,
 	return chunksize;
 }
 
-void KeyValueCountingBloomFilter::add(const unsigned char * key) {
-	unsigned char * resultbuffer;
-	std::size_t resultSize;
-	// Insert the given key once per hash function
-	for (std::size_t i = 0; i < this->functionCount_; i++) {
-		// calculate the db key
-		uint64_t k = this->hashFunction_->operator ()(key,
-				this->cryptoHashFunction_.getHashSize(), i);
-		k = k % this->filterSize_;
-		if (!this->storage_.get((unsigned char*) &k, sizeof(uint64_t),
-				&resultbuffer, &resultSize)) {
-			this->storage_.put((unsigned char*) &k, sizeof(uint64_t), key,
-					this->cryptoHashFunction_.getHashSize());
-			// putting <pos/key> as key/value pair to berkeley db
-		} else {
-			int numberOfResults = resultSize
-					/ this->cryptoHashFunction_.getHashSize();
-			for (int j = 0; j < numberOfResults; j++) {
-				if (memcmp(
-						resultbuffer + j
-								* this->cryptoHashFunction_.getHashSize(), key,
-						this->cryptoHashFunction_.getHashSize()) == 0) {
-					// Key exists, so it can be skipped
-					free(resultbuffer);
-					return;
-				}
-			}
-			unsigned char inputbuffer[resultSize
-					+ this->cryptoHashFunction_.getHashSize()];
-			memcpy(inputbuffer, resultbuffer, resultSize);
-			memcpy(inputbuffer + resultSize, key,
-					this->cryptoHashFunction_.getHashSize());
-			this->storage_.put((unsigned char*) &k, sizeof(uint64_t),
-					inputbuffer,
-					resultSize + this->cryptoHashFunction_.getHashSize());
-			free(resultbuffer);
-		}
+std::size_t KeyValueCountingBloomFilter::getCompressedChunk(
+		unsigned char * buffer, const std::size_t maxlength,
+		std::size_t offset, std::size_t * covered) {
+	// Estimated number of set bits
+	double bits = this->filterSize_;
+	double setBits = bits * (1.0 - exp(-(double) this->functionCount_
+			* this->itemCount_ / bits));
+	unsigned int parameter = BloomFilterChunkCodec::optimalParameter(
+			(uint64_t) setBits, this->filterSize_);
+	return BloomFilterChunkCodec::encode(this->bitArray_, size(), offset,
+			parameter, buffer, maxlength, covered);
+}
+
+/**
+ * Passes the decoded windows of a compressed chunk to
+ * KeyValueCountingBloomFilter::diff
+ */
+class DiffWindowHandler: public BloomFilterChunkCodec::WindowHandler {
+private:
+	const KeyValueCountingBloomFilter& bf_;
+	setsync::AbstractDiffHandler& handler_;
+public:
+	DiffWindowHandler(const KeyValueCountingBloomFilter& bf,
+			setsync::AbstractDiffHandler& handler) :
+		bf_(bf), handler_(handler) {
 	}
-	// finally adding the key also to the bloom filter
-	FSBloomFilter::add(key);
+	virtual void handle(const unsigned char * bits, const std::size_t length,
+			const std::size_t offset) {
+		bf_.diff(bits, length, offset, handler_);
+	}
+};
+
+std::size_t KeyValueCountingBloomFilter::diffCompressed(
+		const unsigned char * chunk, const std::size_t length,
+		setsync::AbstractDiffHandler& handler) const {
+	DiffWindowHandler windowHandler(*this, handler);
+	return BloomFilterChunkCodec::decode(chunk, length, windowHandler);
+}
+
+void KeyValueCountingBloomFilter::add(const unsigned char * key) {
+	addAll(key, 1);
 }
 
 void KeyValueCountingBloomFilter::clear() {
+	MutexLock checkpointLock(this->checkpointMutex_);
+	MutexLock lock(this->mutex_);
 	this->storage_.clear();
+	this->storage_.put((unsigned char *) versionKey, strlen(versionKey),
+			(const unsigned char *) &LAYOUT_VERSION, sizeof(uint32_t));
+	// A checkpoint of the old bits doesn't match the cleared storage
+	setFileGeneration(getFileGeneration() + 1);
+	storeGeneration();
 	FSBloomFilter::clear();
+	// The journal has been cleared with the storage
+	this->journalSequence_ = 0;
+	this->journalStart_ = 0;
+	this->checkpointedSequence_ = 0;
+	if (this->journaled_)
+		FSBloomFilter::checkpoint(0);
+}
+
+void KeyValueCountingBloomFilter::storeGeneration() {
+	const uint64_t generation = getFileGeneration();
+	this->storage_.put((unsigned char *) generationKey, strlen(generationKey),
+			(const unsigned char *) &generation, sizeof(uint64_t));
+}
+
+void KeyValueCountingBloomFilter::getAll(setsync::AbstractDiffHandler& handler) {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	const std::size_t entrySize = 1 + hashSize;
+	const unsigned char prefix = BUCKET_PREFIX;
+	setsync::storage::AbstractKeyValueIterator * iter =
+			storage_.createPrefixIterator(&prefix, 1);
+	std::string record;
+	while (iter->valid()) {
+		if (iter->keySize() == BUCKET_KEY_SIZE) {
+			record.resize(iter->valueSize());
+			if (record.size() > 0)
+				iter->value((unsigned char *) &record[0]);
+			for (std::size_t k = 0; k + entrySize <= record.size(); k
+					+= entrySize) {
+				handler((const unsigned char *) record.data() + k + 1,
+						hashSize, true);
+			}
+		}
+		iter->next();
+	}
+	delete iter;
+}
+
+void KeyValueCountingBloomFilter::sortedPositions(
+		const unsigned char * keys, const std::size_t count,
+		std::vector<std::pair<uint64_t, std::size_t> >& result) const {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	uint64_t positions[this->functionCount_];
+	result.clear();
+	result.reserve(count * this->functionCount_);
+	for (std::size_t i = 0; i < count; i++) {
+		this->doubleHashing_->positions(keys + i * hashSize,
+				this->functionCount_, this->filterSize_, positions);
+		for (std::size_t j = 0; j < this->functionCount_; j++) {
+			result.push_back(std::make_pair(positions[j], i));
+		}
+	}
+	std::sort(result.begin(), result.end());
 }
 
 void KeyValueCountingBloomFilter::addAll(const unsigned char* keys,
 		const std::size_t count) {
-	for (std::size_t i = 0; i < count; i++) {
-		add(keys + this->cryptoHashFunction_.getHashSize() * i);
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	for (std::size_t offset = 0; offset < count; offset += STORAGE_BATCH_SIZE) {
+		const unsigned char * block = keys + offset * hashSize;
+		const std::size_t blockSize = std::min(count - offset,
+				STORAGE_BATCH_SIZE);
+		std::vector<std::pair<uint64_t, std::size_t> > entries;
+		sortedPositions(block, blockSize, entries);
+		// Keys, which are already stored or appear twice, are skipped
+		std::vector<bool> skip(blockSize, false);
+		// The changed bucket records
+		std::vector<std::pair<uint64_t, std::string> > records;
+		std::size_t i = 0;
+		while (i < entries.size()) {
+			const uint64_t bucket = entries[i].first / BUCKET_SIZE;
+			std::string record;
+			readBucket(bucket, record);
+			bool changed = false;
+			while (i < entries.size() && entries[i].first / BUCKET_SIZE
+					== bucket) {
+				const uint64_t pos = entries[i].first;
+				// Index of the last key, which has been inserted at pos
+				std::size_t last = blockSize;
+				for (; i < entries.size() && entries[i].first == pos; i++) {
+					const std::size_t index = entries[i].second;
+					if (index == last) {
+						// Two hash functions have got the same position
+						continue;
+					}
+					if (insertEntry(record, pos % BUCKET_SIZE,
+							block + index * hashSize)) {
+						last = index;
+						changed = true;
+					} else {
+						skip[index] = true;
+					}
+				}
+			}
+			if (changed) {
+				records.push_back(std::make_pair(bucket, record));
+			}
+		}
+		std::string added;
+		for (std::size_t k = 0; k < blockSize; k++) {
+			if (!skip[k])
+				added.append((const char *) block + k * hashSize, hashSize);
+		}
+		const std::size_t numberOfAdded = added.size() / hashSize;
+		if (this->hardMaximum_ && this->itemCount_ + numberOfAdded
+				> this->maxElements_) {
+			throw std::runtime_error("Maximum of Elements reached, adding failed");
+		}
+		const uint64_t itemCount = (this->itemCount_ + numberOfAdded
+				< std::numeric_limits<uint64_t>::max()) ? this->itemCount_
+				+ numberOfAdded : std::numeric_limits<uint64_t>::max();
+		MutexLock lock(this->mutex_);
+		writeRecords(records, itemCount);
+		FSBloomFilter::addAll((const unsigned char *) added.data(),
+				numberOfAdded);
 	}
 }
 
-bool KeyValueCountingBloomFilter::remove(const unsigned char * key) {
-	// Check, if the key has been added to the filter
-	if (!contains(key)) {
-		// Abort: key doesn't exists in bloom filter
-		return false;
+void KeyValueCountingBloomFilter::putRecords(
+		const std::vector<std::pair<uint64_t, std::string> >& records) {
+	unsigned char key[BUCKET_KEY_SIZE];
+	for (std::size_t i = 0; i < records.size(); i++) {
+		bucketKey(records[i].first, key);
+		if (records[i].second.empty()) {
+			this->storage_.del(key, BUCKET_KEY_SIZE);
+		} else {
+			this->storage_.put(key, BUCKET_KEY_SIZE,
+					(const unsigned char *) records[i].second.data(),
+					records[i].second.size());
+		}
 	}
-	unsigned char * resultbuffer;
-	std::size_t resultSize;
-	// success status of the remove process
-	bool result = false;
-	// position in the bloom filter
-	uint64_t pos;
-	// Getting crypto key entries for all hash functions
-	for (std::size_t func = 0; func < functionCount_; func++) {
-		// The searched crypto hash has been found
-		bool hash_found = false;
-		// Another crypto hash has been found
-		bool other_hash_found = false;
-		pos = this->hashFunction_->operator ()(key,
-				this->cryptoHashFunction_.getHashSize(), func);
-		pos = pos % this->filterSize_;
-		if (this->storage_.get((unsigned char*) &pos, sizeof(uint64_t),
-				&resultbuffer, &resultSize)) {
-			int numberOfResults = resultSize
-					/ this->cryptoHashFunction_.getHashSize();
-			if (numberOfResults > 1) {
-				other_hash_found = true;
-				unsigned char * output_position = resultbuffer;
-				for (int j = 0; j < numberOfResults; j++) {
-					memcpy(
-							output_position,
-							resultbuffer + j
-									* this->cryptoHashFunction_.getHashSize(),
-							this->cryptoHashFunction_.getHashSize());
-					if (memcmp(
-							resultbuffer + j
-									* this->cryptoHashFunction_.getHashSize(),
-							key, this->cryptoHashFunction_.getHashSize()) != 0) {
-						output_position
-								+= this->cryptoHashFunction_.getHashSize();
-					}
+}
+
+void KeyValueCountingBloomFilter::writeRecords(
+		const std::vector<std::pair<uint64_t, std::string> >& records,
+		const uint64_t itemCount) {
+	if (records.empty())
+		return;
+	setsync::storage::StorageBatch batch(this->storage_);
+	putRecords(records);
+	this->storage_.put((unsigned char*) sizeKey, strlen(sizeKey),
+			(const unsigned char*) &itemCount, sizeof(uint64_t));
+	if (this->journaled_) {
+		std::vector<uint64_t> buckets(records.size());
+		for (std::size_t i = 0; i < records.size(); i++)
+			buckets[i] = records[i].first;
+		unsigned char key[BUCKET_KEY_SIZE];
+		journalKey(this->journalSequence_, key);
+		this->storage_.put(key, BUCKET_KEY_SIZE,
+				(const unsigned char *) &buckets[0], buckets.size()
+						* sizeof(uint64_t));
+		// Records before the last checkpoint aren't needed anymore
+		deleteJournal(this->journalStart_, this->checkpointedSequence_);
+	}
+	batch.commit();
+	if (this->journaled_) {
+		this->journalSequence_++;
+		this->journalStart_ = this->checkpointedSequence_;
+	}
+}
+
+bool KeyValueCountingBloomFilter::remove(const unsigned char * key) {
+	return removeAll(key, 1) == 1;
+}
+
+std::size_t KeyValueCountingBloomFilter::removeAll(const unsigned char * keys,
+		const std::size_t count) {
+	const std::size_t hashSize = this->cryptoHashFunction_.getHashSize();
+	std::size_t removed = 0;
+	for (std::size_t offset = 0; offset < count; offset += STORAGE_BATCH_SIZE) {
+		const std::size_t blockSize = std::min(count - offset,
+				STORAGE_BATCH_SIZE);
+		// Only keys, which are contained in the filter, could be stored
+		std::string candidates;
+		for (std::size_t k = 0; k < blockSize; k++) {
+			const unsigned char * key = keys + (offset + k) * hashSize;
+			if (contains(key))
+				candidates.append((const char *) key, hashSize);
+		}
+		const unsigned char * block =
+				(const unsigned char *) candidates.data();
+		const std::size_t numberOfCandidates = candidates.size() / hashSize;
+		std::vector<std::pair<uint64_t, std::size_t> > entries;
+		sortedPositions(block, numberOfCandidates, entries);
+		std::vector<bool> found(numberOfCandidates, false);
+		std::vector<std::pair<uint64_t, std::string> > records;
+		// Positions without any remaining hash
+		std::vector<uint64_t> emptied;
+		std::size_t i = 0;
+		while (i < entries.size()) {
+			const uint64_t bucket = entries[i].first / BUCKET_SIZE;
+			std::string record;
+			bool exists = readBucket(bucket, record);
+			bool changed = false;
+			for (; i < entries.size() && entries[i].first / BUCKET_SIZE
+					== bucket; i++) {
+				if (!exists)
+					continue;
+				const uint64_t pos = entries[i].first;
+				// A key given twice is only removed once
+				if (removeEntry(record, pos % BUCKET_SIZE, block
+						+ entries[i].second * hashSize)) {
+					found[entries[i].second] = true;
+					changed = true;
+					if (!hasEntry(record, pos % BUCKET_SIZE))
+						emptied.push_back(pos);
 				}
-				this->storage_.put((unsigned char *) &pos, sizeof(uint64_t),
-						resultbuffer, resultSize - 1);
-			} else {
-				this->storage_.del((unsigned char *) &pos, sizeof(uint64_t));
-				hash_found = true;
 			}
-			free(resultbuffer);
+			if (changed) {
+				records.push_back(std::make_pair(bucket, record));
+			}
 		}
-		// delete the bloom filter bit only if the found set of entries is now 0
-		if (hash_found && !other_hash_found) {
-			std::size_t bit_index = 0;
-			std::size_t bit = 0;
-			compute_indices(pos, bit_index, bit);
-			// sets bloom filter bit to 0
-			BITCLEAR(this->bitArray_, pos);
+		std::size_t blockRemoved = 0;
+		for (std::size_t k = 0; k < numberOfCandidates; k++) {
+			if (found[k])
+				blockRemoved++;
 		}
-		if (hash_found) {
-			// Operation has been successful
-			result = true;
+		MutexLock lock(this->mutex_);
+		// The count is used as load of the filter, so removed keys free it
+		const uint64_t itemCount = std::max(this->itemCount_,
+				(uint64_t) blockRemoved) - blockRemoved;
+		writeRecords(records, itemCount);
+		this->itemCount_ = itemCount;
+		// delete the bloom filter bits of all emptied positions
+		for (std::size_t e = 0; e < emptied.size(); e++) {
+			BITCLEAR(this->bitArray_, emptied[e]);
 		}
+		removed += blockRemoved;
 	}
-	return result;
+	return removed;
 }
 
 }
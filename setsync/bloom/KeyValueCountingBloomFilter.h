@@ -12,6 +12,10 @@
 #include <setsync/bloom/ComparableBloomFilter.h>
 #include <setsync/storage/KeyValueStorage.h>
 #include <setsync/DiffHandler.h>
+#include <pthread.h>
+#include <string>
+#include <utility>
+#include <vector>
 namespace setsync {
 
 namespace bloom {
@@ -20,6 +24,28 @@ namespace bloom {
  * which uses the given Key-Value store to load and safe the hashes
  * added to the Filter. The filter itself remains in a memory mapped
  * file.
+ *
+ * The hashes are stored in buckets of BUCKET_SIZE bloom filter positions.
+ * The record of a bucket is a list of entries sorted by position, each
+ * consisting of one byte offset of the position within the bucket and
+ * the hash, which has been added at this position. Storages written in
+ * the former layout with one record per position are migrated on
+ * construction.
+ *
+ * Each opening starts a new generation, which is stored in the storage
+ * and in the file. If both match on the next opening, the bits of the
+ * properly closed file are used, otherwise they are rebuilt from the
+ * storage.
+ *
+ * The number of elements is written in the batch of each change. The
+ * buckets changed by a batch are listed in a journal record of the same
+ * batch. A background thread checkpoints the file every
+ * checkpointInterval seconds, afterwards the older journal records are
+ * deleted. After a crash, the bits of the checkpointed file are kept and
+ * only the buckets of the remaining journal records are restored from
+ * the storage, so the recovery depends on the changes since the last
+ * checkpoint and not on the size of the set. A filter without a file
+ * isn't journaled.
  */
 class KeyValueCountingBloomFilter: public CountingBloomFilter,
 		public FSBloomFilter{
@@ -28,30 +54,249 @@ class KeyValueCountingBloomFilter: public CountingBloomFilter,
 	friend class KeyValueBloomFilterSync;
 private:
 	static const char sizeKey[];
+	static const char versionKey[];
+	static const char generationKey[];
+	/// true, if the changed buckets are journaled
+	bool journaled_;
+	/// Sequence number of the next journal record
+	uint64_t journalSequence_;
+	/// Sequence number of the oldest stored journal record
+	uint64_t journalStart_;
+	/// Journal records before this one are covered by the last checkpoint
+	uint64_t checkpointedSequence_;
+	/// Seconds between two checkpoints, 0 if there is no checkpoint thread
+	unsigned int checkpointInterval_;
+	/// Guards the bits and the journal sequence numbers
+	pthread_mutex_t mutex_;
+	/// Lets only one checkpoint run at a time
+	pthread_mutex_t checkpointMutex_;
+	/// Signals the checkpoint thread to stop
+	pthread_cond_t stopCondition_;
+	/// true, if the checkpoint thread has to stop
+	bool stopping_;
+	/// true, if the checkpoint thread has been started
+	bool threadStarted_;
+	/// Thread, which checkpoints the file periodically
+	pthread_t checkpointThread_;
+	/// Number of threads rebuilding the bits, 0 for one per core
+	std::size_t rebuildThreads_;
+	/**
+	 * Checkpoints the file every checkpointInterval_ seconds, until
+	 * stopping_ is set
+	 *
+	 * \param filter the KeyValueCountingBloomFilter
+	 */
+	static void * checkpointLoop(void * filter);
+	/**
+	 * Stops and joins the checkpoint thread, if it has been started
+	 */
+	void stopCheckpoints();
+	/**
+	 * Rebuilds the bits of the range of a RebuildTask
+	 *
+	 * \param task the RebuildTask
+	 */
+	static void * rebuildWorker(void * task);
 protected:
 	setsync::storage::AbstractKeyValueStorage& storage_;
+	/**
+	 * Writes the storage key of the given bucket into the buffer, which
+	 * must be able to hold BUCKET_KEY_SIZE bytes. The bucket number is
+	 * written big endian, so ordered storages iterate bucket by bucket.
+	 */
+	static void bucketKey(const uint64_t bucket, unsigned char * key);
+	/**
+	 * Loads the record of the given key into the given string. Its
+	 * memory is reused, so reading many records into the same string
+	 * allocates only, if a record is larger than all before.
+	 *
+	 * \param key of the record
+	 * \param length of the key
+	 * \param record is set to the stored record or cleared, if there is none
+	 * \return true, if the record has been found
+	 */
+	bool readRecord(const unsigned char * key, const std::size_t length,
+			std::string& record) const;
+	/**
+	 * Loads the record of the given bucket
+	 *
+	 * \param bucket number
+	 * \param record is set to the stored record or cleared, if there is none
+	 * \return true, if the bucket has been found
+	 */
+	bool readBucket(const uint64_t bucket, std::string& record) const;
+	/**
+	 * Loads the records of several buckets with a single multiGet() of
+	 * the storage
+	 *
+	 * \param buckets numbers of the buckets
+	 * \param records is set to the records, empty for missing buckets
+	 */
+	void readBuckets(const std::vector<uint64_t>& buckets,
+			std::vector<std::string>& records) const;
+	/**
+	 * Passes the hashes of the given positions, which are sorted, to the
+	 * handler. The buckets of the positions are read at once.
+	 */
+	void diffPositions(const std::vector<uint64_t>& positions,
+			setsync::AbstractDiffHandler& handler) const;
+	/**
+	 * Inserts the hash at the given offset into the bucket record, if it
+	 * is not already stored there.
+	 *
+	 * \return true, if the hash has been inserted
+	 */
+	bool insertEntry(std::string& record, const std::size_t offset,
+			const unsigned char * hash) const;
+	/**
+	 * Removes the hash at the given offset from the bucket record
+	 *
+	 * \return true, if the hash has been found and removed
+	 */
+	bool removeEntry(std::string& record, const std::size_t offset,
+			const unsigned char * hash) const;
+	/**
+	 * \return true, if the bucket record has got an entry at the offset
+	 */
+	bool hasEntry(const std::string& record, const std::size_t offset) const;
+	/**
+	 * Converts the records of the former layout, one record per
+	 * position, into bucket records. The conversion can be interrupted
+	 * at any time and is continued by the next call.
+	 */
+	void upgradeStorage();
+	/**
+	 * Sets the bits of all positions stored in the storage, after all
+	 * bits have been cleared. If the storage is ordered and concurrently
+	 * readable, large filters are rebuilt by several threads, each
+	 * scanning its own range of buckets. Their number is given to the
+	 * constructor, at most MAX_REBUILD_THREADS.
+	 *
+	 * \throws std::runtime_error, if the storage couldn't be read
+	 */
+	void rebuild();
+	/**
+	 * Sets the bits of all bucket records passed by the iterator
+	 *
+	 * \param iter over the bucket records
+	 */
+	void rebuildRange(setsync::storage::AbstractKeyValueIterator * iter);
+	/**
+	 * Restores the bits of all buckets, which are listed in the journal
+	 * records starting at the given sequence number
+	 *
+	 * \param sequence of the checkpoint of the file
+	 */
+	void replayJournal(const uint64_t sequence);
+	/**
+	 * Sets the bits of a bucket to the positions of its record
+	 */
+	void restoreBucket(const uint64_t bucket, const std::string& record);
+	/**
+	 * Loads the number of elements from the storage
+	 */
+	void loadSize();
+	/**
+	 * Writes the storage key of the given journal record into the buffer,
+	 * which must be able to hold BUCKET_KEY_SIZE bytes
+	 */
+	static void journalKey(const uint64_t sequence, unsigned char * key);
+	/**
+	 * Deletes the journal records from first to last, excluding last
+	 */
+	void deleteJournal(const uint64_t first, const uint64_t last);
+	/**
+	 * Deletes all journal records in the storage and starts the journal
+	 * again with the first sequence number
+	 */
+	void clearJournal();
+	/**
+	 * Writes the generation of the bloom filter file into the storage.
+	 * The file is only trusted on opening, if both generations match.
+	 */
+	void storeGeneration();
+	/**
+	 * Calculates the positions of all given keys, sorted by position
+	 *
+	 * \param keys array of hashes
+	 * \param count number of hashes in the array
+	 * \param result pairs of position and index of the key in the array
+	 */
+	void sortedPositions(const unsigned char * keys, const std::size_t count,
+			std::vector<std::pair<uint64_t, std::size_t> >& result) const;
+	/**
+	 * Writes the given bucket records to the storage, empty records are
+	 * deleted
+	 */
+	void putRecords(
+			const std::vector<std::pair<uint64_t, std::string> >& records);
+	/**
+	 * Writes the given bucket records, the number of elements and the
+	 * journal record of the buckets to the storage in a single batch.
+	 * Empty records are deleted.
+	 *
+	 * \param records of the changed buckets
+	 * \param itemCount number of elements after the change
+	 */
+	void writeRecords(
+			const std::vector<std::pair<uint64_t, std::string> >& records,
+			const uint64_t itemCount);
 public:
+	/// Maximum number of keys, which are merged into the storage at once
+	static const std::size_t STORAGE_BATCH_SIZE;
+	/// Maximum number of buckets read by a single multiGet() of the storage
+	static const std::size_t MULTI_GET_SIZE;
+	/// Number of bloom filter positions stored in one record (at most 256)
+	static const uint64_t BUCKET_SIZE;
+	/// Size of the storage key of a bucket record
+	static const std::size_t BUCKET_KEY_SIZE;
+	/// Version of the storage layout written by this implementation
+	static const uint32_t LAYOUT_VERSION;
+	/// Maximum number of threads rebuilding the bits
+	static const std::size_t MAX_REBUILD_THREADS;
+	/// Minimum number of buckets, which are rebuilt by several threads
+	static const uint64_t PARALLEL_REBUILD_BUCKETS;
 	/**
 	 * To create a new KeyValueCountingBloomFilter, create a new
 	 * AbstractKeyValueStorage and pass it as second parameter.
-	 * The storage will be used to save the bit position in the
-	 * bloom filter as key and the corresponding hashes as value.
-	 * If more then one cryptographic hash corresponds to one position,
-	 * all hashes are saved as an array
+	 * The storage will be used to save the buckets of bit positions in
+	 * the bloom filter as key and the corresponding hashes as value.
+	 * A storage of an older layout version is upgraded.
 	 *
 	 * \param hash the crypto hash function, used for keys
 	 * \param storage to load and save the bloom filter entries
 	 * \param maxNumberOfElements will be passed to FSBloomFilter
 	 * \param hardMaximum will be passed to FSBloomFilter
 	 * \param falsePositiveRate will be passed to FSBloomFilter
+	 * \param checkpointInterval seconds between two checkpoints of the
+	 * file, if 0, the file is only checkpointed on opening, closing and
+	 * clearing
+	 * \param segmentSize will be passed to FSBloomFilter
+	 * \param prefault will be passed to FSBloomFilter
+	 * \param hugePages will be passed to FSBloomFilter
+	 * \param rebuildThreads number of threads rebuilding large filters,
+	 * if 0, one per online processor core
+	 * \throws an Exception, if the storage has got an unknown layout version
 	 */
 	KeyValueCountingBloomFilter(const crypto::CryptoHash& hash,
 			setsync::storage::AbstractKeyValueStorage& storage,
 			const std::string& file,
 			const uint64_t maxNumberOfElements = 10000,
 			const bool hardMaximum = false,
-			const float falsePositiveRate = 0.001);
+			const float falsePositiveRate = 0.001,
+			const unsigned int checkpointInterval = 0,
+			const uint64_t segmentSize = 0, const bool prefault = false,
+			const bool hugePages = false, const std::size_t rebuildThreads = 0);
 	virtual ~KeyValueCountingBloomFilter();
+	/**
+	 * Writes the bits to the file, so the journal records of the changes
+	 * before can be deleted. It is called by the checkpoint thread and
+	 * does nothing, if there haven't been any changes since the last
+	 * checkpoint.
+	 *
+	 * \throws std::runtime_error, if the file couldn't be synced
+	 */
+	void checkpoint();
 	/**
 	 * Calculates the difference between the given part of the
 	 * external bloom filter and the local one. Each hash, which
@@ -74,12 +319,41 @@ public:
 	 */
 	virtual std::size_t getChunk(unsigned char * buffer,
 			const std::size_t maxlength, std::size_t offset);
+	/**
+	 * Writes the next part of the bloom filter as compressed chunk into
+	 * the buffer, starting from the offset.
+	 *
+	 * \param buffer where the chunk is written to
+	 * \param maxlength of the buffer, at least BloomFilterChunkCodec::MIN_CHUNK_SIZE
+	 * \param offset of the first byte of the bloom filter to be written
+	 * \param covered is set to the number of bloom filter bytes in the chunk
+	 * \return the size of the written chunk
+	 */
+	virtual std::size_t getCompressedChunk(unsigned char * buffer,
+			const std::size_t maxlength, std::size_t offset,
+			std::size_t * covered);
+	/**
+	 * Same as diff, but for a chunk written by getCompressedChunk of the
+	 * external bloom filter. The chunk contains its own offset.
+	 *
+	 * \param chunk of the external bloom filter
+	 * \param length of the chunk
+	 * \param handler to be informed about different hashes
+	 * \return the offset behind the bloom filter part of the chunk
+	 */
+	virtual std::size_t diffCompressed(const unsigned char * chunk,
+			const std::size_t length, setsync::AbstractDiffHandler& handler) const;
 	/**
 	 *  adds this given key to bloom filter and the key value storage
 	 *  \param key to be added
 	 */
 	void virtual add(const unsigned char * key);
 	/**
+	 * Adds the keys in blocks of STORAGE_BATCH_SIZE keys. The positions
+	 * of a block are sorted, so each position record is read and
+	 * written once per block, in the order of the positions. All
+	 * changed records of a block are written in a single storage batch.
+	 *
 	 * \param keys to be added to the BloomFilter
 	 * \param count number of keys in the array
 	 * \throws an Exception, if the maximum is reached and hardMaximum has been set
@@ -91,10 +365,28 @@ public:
 	 * \return true on success
 	 */
 	virtual bool remove(const unsigned char * key);
+	/**
+	 * Removes the given keys in blocks of STORAGE_BATCH_SIZE keys, in
+	 * the same way as addAll adds them.
+	 *
+	 * \param keys to be removed
+	 * \param count number of keys in the array
+	 * \return the number of removed keys
+	 */
+	virtual std::size_t removeAll(const unsigned char * keys,
+			const std::size_t count);
 	/**
 	 * cleans the key value storage and the bloom filter
 	 */
 	virtual void clear(void);
+	/**
+	 * Passes all saved hashes to the given handler. A hash is passed
+	 * once per position in the bloom filter, so the handler could be
+	 * called multiple times with the same hash.
+	 *
+	 * \param handler to be called for each saved hash
+	 */
+	virtual void getAll(setsync::AbstractDiffHandler& handler);
 };
 
 }
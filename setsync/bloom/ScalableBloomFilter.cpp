@@ -0,0 +1,302 @@
+/*
+ * ScalableBloomFilter.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "ScalableBloomFilter.h"
+#include "BloomFilterChunkCodec.h"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+
+namespace setsync {
+
+namespace bloom {
+
+const char ScalableBloomFilter::sliceCountKey[] = "bfslicecount";
+const uint64_t ScalableBloomFilter::GROWTH_FACTOR = 2;
+const float ScalableBloomFilter::TIGHTENING_RATIO = 0.5;
+
+/// First byte of the keyspace of a slice in the storage
+#define SLICE_PREFIX 'S'
+
+ScalableBloomFilter::ScalableBloomFilter(const crypto::CryptoHash& hash,
+		setsync::storage::AbstractKeyValueStorage& storage,
+		const std::string& file, const uint64_t maxNumberOfElements,
+		const bool hardMaximum, const float falsePositiveRate,
+		const bool scalable, const unsigned int checkpointInterval,
+		const uint64_t segmentSize, const bool prefault, const bool hugePages) :
+	hash_(hash), storage_(storage), file_(file),
+			maxNumberOfElements_(maxNumberOfElements),
+			hardMaximum_(hardMaximum), falsePositiveRate_(falsePositiveRate),
+			scalable_(scalable), checkpointInterval_(checkpointInterval),
+			segmentSize_(segmentSize), prefault_(prefault),
+			hugePages_(hugePages) {
+	uint32_t count;
+	std::size_t valuesize;
+	if (!this->storage_.getInto((unsigned char *) sliceCountKey,
+			strlen(sliceCountKey), (unsigned char *) &count, sizeof(uint32_t),
+			&valuesize) || valuesize != sizeof(uint32_t) || count == 0) {
+		count = 1;
+	}
+	try {
+		while (this->slices_.size() < count) {
+			openSlice();
+		}
+	} catch (...) {
+		closeSlices(0);
+		throw;
+	}
+}
+
+ScalableBloomFilter::~ScalableBloomFilter() {
+	closeSlices(0);
+}
+
+void ScalableBloomFilter::closeSlices(const std::size_t keep) {
+	while (this->slices_.size() > keep) {
+		delete this->slices_.back();
+		this->slices_.pop_back();
+		delete this->storages_.back();
+		this->storages_.pop_back();
+	}
+}
+
+void ScalableBloomFilter::openSlice() {
+	const std::size_t slice = this->slices_.size();
+	setsync::storage::PrefixStorage * sliceStorage = NULL;
+	std::string sliceFile = this->file_;
+	if (slice > 0) {
+		// The slice number is written big endian, like the bucket numbers
+		std::string prefix(1, SLICE_PREFIX);
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			prefix.push_back((char) ((slice >> shift) & 0xFF));
+		}
+		sliceStorage = new setsync::storage::PrefixStorage(this->storage_,
+				prefix);
+		if (!this->file_.empty()) {
+			std::stringstream name;
+			name << this->file_ << ".slice" << slice;
+			sliceFile = name.str();
+		}
+	}
+	KeyValueCountingBloomFilter * filter;
+	try {
+		filter = new KeyValueCountingBloomFilter(this->hash_,
+				sliceStorage != NULL ? *sliceStorage : this->storage_,
+				sliceFile, capacity(slice), this->hardMaximum_,
+				this->falsePositiveRate_ * pow(TIGHTENING_RATIO, (int) slice),
+				this->checkpointInterval_, this->segmentSize_, this->prefault_,
+				this->hugePages_);
+	} catch (...) {
+		delete sliceStorage;
+		throw;
+	}
+	this->slices_.push_back(filter);
+	this->storages_.push_back(sliceStorage);
+}
+
+void ScalableBloomFilter::storeSliceCount(const uint32_t count) {
+	this->storage_.put((unsigned char *) sliceCountKey, strlen(sliceCountKey),
+			(const unsigned char *) &count, sizeof(uint32_t));
+}
+
+uint64_t ScalableBloomFilter::capacity(const std::size_t slice) const {
+	uint64_t result = this->maxNumberOfElements_;
+	for (std::size_t i = 0; i < slice; i++) {
+		result *= GROWTH_FACTOR;
+	}
+	return result;
+}
+
+bool ScalableBloomFilter::isFull() const {
+	if (!this->scalable_ || this->hardMaximum_)
+		return false;
+	return this->slices_.back()->numberOfElements() >= capacity(
+			this->slices_.size() - 1);
+}
+
+std::size_t ScalableBloomFilter::sliceAt(const std::size_t offset,
+		std::size_t * start) const {
+	*start = 0;
+	for (std::size_t i = 0; i < this->slices_.size(); i++) {
+		const std::size_t sliceSize = this->slices_[i]->size();
+		if (offset < *start + sliceSize)
+			return i;
+		*start += sliceSize;
+	}
+	return this->slices_.size();
+}
+
+std::size_t ScalableBloomFilter::numberOfSlices() const {
+	return this->slices_.size();
+}
+
+std::size_t ScalableBloomFilter::size() const {
+	std::size_t result = 0;
+	for (std::size_t i = 0; i < this->slices_.size(); i++) {
+		result += this->slices_[i]->size();
+	}
+	return result;
+}
+
+uint64_t ScalableBloomFilter::numberOfElements() const {
+	uint64_t result = 0;
+	for (std::size_t i = 0; i < this->slices_.size(); i++) {
+		result += this->slices_[i]->numberOfElements();
+	}
+	return result;
+}
+
+std::size_t ScalableBloomFilter::numberOfFunctions() const {
+	return this->slices_.front()->numberOfFunctions();
+}
+
+void ScalableBloomFilter::add(const unsigned char * key) {
+	addAll(key, 1);
+}
+
+void ScalableBloomFilter::addAll(const unsigned char * keys,
+		const std::size_t count) {
+	const std::size_t hashSize = this->hash_.getHashSize();
+	std::size_t added = 0;
+	while (added < count) {
+		if (isFull()) {
+			// A crash before the slice is written leaves an empty slice
+			storeSliceCount(this->slices_.size() + 1);
+			openSlice();
+		}
+		KeyValueCountingBloomFilter * newest = this->slices_.back();
+		std::size_t block = count - added;
+		if (this->scalable_ && !this->hardMaximum_) {
+			const uint64_t free = capacity(this->slices_.size() - 1)
+					- newest->numberOfElements();
+			if (free < block)
+				block = free;
+		}
+		newest->addAll(keys + added * hashSize, block);
+		added += block;
+	}
+}
+
+bool ScalableBloomFilter::contains(const unsigned char * key) const {
+	for (std::size_t i = this->slices_.size(); i > 0; i--) {
+		if (this->slices_[i - 1]->contains(key))
+			return true;
+	}
+	return false;
+}
+
+std::size_t ScalableBloomFilter::containsAll(const unsigned char * keys,
+		const std::size_t count) const {
+	const std::size_t hashSize = this->hash_.getHashSize();
+	for (std::size_t i = 0; i < count; i++) {
+		if (!contains(keys + i * hashSize))
+			return i;
+	}
+	return count;
+}
+
+bool ScalableBloomFilter::remove(const unsigned char * key) {
+	return removeAll(key, 1) == 1;
+}
+
+std::size_t ScalableBloomFilter::removeAll(const unsigned char * keys,
+		const std::size_t count) {
+	// A key is stored in one slice only, the other slices skip it after
+	// a lookup of its bits or, on a false positive, of its buckets
+	std::size_t removed = 0;
+	for (std::size_t i = this->slices_.size(); i > 0; i--) {
+		removed += this->slices_[i - 1]->removeAll(keys, count);
+	}
+	return removed;
+}
+
+void ScalableBloomFilter::clear() {
+	closeSlices(1);
+	// Clears the keyspaces of the other slices and the number of slices,
+	// too. Their files are rebuilt, when the slices are added again.
+	this->slices_.front()->clear();
+}
+
+void ScalableBloomFilter::getAll(setsync::AbstractDiffHandler& handler) {
+	for (std::size_t i = 0; i < this->slices_.size(); i++) {
+		this->slices_[i]->getAll(handler);
+	}
+}
+
+void ScalableBloomFilter::diff(const unsigned char * externalBF,
+		const std::size_t length, const std::size_t offset,
+		setsync::AbstractDiffHandler& handler) const {
+	const std::size_t end = offset + length;
+	std::size_t start = 0;
+	for (std::size_t i = 0; i < this->slices_.size() && start < end; i++) {
+		const std::size_t sliceEnd = start + this->slices_[i]->size();
+		if (offset < sliceEnd) {
+			const std::size_t first = std::max(offset, start);
+			const std::size_t last = std::min(end, sliceEnd);
+			this->slices_[i]->diff(externalBF + (first - offset), last - first,
+					first - start, handler);
+		}
+		start = sliceEnd;
+	}
+}
+
+std::size_t ScalableBloomFilter::getChunk(unsigned char * buffer,
+		const std::size_t maxlength, std::size_t offset) {
+	std::size_t written = 0;
+	std::size_t start;
+	std::size_t slice = sliceAt(offset, &start);
+	while (written < maxlength && slice < this->slices_.size()) {
+		written += this->slices_[slice]->getChunk(buffer + written,
+				maxlength - written, offset + written - start);
+		start += this->slices_[slice]->size();
+		slice++;
+	}
+	return written;
+}
+
+std::size_t ScalableBloomFilter::getCompressedChunk(unsigned char * buffer,
+		const std::size_t maxlength, std::size_t offset, std::size_t * covered) {
+	std::size_t start;
+	const std::size_t slice = sliceAt(offset, &start);
+	if (slice == this->slices_.size()) {
+		*covered = 0;
+		return 0;
+	}
+	const std::size_t written = this->slices_[slice]->getCompressedChunk(
+			buffer, maxlength, offset - start, covered);
+	BloomFilterChunkCodec::relocate(buffer, written, offset);
+	return written;
+}
+
+/**
+ * Passes the decoded windows of a compressed chunk to
+ * ScalableBloomFilter::diff
+ */
+class SliceDiffWindowHandler: public BloomFilterChunkCodec::WindowHandler {
+private:
+	const ScalableBloomFilter& bf_;
+	setsync::AbstractDiffHandler& handler_;
+public:
+	SliceDiffWindowHandler(const ScalableBloomFilter& bf,
+			setsync::AbstractDiffHandler& handler) :
+		bf_(bf), handler_(handler) {
+	}
+	virtual void handle(const unsigned char * bits, const std::size_t length,
+			const std::size_t offset) {
+		bf_.diff(bits, length, offset, handler_);
+	}
+};
+
+std::size_t ScalableBloomFilter::diffCompressed(const unsigned char * chunk,
+		const std::size_t length, setsync::AbstractDiffHandler& handler) const {
+	SliceDiffWindowHandler windowHandler(*this, handler);
+	return BloomFilterChunkCodec::decode(chunk, length, windowHandler);
+}
+
+}
+
+}
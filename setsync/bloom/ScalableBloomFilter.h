@@ -0,0 +1,240 @@
+/*
+ * ScalableBloomFilter.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef SCALABLEBLOOMFILTER_H_
+#define SCALABLEBLOOMFILTER_H_
+
+#include <setsync/bloom/KeyValueCountingBloomFilter.h>
+#include <setsync/bloom/ComparableBloomFilter.h>
+#include <setsync/storage/PrefixStorage.h>
+#include <setsync/storage/KeyValueStorage.h>
+#include <setsync/DiffHandler.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace setsync {
+
+namespace bloom {
+
+/**
+ * A counting bloom filter, which grows past its maximum number of
+ * elements without a rebuild. It consists of a stack of
+ * KeyValueCountingBloomFilter slices. New keys are added to the newest
+ * slice. If it is full, a new slice is added with GROWTH_FACTOR times the
+ * capacity and a false positive rate lowered by TIGHTENING_RATIO, so the
+ * false positive rate of all slices together stays below twice the
+ * configured one.
+ *
+ * The first slice uses the storage and the file directly, so a storage
+ * written by a single KeyValueCountingBloomFilter is the first slice of a
+ * ScalableBloomFilter. Each further slice gets its own keyspace in the
+ * storage and its own file, named after the given file with the suffix
+ * ".slice" and the slice number. The number of slices is kept in the
+ * storage.
+ *
+ * For the synchronization, the bits of all slices are treated as one bloom
+ * filter, the slices one after another. Both sides have to use the same
+ * maximum number of elements and false positive rate, so the slices of the
+ * same number have the same size. Slices, which only exist on one side,
+ * are skipped by diff().
+ */
+class ScalableBloomFilter: public ComparableBloomFilterInterface {
+public:
+	/// Capacity of a new slice compared to the one before
+	static const uint64_t GROWTH_FACTOR;
+	/// False positive rate of a new slice compared to the one before
+	static const float TIGHTENING_RATIO;
+private:
+	static const char sliceCountKey[];
+	/// The crypto hash function of the keys
+	const crypto::CryptoHash& hash_;
+	/// The storage of the first slice, which holds the other ones, too
+	setsync::storage::AbstractKeyValueStorage& storage_;
+	/// File of the first slice, an empty string for in memory slices
+	std::string file_;
+	/// Maximum number of elements of the first slice
+	uint64_t maxNumberOfElements_;
+	/// true, if the first slice never grows
+	bool hardMaximum_;
+	/// False positive rate of the first slice
+	float falsePositiveRate_;
+	/// true, if new slices are added, when the newest one is full
+	bool scalable_;
+	/// Passed to KeyValueCountingBloomFilter
+	unsigned int checkpointInterval_;
+	/// Passed to KeyValueCountingBloomFilter
+	uint64_t segmentSize_;
+	/// Passed to KeyValueCountingBloomFilter
+	bool prefault_;
+	/// Passed to KeyValueCountingBloomFilter
+	bool hugePages_;
+	/// The slices, the oldest one first
+	std::vector<KeyValueCountingBloomFilter *> slices_;
+	/// Keyspaces of the slices, NULL for the first one
+	std::vector<setsync::storage::PrefixStorage *> storages_;
+	/**
+	 * Opens the slice with the next number and appends it to slices_
+	 */
+	void openSlice();
+	/**
+	 * Closes the newest slices, until only the given number is left
+	 */
+	void closeSlices(const std::size_t keep);
+	/**
+	 * Writes the number of slices into the storage
+	 */
+	void storeSliceCount(const uint32_t count);
+	/**
+	 * \return the maximum number of elements of the given slice
+	 */
+	uint64_t capacity(const std::size_t slice) const;
+	/**
+	 * \return true, if a new slice is added for the next key
+	 */
+	bool isFull() const;
+	/**
+	 * Finds the slice, which contains the given offset of the bits of
+	 * all slices
+	 *
+	 * \param offset of a byte of the bits of all slices
+	 * \param start is set to the offset of the first byte of the slice
+	 * \return the index of the slice, or the number of slices, if the
+	 * offset is behind the last slice
+	 */
+	std::size_t sliceAt(const std::size_t offset, std::size_t * start) const;
+	ScalableBloomFilter(const ScalableBloomFilter&);
+	ScalableBloomFilter& operator=(const ScalableBloomFilter&);
+public:
+	/**
+	 * Opens all slices stored in the storage, or a single empty one
+	 *
+	 * \param hash the crypto hash function, used for keys
+	 * \param storage to load and save the bloom filter entries
+	 * \param file of the first slice, an empty string to keep the slices
+	 * in memory
+	 * \param maxNumberOfElements of the first slice
+	 * \param hardMaximum will be passed to KeyValueCountingBloomFilter,
+	 * no slices are added, if it is set
+	 * \param falsePositiveRate of the first slice
+	 * \param scalable if false, no slices are added, but existing ones
+	 * are still opened
+	 * \param checkpointInterval will be passed to KeyValueCountingBloomFilter
+	 * \param segmentSize will be passed to KeyValueCountingBloomFilter
+	 * \param prefault will be passed to KeyValueCountingBloomFilter
+	 * \param hugePages will be passed to KeyValueCountingBloomFilter
+	 */
+	ScalableBloomFilter(const crypto::CryptoHash& hash,
+			setsync::storage::AbstractKeyValueStorage& storage,
+			const std::string& file,
+			const uint64_t maxNumberOfElements = 10000,
+			const bool hardMaximum = false,
+			const float falsePositiveRate = 0.001, const bool scalable = true,
+			const unsigned int checkpointInterval = 0,
+			const uint64_t segmentSize = 0, const bool prefault = false,
+			const bool hugePages = false);
+	virtual ~ScalableBloomFilter();
+	/**
+	 * \return the number of slices
+	 */
+	std::size_t numberOfSlices() const;
+	/**
+	 * \return the size of the bits of all slices in bytes
+	 */
+	std::size_t size() const;
+	/**
+	 * \return the number of elements in all slices
+	 */
+	uint64_t numberOfElements() const;
+	/**
+	 * \return the number of hash functions of the first slice
+	 */
+	std::size_t numberOfFunctions() const;
+	/**
+	 * Adds the key to the newest slice, a new slice is added before, if
+	 * it is full
+	 */
+	void add(const unsigned char * key);
+	/**
+	 * Adds the keys to the newest slice. If it gets full, the remaining
+	 * keys are added to new slices.
+	 *
+	 * \param keys to be added
+	 * \param count number of keys in the array
+	 * \throws an Exception, if the maximum is reached and hardMaximum has been set
+	 */
+	void addAll(const unsigned char * keys, const std::size_t count);
+	/**
+	 * \return true, if any slice seems to contain the key
+	 */
+	bool contains(const unsigned char * key) const;
+	/**
+	 * \return the given count on containing all keys, otherwise the first
+	 * failed position in the given key array
+	 */
+	std::size_t containsAll(const unsigned char * keys,
+			const std::size_t count) const;
+	/**
+	 * Removes the key from the slice, which holds it
+	 *
+	 * \return true on success
+	 */
+	bool remove(const unsigned char * key);
+	/**
+	 * Removes the keys from the slices, which hold them
+	 *
+	 * \return the number of removed keys
+	 */
+	std::size_t removeAll(const unsigned char * keys, const std::size_t count);
+	/**
+	 * Clears the storage and removes all slices except the first one
+	 */
+	void clear();
+	/**
+	 * Passes all saved hashes of all slices to the given handler
+	 */
+	void getAll(setsync::AbstractDiffHandler& handler);
+	/**
+	 * Calculates the difference of each slice to the part of the given
+	 * fragment, which covers the slice of the same number on the other side
+	 */
+	virtual void diff(const unsigned char * externalBF,
+			const std::size_t length, const std::size_t offset,
+			setsync::AbstractDiffHandler& handler) const;
+	/**
+	 * Writes the bits of the slices, starting at the offset, into the buffer
+	 */
+	virtual std::size_t getChunk(unsigned char * buffer,
+			const std::size_t maxlength, std::size_t offset);
+	/**
+	 * Writes the next part of the slice, which contains the offset, as
+	 * compressed chunk into the buffer. A chunk never covers two slices.
+	 *
+	 * \param buffer where the chunk is written to
+	 * \param maxlength of the buffer, at least BloomFilterChunkCodec::MIN_CHUNK_SIZE
+	 * \param offset of the first byte of the bits of all slices
+	 * \param covered is set to the number of bloom filter bytes in the chunk
+	 * \return the size of the written chunk, 0 if the offset is behind
+	 * the last slice
+	 */
+	std::size_t getCompressedChunk(unsigned char * buffer,
+			const std::size_t maxlength, std::size_t offset,
+			std::size_t * covered);
+	/**
+	 * Same as diff, but for a chunk written by getCompressedChunk of the
+	 * external bloom filter
+	 *
+	 * \return the offset behind the bloom filter part of the chunk
+	 */
+	std::size_t diffCompressed(const unsigned char * chunk,
+			const std::size_t length, setsync::AbstractDiffHandler& handler) const;
+};
+
+}
+
+}
+
+#endif /* SCALABLEBLOOMFILTER_H_ */
@@ -10,7 +10,14 @@ namespace setsync {
 
 namespace config {
 
-Configuration::TrieConfig::TrieConfig() {
+const unsigned int Configuration::BloomFilterConfig::DEFAULT_CHECKPOINT_INTERVAL =
+		5;
+const std::size_t Configuration::TrieConfig::DEFAULT_CACHE_SIZE = 4 * 1024
+		* 1024;
+
+Configuration::TrieConfig::TrieConfig(const TrieType type,
+		const std::size_t cacheSize) :
+	type_(type), cacheSize_(cacheSize) {
 
 }
 
@@ -51,6 +58,20 @@ Configuration::Configuration(const SET_CONFIG config) {
 	bfConfig_.falsePositiveRate = config.false_positive_rate;
 	bfConfig_.hardMaximum_ = config.bf_hard_max;
 	bfConfig_.maxElements_ = config.bf_max_elements;
+	bfConfig_.blockedLocalFilter_ = config.bf_blocked_local;
+	bfConfig_.checkpointInterval_ = config.bf_checkpoint_interval;
+	bfConfig_.segmentSize_ = config.bf_segment_size;
+	bfConfig_.prefault_ = config.bf_prefault;
+	bfConfig_.hugePages_ = config.bf_huge_pages;
+	bfConfig_.scalable_ = config.bf_scalable;
+	switch (config.bf_transfer) {
+	case BF_TRANSFER_COMPRESSED:
+		this->bfConfig_.type_ = Configuration::BloomFilterConfig::COMPRESSED;
+		break;
+	default:
+		this->bfConfig_.type_ = Configuration::BloomFilterConfig::NORMAL;
+		break;
+	}
 	switch (config.function) {
 	case SHA_1:
 		this->hashname_ = "sha1";
@@ -77,8 +98,18 @@ Configuration::Configuration(const SET_CONFIG config) {
 		this->hashname_ = "sha512";
 		break;
 	}
+	switch (config.trie) {
+	case IN_MEMORY_TRIE:
+		this->trieConfig_.type_ = Configuration::TrieConfig::IN_MEMORY_TRIE;
+		break;
+	default:
+		this->trieConfig_.type_ = Configuration::TrieConfig::KEY_VALUE_TRIE;
+		break;
+	}
+	this->trieConfig_.cacheSize_ = config.trie_cache_bytes;
 	this->storageConfig_.cacheInBytes_ = config.storage_cache_bytes;
 	this->storageConfig_.cacheInGBytes_ = config.storage_cache_gbytes;
+	this->storageConfig_.shared_ = config.storage_shared;
 	if (config.storage_cache_bytes == 0 && config.storage_cache_gbytes == 0) {
 		this->storageConfig_.cacheSizeGiven_ = false;
 	} else {
@@ -94,9 +125,14 @@ Configuration::Configuration(const SET_CONFIG config) {
 	case BERKELEY_DB:
 		this->storageConfig_.type_ = Configuration::StorageConfig::BERKELEY_DB;
 		break;
+#endif
 	case IN_MEMORY_DB:
 		this->storageConfig_.type_ = Configuration::StorageConfig::IN_MEMORY;
 		break;
+#ifdef HAVE_LMDB
+	case LMDB:
+		this->storageConfig_.type_ = Configuration::StorageConfig::LMDB;
+		break;
 #endif
 	default:
 		break;
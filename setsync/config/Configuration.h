@@ -24,16 +24,30 @@ public:
 		enum BloomFilterType {
 			NORMAL = 0, COMPRESSED = 1
 		};
+		/// Default number of seconds between two checkpoints of the bloom filter file
+		static const unsigned int DEFAULT_CHECKPOINT_INTERVAL;
 
 	private:
 		uint64_t maxElements_;
 		BloomFilterType type_;
 		bool hardMaximum_;
+		bool blockedLocalFilter_;
+		unsigned int checkpointInterval_;
+		uint64_t segmentSize_;
+		bool prefault_;
+		bool hugePages_;
+		bool scalable_;
 	public:
 		BloomFilterConfig(const uint64_t maxNumberOfElements = 10000,
 				const bool hardMaximum = false,
-				const float falsePositiveRate = 0.001) :
-			maxElements_(maxNumberOfElements), hardMaximum_(hardMaximum),
+				const float falsePositiveRate = 0.001,
+				const bool blockedLocalFilter = false) :
+			maxElements_(maxNumberOfElements), type_(NORMAL),
+					hardMaximum_(hardMaximum),
+					blockedLocalFilter_(blockedLocalFilter),
+					checkpointInterval_(DEFAULT_CHECKPOINT_INTERVAL),
+					segmentSize_(0), prefault_(false), hugePages_(false),
+					scalable_(false),
 					falsePositiveRate(falsePositiveRate) {
 		}
 		virtual ~BloomFilterConfig() {
@@ -46,32 +60,137 @@ public:
 		void setHardMaximum(bool isHardMax) {
 			this->hardMaximum_ = isHardMax;
 		}
+		/**
+		 * \return the preferred transfer mode of the bloom filter during
+		 * a synchronization, COMPRESSED sends Golomb-Rice coded chunks
+		 */
+		BloomFilterType getType(void) const {
+			return this->type_;
+		}
+		void setType(const BloomFilterType type) {
+			this->type_ = type;
+		}
+		/**
+		 * \return true, if a cache-line-blocked bloom filter is used for
+		 * local lookups in front of the synchronized bloom filter
+		 */
+		bool isBlockedLocalFilter(void) const {
+			return this->blockedLocalFilter_;
+		}
+		void setBlockedLocalFilter(bool blocked) {
+			this->blockedLocalFilter_ = blocked;
+		}
+		/**
+		 * \return the number of seconds between two checkpoints of the
+		 * bloom filter file, 0 if it is only checkpointed on opening and
+		 * closing. A crash costs the replay of the changes since the last
+		 * checkpoint.
+		 */
+		unsigned int getCheckpointInterval(void) const {
+			return this->checkpointInterval_;
+		}
+		void setCheckpointInterval(const unsigned int seconds) {
+			this->checkpointInterval_ = seconds;
+		}
+		/**
+		 * \return the maximum number of bytes of a single bloom filter
+		 * file, larger filters are split into several files. 0, if the
+		 * filter is stored in a single file.
+		 */
+		uint64_t getSegmentSize(void) const {
+			return this->segmentSize_;
+		}
+		void setSegmentSize(const uint64_t bytes) {
+			this->segmentSize_ = bytes;
+		}
+		/**
+		 * \return true, if the bloom filter file is read into memory on
+		 * opening, instead of page by page on the first lookups
+		 */
+		bool isPrefault(void) const {
+			return this->prefault_;
+		}
+		void setPrefault(const bool prefault) {
+			this->prefault_ = prefault;
+		}
+		/**
+		 * \return true, if huge pages are requested for the bloom filter
+		 * file. They save TLB misses of lookups in large filters, but each
+		 * checkpoint writes back whole huge pages.
+		 */
+		bool isHugePages(void) const {
+			return this->hugePages_;
+		}
+		void setHugePages(const bool hugePages) {
+			this->hugePages_ = hugePages;
+		}
+		/**
+		 * \return true, if the bloom filter adds slices with a lower false
+		 * positive rate, when it exceeds the maximum number of elements.
+		 * It has no effect on a hard maximum.
+		 */
+		bool isScalable(void) const {
+			return this->scalable_;
+		}
+		void setScalable(const bool scalable) {
+			this->scalable_ = scalable;
+		}
 		float falsePositiveRate;
 	};
 	class TrieConfig {
 		friend class Configuration;
 	public:
-		TrieConfig();
+		enum TrieType {
+			KEY_VALUE_TRIE = 0, IN_MEMORY_TRIE = 1
+		};
+		/**
+		 * Default size of the node cache of a KeyValueTrie in bytes. The
+		 * cache writes the changes of each insert and erase with a single
+		 * batch, so it is as crash-safe as the storage.
+		 */
+		static const std::size_t DEFAULT_CACHE_SIZE;
+	private:
+		TrieType type_;
+		std::size_t cacheSize_;
+	public:
+		TrieConfig(const TrieType type = KEY_VALUE_TRIE,
+				const std::size_t cacheSize = DEFAULT_CACHE_SIZE);
 		virtual ~TrieConfig();
+		TrieType getType(void) const {
+			return this->type_;
+		}
+		void setType(const TrieType type) {
+			this->type_ = type;
+		}
+		/**
+		 * \return the maximum number of bytes of the node cache, 0 if disabled
+		 */
+		std::size_t getCacheSize(void) const {
+			return this->cacheSize_;
+		}
+		void setCacheSize(const std::size_t cacheSize) {
+			this->cacheSize_ = cacheSize;
+		}
 	};
 	class StorageConfig {
 		friend class Configuration;
 	public:
 		enum StorageType {
-			BERKELEY_DB = 0, LEVELDB = 1, IN_MEMORY = 2
+			BERKELEY_DB = 0, LEVELDB = 1, IN_MEMORY = 2, LMDB = 3
 		};
 	private:
 		StorageType type_;
 		bool cacheSizeGiven_;
 		std::size_t cacheInBytes_;
 		std::size_t cacheInGBytes_;
+		bool shared_;
 
 	public:
 		StorageConfig(const StorageType type = BERKELEY_DB,
 					const std::size_t cacheInBytes = 0,
 					const std::size_t cacheInGBytes = 0) :
 			type_(type), cacheInBytes_(cacheInBytes),
-			cacheInGBytes_(cacheInGBytes_) {
+			cacheInGBytes_(cacheInGBytes_), shared_(false) {
 			if (cacheInGBytes == 0) {
 				if (cacheInBytes == 0) {
 					this->cacheSizeGiven_ = false;
@@ -94,6 +213,16 @@ public:
 		std::size_t getGByteCacheSize() const {
 			return this->cacheInGBytes_;
 		}
+		/**
+		 * \return true, if trie, bloom filter and index share a single
+		 * database with one cache, their keys are prefixed
+		 */
+		bool isShared(void) const {
+			return this->shared_;
+		}
+		void setShared(bool shared) {
+			this->shared_ = shared;
+		}
 	};
 private:
 	std::string path_;
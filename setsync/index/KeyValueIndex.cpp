@@ -35,28 +35,34 @@ bool KeyValueIndex::remove(const unsigned char* hash) {
 }
 
 size_t KeyValueIndex::getSizeOf(const unsigned char * hash) const {
-	unsigned char * resultBuffer;
 	std::size_t resultSize;
-	if (this->storage_.get(hash, this->AbstractSetIndex::hash_.getHashSize(),
-			&resultBuffer, &resultSize)) {
-		free(resultBuffer);
-	}
+	// An empty buffer is sufficient to ask for the size only
+	this->storage_.getInto(hash, this->AbstractSetIndex::hash_.getHashSize(),
+			NULL, 0, &resultSize);
 	return resultSize;
 }
 
 bool KeyValueIndex::get(const unsigned char * hash, void * buffer,
 		size_t * buffersize) const {
-	unsigned char * resultBuffer;
 	std::size_t resultSize;
-	if (this->storage_.get(hash, this->AbstractSetIndex::hash_.getHashSize(),
-			&resultBuffer, &resultSize)) {
+	if (!this->storage_.getInto(hash,
+			this->AbstractSetIndex::hash_.getHashSize(),
+			(unsigned char *) buffer, *buffersize, &resultSize)) {
+		return false;
+	}
+	if (resultSize > *buffersize) {
+		// Only a part of the value fits into the buffer
+		unsigned char * resultBuffer;
+		if (!this->storage_.get(hash,
+				this->AbstractSetIndex::hash_.getHashSize(), &resultBuffer,
+				&resultSize)) {
+			return false;
+		}
 		memcpy(buffer, resultBuffer, std::min(resultSize, *buffersize));
 		free(resultBuffer);
-		*buffersize = std::min(resultSize, *buffersize);
-		return true;
-	} else {
-		return false;
 	}
+	*buffersize = std::min(resultSize, *buffersize);
+	return true;
 }
 
 bool KeyValueIndex::put(const unsigned char * hash, const void * data,
@@ -30,9 +30,17 @@ typedef enum {
 } SET_HASH_FUNCTION;
 
 typedef enum {
-	LEVELDB, BERKELEY_DB, IN_MEMORY_DB
+	LEVELDB, BERKELEY_DB, IN_MEMORY_DB, LMDB
 } SET_STORAGE_TYPE;
 
+typedef enum {
+	KEY_VALUE_TRIE, IN_MEMORY_TRIE
+} SET_TRIE_TYPE;
+
+typedef enum {
+	BF_TRANSFER_NORMAL, BF_TRANSFER_COMPRESSED
+} SET_BF_TRANSFER_TYPE;
+
 typedef struct {
 	SET_HASH_FUNCTION function;
 	SET_STORAGE_TYPE storage;
@@ -41,8 +49,46 @@ typedef struct {
 	float false_positive_rate;
 	size_t storage_cache_gbytes;
 	size_t storage_cache_bytes;
+	SET_TRIE_TYPE trie;
+	size_t trie_cache_bytes;
+	int bf_blocked_local;
+	SET_BF_TRANSFER_TYPE bf_transfer;
+	int storage_shared;
+	unsigned int bf_checkpoint_interval;
+	uint64_t bf_segment_size;
+	int bf_prefault;
+	int bf_huge_pages;
+	int bf_scalable;
 } SET_CONFIG;
 
+#define SET_STATS_LATENCY_BUCKETS 32
+
+/**
+ * I/O statistics of one storage of a set. Bucket i of a latency
+ * histogram counts the sampled operations, which took between 2^i and
+ * 2^(i+1) nanoseconds.
+ */
+typedef struct {
+	uint64_t gets;
+	uint64_t hits;
+	uint64_t puts;
+	uint64_t dels;
+	uint64_t clears;
+	uint64_t commits;
+	uint64_t scans;
+	uint64_t scanned_entries;
+	uint64_t bytes_read;
+	uint64_t bytes_written;
+	uint64_t read_latency[SET_STATS_LATENCY_BUCKETS];
+	uint64_t write_latency[SET_STATS_LATENCY_BUCKETS];
+} SET_STORAGE_STATS;
+
+typedef struct {
+	SET_STORAGE_STATS trie;
+	SET_STORAGE_STATS bf;
+	SET_STORAGE_STATS index;
+} SET_STATS;
+
 typedef void diff_callback(void *closure, const unsigned char * hash,
 		const size_t hashsize, const size_t existsLocally);
 
@@ -58,6 +104,10 @@ int set_empty(SET *set);
 size_t set_size(SET *set);
 size_t set_max_size(SET *set);
 
+// Statistics
+int set_get_stats(SET *set, SET_STATS * stats);
+int set_reset_stats(SET *set);
+
 // Lookup
 int set_find(SET *set, const unsigned char * key);
 int set_find_string(SET *set, const char * str);
@@ -69,6 +119,8 @@ int set_get_data(SET *set, const unsigned char * key, unsigned char ** value,
 int set_insert(SET *set, const unsigned char * key);
 int set_insert_string(SET *set, const char * str);
 int set_insert_data(SET *set, const void * data, const size_t length);
+size_t set_insert_batch(SET *set, const unsigned char * keys,
+		const size_t count);
 
 int set_erase(SET *set, const unsigned char * key);
 int set_erase_string(SET *set, const char * str);
@@ -100,6 +152,17 @@ size_t set_sync_bf_read_next_chunk(SET_SYNC_HANDLE * handle, unsigned char* buff
  */
 int set_sync_bf_process_chunk(SET_SYNC_HANDLE * handle, const unsigned char* inbuffer,
 		const size_t inlength, diff_callback * callback, void * closure);
+/**
+ * Returns the bloom filter transfer type proposed by this side, which
+ * should be sent to the remote side before the bloom filter is transfered
+ */
+int set_sync_bf_get_transfer_type(SET_SYNC_HANDLE * handle);
+/**
+ * Agrees on the bloom filter transfer type with the proposal of the remote
+ * side and returns the type used by both sides, or -1 on error
+ */
+int set_sync_bf_negotiate_transfer_type(SET_SYNC_HANDLE * handle,
+		const int remoteType);
 // Synchronization buffer
 size_t set_sync_min_trie_buffer(SET_SYNC_HANDLE * handle);
 size_t set_sync_min_bf_buffer(SET_SYNC_HANDLE * handle);
@@ -15,6 +15,8 @@ namespace storage {
 
 BdbIterator::BdbIterator(Db * db, DbTxn * parent) :
 	valid_(true) {
+	DBTYPE type;
+	this->ordered_ = db->get_type(&type) == 0 && type == DB_BTREE;
 	txn = NULL;
 	if (utils::BerkeleyDB::isTransactionEnabled(db)) {
 		db->get_env()->txn_begin(parent, &txn, 0);
@@ -43,6 +45,26 @@ void BdbIterator::seekToFirst() {
 	}
 }
 
+void BdbIterator::seek(const unsigned char * key, const std::size_t length) {
+	if (!this->ordered_) {
+		seekToFirst();
+		return;
+	}
+	// The cursor writes the found key into key_
+	this->key_.set_data((void *) key);
+	this->key_.set_size(length);
+	int ret = this->cursorp->get(&key_, &data_, DB_SET_RANGE);
+	if (ret == DB_NOTFOUND) {
+		this->valid_ = false;
+	} else if (ret == 0) {
+		this->valid_ = true;
+	}
+}
+
+bool BdbIterator::isOrdered() const {
+	return this->ordered_;
+}
+
 void BdbIterator::next() {
 	int ret = this->cursorp->get(&key_, &data_, DB_NEXT);
 	if (ret == DB_NOTFOUND) {
@@ -60,6 +82,14 @@ void BdbIterator::key(unsigned char * buffer) const {
 	memcpy(buffer, this->key_.get_data(), this->key_.get_size());
 }
 
+size_t BdbIterator::valueSize() const {
+	return this->data_.get_size();
+}
+
+void BdbIterator::value(unsigned char * buffer) const {
+	memcpy(buffer, this->data_.get_data(), this->data_.get_size());
+}
+
 BdbStorage::BdbStorage(Db * db) :
 		berkeley::AbstractBdbTableUser(db), db_(db) {
 
@@ -70,6 +100,10 @@ BdbStorage::~BdbStorage() {
 
 bool BdbStorage::get(const unsigned char * key, const std::size_t length,
 		unsigned char ** value, std::size_t * valueSize) const {
+	bool found;
+	if (batchGet(key, length, value, valueSize, &found)) {
+		return found;
+	}
 	DbTxn * txn = NULL;
 	int ret;
 	Dbt k((char*) key, length);
@@ -97,8 +131,55 @@ bool BdbStorage::get(const unsigned char * key, const std::size_t length,
 	*valueSize = data.get_size();
 	return true;
 }
+
+bool BdbStorage::getInto(const unsigned char * key, const std::size_t length,
+		unsigned char * buffer, const std::size_t bufferSize,
+		std::size_t * valueSize) const {
+	bool found;
+	if (batchGetInto(key, length, buffer, bufferSize, valueSize, &found)) {
+		return found;
+	}
+	DbTxn * txn = NULL;
+	int ret;
+	Dbt k((char*) key, length);
+	Dbt data(buffer, 0);
+	data.set_ulen(bufferSize);
+	data.set_flags(DB_DBT_USERMEM);
+	if (this->isTransactionEnabled()) {
+		this->db_->get_env()->txn_begin(this->getParentTransaction(), &txn, 0);
+	}
+	try {
+		ret = this->db_->get(txn, &k, &data, 0);
+	} catch (DbMemoryException&) {
+		// The size of the value is passed back, even if it doesn't fit
+		ret = DB_BUFFER_SMALL;
+	} catch (...) {
+		if (txn != NULL) {
+			txn->abort();
+		}
+		throw;
+	}
+	if (this->isTransactionEnabled()) {
+		if (ret != 0 && ret != DB_BUFFER_SMALL) {
+			txn->abort();
+		} else {
+			txn->commit(0);
+		}
+	}
+	if (ret == DB_NOTFOUND) {
+		*valueSize = 0;
+		return false;
+	} else if (ret != 0 && ret != DB_BUFFER_SMALL) {
+		throw DbException(0);
+	}
+	*valueSize = data.get_size();
+	return true;
+}
 void BdbStorage::put(const unsigned char * key, const std::size_t keySize,
 		const unsigned char * value, const std::size_t valueSize) {
+	if (batchPut(key, keySize, value, valueSize)) {
+		return;
+	}
 	int ret;
 	DbTxn * txn = NULL;
 	Dbt k((char*) key, keySize);
@@ -121,6 +202,9 @@ void BdbStorage::put(const unsigned char * key, const std::size_t keySize,
 }
 
 void BdbStorage::del(const unsigned char * key, const std::size_t keySize) {
+	if (batchDel(key, keySize)) {
+		return;
+	}
 	Dbt k((char*) key, keySize);
 	int ret;
 	if (this->isTransactionEnabled()) {
@@ -141,6 +225,7 @@ void BdbStorage::del(const unsigned char * key, const std::size_t keySize) {
 
 }
 void BdbStorage::clear(void) {
+	this->batch_.clear();
 	u_int32_t counter;
 	if (this->isTransactionEnabled()) {
 		DbTxn * txn;
@@ -158,6 +243,45 @@ void BdbStorage::clear(void) {
 	}
 
 }
+void BdbStorage::writeBatch(const Batch& batch) {
+	DbTxn * txn = NULL;
+	if (this->isTransactionEnabled()) {
+		this->db_->get_env()->txn_begin(this->getParentTransaction(), &txn, 0);
+	}
+	int ret = 0;
+	try {
+		for (Batch::const_iterator it = batch.begin(); ret == 0 && it
+				!= batch.end(); it++) {
+			Dbt k((char *) it->first.data(), it->first.size());
+			if (it->second.deleted) {
+				ret = this->db_->del(txn, &k, 0);
+				// The key could have been put and deleted by the batch
+				if (ret == DB_NOTFOUND)
+					ret = 0;
+			} else {
+				Dbt data((char *) it->second.value.data(),
+						it->second.value.size());
+				data.set_flags(DB_DBT_USERMEM);
+				ret = this->db_->put(txn, &k, &data, 0);
+			}
+		}
+	} catch (...) {
+		if (txn != NULL)
+			txn->abort();
+		throw;
+	}
+	if (txn != NULL) {
+		if (ret != 0) {
+			txn->abort();
+		} else {
+			txn->commit(0);
+		}
+	}
+	if (ret != 0) {
+		throw DbException(ret);
+	}
+}
+
 AbstractKeyValueIterator * BdbStorage::createIterator() {
 	if (this->isTransactionEnabled()) {
 		return new BdbIterator(this->db_, this->getParentTransaction());
@@ -25,6 +25,8 @@ private:
 	Dbc *cursorp;
 	DbTxn * txn;
 	bool valid_;
+	/// true, if the database is a btree, which is ordered by the keys
+	bool ordered_;
 	Dbt key_;
 	Dbt data_;
 public:
@@ -41,6 +43,14 @@ public:
 	virtual void next();
 	virtual size_t keySize() const;
 	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	/**
+	 * Seeks inside btree databases, hash databases start at the
+	 * first entry
+	 */
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
 };
 
 class BdbStorage: public setsync::storage::AbstractKeyValueStorage,
@@ -58,6 +68,13 @@ public:
 	virtual ~BdbStorage();
 	virtual bool get(const unsigned char * key, const std::size_t length,
 			unsigned char ** value, std::size_t * valueSize) const;
+	/**
+	 * Lets the berkeley db write the value directly into the given
+	 * buffer (DB_DBT_USERMEM)
+	 */
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
 	virtual void put(const unsigned char * key, const std::size_t keySize,
 			const unsigned char * value, const std::size_t valueSize);
 	virtual void del(const unsigned char * key, const std::size_t keySize);
@@ -67,6 +84,12 @@ public:
 	 */
 	virtual void clear(void);
 	virtual AbstractKeyValueIterator * createIterator();
+protected:
+	/**
+	 * Writes the batch in a single transaction, if transactions are
+	 * enabled.
+	 */
+	virtual void writeBatch(const Batch& batch);
 };
 
 }
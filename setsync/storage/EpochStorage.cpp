@@ -0,0 +1,282 @@
+/*
+ * EpochStorage.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "EpochStorage.h"
+#include <stdlib.h>
+#include <vector>
+
+namespace setsync {
+
+namespace storage {
+
+const std::size_t EpochStorage::RECLAIM_INTERVAL;
+const std::size_t EpochStorage::RECLAIM_STEP;
+const std::size_t EpochStorage::UPGRADE_STEP;
+const uint32_t EpochStorage::META_EPOCH;
+
+EpochStorage::EpochStorage(AbstractKeyValueStorage& storage,
+		const std::string& space) :
+	PrefixStorage(storage, space), space_(space), metaKey_(
+			epochKey(META_EPOCH)), upgradeKey_(metaKey_ + "upgrade"), epoch_(0),
+			oldestEpoch_(0), writes_(0) {
+	if (!loadEpochs()) {
+		upgradeStorage();
+	}
+	setPrefix(epochKey(this->epoch_));
+}
+
+EpochStorage::~EpochStorage() {
+}
+
+std::string EpochStorage::epochKey(const uint32_t epoch) const {
+	// Big endian, so the entries are ordered by their epochs
+	std::string key(this->space_);
+	key.push_back((char) (epoch >> 24));
+	key.push_back((char) (epoch >> 16));
+	key.push_back((char) (epoch >> 8));
+	key.push_back((char) epoch);
+	return key;
+}
+
+bool EpochStorage::loadEpochs() {
+	unsigned char value[2 * sizeof(uint32_t)];
+	std::size_t valueSize;
+	if (!this->storage_.getInto((const unsigned char *) this->metaKey_.data(),
+			this->metaKey_.size(), value, sizeof(value), &valueSize)
+			|| valueSize != sizeof(value)) {
+		return false;
+	}
+	this->epoch_ = ((uint32_t) value[0] << 24) | ((uint32_t) value[1] << 16)
+			| ((uint32_t) value[2] << 8) | value[3];
+	this->oldestEpoch_ = ((uint32_t) value[4] << 24) | ((uint32_t) value[5]
+			<< 16) | ((uint32_t) value[6] << 8) | value[7];
+	return true;
+}
+
+void EpochStorage::storeEpochs() {
+	unsigned char value[2 * sizeof(uint32_t)];
+	for (std::size_t i = 0; i < sizeof(uint32_t); i++) {
+		value[i] = (unsigned char) (this->epoch_ >> (24 - 8 * i));
+		value[sizeof(uint32_t) + i] = (unsigned char) (this->oldestEpoch_
+				>> (24 - 8 * i));
+	}
+	this->storage_.put((const unsigned char *) this->metaKey_.data(),
+			this->metaKey_.size(), value, sizeof(value));
+}
+
+void EpochStorage::collectUpgradeStep(const std::string * last,
+		std::map<std::string, std::string>& entries) {
+	std::string start(this->space_);
+	if (last != NULL) {
+		// The smallest key after the last moved one
+		start.append(*last);
+		start.push_back('\0');
+	}
+	const std::string first = epochKey(0);
+	AbstractKeyValueIterator * it = this->storage_.createRangeIterator(
+			(const unsigned char *) start.data(), start.size(), NULL, 0);
+	const bool ordered = it->isOrdered();
+	std::string key;
+	for (; it->valid(); it->next()) {
+		key.resize(it->keySize());
+		it->key((unsigned char *) &key[0]);
+		if (key.compare(0, this->space_.size(), this->space_) != 0) {
+			if (ordered) {
+				break;
+			}
+			continue;
+		}
+		if (key == this->upgradeKey_ || (last != NULL && key.compare(0,
+				first.size(), first) == 0 && key.compare(first.size(),
+				std::string::npos, *last) <= 0)) {
+			// Already moved by a former step
+			continue;
+		}
+		if (entries.size() == UPGRADE_STEP) {
+			// Unordered iterators have to be scanned for the smallest keys
+			if (key >= entries.rbegin()->first) {
+				continue;
+			}
+			entries.erase(--entries.end());
+		}
+		std::string& value = entries[key];
+		value.resize(it->valueSize());
+		if (value.size() > 0) {
+			it->value((unsigned char *) &value[0]);
+		}
+		if (ordered && entries.size() == UPGRADE_STEP) {
+			break;
+		}
+	}
+	delete it;
+}
+
+void EpochStorage::upgradeStorage() {
+	std::string last;
+	bool resumed = false;
+	unsigned char * value;
+	std::size_t valueSize;
+	if (this->storage_.get((const unsigned char *) this->upgradeKey_.data(),
+			this->upgradeKey_.size(), &value, &valueSize)) {
+		last.assign((const char *) value, valueSize);
+		free(value);
+		resumed = true;
+	}
+	this->epoch_ = 0;
+	this->oldestEpoch_ = 0;
+	const std::string first = epochKey(0);
+	std::map<std::string, std::string> entries;
+	do {
+		// Collect the entries first, the storage is changed afterwards
+		entries.clear();
+		collectUpgradeStep(resumed ? &last : NULL, entries);
+		StorageBatch batch(this->storage_);
+		std::map<std::string, std::string>::const_iterator it;
+		for (it = entries.begin(); it != entries.end(); it++) {
+			std::string moved(first);
+			moved.append(it->first, this->space_.size(), std::string::npos);
+			this->storage_.del((const unsigned char *) it->first.data(),
+					it->first.size());
+			this->storage_.put((const unsigned char *) moved.data(),
+					moved.size(), (const unsigned char *) it->second.data(),
+					it->second.size());
+		}
+		if (entries.size() == UPGRADE_STEP) {
+			last.assign(entries.rbegin()->first, this->space_.size(),
+					std::string::npos);
+			resumed = true;
+			this->storage_.put((const unsigned char *) this->upgradeKey_.data(),
+					this->upgradeKey_.size(),
+					(const unsigned char *) last.data(), last.size());
+		} else {
+			if (resumed) {
+				this->storage_.del(
+						(const unsigned char *) this->upgradeKey_.data(),
+						this->upgradeKey_.size());
+			}
+			storeEpochs();
+		}
+		batch.commit();
+	} while (entries.size() == UPGRADE_STEP);
+}
+
+void EpochStorage::reset() {
+	std::vector<std::string> keys;
+	const std::string first = epochKey(0);
+	AbstractKeyValueIterator * it = this->storage_.createRangeIterator(
+			(const unsigned char *) first.data(), first.size(),
+			(const unsigned char *) this->metaKey_.data(),
+			this->metaKey_.size());
+	std::string key;
+	for (; it->valid(); it->next()) {
+		key.resize(it->keySize());
+		it->key((unsigned char *) &key[0]);
+		keys.push_back(key);
+	}
+	delete it;
+	StorageBatch batch(this->storage_);
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		this->storage_.del((const unsigned char *) keys[i].data(),
+				keys[i].size());
+	}
+	this->epoch_ = 0;
+	this->oldestEpoch_ = 0;
+	storeEpochs();
+	batch.commit();
+	setPrefix(first);
+}
+
+void EpochStorage::written() {
+	this->writes_++;
+	reclaimStep();
+}
+
+void EpochStorage::reclaimStep() {
+	// Inside a batch, the step is done after it has been committed
+	if (this->writes_ < RECLAIM_INTERVAL || this->storage_.isBatchRunning()) {
+		return;
+	}
+	this->writes_ = 0;
+	if (this->oldestEpoch_ != this->epoch_) {
+		reclaim(RECLAIM_STEP);
+	}
+}
+
+void EpochStorage::put(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize) {
+	PrefixStorage::put(key, keySize, value, valueSize);
+	written();
+}
+
+void EpochStorage::del(const unsigned char * key, const std::size_t keySize) {
+	PrefixStorage::del(key, keySize);
+	written();
+}
+
+void EpochStorage::clear(void) {
+	if (this->epoch_ + 1 == META_EPOCH) {
+		reset();
+		return;
+	}
+	this->epoch_++;
+	storeEpochs();
+	setPrefix(epochKey(this->epoch_));
+}
+
+void EpochStorage::commitBatch() {
+	PrefixStorage::commitBatch();
+	reclaimStep();
+}
+
+void EpochStorage::abortBatch() {
+	PrefixStorage::abortBatch();
+	if (!isBatchRunning() && loadEpochs()) {
+		setPrefix(epochKey(this->epoch_));
+	}
+}
+
+bool EpochStorage::reclaim(const std::size_t maxEntries) {
+	if (this->oldestEpoch_ == this->epoch_) {
+		return true;
+	}
+	if (this->storage_.isBatchRunning()) {
+		// Iterators don't see the changes of the batch
+		return false;
+	}
+	std::vector<std::string> keys;
+	const std::string oldest = epochKey(this->oldestEpoch_);
+	const std::string actual = epochKey(this->epoch_);
+	AbstractKeyValueIterator * it = this->storage_.createRangeIterator(
+			(const unsigned char *) oldest.data(), oldest.size(),
+			(const unsigned char *) actual.data(), actual.size());
+	std::string key;
+	for (; it->valid() && keys.size() < maxEntries; it->next()) {
+		key.resize(it->keySize());
+		it->key((unsigned char *) &key[0]);
+		keys.push_back(key);
+	}
+	const bool finished = !it->valid();
+	delete it;
+	StorageBatch batch(this->storage_);
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		this->storage_.del((const unsigned char *) keys[i].data(),
+				keys[i].size());
+	}
+	if (finished) {
+		this->oldestEpoch_ = this->epoch_;
+		storeEpochs();
+	}
+	batch.commit();
+	return finished;
+}
+
+uint32_t EpochStorage::getEpoch() const {
+	return this->epoch_;
+}
+
+}
+
+}
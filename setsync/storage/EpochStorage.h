@@ -0,0 +1,141 @@
+/*
+ * EpochStorage.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef EPOCHSTORAGE_H_
+#define EPOCHSTORAGE_H_
+
+#include "PrefixStorage.h"
+#include <map>
+#include <stdint.h>
+
+namespace setsync {
+
+namespace storage {
+
+/**
+ * A storage, whose keys carry the number of the actual epoch as prefix.
+ * clear() only starts a new epoch by writing a single record, so it
+ * doesn't depend on the number of entries. The entries of former epochs
+ * are invisible and get deleted incrementally during the following writes,
+ * or by calling reclaim(). The entries of an epoch are only neighbours on
+ * ordered storages, like LevelDbStorage or LmdbStorage, so it shouldn't
+ * be used on top of other storages.
+ */
+class EpochStorage: public PrefixStorage {
+public:
+	/// Number of writes between two incremental reclaim steps
+	static const std::size_t RECLAIM_INTERVAL = 256;
+	/// Maximum number of old entries deleted by one reclaim step
+	static const std::size_t RECLAIM_STEP = 1024;
+	/// Maximum number of entries moved by one batch of the upgrade
+	static const std::size_t UPGRADE_STEP = 1024;
+private:
+	/// The epoch of the record holding the epochs, it is never used for entries
+	static const uint32_t META_EPOCH = 0xffffffff;
+	/// Prefix of the keyspace inside the storage
+	std::string space_;
+	/// Key of the record holding the actual and the oldest epoch
+	std::string metaKey_;
+	/// Key of the record holding the last entry moved by the upgrade
+	std::string upgradeKey_;
+	/// Epoch of the visible entries
+	uint32_t epoch_;
+	/// Oldest epoch, which could still have entries
+	uint32_t oldestEpoch_;
+	/// Number of writes since the last reclaim step
+	std::size_t writes_;
+	/**
+	 * \return the prefix of all keys of the given epoch
+	 */
+	std::string epochKey(const uint32_t epoch) const;
+	/**
+	 * Reads the epochs from the storage
+	 *
+	 * \return false, if the storage has no epochs yet
+	 */
+	bool loadEpochs();
+	/**
+	 * Writes the epochs to the storage
+	 */
+	void storeEpochs();
+	/**
+	 * Collects the smallest entries of a storage written without epochs,
+	 * which haven't been moved by the upgrade yet
+	 *
+	 * \param last key moved by the upgrade without the keyspace, NULL if
+	 * no entry has been moved yet
+	 * \param entries gets at most UPGRADE_STEP entries
+	 */
+	void collectUpgradeStep(const std::string * last, std::map<std::string,
+			std::string>& entries);
+	/**
+	 * Moves all entries of a storage, which has been written without
+	 * epochs, into the first epoch. Each step of UPGRADE_STEP entries is
+	 * written by a batch, which saves the last moved key, so an
+	 * interrupted upgrade resumes after it.
+	 */
+	void upgradeStorage();
+	/**
+	 * Deletes the entries of all epochs and starts again with the first
+	 * one, if the epochs are exhausted
+	 */
+	void reset();
+	/**
+	 * Counts a write and reclaims some old entries, if it's time to
+	 */
+	void written();
+	/**
+	 * Reclaims some old entries, if there have been enough writes since
+	 * the last step and no batch is running
+	 */
+	void reclaimStep();
+	EpochStorage(const EpochStorage&);
+	EpochStorage& operator=(const EpochStorage&);
+public:
+	/**
+	 * \param storage which holds the entries of all epochs
+	 * \param space distinct prefix of this keyspace, if the storage is
+	 * shared with other keyspaces
+	 */
+	EpochStorage(AbstractKeyValueStorage& storage, const std::string& space =
+			"");
+	virtual ~EpochStorage();
+	virtual void put(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	virtual void del(const unsigned char * key, const std::size_t keySize);
+	/**
+	 * Starts a new epoch, the entries of the old ones are deleted later
+	 */
+	virtual void clear(void);
+	/**
+	 * Commits the batch and reclaims some old entries, if a reclaim step
+	 * has been put off by the batch
+	 */
+	virtual void commitBatch();
+	/**
+	 * Aborts the batch and restores the epoch, if a clear() has been
+	 * discarded with it
+	 */
+	virtual void abortBatch();
+	/**
+	 * Deletes entries of former epochs. Nothing is done, while a batch is
+	 * running on the storage.
+	 *
+	 * \param maxEntries maximum number of entries to be deleted
+	 * \return true, if there are no more entries of former epochs
+	 */
+	bool reclaim(const std::size_t maxEntries = RECLAIM_STEP);
+	/**
+	 * \return the actual epoch
+	 */
+	uint32_t getEpoch() const;
+};
+
+}
+
+}
+
+#endif /* EPOCHSTORAGE_H_ */
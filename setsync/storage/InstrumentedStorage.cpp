@@ -0,0 +1,258 @@
+/*
+ * InstrumentedStorage.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "InstrumentedStorage.h"
+#include <string.h>
+#include <time.h>
+
+namespace setsync {
+
+namespace storage {
+
+const std::size_t StorageStatistics::LATENCY_BUCKETS;
+const unsigned int InstrumentedStorage::LATENCY_SAMPLE_INTERVAL;
+
+StorageStatistics::StorageStatistics() {
+	reset();
+}
+
+void StorageStatistics::reset() {
+	this->gets = 0;
+	this->hits = 0;
+	this->puts = 0;
+	this->dels = 0;
+	this->clears = 0;
+	this->commits = 0;
+	this->scans = 0;
+	this->scannedEntries = 0;
+	this->bytesRead = 0;
+	this->bytesWritten = 0;
+	memset(this->readLatency, 0, sizeof(this->readLatency));
+	memset(this->writeLatency, 0, sizeof(this->writeLatency));
+}
+
+InstrumentedIterator::InstrumentedIterator(AbstractKeyValueIterator * it,
+		StorageStatistics& statistics) :
+	it_(it), statistics_(statistics), scannedEntries_(0), bytesRead_(0) {
+	this->statistics_.scans++;
+}
+
+InstrumentedIterator::~InstrumentedIterator() {
+	this->statistics_.scannedEntries += this->scannedEntries_;
+	this->statistics_.bytesRead += this->bytesRead_;
+	delete this->it_;
+}
+
+void InstrumentedIterator::seekToFirst() {
+	this->it_->seekToFirst();
+}
+
+bool InstrumentedIterator::valid() const {
+	return this->it_->valid();
+}
+
+void InstrumentedIterator::next() {
+	this->scannedEntries_++;
+	this->it_->next();
+}
+
+size_t InstrumentedIterator::keySize() const {
+	return this->it_->keySize();
+}
+
+void InstrumentedIterator::key(unsigned char * buffer) const {
+	this->it_->key(buffer);
+}
+
+size_t InstrumentedIterator::valueSize() const {
+	return this->it_->valueSize();
+}
+
+void InstrumentedIterator::value(unsigned char * buffer) const {
+	this->bytesRead_ += this->it_->valueSize();
+	this->it_->value(buffer);
+}
+
+void InstrumentedIterator::seek(const unsigned char * key,
+		const std::size_t length) {
+	this->it_->seek(key, length);
+}
+
+bool InstrumentedIterator::isOrdered() const {
+	return this->it_->isOrdered();
+}
+
+InstrumentedStorage::InstrumentedStorage(AbstractKeyValueStorage& storage) :
+	storage_(storage), readSamples_(0), writeSamples_(0) {
+}
+
+InstrumentedStorage::~InstrumentedStorage() {
+}
+
+bool InstrumentedStorage::sampleRead() const {
+	if (++this->readSamples_ < LATENCY_SAMPLE_INTERVAL) {
+		return false;
+	}
+	this->readSamples_ = 0;
+	return true;
+}
+
+bool InstrumentedStorage::sampleWrite() {
+	if (++this->writeSamples_ < LATENCY_SAMPLE_INTERVAL) {
+		return false;
+	}
+	this->writeSamples_ = 0;
+	return true;
+}
+
+uint64_t InstrumentedStorage::now() {
+	timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return (uint64_t) time.tv_sec * 1000000000 + time.tv_nsec;
+}
+
+void InstrumentedStorage::record(uint64_t * histogram, const uint64_t start) {
+	uint64_t duration = now() - start;
+	std::size_t bucket = 0;
+	while (duration > 1 && bucket + 1 < StorageStatistics::LATENCY_BUCKETS) {
+		duration >>= 1;
+		bucket++;
+	}
+	histogram[bucket]++;
+}
+
+bool InstrumentedStorage::get(const unsigned char * key,
+		const std::size_t length, unsigned char ** value,
+		std::size_t * valueSize) const {
+	const bool timed = sampleRead();
+	const uint64_t start = timed ? now() : 0;
+	const bool found = this->storage_.get(key, length, value, valueSize);
+	if (timed) {
+		record(this->statistics_.readLatency, start);
+	}
+	this->statistics_.gets++;
+	if (found) {
+		this->statistics_.hits++;
+		this->statistics_.bytesRead += *valueSize;
+	}
+	return found;
+}
+
+bool InstrumentedStorage::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	const bool timed = sampleRead();
+	const uint64_t start = timed ? now() : 0;
+	const bool found = this->storage_.getInto(key, length, buffer, bufferSize,
+			valueSize);
+	if (timed) {
+		record(this->statistics_.readLatency, start);
+	}
+	this->statistics_.gets++;
+	if (found) {
+		this->statistics_.hits++;
+		this->statistics_.bytesRead += *valueSize;
+	}
+	return found;
+}
+
+std::size_t InstrumentedStorage::multiGet(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t count,
+		unsigned char * values, const std::size_t valueStride,
+		std::size_t * valueSizes, bool * found) const {
+	const bool timed = sampleRead();
+	const uint64_t start = timed ? now() : 0;
+	const std::size_t hits = this->storage_.multiGet(keys, keyLength, count,
+			values, valueStride, valueSizes, found);
+	if (timed) {
+		record(this->statistics_.readLatency, start);
+	}
+	this->statistics_.gets += count;
+	this->statistics_.hits += hits;
+	for (std::size_t i = 0; i < count; i++) {
+		if (found[i]) {
+			this->statistics_.bytesRead += valueSizes[i];
+		}
+	}
+	return hits;
+}
+
+void InstrumentedStorage::put(const unsigned char * key,
+		const std::size_t keySize, const unsigned char * value,
+		const std::size_t valueSize) {
+	const bool timed = sampleWrite();
+	const uint64_t start = timed ? now() : 0;
+	this->storage_.put(key, keySize, value, valueSize);
+	if (timed) {
+		record(this->statistics_.writeLatency, start);
+	}
+	this->statistics_.puts++;
+	this->statistics_.bytesWritten += keySize + valueSize;
+}
+
+void InstrumentedStorage::del(const unsigned char * key,
+		const std::size_t keySize) {
+	const bool timed = sampleWrite();
+	const uint64_t start = timed ? now() : 0;
+	this->storage_.del(key, keySize);
+	if (timed) {
+		record(this->statistics_.writeLatency, start);
+	}
+	this->statistics_.dels++;
+	this->statistics_.bytesWritten += keySize;
+}
+
+void InstrumentedStorage::clear(void) {
+	const uint64_t start = now();
+	this->storage_.clear();
+	record(this->statistics_.writeLatency, start);
+	this->statistics_.clears++;
+}
+
+bool InstrumentedStorage::isConcurrentlyReadable() const {
+	return this->storage_.isConcurrentlyReadable();
+}
+
+void InstrumentedStorage::beginBatch() {
+	this->storage_.beginBatch();
+	AbstractKeyValueStorage::beginBatch();
+}
+
+void InstrumentedStorage::commitBatch() {
+	if (this->batchDepth_ != 1) {
+		this->storage_.commitBatch();
+		AbstractKeyValueStorage::commitBatch();
+		return;
+	}
+	// The outermost commit writes the batch, so it's always timed
+	const uint64_t start = now();
+	this->storage_.commitBatch();
+	record(this->statistics_.writeLatency, start);
+	this->statistics_.commits++;
+	AbstractKeyValueStorage::commitBatch();
+}
+
+void InstrumentedStorage::abortBatch() {
+	this->storage_.abortBatch();
+	AbstractKeyValueStorage::abortBatch();
+}
+
+AbstractKeyValueIterator * InstrumentedStorage::createIterator() {
+	return new InstrumentedIterator(this->storage_.createIterator(),
+			this->statistics_);
+}
+
+const StorageStatistics& InstrumentedStorage::getStatistics() const {
+	return this->statistics_;
+}
+
+void InstrumentedStorage::resetStatistics() {
+	this->statistics_.reset();
+}
+
+}
+
+}
@@ -0,0 +1,184 @@
+/*
+ * InstrumentedStorage.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef INSTRUMENTEDSTORAGE_H_
+#define INSTRUMENTEDSTORAGE_H_
+
+#include "KeyValueStorage.h"
+#include <stdint.h>
+
+namespace setsync {
+
+namespace storage {
+
+/**
+ * Operation counts, byte volumes and latencies of a storage
+ */
+struct StorageStatistics {
+	/// Number of buckets of the latency histograms
+	static const std::size_t LATENCY_BUCKETS = 32;
+	/// Number of looked up keys, including those of multiGet()
+	uint64_t gets;
+	/// Number of looked up keys, which have been found
+	uint64_t hits;
+	/// Number of put calls
+	uint64_t puts;
+	/// Number of del calls
+	uint64_t dels;
+	/// Number of clear calls
+	uint64_t clears;
+	/// Number of committed outermost batches
+	uint64_t commits;
+	/// Number of created iterators
+	uint64_t scans;
+	/// Number of entries passed by iterators
+	uint64_t scannedEntries;
+	/// Bytes of the found values and of the values read by iterators
+	uint64_t bytesRead;
+	/// Bytes of the keys and values, which have been put or deleted
+	uint64_t bytesWritten;
+	/**
+	 * Latencies of sampled reads. Bucket i counts the reads, which took
+	 * between 2^i and 2^(i+1) nanoseconds, the last one all slower reads.
+	 */
+	uint64_t readLatency[LATENCY_BUCKETS];
+	/// Latencies of sampled writes and commits, see readLatency
+	uint64_t writeLatency[LATENCY_BUCKETS];
+	/**
+	 * Creates empty statistics
+	 */
+	StorageStatistics();
+	/**
+	 * Sets all counters to 0
+	 */
+	void reset();
+};
+
+/**
+ * Passes the entries of another iterator and counts the bytes read. The
+ * counts are added to the statistics, when the iterator is deleted, so
+ * iterators used by other threads don't share any counter.
+ */
+class InstrumentedIterator: public AbstractKeyValueIterator {
+private:
+	/// The counted iterator
+	AbstractKeyValueIterator * it_;
+	/// Statistics to be updated
+	StorageStatistics& statistics_;
+	/// Number of entries passed so far
+	uint64_t scannedEntries_;
+	/// Bytes of the values read so far
+	mutable uint64_t bytesRead_;
+	InstrumentedIterator(const InstrumentedIterator&);
+	InstrumentedIterator& operator=(const InstrumentedIterator&);
+public:
+	/**
+	 * \param it iterator to be counted, which is deleted by this one
+	 * \param statistics to be updated
+	 */
+	InstrumentedIterator(AbstractKeyValueIterator * it,
+			StorageStatistics& statistics);
+	virtual ~InstrumentedIterator();
+	virtual void seekToFirst();
+	virtual bool valid() const;
+	virtual void next();
+	virtual size_t keySize() const;
+	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
+};
+
+/**
+ * Passes all operations to another storage and records their counts,
+ * byte volumes and latencies. Counting costs a few additions per
+ * operation. Reading the clock costs more than that, so only every
+ * LATENCY_SAMPLE_INTERVAL-th operation is timed.
+ */
+class InstrumentedStorage: public setsync::storage::AbstractKeyValueStorage {
+public:
+	/// Every n-th read and every n-th write is timed
+	static const unsigned int LATENCY_SAMPLE_INTERVAL = 16;
+private:
+	/// The instrumented storage
+	AbstractKeyValueStorage& storage_;
+	/// Recorded statistics, reads are counted by const methods
+	mutable StorageStatistics statistics_;
+	/// Number of reads since the last timed one
+	mutable unsigned int readSamples_;
+	/// Number of writes since the last timed one
+	unsigned int writeSamples_;
+	/**
+	 * \return true, if the actual read should be timed
+	 */
+	bool sampleRead() const;
+	/**
+	 * \return true, if the actual write should be timed
+	 */
+	bool sampleWrite();
+	/**
+	 * \return a monotonic timestamp in nanoseconds
+	 */
+	static uint64_t now();
+	/**
+	 * Adds the time since start to the given histogram
+	 */
+	static void record(uint64_t * histogram, const uint64_t start);
+	InstrumentedStorage(const InstrumentedStorage&);
+	InstrumentedStorage& operator=(const InstrumentedStorage&);
+public:
+	/**
+	 * \param storage to be instrumented
+	 */
+	InstrumentedStorage(AbstractKeyValueStorage& storage);
+	virtual ~InstrumentedStorage();
+	virtual bool get(const unsigned char * key, const std::size_t length,
+			unsigned char ** value, std::size_t * valueSize) const;
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
+	/**
+	 * Passes all keys to multiGet() of the instrumented storage, the call
+	 * is timed as a single read
+	 */
+	virtual std::size_t multiGet(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t count,
+			unsigned char * values, const std::size_t valueStride,
+			std::size_t * valueSizes, bool * found) const;
+	virtual void put(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	virtual void del(const unsigned char * key, const std::size_t keySize);
+	virtual void clear(void);
+	/**
+	 * \return true, if the instrumented storage is concurrently readable
+	 */
+	virtual bool isConcurrentlyReadable() const;
+	/**
+	 * Starts a batch on the instrumented storage
+	 */
+	virtual void beginBatch();
+	/**
+	 * Commits the batch, the outermost commit is always timed
+	 */
+	virtual void commitBatch();
+	virtual void abortBatch();
+	virtual AbstractKeyValueIterator * createIterator();
+	/**
+	 * \return the statistics recorded since the creation or the last reset
+	 */
+	const StorageStatistics& getStatistics() const;
+	/**
+	 * Sets all statistics to 0
+	 */
+	void resetStatistics();
+};
+
+}
+
+}
+
+#endif /* INSTRUMENTEDSTORAGE_H_ */
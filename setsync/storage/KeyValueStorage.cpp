@@ -5,17 +5,361 @@
  */
 
 #include "KeyValueStorage.h"
+#include "StorageException.h"
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
 
 namespace setsync {
 
 namespace storage {
 
-AbstractKeyValueStorage::AbstractKeyValueStorage() {
+int AbstractKeyValueIterator::compare(const unsigned char * a,
+		const std::size_t aLength, const unsigned char * b,
+		const std::size_t bLength) {
+	const std::size_t length = aLength < bLength ? aLength : bLength;
+	int result = length > 0 ? memcmp(a, b, length) : 0;
+	if (result != 0) {
+		return result;
+	}
+	return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+KeyRangeIterator::KeyRangeIterator(AbstractKeyValueIterator * it,
+		const unsigned char * start, const std::size_t startSize,
+		const unsigned char * limit, const std::size_t limitSize) :
+	it_(it), start_((const char *) start, startSize), limited_(limit != NULL),
+			valid_(false) {
+	if (limit != NULL) {
+		this->limit_.assign((const char *) limit, limitSize);
+	}
+	seekToFirst();
+}
+
+KeyRangeIterator::~KeyRangeIterator() {
+	delete this->it_;
+}
+
+void KeyRangeIterator::skipToRange() {
+	const bool ordered = this->it_->isOrdered();
+	while (this->it_->valid()) {
+		this->key_.resize(this->it_->keySize());
+		if (this->key_.size() > 0) {
+			this->it_->key((unsigned char *) &this->key_[0]);
+		}
+		const bool beforeLimit = !this->limited_ || compare(
+				(const unsigned char *) this->key_.data(), this->key_.size(),
+				(const unsigned char *) this->limit_.data(),
+				this->limit_.size()) < 0;
+		if (ordered && !beforeLimit) {
+			// All following keys are behind the limit too
+			break;
+		}
+		if (beforeLimit && compare((const unsigned char *) this->key_.data(),
+				this->key_.size(), (const unsigned char *) this->start_.data(),
+				this->start_.size()) >= 0) {
+			this->valid_ = true;
+			return;
+		}
+		this->it_->next();
+	}
+	this->valid_ = false;
+}
+
+void KeyRangeIterator::seekToFirst() {
+	if (this->start_.size() > 0) {
+		this->it_->seek((const unsigned char *) this->start_.data(),
+				this->start_.size());
+	} else {
+		this->it_->seekToFirst();
+	}
+	skipToRange();
+}
+
+void KeyRangeIterator::seek(const unsigned char * key, const std::size_t length) {
+	if (compare(key, length, (const unsigned char *) this->start_.data(),
+			this->start_.size()) < 0) {
+		seekToFirst();
+		return;
+	}
+	this->it_->seek(key, length);
+	skipToRange();
+}
+
+bool KeyRangeIterator::valid() const {
+	return this->valid_;
+}
+
+void KeyRangeIterator::next() {
+	this->it_->next();
+	skipToRange();
+}
+
+size_t KeyRangeIterator::keySize() const {
+	return this->key_.size();
+}
+
+void KeyRangeIterator::key(unsigned char * buffer) const {
+	memcpy(buffer, this->key_.data(), this->key_.size());
+}
+
+size_t KeyRangeIterator::valueSize() const {
+	return this->it_->valueSize();
+}
+
+void KeyRangeIterator::value(unsigned char * buffer) const {
+	this->it_->value(buffer);
+}
+
+bool KeyRangeIterator::isOrdered() const {
+	return this->it_->isOrdered();
+}
+
+AbstractKeyValueStorage::AbstractKeyValueStorage() :
+	batchDepth_(0) {
 }
 
 AbstractKeyValueStorage::~AbstractKeyValueStorage() {
 }
 
+void AbstractKeyValueStorage::beginBatch() {
+	this->batchDepth_++;
+}
+
+void AbstractKeyValueStorage::commitBatch() {
+	if (this->batchDepth_ == 0) {
+		throw StorageException("No batch has been started");
+	}
+	this->batchDepth_--;
+	if (this->batchDepth_ > 0) {
+		return;
+	}
+	Batch batch;
+	batch.swap(this->batch_);
+	writeBatch(batch);
+}
+
+void AbstractKeyValueStorage::abortBatch() {
+	this->batchDepth_ = 0;
+	this->batch_.clear();
+}
+
+bool AbstractKeyValueStorage::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	unsigned char * value;
+	if (!get(key, length, &value, valueSize)) {
+		*valueSize = 0;
+		return false;
+	}
+	if (*valueSize <= bufferSize) {
+		memcpy(buffer, value, *valueSize);
+	}
+	free(value);
+	return true;
+}
+
+bool AbstractKeyValueStorage::isBatchRunning() const {
+	return this->batchDepth_ > 0;
+}
+
+bool AbstractKeyValueStorage::isConcurrentlyReadable() const {
+	return false;
+}
+
+bool AbstractKeyValueStorage::batchPut(const unsigned char * key,
+		const std::size_t keySize, const unsigned char * value,
+		const std::size_t valueSize) {
+	if (this->batchDepth_ == 0) {
+		return false;
+	}
+	BatchEntry& entry = this->batch_[std::string((const char *) key, keySize)];
+	entry.value.assign((const char *) value, valueSize);
+	entry.deleted = false;
+	return true;
+}
+
+bool AbstractKeyValueStorage::batchDel(const unsigned char * key,
+		const std::size_t keySize) {
+	if (this->batchDepth_ == 0) {
+		return false;
+	}
+	BatchEntry& entry = this->batch_[std::string((const char *) key, keySize)];
+	entry.value.clear();
+	entry.deleted = true;
+	return true;
+}
+
+bool AbstractKeyValueStorage::batchGet(const unsigned char * key,
+		const std::size_t length, unsigned char ** value,
+		std::size_t * valueSize, bool * found) const {
+	if (this->batch_.empty()) {
+		return false;
+	}
+	Batch::const_iterator it = this->batch_.find(
+			std::string((const char *) key, length));
+	if (it == this->batch_.end()) {
+		return false;
+	}
+	if (it->second.deleted) {
+		*value = NULL;
+		*valueSize = 0;
+		*found = false;
+	} else {
+		*valueSize = it->second.value.size();
+		*value = (unsigned char *) malloc(*valueSize);
+		memcpy(*value, it->second.value.data(), *valueSize);
+		*found = true;
+	}
+	return true;
+}
+
+bool AbstractKeyValueStorage::batchGetInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize, bool * found) const {
+	if (this->batch_.empty()) {
+		return false;
+	}
+	Batch::const_iterator it = this->batch_.find(
+			std::string((const char *) key, length));
+	if (it == this->batch_.end()) {
+		return false;
+	}
+	if (it->second.deleted) {
+		*valueSize = 0;
+		*found = false;
+	} else {
+		*valueSize = it->second.value.size();
+		if (*valueSize <= bufferSize) {
+			memcpy(buffer, it->second.value.data(), *valueSize);
+		}
+		*found = true;
+	}
+	return true;
+}
+
+void AbstractKeyValueStorage::writeBatch(const Batch& batch) {
+	for (Batch::const_iterator it = batch.begin(); it != batch.end(); it++) {
+		const unsigned char * key = (const unsigned char *) it->first.data();
+		if (it->second.deleted) {
+			del(key, it->first.size());
+		} else {
+			put(key, it->first.size(),
+					(const unsigned char *) it->second.value.data(),
+					it->second.value.size());
+		}
+	}
+}
+
+std::size_t AbstractKeyValueStorage::multiGet(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t count,
+		unsigned char * values, const std::size_t valueStride,
+		std::size_t * valueSizes, bool * found) const {
+	std::vector<std::size_t> indices;
+	indices.reserve(count);
+	for (std::size_t i = 0; i < count; i++) {
+		if (!batchGetInto(keys + i * keyLength, keyLength,
+				values + i * valueStride, valueStride, &valueSizes[i],
+				&found[i])) {
+			valueSizes[i] = 0;
+			found[i] = false;
+			indices.push_back(i);
+		}
+	}
+	if (!indices.empty()) {
+		multiRead(keys, keyLength, &indices[0], indices.size(), values,
+				valueStride, valueSizes, found);
+	}
+	std::size_t result = 0;
+	for (std::size_t i = 0; i < count; i++) {
+		if (found[i]) {
+			result++;
+		}
+	}
+	return result;
+}
+
+void AbstractKeyValueStorage::multiRead(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t * indices,
+		const std::size_t count, unsigned char * values,
+		const std::size_t valueStride, std::size_t * valueSizes,
+		bool * found) const {
+	for (std::size_t i = 0; i < count; i++) {
+		const std::size_t index = indices[i];
+		found[index] = getInto(keys + index * keyLength, keyLength,
+				values + index * valueStride, valueStride, &valueSizes[index]);
+	}
+}
+
+/**
+ * Orders indices by the keys, they point to
+ */
+class KeyIndexLess {
+private:
+	const unsigned char * keys_;
+	std::size_t keyLength_;
+public:
+	KeyIndexLess(const unsigned char * keys, const std::size_t keyLength) :
+		keys_(keys), keyLength_(keyLength) {
+	}
+	bool operator()(const std::size_t a, const std::size_t b) const {
+		return memcmp(keys_ + a * keyLength_, keys_ + b * keyLength_,
+				keyLength_) < 0;
+	}
+};
+
+void AbstractKeyValueStorage::sortByKey(const unsigned char * keys,
+		const std::size_t keyLength, std::size_t * indices,
+		const std::size_t count) {
+	std::sort(indices, indices + count, KeyIndexLess(keys, keyLength));
+}
+
+AbstractKeyValueIterator * AbstractKeyValueStorage::createRangeIterator(
+		const unsigned char * start, const std::size_t startSize,
+		const unsigned char * limit, const std::size_t limitSize) {
+	return new KeyRangeIterator(createIterator(), start, startSize, limit,
+			limitSize);
+}
+
+AbstractKeyValueIterator * AbstractKeyValueStorage::createPrefixIterator(
+		const unsigned char * prefix, const std::size_t length) {
+	// The limit is the smallest key, which is greater than all keys with
+	// the prefix. Prefixes of 0xff bytes only are open to the end.
+	std::string limit((const char *) prefix, length);
+	while (limit.size() > 0 && (unsigned char) limit[limit.size() - 1]
+			== 0xff) {
+		limit.resize(limit.size() - 1);
+	}
+	if (limit.size() == 0) {
+		return createRangeIterator(prefix, length, NULL, 0);
+	}
+	limit[limit.size() - 1] = (char) ((unsigned char) limit[limit.size() - 1]
+			+ 1);
+	return createRangeIterator(prefix, length,
+			(const unsigned char *) limit.data(), limit.size());
+}
+
+StorageBatch::StorageBatch(AbstractKeyValueStorage& storage) :
+	storage_(storage), open_(true) {
+	this->storage_.beginBatch();
+}
+
+StorageBatch::~StorageBatch() {
+	if (this->open_) {
+		try {
+			this->storage_.abortBatch();
+		} catch (...) {
+			// Nothing can be done about it in a destructor
+		}
+	}
+}
+
+void StorageBatch::commit() {
+	this->storage_.commitBatch();
+	this->open_ = false;
+}
+
 }
 
 }
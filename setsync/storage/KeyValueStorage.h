@@ -7,6 +7,8 @@
 #ifndef KEYVALUESTORAGE_H_
 #define KEYVALUESTORAGE_H_
 #include <setsync/crypto/CryptoHash.h>
+#include <map>
+#include <string>
 namespace setsync {
 
 namespace storage {
@@ -16,6 +18,8 @@ namespace storage {
  */
 class AbstractKeyValueIterator {
 public:
+	virtual ~AbstractKeyValueIterator() {
+	}
 	/**
 	 * Resets the Iterator position to the first position
 	 */
@@ -39,6 +43,97 @@ public:
 	 * \param buffer where the key should be copied to
 	 */
 	virtual void key(unsigned char * buffer) const = 0;
+	/**
+	 * \return the size in bytes of the actual value
+	 */
+	virtual size_t valueSize() const = 0;
+	/**
+	 * Copies the actual value with the valueSize() to a given
+	 * allocated memory, so a full scan doesn't need a get per entry
+	 *
+	 * \param buffer where the value should be copied to
+	 */
+	virtual void value(unsigned char * buffer) const = 0;
+	/**
+	 * Moves the iterator to the first entry, whose key isn't smaller than
+	 * the given one. Keys are compared bytewise, a key is greater than its
+	 * prefixes. Iterators of unordered storages, see isOrdered(), can't
+	 * seek and start at the first entry instead.
+	 *
+	 * \param key to seek to
+	 * \param length of the given key
+	 */
+	virtual void seek(const unsigned char * /* key */,
+			const std::size_t /* length */) {
+		seekToFirst();
+	}
+	/**
+	 * \return true, if the entries are passed ordered by their keys
+	 */
+	virtual bool isOrdered() const {
+		return false;
+	}
+	/**
+	 * Compares two keys bytewise in the order used by the iterators
+	 *
+	 * \return a negative number, 0 or a positive number, if the first key
+	 * is smaller, equal or greater than the second one
+	 */
+	static int compare(const unsigned char * a, const std::size_t aLength,
+			const unsigned char * b, const std::size_t bLength);
+};
+
+/**
+ * Passes the entries of another iterator, whose keys are inside the
+ * range [start, limit). On ordered iterators, the range is read
+ * sequentially by seeking to its start and stopping at its limit. Other
+ * iterators are filtered entry by entry.
+ */
+class KeyRangeIterator: public AbstractKeyValueIterator {
+private:
+	/// The iterator over the complete storage
+	AbstractKeyValueIterator * it_;
+	/// First key of the range
+	std::string start_;
+	/// First key behind the range
+	std::string limit_;
+	/// false, if the range is open to the end
+	bool limited_;
+	/// The actual key
+	std::string key_;
+	/// true, if the iterator points to an entry of the range
+	bool valid_;
+	/**
+	 * Moves the iterator to the next entry of the range, starting at
+	 * the actual one
+	 */
+	void skipToRange();
+	KeyRangeIterator(const KeyRangeIterator&);
+	KeyRangeIterator& operator=(const KeyRangeIterator&);
+public:
+	/**
+	 * \param it iterator over the storage, which is deleted by this one
+	 * \param start first key of the range
+	 * \param startSize of the start key, 0 to start at the first entry
+	 * \param limit first key behind the range, NULL if it's open
+	 * \param limitSize of the limit key
+	 */
+	KeyRangeIterator(AbstractKeyValueIterator * it,
+			const unsigned char * start, const std::size_t startSize,
+			const unsigned char * limit, const std::size_t limitSize);
+	virtual ~KeyRangeIterator();
+	virtual void seekToFirst();
+	virtual bool valid() const;
+	virtual void next();
+	virtual size_t keySize() const;
+	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	/**
+	 * Seeks inside the range, keys before it seek to its start
+	 */
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
 };
 /**
  * A generic interface for key-value storages
@@ -64,6 +159,45 @@ public:
 	 */
 	virtual bool get(const unsigned char * key, const std::size_t length,
 			unsigned char ** value, std::size_t * valueSize) const = 0;
+	/**
+	 * Copies the value of the given key into a buffer provided by the
+	 * caller, so no memory is allocated for the result. The size of the
+	 * value is passed to valueSize in any case. If the buffer is too
+	 * small, nothing is copied and the caller is able to retry with a
+	 * buffer of at least valueSize bytes.
+	 * The default implementation falls back to get().
+	 *
+	 * \param key to be searched for
+	 * \param length of the given key
+	 * \param buffer where the value is copied to
+	 * \param bufferSize of the given buffer
+	 * \param valueSize of the stored value, 0 if no entry has been found
+	 * \return true, if an entry has been found, otherwise false
+	 */
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
+	/**
+	 * Looks up several keys of the same length at once, so storages are
+	 * able to serve them with a single snapshot and in the order of the
+	 * keys, instead of one independent lookup per key. The value of the
+	 * i-th key is copied like by getInto() to values + i * valueStride.
+	 * Changes of a running batch are taken into account.
+	 *
+	 * \param keys to be searched for, one after another
+	 * \param keyLength of each key
+	 * \param count number of keys
+	 * \param values buffer of count * valueStride bytes
+	 * \param valueStride bytes reserved for each value, larger values
+	 * aren't copied
+	 * \param valueSizes array of count sizes, 0 for keys not found
+	 * \param found array of count flags, true for keys found
+	 * \return the number of found keys
+	 */
+	virtual std::size_t multiGet(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t count,
+			unsigned char * values, const std::size_t valueStride,
+			std::size_t * valueSizes, bool * found) const;
 	/**
 	 * Adds or updates the key and its value
 	 *
@@ -86,6 +220,43 @@ public:
 	 * after this call
 	 */
 	virtual void clear(void) = 0;
+	/**
+	 * Starts collecting the following put and del calls, until
+	 * commitBatch() is called. Storages, which support it, write the
+	 * collected changes at once and atomically. The collected changes are
+	 * visible to get(), but not to iterators, before they are committed.
+	 * Storages without batch support write each change immediately.
+	 *
+	 * Batches could be nested, only the outermost commitBatch() writes
+	 * the changes.
+	 */
+	virtual void beginBatch();
+	/**
+	 * Ends the innermost batch. If it has been the outermost one, all
+	 * collected changes are written.
+	 *
+	 * \throws StorageException, if there is no running batch
+	 */
+	virtual void commitBatch();
+	/**
+	 * Discards all changes collected since the outermost beginBatch()
+	 * and ends all nested batches. Does nothing, if there is no
+	 * running batch.
+	 */
+	virtual void abortBatch();
+	/**
+	 * \return true, if a batch has been started and not yet finished
+	 */
+	bool isBatchRunning() const;
+	/**
+	 * Iterators are always created and deleted by the same thread. If the
+	 * storage is concurrently readable, they could be used by other
+	 * threads meanwhile, each iterator by a single thread, as long as no
+	 * changes are written. The default implementation returns false.
+	 *
+	 * \return true, if iterators could be used by several threads at once
+	 */
+	virtual bool isConcurrentlyReadable() const;
 	/**
 	 * To iterate over the complete key value store, this
 	 * method provides an iterator to perform such a search.
@@ -93,6 +264,132 @@ public:
 	 * \return a new iterator
 	 */
 	virtual AbstractKeyValueIterator * createIterator() = 0;
+	/**
+	 * Creates an iterator over all entries with keys inside the range
+	 * [start, limit), see KeyRangeIterator
+	 *
+	 * \param start first key of the range
+	 * \param startSize of the start key, 0 to start at the first entry
+	 * \param limit first key behind the range, NULL if it's open
+	 * \param limitSize of the limit key
+	 * \return a new iterator
+	 */
+	AbstractKeyValueIterator * createRangeIterator(
+			const unsigned char * start, const std::size_t startSize,
+			const unsigned char * limit, const std::size_t limitSize);
+	/**
+	 * Creates an iterator over all entries, whose keys start with the
+	 * given prefix
+	 *
+	 * \param prefix of the keys
+	 * \param length of the prefix
+	 * \return a new iterator
+	 */
+	AbstractKeyValueIterator * createPrefixIterator(
+			const unsigned char * prefix, const std::size_t length);
+protected:
+	/**
+	 * A change collected by a batch
+	 */
+	struct BatchEntry {
+		/// The new value, empty if deleted is set
+		std::string value;
+		/// true, if the record is deleted
+		bool deleted;
+	};
+	/// Collected changes by key, the last change of a key wins
+	typedef std::map<std::string, BatchEntry> Batch;
+	/// Changes collected by the running batch
+	Batch batch_;
+	/// Nesting depth of the running batch, 0 if there is none
+	unsigned int batchDepth_;
+	/**
+	 * Collects the put in the running batch
+	 *
+	 * \return false, if there is no running batch
+	 */
+	bool batchPut(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	/**
+	 * Collects the delete in the running batch
+	 *
+	 * \return false, if there is no running batch
+	 */
+	bool batchDel(const unsigned char * key, const std::size_t keySize);
+	/**
+	 * Looks up the given key in the changes of the running batch. The
+	 * result is passed like by get().
+	 *
+	 * \param found is set to true, if the key has been put by the batch
+	 * \return false, if the batch doesn't contain the key
+	 */
+	bool batchGet(const unsigned char * key, const std::size_t length,
+			unsigned char ** value, std::size_t * valueSize, bool * found) const;
+	/**
+	 * Looks up the given key in the changes of the running batch. The
+	 * result is passed like by getInto().
+	 *
+	 * \param found is set to true, if the key has been put by the batch
+	 * \return false, if the batch doesn't contain the key
+	 */
+	bool batchGetInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize, bool * found) const;
+	/**
+	 * Writes the collected changes of a finished batch. The default
+	 * implementation calls put and del for each change. Deleting a key,
+	 * which doesn't exist, must not fail.
+	 *
+	 * \param batch changes to be written
+	 */
+	virtual void writeBatch(const Batch& batch);
+	/**
+	 * Looks up the keys with the given indices for multiGet(), which
+	 * aren't changed by the running batch. The results are written like
+	 * by multiGet() at the positions of the indices. The default
+	 * implementation calls getInto() for each key.
+	 *
+	 * \param indices of the keys to be searched for
+	 * \param count number of indices
+	 */
+	virtual void multiRead(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t * indices,
+			const std::size_t count, unsigned char * values,
+			const std::size_t valueStride, std::size_t * valueSizes,
+			bool * found) const;
+	/**
+	 * Sorts the given indices by the keys, they point to
+	 */
+	static void sortByKey(const unsigned char * keys,
+			const std::size_t keyLength, std::size_t * indices,
+			const std::size_t count);
+};
+
+/**
+ * Groups all changes of a scope to a storage into one batch. If the scope
+ * is left without calling commit(), e.g. by an exception, the batch is
+ * aborted.
+ */
+class StorageBatch {
+private:
+	AbstractKeyValueStorage& storage_;
+	/// true, until the batch has been committed
+	bool open_;
+	StorageBatch(const StorageBatch&);
+	StorageBatch& operator=(const StorageBatch&);
+public:
+	/**
+	 * Starts a batch on the given storage
+	 */
+	StorageBatch(AbstractKeyValueStorage& storage);
+	/**
+	 * Aborts the batch, if it hasn't been committed
+	 */
+	~StorageBatch();
+	/**
+	 * Commits the batch
+	 */
+	void commit();
 };
 
 }
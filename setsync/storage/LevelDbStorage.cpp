@@ -8,7 +8,10 @@
 #include <setsync/utils/FileSystem.h>
 #include <setsync/storage/StorageException.h>
 #include <stdlib.h>
+#include <vector>
 #include <leveldb/cache.h>
+#include <leveldb/write_batch.h>
+#include <leveldb/filter_policy.h>
 
 namespace setsync {
 
@@ -39,34 +42,58 @@ void LevelDbIterator::key(unsigned char * buffer) const {
 	memcpy(buffer, it->key().data(), it->key().size());
 }
 
+size_t LevelDbIterator::valueSize() const {
+	return it->value().size();
+}
+
+void LevelDbIterator::value(unsigned char * buffer) const {
+	memcpy(buffer, it->value().data(), it->value().size());
+}
+
+void LevelDbIterator::seek(const unsigned char * key, const std::size_t length) {
+	it->Seek(leveldb::Slice((const char *) key, length));
+}
+
+bool LevelDbIterator::isOrdered() const {
+	return true;
+}
+
 LevelDbStorage::LevelDbStorage(const std::string& path) :
-	path_(path) {
+	path_(path), filterPolicy_(leveldb::NewBloomFilterPolicy(
+			DEFAULT_BLOOM_BITS)) {
+	options_.filter_policy = filterPolicy_;
 	init();
 }
 
 LevelDbStorage::LevelDbStorage(const std::string& path,
-		const std::size_t cache_capacity) :
-	path_(path) {
+		const std::size_t cache_capacity, const int bloomBitsPerKey) :
+	path_(path), filterPolicy_(NULL) {
 	if (cache_capacity > 0) {
 		options_.block_cache = leveldb::NewLRUCache(cache_capacity);
 	}
+	if (bloomBitsPerKey > 0) {
+		filterPolicy_ = leveldb::NewBloomFilterPolicy(bloomBitsPerKey);
+		options_.filter_policy = filterPolicy_;
+	}
 	init();
 }
 
 LevelDbStorage::LevelDbStorage(const std::string& path,
 		const leveldb::Options& options) :
-	path_(path), options_(options) {
+	path_(path), options_(options), filterPolicy_(NULL) {
 	init();
 }
 LevelDbStorage::LevelDbStorage(const std::string& path,
 		const leveldb::Options& options, const leveldb::WriteOptions& woptions) :
-	path_(path), options_(options), writeOptions_(woptions) {
+	path_(path), options_(options), writeOptions_(woptions),
+			filterPolicy_(NULL) {
 	init();
 }
 
 LevelDbStorage::LevelDbStorage(const std::string& path,
 		const leveldb::Options& options, const leveldb::ReadOptions& roptions) :
-	path_(path), options_(options), readOptions_(roptions) {
+	path_(path), options_(options), readOptions_(roptions),
+			filterPolicy_(NULL) {
 	init();
 }
 
@@ -74,7 +101,7 @@ LevelDbStorage::LevelDbStorage(const std::string& path,
 		const leveldb::Options& options, const leveldb::ReadOptions& roptions,
 		const leveldb::WriteOptions& woptions) :
 	path_(path), options_(options), writeOptions_(woptions),
-			readOptions_(roptions) {
+			readOptions_(roptions), filterPolicy_(NULL) {
 	init();
 }
 
@@ -91,17 +118,24 @@ LevelDbStorage::~LevelDbStorage() {
 	if (this->options_.block_cache != NULL) {
 		delete this->options_.block_cache;
 	}
+	if (this->filterPolicy_ != NULL) {
+		delete this->filterPolicy_;
+	}
 }
 
 bool LevelDbStorage::get(const unsigned char * key, const std::size_t length,
 		unsigned char ** value, std::size_t * valueSize) const {
-	std::string v;
+	bool found;
+	if (batchGet(key, length, value, valueSize, &found)) {
+		return found;
+	}
 	leveldb::Slice k((char *) key, length);
-	leveldb::Status s = this->db_->Get(readOptions_, k, &v);
+	std::string result;
+	leveldb::Status s = this->db_->Get(readOptions_, k, &result);
 	if (s.ok()) {
-		*value = (unsigned char *) malloc(v.size());
-		memcpy(*value, v.c_str(), v.size());
-		*valueSize = v.size();
+		*valueSize = result.size();
+		*value = (unsigned char *) malloc(*valueSize);
+		memcpy(*value, result.data(), *valueSize);
 		return true;
 	} else {
 		*value = NULL;
@@ -109,8 +143,59 @@ bool LevelDbStorage::get(const unsigned char * key, const std::size_t length,
 		return false;
 	}
 }
+
+bool LevelDbStorage::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	bool found;
+	if (batchGetInto(key, length, buffer, bufferSize, valueSize, &found)) {
+		return found;
+	}
+	// LevelDB doesn't hand out pinned values. The string is local to the
+	// call, a shared one would be overwritten by concurrent readers.
+	leveldb::Slice k((char *) key, length);
+	std::string result;
+	leveldb::Status s = this->db_->Get(readOptions_, k, &result);
+	if (s.ok()) {
+		*valueSize = result.size();
+		if (*valueSize <= bufferSize) {
+			memcpy(buffer, result.data(), *valueSize);
+		}
+		return true;
+	} else {
+		*valueSize = 0;
+		return false;
+	}
+}
+void LevelDbStorage::multiRead(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t * indices,
+		const std::size_t count, unsigned char * values,
+		const std::size_t valueStride, std::size_t * valueSizes,
+		bool * found) const {
+	// Neighbouring keys are likely found in the same cached block
+	std::vector<std::size_t> sorted(indices, indices + count);
+	sortByKey(keys, keyLength, &sorted[0], count);
+	leveldb::ReadOptions options(this->readOptions_);
+	options.snapshot = this->db_->GetSnapshot();
+	std::string result;
+	for (std::size_t i = 0; i < count; i++) {
+		const std::size_t index = sorted[i];
+		leveldb::Slice k((const char *) keys + index * keyLength, keyLength);
+		found[index] = this->db_->Get(options, k, &result).ok();
+		valueSizes[index] = found[index] ? result.size() : 0;
+		if (found[index] && valueSizes[index] <= valueStride) {
+			memcpy(values + index * valueStride, result.data(),
+					valueSizes[index]);
+		}
+	}
+	this->db_->ReleaseSnapshot(options.snapshot);
+}
+
 void LevelDbStorage::put(const unsigned char * key, const std::size_t keySize,
 		const unsigned char * value, const std::size_t valueSize) {
+	if (batchPut(key, keySize, value, valueSize)) {
+		return;
+	}
 	leveldb::Slice k((char *) key, keySize);
 	leveldb::Slice v((char *) value, valueSize);
 	leveldb::Status s = this->db_->Put(this->writeOptions_, k, v);
@@ -119,6 +204,9 @@ void LevelDbStorage::put(const unsigned char * key, const std::size_t keySize,
 	}
 }
 void LevelDbStorage::del(const unsigned char * key, const std::size_t keySize) {
+	if (batchDel(key, keySize)) {
+		return;
+	}
 	leveldb::Slice k((char*) key, keySize);
 	leveldb::Status s = this->db_->Delete(writeOptions_, k);
 	if (!s.ok()) {
@@ -127,16 +215,36 @@ void LevelDbStorage::del(const unsigned char * key, const std::size_t keySize) {
 }
 
 void LevelDbStorage::clear(void) {
+	this->batch_.clear();
 	delete this->db_;
 	utils::FileSystem::rmDirRecursive(this->path_.c_str());
 	leveldb::Status s = leveldb::DB::Open(options_, path_, &(this->db_));
 }
 
+void LevelDbStorage::writeBatch(const Batch& batch) {
+	leveldb::WriteBatch writeBatch;
+	for (Batch::const_iterator it = batch.begin(); it != batch.end(); it++) {
+		if (it->second.deleted) {
+			writeBatch.Delete(it->first);
+		} else {
+			writeBatch.Put(it->first, it->second.value);
+		}
+	}
+	leveldb::Status s = this->db_->Write(this->writeOptions_, &writeBatch);
+	if (!s.ok()) {
+		throw StorageException(s.ToString());
+	}
+}
+
 AbstractKeyValueIterator * LevelDbStorage::createIterator() {
 	leveldb::Iterator* it = this->db_->NewIterator(readOptions_);
 	return new LevelDbIterator(it);
 }
 
+bool LevelDbStorage::isConcurrentlyReadable() const {
+	return true;
+}
+
 }
 
 }
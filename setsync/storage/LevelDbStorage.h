@@ -36,6 +36,10 @@ public:
 	virtual void next();
 	virtual size_t keySize() const;
 	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
 };
 
 /**
@@ -44,6 +48,14 @@ public:
  */
 class LevelDbStorage: public setsync::storage::AbstractKeyValueStorage {
 	friend class LevelDbStorageTest;
+	friend class KeyValueStorageTest;
+public:
+	/**
+	 * Default number of bloom filter bits per key of the tables. Lookups
+	 * of missing keys, like most lookups of a synchronization, skip the
+	 * tables, whose filters don't contain the key, without reading them.
+	 */
+	static const int DEFAULT_BLOOM_BITS = 10;
 private:
 	/// Instance of the table to be used
 	leveldb::DB * db_;
@@ -55,6 +67,8 @@ private:
 	leveldb::WriteOptions writeOptions_;
 	/// Options for read accesses
 	leveldb::ReadOptions readOptions_;
+	/// Filter policy created by this storage, NULL if there is none
+	const leveldb::FilterPolicy * filterPolicy_;
 	/**
 	 *
 	 */
@@ -73,8 +87,10 @@ public:
 	 *
 	 * \param path where the database exists, or should be saved to
 	 * \param cache_capacity with can be used
+	 * \param bloomBitsPerKey of the table filters, 0 disables them
 	 */
-	LevelDbStorage(const std::string& path, const std::size_t cache_capacity);
+	LevelDbStorage(const std::string& path, const std::size_t cache_capacity,
+			const int bloomBitsPerKey = DEFAULT_BLOOM_BITS);
 	/**
 	 * Creates a new key value store at the given path, or
 	 * loads an existing store.
@@ -110,6 +126,9 @@ public:
 	virtual ~LevelDbStorage();
 	virtual bool get(const unsigned char * key, const std::size_t length,
 			unsigned char ** value, std::size_t * valueSize) const;
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
 	virtual void put(const unsigned char * key, const std::size_t keySize,
 			const unsigned char * value, const std::size_t valueSize);
 	virtual void del(const unsigned char * key, const std::size_t keySize);
@@ -119,6 +138,23 @@ public:
 	 */
 	virtual void clear(void);
 	virtual AbstractKeyValueIterator * createIterator();
+	/**
+	 * \return true, each iterator reads its own snapshot of the database
+	 */
+	virtual bool isConcurrentlyReadable() const;
+protected:
+	/**
+	 * Writes the batch as a single leveldb::WriteBatch
+	 */
+	virtual void writeBatch(const Batch& batch);
+	/**
+	 * Reads all keys in their order from a single snapshot
+	 */
+	virtual void multiRead(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t * indices,
+			const std::size_t count, unsigned char * values,
+			const std::size_t valueStride, std::size_t * valueSizes,
+			bool * found) const;
 };
 
 }
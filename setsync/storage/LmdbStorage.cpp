@@ -0,0 +1,339 @@
+/*
+ * LmdbStorage.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "LmdbStorage.h"
+#include <setsync/storage/StorageException.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <vector>
+
+namespace setsync {
+
+namespace storage {
+
+const std::size_t LmdbStorage::DEFAULT_MAP_SIZE;
+const unsigned int LmdbStorage::DEFAULT_FLAGS;
+
+LmdbIterator::LmdbIterator(LmdbStorage& storage) :
+	storage_(storage), txn_(NULL), cursor_(NULL), valid_(false) {
+	LmdbStorage::check(
+			mdb_txn_begin(storage_.env_, NULL, MDB_RDONLY, &this->txn_));
+	int rc = mdb_cursor_open(this->txn_, storage_.dbi_, &this->cursor_);
+	if (rc != MDB_SUCCESS) {
+		mdb_txn_abort(this->txn_);
+		LmdbStorage::check(rc);
+	}
+	this->storage_.iterators_++;
+	seekToFirst();
+}
+
+LmdbIterator::~LmdbIterator() {
+	mdb_cursor_close(this->cursor_);
+	mdb_txn_abort(this->txn_);
+	this->storage_.iterators_--;
+}
+
+void LmdbIterator::seekToFirst() {
+	this->valid_ = mdb_cursor_get(this->cursor_, &this->key_, &this->value_,
+			MDB_FIRST) == MDB_SUCCESS;
+}
+
+void LmdbIterator::seek(const unsigned char * key, const std::size_t length) {
+	this->key_.mv_size = length;
+	this->key_.mv_data = (void *) key;
+	this->valid_ = mdb_cursor_get(this->cursor_, &this->key_, &this->value_,
+			MDB_SET_RANGE) == MDB_SUCCESS;
+}
+
+bool LmdbIterator::isOrdered() const {
+	return true;
+}
+
+bool LmdbIterator::valid() const {
+	return this->valid_;
+}
+
+void LmdbIterator::next() {
+	this->valid_ = mdb_cursor_get(this->cursor_, &this->key_, &this->value_,
+			MDB_NEXT) == MDB_SUCCESS;
+}
+
+size_t LmdbIterator::keySize() const {
+	return this->key_.mv_size;
+}
+
+void LmdbIterator::key(unsigned char * buffer) const {
+	memcpy(buffer, this->key_.mv_data, this->key_.mv_size);
+}
+
+size_t LmdbIterator::valueSize() const {
+	return this->value_.mv_size;
+}
+
+void LmdbIterator::value(unsigned char * buffer) const {
+	memcpy(buffer, this->value_.mv_data, this->value_.mv_size);
+}
+
+LmdbStorage::LmdbStorage(const std::string& path, const std::size_t mapSize,
+		const unsigned int flags) :
+	env_(NULL), dbi_(0), path_(path), mapSize_(mapSize), flags_(flags),
+			readTxn_(NULL), iterators_(0) {
+	init();
+}
+
+void LmdbStorage::init() {
+	// LMDB expects an existing directory
+	mkdir(this->path_.c_str(), 0755);
+	check(mdb_env_create(&this->env_));
+	int rc = mdb_env_set_mapsize(this->env_, this->mapSize_);
+	if (rc == MDB_SUCCESS) {
+		// Without thread local storage, a thread could hold several snapshots
+		rc = mdb_env_open(this->env_, this->path_.c_str(),
+				this->flags_ | MDB_NOTLS, 0644);
+	}
+	if (rc != MDB_SUCCESS) {
+		mdb_env_close(this->env_);
+		this->env_ = NULL;
+		throw StorageException("Failed to open db");
+	}
+	MDB_txn * txn = beginWrite();
+	rc = mdb_dbi_open(txn, NULL, 0, &this->dbi_);
+	if (rc != MDB_SUCCESS) {
+		mdb_txn_abort(txn);
+		mdb_env_close(this->env_);
+		this->env_ = NULL;
+		throw StorageException("Failed to open db");
+	}
+	check(mdb_txn_commit(txn));
+}
+
+LmdbStorage::~LmdbStorage() {
+	if (this->readTxn_ != NULL) {
+		mdb_txn_abort(this->readTxn_);
+	}
+	mdb_env_sync(this->env_, 1);
+	mdb_env_close(this->env_);
+}
+
+void LmdbStorage::check(const int rc) {
+	if (rc != MDB_SUCCESS) {
+		throw StorageException(mdb_strerror(rc));
+	}
+}
+
+MDB_txn * LmdbStorage::beginRead() const {
+	if (this->readTxn_ == NULL) {
+		check(mdb_txn_begin(this->env_, NULL, MDB_RDONLY, &this->readTxn_));
+	} else {
+		check(mdb_txn_renew(this->readTxn_));
+	}
+	return this->readTxn_;
+}
+
+MDB_txn * LmdbStorage::beginWrite() {
+	MDB_txn * txn;
+	check(mdb_txn_begin(this->env_, NULL, 0, &txn));
+	return txn;
+}
+
+void LmdbStorage::grow() {
+	if (this->iterators_ > 0) {
+		throw StorageException("The memory map is full");
+	}
+	// Resizing requires, that there is no transaction in this process
+	if (this->readTxn_ != NULL) {
+		mdb_txn_abort(this->readTxn_);
+		this->readTxn_ = NULL;
+	}
+	this->mapSize_ *= 2;
+	check(mdb_env_set_mapsize(this->env_, this->mapSize_));
+}
+
+bool LmdbStorage::get(const unsigned char * key, const std::size_t length,
+		unsigned char ** value, std::size_t * valueSize) const {
+	bool found;
+	if (batchGet(key, length, value, valueSize, &found)) {
+		return found;
+	}
+	MDB_txn * txn = beginRead();
+	MDB_val k;
+	k.mv_size = length;
+	k.mv_data = (void *) key;
+	MDB_val v;
+	int rc = mdb_get(txn, this->dbi_, &k, &v);
+	if (rc == MDB_SUCCESS) {
+		*valueSize = v.mv_size;
+		*value = (unsigned char *) malloc(*valueSize);
+		memcpy(*value, v.mv_data, *valueSize);
+	} else {
+		*value = NULL;
+		*valueSize = 0;
+	}
+	mdb_txn_reset(txn);
+	if (rc != MDB_NOTFOUND) {
+		check(rc);
+	}
+	return rc == MDB_SUCCESS;
+}
+
+bool LmdbStorage::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	bool found;
+	if (batchGetInto(key, length, buffer, bufferSize, valueSize, &found)) {
+		return found;
+	}
+	MDB_txn * txn = beginRead();
+	MDB_val k;
+	k.mv_size = length;
+	k.mv_data = (void *) key;
+	MDB_val v;
+	int rc = mdb_get(txn, this->dbi_, &k, &v);
+	if (rc == MDB_SUCCESS) {
+		*valueSize = v.mv_size;
+		if (*valueSize <= bufferSize) {
+			memcpy(buffer, v.mv_data, *valueSize);
+		}
+	} else {
+		*valueSize = 0;
+	}
+	mdb_txn_reset(txn);
+	if (rc != MDB_NOTFOUND) {
+		check(rc);
+	}
+	return rc == MDB_SUCCESS;
+}
+
+void LmdbStorage::multiRead(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t * indices,
+		const std::size_t count, unsigned char * values,
+		const std::size_t valueStride, std::size_t * valueSizes,
+		bool * found) const {
+	// Keys in order walk down neighbouring pages of the B+tree
+	std::vector<std::size_t> sorted(indices, indices + count);
+	sortByKey(keys, keyLength, &sorted[0], count);
+	MDB_txn * txn = beginRead();
+	int rc = MDB_SUCCESS;
+	for (std::size_t i = 0; i < count; i++) {
+		const std::size_t index = sorted[i];
+		MDB_val k;
+		k.mv_size = keyLength;
+		k.mv_data = (void *) (keys + index * keyLength);
+		MDB_val v;
+		rc = mdb_get(txn, this->dbi_, &k, &v);
+		found[index] = rc == MDB_SUCCESS;
+		valueSizes[index] = found[index] ? v.mv_size : 0;
+		if (found[index] && v.mv_size <= valueStride) {
+			memcpy(values + index * valueStride, v.mv_data, v.mv_size);
+		}
+		if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND) {
+			break;
+		}
+	}
+	mdb_txn_reset(txn);
+	if (rc != MDB_NOTFOUND) {
+		check(rc);
+	}
+}
+
+int LmdbStorage::change(MDB_txn * txn, const unsigned char * key,
+		const std::size_t keySize, const unsigned char * value,
+		const std::size_t valueSize, const bool deleted) {
+	MDB_val k;
+	k.mv_size = keySize;
+	k.mv_data = (void *) key;
+	if (deleted) {
+		int rc = mdb_del(txn, this->dbi_, &k, NULL);
+		return rc == MDB_NOTFOUND ? MDB_SUCCESS : rc;
+	}
+	MDB_val v;
+	v.mv_size = valueSize;
+	v.mv_data = (void *) value;
+	return mdb_put(txn, this->dbi_, &k, &v, 0);
+}
+
+void LmdbStorage::write(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize,
+		const bool deleted) {
+	while (true) {
+		MDB_txn * txn = beginWrite();
+		int rc = change(txn, key, keySize, value, valueSize, deleted);
+		if (rc == MDB_SUCCESS) {
+			rc = mdb_txn_commit(txn);
+		} else {
+			mdb_txn_abort(txn);
+		}
+		if (rc != MDB_MAP_FULL) {
+			check(rc);
+			return;
+		}
+		grow();
+	}
+}
+
+void LmdbStorage::put(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize) {
+	if (batchPut(key, keySize, value, valueSize)) {
+		return;
+	}
+	write(key, keySize, value, valueSize, false);
+}
+
+void LmdbStorage::del(const unsigned char * key, const std::size_t keySize) {
+	if (batchDel(key, keySize)) {
+		return;
+	}
+	write(key, keySize, NULL, 0, true);
+}
+
+void LmdbStorage::writeBatch(const Batch& batch) {
+	while (true) {
+		MDB_txn * txn = beginWrite();
+		int rc = MDB_SUCCESS;
+		for (Batch::const_iterator it = batch.begin(); rc == MDB_SUCCESS
+				&& it != batch.end(); it++) {
+			rc = change(txn, (const unsigned char *) it->first.data(),
+					it->first.size(),
+					(const unsigned char *) it->second.value.data(),
+					it->second.value.size(), it->second.deleted);
+		}
+		if (rc == MDB_SUCCESS) {
+			rc = mdb_txn_commit(txn);
+		} else {
+			mdb_txn_abort(txn);
+		}
+		if (rc != MDB_MAP_FULL) {
+			check(rc);
+			return;
+		}
+		grow();
+	}
+}
+
+void LmdbStorage::clear(void) {
+	this->batch_.clear();
+	MDB_txn * txn = beginWrite();
+	int rc = mdb_drop(txn, this->dbi_, 0);
+	if (rc != MDB_SUCCESS) {
+		mdb_txn_abort(txn);
+		check(rc);
+	}
+	check(mdb_txn_commit(txn));
+}
+
+AbstractKeyValueIterator * LmdbStorage::createIterator() {
+	return new LmdbIterator(*this);
+}
+
+bool LmdbStorage::isConcurrentlyReadable() const {
+	return true;
+}
+
+}
+
+}
@@ -0,0 +1,184 @@
+/*
+ * LmdbStorage.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef LMDBSTORAGE_H_
+#define LMDBSTORAGE_H_
+
+#include "KeyValueStorage.h"
+#include <lmdb.h>
+
+namespace setsync {
+
+namespace storage {
+
+class LmdbStorage;
+
+/**
+ * Implementation of an abstract iterator to provide the
+ * possibility to iterate over a LmdbStorage. The iterator reads
+ * a snapshot of the storage, which is taken on its creation.
+ */
+class LmdbIterator: public AbstractKeyValueIterator {
+private:
+	/// The storage, which is iterated
+	LmdbStorage& storage_;
+	/// Read only transaction holding the snapshot
+	MDB_txn * txn_;
+	/// The lmdb cursor to be used
+	MDB_cursor * cursor_;
+	/// The actual key, pointing into the memory map
+	MDB_val key_;
+	/// The actual value, pointing into the memory map
+	MDB_val value_;
+	/// true, if the cursor points to an entry
+	bool valid_;
+public:
+	/**
+	 * Creates a new iterator over the given storage
+	 *
+	 * \param storage to iterate over
+	 */
+	LmdbIterator(LmdbStorage& storage);
+	virtual ~LmdbIterator();
+	virtual void seekToFirst();
+	virtual bool valid() const;
+	virtual void next();
+	virtual size_t keySize() const;
+	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
+};
+
+/**
+ * An implementation of the abstract key value storage by using LMDB, a
+ * memory mapped B+tree. Reads copy the values directly out of the memory
+ * map. The map grows automatically, if it is full.
+ */
+class LmdbStorage: public setsync::storage::AbstractKeyValueStorage {
+	friend class LmdbIterator;
+public:
+	/// Initial size of the memory map in bytes
+	static const std::size_t DEFAULT_MAP_SIZE = 64 * 1024 * 1024;
+	/**
+	 * Default environment flags. Like the other storages, commits aren't
+	 * flushed to disk, the environment is synced on closing.
+	 */
+	static const unsigned int DEFAULT_FLAGS = MDB_NOSYNC;
+private:
+	/// The lmdb environment
+	MDB_env * env_;
+	/// Handle of the database inside the environment
+	MDB_dbi dbi_;
+	/// Path where the db exists
+	std::string path_;
+	/// Actual size of the memory map in bytes
+	std::size_t mapSize_;
+	/// Flags of the environment
+	unsigned int flags_;
+	/// Read only transaction, which is renewed for each read
+	mutable MDB_txn * readTxn_;
+	/// Number of open iterators, the map doesn't grow while there are some
+	unsigned int iterators_;
+	/**
+	 * Opens the environment and the database
+	 */
+	void init();
+	/**
+	 * Starts a snapshot for a read
+	 *
+	 * \return the read transaction
+	 */
+	MDB_txn * beginRead() const;
+	/**
+	 * Starts a write transaction
+	 */
+	MDB_txn * beginWrite();
+	/**
+	 * Doubles the size of the memory map
+	 *
+	 * \throws StorageException, if there are open iterators
+	 */
+	void grow();
+	/**
+	 * Puts or deletes an entry inside the given write transaction.
+	 * Deleting a key, which doesn't exist, succeeds.
+	 *
+	 * \return the lmdb error code
+	 */
+	int change(MDB_txn * txn, const unsigned char * key,
+			const std::size_t keySize, const unsigned char * value,
+			const std::size_t valueSize, const bool deleted);
+	/**
+	 * Writes a single change in its own transaction
+	 */
+	void write(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize,
+			const bool deleted);
+	/**
+	 * Throws a StorageException, if the given code is an error
+	 */
+	static void check(const int rc);
+	LmdbStorage(const LmdbStorage&);
+	LmdbStorage& operator=(const LmdbStorage&);
+public:
+	/**
+	 * Creates a new key value store at the given path, or
+	 * loads an existing store.
+	 *
+	 * \param path of the directory, where the database exists, or should be
+	 * saved to
+	 * \param mapSize initial size of the memory map in bytes
+	 * \param flags of the lmdb environment, 0 syncs each commit
+	 */
+	LmdbStorage(const std::string& path, const std::size_t mapSize =
+			DEFAULT_MAP_SIZE, const unsigned int flags = DEFAULT_FLAGS);
+	/**
+	 * Closes the connection to the key value store
+	 */
+	virtual ~LmdbStorage();
+	virtual bool get(const unsigned char * key, const std::size_t length,
+			unsigned char ** value, std::size_t * valueSize) const;
+	/**
+	 * Copies the value directly from the memory map into the buffer
+	 */
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
+	virtual void put(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	virtual void del(const unsigned char * key, const std::size_t keySize);
+	/**
+	 * Deletes all entries of the database
+	 */
+	virtual void clear(void);
+	virtual AbstractKeyValueIterator * createIterator();
+	/**
+	 * \return true, each iterator has got its own read transaction, which
+	 * isn't bound to a thread
+	 */
+	virtual bool isConcurrentlyReadable() const;
+protected:
+	/**
+	 * Writes the batch in a single write transaction
+	 */
+	virtual void writeBatch(const Batch& batch);
+	/**
+	 * Reads all keys in their order inside a single read transaction
+	 */
+	virtual void multiRead(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t * indices,
+			const std::size_t count, unsigned char * values,
+			const std::size_t valueStride, std::size_t * valueSizes,
+			bool * found) const;
+};
+
+}
+
+}
+
+#endif /* LMDBSTORAGE_H_ */
@@ -5,48 +5,384 @@
  */
 
 #include "MemStorage.h"
+#include "StorageException.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits>
+#include <vector>
 
 namespace setsync {
 
 namespace storage {
 
-MemStorage::MemStorage(const std::size_t gbcache, const std::size_t cache) :
-	inMemoryDb_(NULL), storage_(NULL) {
-	this->inMemoryDb_ = new Db(NULL, 0);
-	this->inMemoryDb_->set_cachesize(gbcache, cache, 0);
-	this->inMemoryDb_->open(NULL, NULL, NULL, DB_BTREE, DB_CREATE, 0);
-	this->storage_ = new BdbStorage(this->inMemoryDb_);
+const std::size_t MemStorage::DEFAULT_INLINE_SIZE;
+const std::size_t MemStorage::INITIAL_CAPACITY;
+const std::size_t MemStorage::CHUNK_SIZE;
+const std::size_t MemStorage::BLOCK_ALIGNMENT;
+const std::size_t MemStorage::PREFETCH_DISTANCE;
+const uint64_t MemStorage::EMPTY;
+const uint64_t MemStorage::DELETED;
+
+MemStorageIterator::MemStorageIterator(const MemStorage& storage) :
+	storage_(storage), position_(0) {
+	skipToUsed(0);
+}
+
+MemStorageIterator::~MemStorageIterator() {
+}
+
+void MemStorageIterator::skipToUsed(const std::size_t position) {
+	this->position_ = position;
+	while (this->position_ < this->storage_.capacity_
+			&& this->storage_.slot(this->position_)->hash <= MemStorage::DELETED) {
+		this->position_++;
+	}
+}
+
+void MemStorageIterator::seekToFirst() {
+	skipToUsed(0);
+}
+
+bool MemStorageIterator::valid() const {
+	return this->position_ < this->storage_.capacity_;
+}
+
+void MemStorageIterator::next() {
+	skipToUsed(this->position_ + 1);
+}
+
+size_t MemStorageIterator::keySize() const {
+	return this->storage_.slot(this->position_)->keySize;
+}
+
+void MemStorageIterator::key(unsigned char * buffer) const {
+	const MemStorage::Slot * s = this->storage_.slot(this->position_);
+	memcpy(buffer, this->storage_.data(s), s->keySize);
+}
+
+size_t MemStorageIterator::valueSize() const {
+	return this->storage_.slot(this->position_)->valueSize;
+}
+
+void MemStorageIterator::value(unsigned char * buffer) const {
+	const MemStorage::Slot * s = this->storage_.slot(this->position_);
+	memcpy(buffer, this->storage_.data(s) + s->keySize, s->valueSize);
+}
+
+MemStorage::MemStorage(const std::size_t inlineSize) :
+	slots_(NULL), capacity_(0), size_(0), deleted_(0), chunkUsed_(0) {
+	// The inline bytes hold at least the pointer to an arena block
+	this->inlineSize_ = inlineSize < sizeof(unsigned char *) ? sizeof(
+			unsigned char *) : inlineSize;
+	this->inlineSize_ = (this->inlineSize_ + sizeof(uint64_t) - 1)
+			/ sizeof(uint64_t) * sizeof(uint64_t);
+	this->slotSize_ = sizeof(Slot) + this->inlineSize_;
+	rehash(INITIAL_CAPACITY);
 }
 
 MemStorage::~MemStorage() {
-	if (storage_ != NULL)
-		delete storage_;
-	if (inMemoryDb_ != NULL) {
-		this->inMemoryDb_->close(0);
-		delete this->inMemoryDb_;
+	freeAll();
+}
+
+uint64_t MemStorage::hashKey(const unsigned char * key,
+		const std::size_t length) {
+	uint64_t h = 0xcbf29ce484222325ULL ^ length;
+	uint64_t word;
+	std::size_t i = 0;
+	for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+		memcpy(&word, key + i, sizeof(uint64_t));
+		h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+		h ^= h >> 29;
+	}
+	word = 0;
+	for (std::size_t j = 0; i + j < length; j++) {
+		word |= ((uint64_t) key[i + j]) << (8 * j);
 	}
+	h = (h ^ word) * 0x9e3779b97f4a7c15ULL;
+	// Final mixing of MurmurHash3
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h > DELETED ? h : h + DELETED + 1;
 }
 
-void MemStorage::put(const unsigned char * key, const std::size_t keySize,
-		const unsigned char * value, const std::size_t valueSize) {
-	this->storage_->put(key, keySize, value, valueSize);
+std::size_t MemStorage::blockSize(const std::size_t entrySize) {
+	return (entrySize + BLOCK_ALIGNMENT - 1) / BLOCK_ALIGNMENT * BLOCK_ALIGNMENT;
+}
+
+MemStorage::Slot * MemStorage::slot(const std::size_t index) const {
+	return (Slot *) (this->slots_ + index * this->slotSize_);
+}
+
+bool MemStorage::isInline(const Slot * s) const {
+	return (std::size_t) s->keySize + s->valueSize <= this->inlineSize_;
+}
+
+unsigned char * MemStorage::data(const Slot * s) const {
+	unsigned char * inlineData = (unsigned char *) (s + 1);
+	if (isInline(s)) {
+		return inlineData;
+	}
+	unsigned char * block;
+	memcpy(&block, inlineData, sizeof(unsigned char *));
+	return block;
+}
+
+std::size_t MemStorage::find(const unsigned char * key,
+		const std::size_t length, const uint64_t hash) const {
+	const std::size_t mask = this->capacity_ - 1;
+	for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+		const Slot * s = slot(i);
+		if (s->hash == EMPTY) {
+			return this->capacity_;
+		}
+		if (s->hash == hash && s->keySize == length && memcmp(data(s), key,
+				length) == 0) {
+			return i;
+		}
+	}
+}
+
+unsigned char * MemStorage::allocate(const std::size_t entrySize) {
+	const std::size_t size = blockSize(entrySize);
+	FreeBlocks::iterator it = this->freeBlocks_.find(size);
+	if (it != this->freeBlocks_.end() && !it->second.empty()) {
+		unsigned char * block = it->second.back();
+		it->second.pop_back();
+		return block;
+	}
+	if (size > CHUNK_SIZE / 4) {
+		// Large blocks get a chunk of their own
+		unsigned char * chunk = (unsigned char *) malloc(size);
+		if (chunk == NULL) {
+			throw StorageException("Failed to allocate memory");
+		}
+		// Insert in front of the last chunk, which is still in use
+		this->chunks_.insert(
+				this->chunks_.empty() ? this->chunks_.end()
+						: this->chunks_.end() - 1, chunk);
+		return chunk;
+	}
+	if (this->chunks_.empty() || this->chunkUsed_ + size > CHUNK_SIZE) {
+		unsigned char * chunk = (unsigned char *) malloc(CHUNK_SIZE);
+		if (chunk == NULL) {
+			throw StorageException("Failed to allocate memory");
+		}
+		this->chunks_.push_back(chunk);
+		this->chunkUsed_ = 0;
+	}
+	unsigned char * block = this->chunks_.back() + this->chunkUsed_;
+	this->chunkUsed_ += size;
+	return block;
+}
+
+void MemStorage::release(unsigned char * block, const std::size_t entrySize) {
+	this->freeBlocks_[blockSize(entrySize)].push_back(block);
+}
+
+void MemStorage::releaseSlot(Slot * s) {
+	if (!isInline(s)) {
+		release(data(s), (std::size_t) s->keySize + s->valueSize);
+	}
+}
+
+void MemStorage::rehash(const std::size_t capacity) {
+	unsigned char * slots = (unsigned char *) calloc(capacity, this->slotSize_);
+	if (slots == NULL) {
+		throw StorageException("Failed to allocate memory");
+	}
+	const std::size_t mask = capacity - 1;
+	for (std::size_t i = 0; i < this->capacity_; i++) {
+		const Slot * s = slot(i);
+		if (s->hash <= DELETED) {
+			continue;
+		}
+		std::size_t j = s->hash & mask;
+		while (((Slot *) (slots + j * this->slotSize_))->hash != EMPTY) {
+			j = (j + 1) & mask;
+		}
+		// Arena blocks stay where they are, only the slot is moved
+		memcpy(slots + j * this->slotSize_, s, this->slotSize_);
+	}
+	free(this->slots_);
+	this->slots_ = slots;
+	this->capacity_ = capacity;
+	this->deleted_ = 0;
+}
+
+void MemStorage::freeAll() {
+	for (std::size_t i = 0; i < this->chunks_.size(); i++) {
+		free(this->chunks_[i]);
+	}
+	this->chunks_.clear();
+	this->chunkUsed_ = 0;
+	this->freeBlocks_.clear();
+	free(this->slots_);
+	this->slots_ = NULL;
+	this->capacity_ = 0;
+	this->size_ = 0;
+	this->deleted_ = 0;
 }
 
 bool MemStorage::get(const unsigned char * key, const std::size_t length,
 		unsigned char ** value, std::size_t * valueSize) const {
-	return this->storage_->get(key, length, value, valueSize);
+	bool found;
+	if (batchGet(key, length, value, valueSize, &found)) {
+		return found;
+	}
+	std::size_t i = find(key, length, hashKey(key, length));
+	if (i == this->capacity_) {
+		*value = NULL;
+		*valueSize = 0;
+		return false;
+	}
+	const Slot * s = slot(i);
+	*valueSize = s->valueSize;
+	*value = (unsigned char *) malloc(*valueSize);
+	memcpy(*value, data(s) + s->keySize, *valueSize);
+	return true;
+}
+
+bool MemStorage::getInto(const unsigned char * key, const std::size_t length,
+		unsigned char * buffer, const std::size_t bufferSize,
+		std::size_t * valueSize) const {
+	bool found;
+	if (batchGetInto(key, length, buffer, bufferSize, valueSize, &found)) {
+		return found;
+	}
+	std::size_t i = find(key, length, hashKey(key, length));
+	if (i == this->capacity_) {
+		*valueSize = 0;
+		return false;
+	}
+	const Slot * s = slot(i);
+	*valueSize = s->valueSize;
+	if (*valueSize <= bufferSize) {
+		memcpy(buffer, data(s) + s->keySize, *valueSize);
+	}
+	return true;
+}
+
+void MemStorage::multiRead(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t * indices,
+		const std::size_t count, unsigned char * values,
+		const std::size_t valueStride, std::size_t * valueSizes,
+		bool * found) const {
+	std::vector<uint64_t> hashes(count);
+	for (std::size_t i = 0; i < count; i++) {
+		hashes[i] = hashKey(keys + indices[i] * keyLength, keyLength);
+	}
+	const std::size_t mask = this->capacity_ - 1;
+	for (std::size_t i = 0; i < count; i++) {
+#ifdef __GNUC__
+		if (i + PREFETCH_DISTANCE < count) {
+			__builtin_prefetch(slot(hashes[i + PREFETCH_DISTANCE] & mask));
+		}
+#endif
+		const std::size_t index = indices[i];
+		std::size_t j = find(keys + index * keyLength, keyLength, hashes[i]);
+		found[index] = j != this->capacity_;
+		if (!found[index]) {
+			valueSizes[index] = 0;
+			continue;
+		}
+		const Slot * s = slot(j);
+		valueSizes[index] = s->valueSize;
+		if (s->valueSize <= valueStride) {
+			memcpy(values + index * valueStride, data(s) + s->keySize,
+					s->valueSize);
+		}
+	}
+}
+
+void MemStorage::put(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize) {
+	if (batchPut(key, keySize, value, valueSize)) {
+		return;
+	}
+	if (keySize > std::numeric_limits<uint32_t>::max() || valueSize
+			> std::numeric_limits<uint32_t>::max()) {
+		throw StorageException("Entry too large");
+	}
+	const uint64_t hash = hashKey(key, keySize);
+	std::size_t i = find(key, keySize, hash);
+	Slot * s;
+	if (i != this->capacity_) {
+		s = slot(i);
+		const std::size_t oldSize = (std::size_t) s->keySize + s->valueSize;
+		if (!isInline(s) && (keySize + valueSize <= this->inlineSize_
+				|| blockSize(oldSize) != blockSize(keySize + valueSize))) {
+			releaseSlot(s);
+		} else if (!isInline(s)) {
+			// The block is large enough for the new value
+			s->valueSize = valueSize;
+			memcpy(data(s) + keySize, value, valueSize);
+			return;
+		}
+	} else {
+		// Keep the load including deleted slots below 3/4
+		if ((this->size_ + this->deleted_ + 1) * 4 > this->capacity_ * 3) {
+			rehash(this->size_ * 2 + 2 > this->capacity_ ? this->capacity_ * 2
+					: this->capacity_);
+		}
+		const std::size_t mask = this->capacity_ - 1;
+		i = hash & mask;
+		while (slot(i)->hash > DELETED) {
+			i = (i + 1) & mask;
+		}
+		s = slot(i);
+		if (s->hash == DELETED) {
+			this->deleted_--;
+		}
+		s->hash = hash;
+		this->size_++;
+	}
+	s->keySize = keySize;
+	s->valueSize = valueSize;
+	unsigned char * target = (unsigned char *) (s + 1);
+	if (keySize + valueSize > this->inlineSize_) {
+		unsigned char * block = allocate(keySize + valueSize);
+		memcpy(target, &block, sizeof(unsigned char *));
+		target = block;
+	}
+	memcpy(target, key, keySize);
+	memcpy(target + keySize, value, valueSize);
 }
 
 void MemStorage::del(const unsigned char * key, const std::size_t keySize) {
-	this->storage_->del(key, keySize);
+	if (batchDel(key, keySize)) {
+		return;
+	}
+	std::size_t i = find(key, keySize, hashKey(key, keySize));
+	if (i == this->capacity_) {
+		return;
+	}
+	Slot * s = slot(i);
+	releaseSlot(s);
+	// A slot followed by an empty one doesn't interrupt any probe sequence
+	if (slot((i + 1) & (this->capacity_ - 1))->hash == EMPTY) {
+		s->hash = EMPTY;
+	} else {
+		s->hash = DELETED;
+		this->deleted_++;
+	}
+	this->size_--;
 }
 
 void MemStorage::clear(void) {
-	this->storage_->clear();
+	this->batch_.clear();
+	freeAll();
+	rehash(INITIAL_CAPACITY);
 }
 
 AbstractKeyValueIterator * MemStorage::createIterator() {
-	return this->storage_->createIterator();
+	return new MemStorageIterator(*this);
+}
+
+std::size_t MemStorage::size() const {
+	return this->size_;
 }
 
 }
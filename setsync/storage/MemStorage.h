@@ -8,28 +8,187 @@
 #define MEMSTORAGE_H_
 
 #include "KeyValueStorage.h"
-#include <setsync/storage/BdbStorage.h>
+#include <stdint.h>
+#include <map>
+#include <vector>
+
 namespace setsync {
 
 namespace storage {
 
+class MemStorage;
+
+/**
+ * Iterator over the entries of a MemStorage in the order of its hash
+ * table. Changing the storage invalidates the iterator.
+ */
+class MemStorageIterator: public AbstractKeyValueIterator {
+private:
+	/// The storage to iterate over
+	const MemStorage& storage_;
+	/// Index of the actual slot
+	std::size_t position_;
+	/**
+	 * Moves the position to the next used slot, starting at the
+	 * given one
+	 */
+	void skipToUsed(const std::size_t position);
+public:
+	/**
+	 * \param storage to iterate over
+	 */
+	MemStorageIterator(const MemStorage& storage);
+	virtual ~MemStorageIterator();
+	virtual void seekToFirst();
+	virtual bool valid() const;
+	virtual void next();
+	virtual size_t keySize() const;
+	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+};
+
+/**
+ * A key value storage, which keeps all entries in memory without any
+ * database. The entries are stored in an open addressing hash table
+ * with linear probing, which is optimized for the fixed size hash keys
+ * of the set: key and value are stored inline in the table slot, if
+ * they fit into it, otherwise the slot points to a block of an arena.
+ */
 class MemStorage: public setsync::storage::AbstractKeyValueStorage {
+	friend class MemStorageIterator;
+public:
+	/// Default number of bytes in a slot for inline key and value
+	static const std::size_t DEFAULT_INLINE_SIZE = 112;
 private:
-	Db * inMemoryDb_;
-	BdbStorage * storage_;
+	/// Number of slots of an empty table
+	static const std::size_t INITIAL_CAPACITY = 64;
+	/// Size of the memory chunks of the arena
+	static const std::size_t CHUNK_SIZE = 1024 * 1024;
+	/// Granularity of the blocks allocated from the arena
+	static const std::size_t BLOCK_ALIGNMENT = 16;
+	/// Number of keys, whose slots are prefetched ahead by multiGet()
+	static const std::size_t PREFETCH_DISTANCE = 8;
+	/**
+	 * Header of each slot, the inline bytes follow directly
+	 */
+	struct Slot {
+		/// Hash of the key, EMPTY or DELETED if the slot isn't used
+		uint64_t hash;
+		/// Size of the key in bytes
+		uint32_t keySize;
+		/// Size of the value in bytes
+		uint32_t valueSize;
+	};
+	/// Hash of a slot, which has never been used
+	static const uint64_t EMPTY = 0;
+	/// Hash of a slot, whose entry has been deleted
+	static const uint64_t DELETED = 1;
+	/// Free blocks of the arena by their size
+	typedef std::map<std::size_t, std::vector<unsigned char *> > FreeBlocks;
+	/// Number of bytes in a slot for inline key and value
+	std::size_t inlineSize_;
+	/// Number of bytes of a slot including its header
+	std::size_t slotSize_;
+	/// The hash table, capacity_ * slotSize_ bytes
+	unsigned char * slots_;
+	/// Number of slots, always a power of 2
+	std::size_t capacity_;
+	/// Number of stored entries
+	std::size_t size_;
+	/// Number of slots marked as DELETED
+	std::size_t deleted_;
+	/// Chunks of the arena, blocks of large entries are allocated from
+	std::vector<unsigned char *> chunks_;
+	/// Next unused byte of the last chunk
+	std::size_t chunkUsed_;
+	/// Blocks of deleted or moved entries, which could be reused
+	FreeBlocks freeBlocks_;
+	/**
+	 * \return the hash of the given key, never EMPTY or DELETED
+	 */
+	static uint64_t hashKey(const unsigned char * key, const std::size_t length);
+	/**
+	 * \return the size of the arena block needed by the given entry size
+	 */
+	static std::size_t blockSize(const std::size_t entrySize);
+	/**
+	 * \return the slot at the given index
+	 */
+	Slot * slot(const std::size_t index) const;
+	/**
+	 * \return true, if key and value of the slot are stored inline
+	 */
+	bool isInline(const Slot * s) const;
+	/**
+	 * \return the memory holding key and value of the given slot
+	 */
+	unsigned char * data(const Slot * s) const;
+	/**
+	 * Searches the slot of the given key
+	 *
+	 * \return the index of the slot or capacity_, if there is none
+	 */
+	std::size_t find(const unsigned char * key, const std::size_t length,
+			const uint64_t hash) const;
+	/**
+	 * Allocates a block for an entry of the given size from the arena
+	 */
+	unsigned char * allocate(const std::size_t entrySize);
+	/**
+	 * Passes the block of an entry of the given size back to the arena
+	 */
+	void release(unsigned char * block, const std::size_t entrySize);
+	/**
+	 * Releases the arena block of the given slot, if it has got one
+	 */
+	void releaseSlot(Slot * s);
+	/**
+	 * Moves all entries into a new table of the given capacity
+	 */
+	void rehash(const std::size_t capacity);
+	/**
+	 * Frees the table and all chunks of the arena
+	 */
+	void freeAll();
+	MemStorage(const MemStorage&);
+	MemStorage& operator=(const MemStorage&);
 public:
-	MemStorage(const std::size_t gbcache, const std::size_t cache);
+	/**
+	 * Creates an empty storage
+	 *
+	 * \param inlineSize number of bytes of key and value, which are stored
+	 * in the hash table itself. Larger entries are stored in an arena.
+	 */
+	MemStorage(const std::size_t inlineSize = DEFAULT_INLINE_SIZE);
 	virtual ~MemStorage();
 	virtual bool get(const unsigned char * key, const std::size_t length,
 			unsigned char ** value, std::size_t * valueSize) const;
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
 	virtual void put(const unsigned char * key, const std::size_t keySize,
 			const unsigned char * value, const std::size_t valueSize);
 	virtual void del(const unsigned char * key, const std::size_t keySize);
 	/**
-	 * Cleans map and frees all memory
+	 * Cleans the table and frees all memory
 	 */
 	virtual void clear(void);
 	virtual AbstractKeyValueIterator * createIterator();
+	/**
+	 * \return the number of stored entries
+	 */
+	std::size_t size() const;
+protected:
+	/**
+	 * Hashes all keys first and prefetches the slots of the following
+	 * keys, so the cache misses of the lookups overlap
+	 */
+	virtual void multiRead(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t * indices,
+			const std::size_t count, unsigned char * values,
+			const std::size_t valueStride, std::size_t * valueSizes,
+			bool * found) const;
 };
 
 }
@@ -0,0 +1,216 @@
+/*
+ * PrefixStorage.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "PrefixStorage.h"
+#include <string.h>
+#include <vector>
+
+namespace setsync {
+
+namespace storage {
+
+const std::size_t PrefixStorage::MAX_INLINE_KEY_SIZE;
+
+PrefixIterator::PrefixIterator(AbstractKeyValueIterator * it,
+		const std::string& prefix) :
+	it_(it), prefix_(prefix), valid_(false) {
+	seekToFirst();
+}
+
+PrefixIterator::~PrefixIterator() {
+	delete this->it_;
+}
+
+void PrefixIterator::skipToPrefix() {
+	const bool ordered = this->it_->isOrdered();
+	while (this->it_->valid()) {
+		this->key_.resize(this->it_->keySize());
+		if (this->key_.size() > 0) {
+			this->it_->key((unsigned char *) &this->key_[0]);
+		}
+		if (this->key_.compare(0, this->prefix_.size(), this->prefix_) == 0) {
+			this->valid_ = true;
+			return;
+		}
+		if (ordered && this->key_ > this->prefix_) {
+			// The keyspace has been passed
+			break;
+		}
+		this->it_->next();
+	}
+	this->valid_ = false;
+}
+
+void PrefixIterator::seekToFirst() {
+	this->it_->seek((const unsigned char *) this->prefix_.data(),
+			this->prefix_.size());
+	skipToPrefix();
+}
+
+void PrefixIterator::seek(const unsigned char * key, const std::size_t length) {
+	std::string prefixed(this->prefix_);
+	prefixed.append((const char *) key, length);
+	this->it_->seek((const unsigned char *) prefixed.data(), prefixed.size());
+	skipToPrefix();
+}
+
+bool PrefixIterator::valid() const {
+	return this->valid_;
+}
+
+void PrefixIterator::next() {
+	this->it_->next();
+	skipToPrefix();
+}
+
+size_t PrefixIterator::keySize() const {
+	return this->key_.size() - this->prefix_.size();
+}
+
+void PrefixIterator::key(unsigned char * buffer) const {
+	memcpy(buffer, this->key_.data() + this->prefix_.size(),
+			this->key_.size() - this->prefix_.size());
+}
+
+size_t PrefixIterator::valueSize() const {
+	return this->it_->valueSize();
+}
+
+void PrefixIterator::value(unsigned char * buffer) const {
+	this->it_->value(buffer);
+}
+
+bool PrefixIterator::isOrdered() const {
+	return this->it_->isOrdered();
+}
+
+PrefixStorage::PrefixStorage(AbstractKeyValueStorage& storage,
+		const unsigned char prefix) :
+	prefix_(1, (char) prefix), storage_(storage) {
+}
+
+PrefixStorage::PrefixStorage(AbstractKeyValueStorage& storage,
+		const std::string& prefix) :
+	prefix_(prefix), storage_(storage) {
+}
+
+void PrefixStorage::setPrefix(const std::string& prefix) {
+	this->prefix_ = prefix;
+}
+
+const std::string& PrefixStorage::getPrefix() const {
+	return this->prefix_;
+}
+
+PrefixStorage::~PrefixStorage() {
+}
+
+const unsigned char * PrefixStorage::prefixed(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer, std::string& large) const {
+	if (this->prefix_.size() + length <= MAX_INLINE_KEY_SIZE) {
+		memcpy(buffer, this->prefix_.data(), this->prefix_.size());
+		memcpy(buffer + this->prefix_.size(), key, length);
+		return buffer;
+	}
+	large.assign(this->prefix_);
+	large.append((const char *) key, length);
+	return (const unsigned char *) large.data();
+}
+
+bool PrefixStorage::get(const unsigned char * key, const std::size_t length,
+		unsigned char ** value, std::size_t * valueSize) const {
+	unsigned char buffer[MAX_INLINE_KEY_SIZE];
+	std::string large;
+	return this->storage_.get(prefixed(key, length, buffer, large),
+			this->prefix_.size() + length, value, valueSize);
+}
+
+bool PrefixStorage::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	unsigned char keyBuffer[MAX_INLINE_KEY_SIZE];
+	std::string large;
+	return this->storage_.getInto(prefixed(key, length, keyBuffer, large),
+			this->prefix_.size() + length, buffer, bufferSize, valueSize);
+}
+
+std::size_t PrefixStorage::multiGet(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t count,
+		unsigned char * values, const std::size_t valueStride,
+		std::size_t * valueSizes, bool * found) const {
+	const std::size_t length = this->prefix_.size() + keyLength;
+	std::vector<unsigned char> prefixedKeys(count * length);
+	for (std::size_t i = 0; i < count; i++) {
+		memcpy(&prefixedKeys[i * length], this->prefix_.data(),
+				this->prefix_.size());
+		if (keyLength > 0) {
+			memcpy(&prefixedKeys[i * length + this->prefix_.size()],
+					keys + i * keyLength, keyLength);
+		}
+	}
+	return this->storage_.multiGet(count > 0 ? &prefixedKeys[0] : NULL,
+			length, count, values, valueStride, valueSizes, found);
+}
+
+void PrefixStorage::put(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize) {
+	unsigned char buffer[MAX_INLINE_KEY_SIZE];
+	std::string large;
+	this->storage_.put(prefixed(key, keySize, buffer, large),
+			this->prefix_.size() + keySize, value, valueSize);
+}
+
+void PrefixStorage::del(const unsigned char * key, const std::size_t keySize) {
+	unsigned char buffer[MAX_INLINE_KEY_SIZE];
+	std::string large;
+	this->storage_.del(prefixed(key, keySize, buffer, large),
+			this->prefix_.size() + keySize);
+}
+
+void PrefixStorage::clear(void) {
+	// Collect the keys first, the storage is changed afterwards
+	std::vector<std::string> keys;
+	AbstractKeyValueIterator * it = createIterator();
+	std::string key;
+	for (; it->valid(); it->next()) {
+		key.resize(it->keySize());
+		it->key((unsigned char *) &key[0]);
+		keys.push_back(key);
+	}
+	delete it;
+	StorageBatch batch(*this);
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		del((const unsigned char *) keys[i].data(), keys[i].size());
+	}
+	batch.commit();
+}
+
+void PrefixStorage::beginBatch() {
+	this->storage_.beginBatch();
+	AbstractKeyValueStorage::beginBatch();
+}
+
+void PrefixStorage::commitBatch() {
+	this->storage_.commitBatch();
+	AbstractKeyValueStorage::commitBatch();
+}
+
+void PrefixStorage::abortBatch() {
+	this->storage_.abortBatch();
+	AbstractKeyValueStorage::abortBatch();
+}
+
+AbstractKeyValueIterator * PrefixStorage::createIterator() {
+	return new PrefixIterator(this->storage_.createIterator(), this->prefix_);
+}
+
+bool PrefixStorage::isConcurrentlyReadable() const {
+	return this->storage_.isConcurrentlyReadable();
+}
+
+}
+
+}
@@ -0,0 +1,141 @@
+/*
+ * PrefixStorage.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef PREFIXSTORAGE_H_
+#define PREFIXSTORAGE_H_
+
+#include "KeyValueStorage.h"
+
+namespace setsync {
+
+namespace storage {
+
+/**
+ * Iterates over the entries of a PrefixStorage, the keys are passed
+ * without the prefix. On ordered storages, only the keyspace is read,
+ * otherwise the entries of the shared storage are filtered.
+ */
+class PrefixIterator: public AbstractKeyValueIterator {
+private:
+	/// Iterator of the shared storage
+	AbstractKeyValueIterator * it_;
+	/// Prefix of the keyspace
+	std::string prefix_;
+	/// Buffer for the keys of the shared storage
+	std::string key_;
+	/// true, if the iterator points to an entry of the keyspace
+	bool valid_;
+	/**
+	 * Moves the iterator to the next entry of the keyspace, starting at
+	 * the actual one
+	 */
+	void skipToPrefix();
+	PrefixIterator(const PrefixIterator&);
+	PrefixIterator& operator=(const PrefixIterator&);
+public:
+	/**
+	 * \param it iterator of the shared storage, which is deleted by this one
+	 * \param prefix of the keyspace
+	 */
+	PrefixIterator(AbstractKeyValueIterator * it, const std::string& prefix);
+	virtual ~PrefixIterator();
+	virtual void seekToFirst();
+	virtual bool valid() const;
+	virtual void next();
+	virtual size_t keySize() const;
+	virtual void key(unsigned char * buffer) const;
+	virtual size_t valueSize() const;
+	virtual void value(unsigned char * buffer) const;
+	virtual void seek(const unsigned char * key, const std::size_t length);
+	virtual bool isOrdered() const;
+};
+
+/**
+ * A keyspace inside another storage. All keys are stored with a
+ * prefix, so several components could share a single database,
+ * with one cache, one log and one set of files.
+ */
+class PrefixStorage: public setsync::storage::AbstractKeyValueStorage {
+private:
+	/// Prefixed keys up to this size are built without an allocation
+	static const std::size_t MAX_INLINE_KEY_SIZE = 128;
+	/// Prefix of the keyspace
+	std::string prefix_;
+	/**
+	 * Writes the prefixed key into the given buffer, if it fits,
+	 * otherwise into the given string
+	 *
+	 * \return the prefixed key
+	 */
+	const unsigned char * prefixed(const unsigned char * key,
+			const std::size_t length, unsigned char * buffer,
+			std::string& large) const;
+	PrefixStorage(const PrefixStorage&);
+	PrefixStorage& operator=(const PrefixStorage&);
+protected:
+	/// The shared storage
+	AbstractKeyValueStorage& storage_;
+	/**
+	 * Moves this view to another keyspace of the storage
+	 */
+	void setPrefix(const std::string& prefix);
+public:
+	/**
+	 * \param storage which is shared with other keyspaces
+	 * \param prefix distinct prefix of this keyspace
+	 */
+	PrefixStorage(AbstractKeyValueStorage& storage, const unsigned char prefix);
+	/**
+	 * \param storage which is shared with other keyspaces
+	 * \param prefix distinct prefix of this keyspace, no prefix of
+	 * another keyspace must start with it
+	 */
+	PrefixStorage(AbstractKeyValueStorage& storage, const std::string& prefix);
+	virtual ~PrefixStorage();
+	virtual bool get(const unsigned char * key, const std::size_t length,
+			unsigned char ** value, std::size_t * valueSize) const;
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
+	/**
+	 * Prefixes all keys and passes them to multiGet() of the shared storage
+	 */
+	virtual std::size_t multiGet(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t count,
+			unsigned char * values, const std::size_t valueStride,
+			std::size_t * valueSizes, bool * found) const;
+	virtual void put(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	virtual void del(const unsigned char * key, const std::size_t keySize);
+	/**
+	 * Deletes all entries of this keyspace, the other keyspaces are kept
+	 */
+	virtual void clear(void);
+	/**
+	 * Starts a batch on the shared storage
+	 */
+	virtual void beginBatch();
+	virtual void commitBatch();
+	virtual void abortBatch();
+	/**
+	 * \return an iterator over the entries of this keyspace
+	 */
+	virtual AbstractKeyValueIterator * createIterator();
+	/**
+	 * \return true, if the shared storage is concurrently readable
+	 */
+	virtual bool isConcurrentlyReadable() const;
+	/**
+	 * \return the prefix of the keyspace
+	 */
+	const std::string& getPrefix() const;
+};
+
+}
+
+}
+
+#endif /* PREFIXSTORAGE_H_ */
@@ -0,0 +1,97 @@
+/*
+ * BFBatchTest.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "BFBatchTest.h"
+#include "StopWatch.h"
+#include <setsync/bloom/FSBloomFilter.h>
+#include <stdlib.h>
+#include <algorithm>
+using namespace std;
+using namespace setsync;
+
+/// Size of the keys, created by the SHA1Generator
+static const std::size_t KEY_SIZE = 20;
+
+BFBatchTest::BFBatchTest(const std::size_t elements) :
+	elements_(elements) {
+}
+
+BFBatchTest::~BFBatchTest() {
+}
+
+void BFBatchTest::print(const std::string& method, const std::size_t keys,
+		const double duration) {
+	cout << method << "," << keys << "," << duration << "," << (long) (keys
+			/ duration) << endl;
+}
+
+double BFBatchTest::runAdd(bloom::AbstractBloomFilter& bf,
+		const unsigned char * keys) {
+	StopWatch watch;
+	watch.start();
+	for (std::size_t i = 0; i < elements_; i++) {
+		bf.add(keys + i * KEY_SIZE);
+	}
+	watch.stop();
+	return watch.getDuration();
+}
+
+double BFBatchTest::runAddAll(bloom::AbstractBloomFilter& bf,
+		const unsigned char * keys) {
+	StopWatch watch;
+	watch.start();
+	for (std::size_t i = 0; i < elements_; i += ITEMS_PER_LOOPS) {
+		bf.addAll(keys + i * KEY_SIZE,
+				std::min((std::size_t) ITEMS_PER_LOOPS, elements_ - i));
+	}
+	watch.stop();
+	return watch.getDuration();
+}
+
+double BFBatchTest::runContains(bloom::AbstractBloomFilter& bf,
+		const unsigned char * keys) {
+	std::size_t found = 0;
+	StopWatch watch;
+	watch.start();
+	for (std::size_t i = 0; i < elements_; i++) {
+		if (bf.contains(keys + i * KEY_SIZE))
+			found++;
+	}
+	watch.stop();
+	if (found != elements_)
+		cout << "contains missed " << elements_ - found << " keys" << endl;
+	return watch.getDuration();
+}
+
+double BFBatchTest::runContainsAll(bloom::AbstractBloomFilter& bf,
+		const unsigned char * keys) {
+	std::size_t found = 0;
+	StopWatch watch;
+	watch.start();
+	for (std::size_t i = 0; i < elements_; i += ITEMS_PER_LOOPS) {
+		found += bf.containsAll(keys + i * KEY_SIZE,
+				std::min((std::size_t) ITEMS_PER_LOOPS, elements_ - i));
+	}
+	watch.stop();
+	if (found != elements_)
+		cout << "containsAll missed " << elements_ - found << " keys" << endl;
+	return watch.getDuration();
+}
+
+void BFBatchTest::run() {
+	cout << "running FSBloomFilter batch test:" << endl;
+	crypto::CryptoHash sha1;
+	SHA1Generator generator(0, elements_);
+	generator.run();
+	bloom::FSBloomFilter single(sha1, NULL, elements_);
+	bloom::FSBloomFilter batch(sha1, NULL, elements_);
+	cout << "method,keys,realtimeDuration,keysPerSecond" << endl;
+	print("add", elements_, runAdd(single, generator.array));
+	print("addAll", elements_, runAddAll(batch, generator.array));
+	print("contains", elements_, runContains(single, generator.array));
+	print("containsAll", elements_, runContainsAll(batch, generator.array));
+	cout << "equal filters: " << ((single == batch) ? "yes" : "no") << endl;
+}
@@ -0,0 +1,51 @@
+/*
+ * BFBatchTest.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef BFBATCHTEST_H_
+#define BFBATCHTEST_H_
+#include "Test.h"
+#include <setsync/bloom/BloomFilter.h>
+
+/**
+ * Compares the throughput of the single key methods add and contains
+ * of the FSBloomFilter with the batched addAll and containsAll methods.
+ */
+class BFBatchTest: public Test {
+private:
+	/// Number of keys added to and checked on each filter
+	std::size_t elements_;
+	/**
+	 * Prints one result line
+	 */
+	void print(const std::string& method, const std::size_t keys,
+			const double duration);
+	/**
+	 * Adds the keys to the filter by calling add for each key
+	 */
+	double runAdd(setsync::bloom::AbstractBloomFilter& bf,
+			const unsigned char * keys);
+	/**
+	 * Adds the keys to the filter by calling addAll once per loop
+	 */
+	double runAddAll(setsync::bloom::AbstractBloomFilter& bf,
+			const unsigned char * keys);
+	/**
+	 * Checks the keys by calling contains for each key
+	 */
+	double runContains(setsync::bloom::AbstractBloomFilter& bf,
+			const unsigned char * keys);
+	/**
+	 * Checks the keys by calling containsAll once per loop
+	 */
+	double runContainsAll(setsync::bloom::AbstractBloomFilter& bf,
+			const unsigned char * keys);
+public:
+	BFBatchTest(const std::size_t elements = ITERATIONS);
+	virtual ~BFBatchTest();
+	void run();
+};
+
+#endif /* BFBATCHTEST_H_ */
@@ -16,7 +16,7 @@ namespace evaluation {
 
 BloomFilterDiff::BloomFilterDiff(const setsync::crypto::CryptoHash& hash,
 		const size_t A, const float p, const size_t salt) :
-	storageA_(1, 0), storageB_(1, 0), A_(hash, storageA_, "", A, false, p),
+	storageA_(), storageB_(), A_(hash, storageA_, "", A, false, p),
 			B_(hash, storageB_, "", A, false, p), diffsize_(A), p_(p), salt_(salt) {
 	uint64_t i;
 	unsigned char buffer[hash.getHashSize()];
@@ -0,0 +1,104 @@
+/*
+ * BulkInsertTest.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "BulkInsertTest.h"
+#include "StopWatch.h"
+#include <setsync/utils/FileSystem.h>
+#include <stdlib.h>
+#include <algorithm>
+
+using namespace std;
+namespace evaluation {
+
+BulkInsertTest::BulkInsertTest(const setsync::config::Configuration& c,
+		const std::size_t elements, const std::size_t batchSize) :
+	config_(c), elements_(elements), batchSize_(batchSize) {
+	switch (c.getStorage().getType()) {
+	case setsync::config::Configuration::StorageConfig::LEVELDB:
+		this->storage_ = "LEVELDB";
+		break;
+	case setsync::config::Configuration::StorageConfig::BERKELEY_DB:
+		this->storage_ = "BERKELEY_DB";
+		break;
+	case setsync::config::Configuration::StorageConfig::IN_MEMORY:
+		this->storage_ = "MEM_DB";
+		break;
+	case setsync::config::Configuration::StorageConfig::LMDB:
+		this->storage_ = "LMDB";
+		break;
+	}
+}
+
+BulkInsertTest::~BulkInsertTest() {
+
+}
+
+void BulkInsertTest::generate(const setsync::crypto::CryptoHash& hash,
+		unsigned char * buffer, const uint64_t start, const std::size_t count) {
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t value = start + i;
+		hash(buffer + i * hash.getHashSize(), (unsigned char *) &value,
+				sizeof(uint64_t));
+	}
+}
+
+double BulkInsertTest::runSingleInserts(setsync::Set& set) {
+	const setsync::crypto::CryptoHash& hash = set.getHashFunction();
+	unsigned char * keys = (unsigned char *) malloc(
+			batchSize_ * hash.getHashSize());
+	StopWatch watch;
+	for (std::size_t i = 0; i < elements_; i += batchSize_) {
+		std::size_t count = std::min(batchSize_, elements_ - i);
+		generate(hash, keys, i, count);
+		watch.start();
+		for (std::size_t j = 0; j < count; j++) {
+			set.insert(keys + j * hash.getHashSize());
+		}
+		watch.stop();
+	}
+	free(keys);
+	return watch.getDuration();
+}
+
+double BulkInsertTest::runBatchInserts(setsync::Set& set) {
+	const setsync::crypto::CryptoHash& hash = set.getHashFunction();
+	unsigned char * keys = (unsigned char *) malloc(
+			batchSize_ * hash.getHashSize());
+	StopWatch watch;
+	for (std::size_t i = 0; i < elements_; i += batchSize_) {
+		std::size_t count = std::min(batchSize_, elements_ - i);
+		generate(hash, keys, i, count);
+		watch.start();
+		set.insertAll(keys, count);
+		watch.stop();
+	}
+	free(keys);
+	return watch.getDuration();
+}
+
+void BulkInsertTest::run() {
+	cout << "running Set bulk insertion test (" << storage_ << ", batch size "
+			<< batchSize_ << ")" << endl;
+	cout << "method,inserts,realtimeDuration,keysPerSecond" << endl;
+	setsync::utils::FileSystem::TemporaryDirectory singleDir("bulkinsert");
+	setsync::utils::FileSystem::TemporaryDirectory batchDir("bulkinsert");
+	setsync::config::Configuration singleConfig(config_);
+	singleConfig.setPath(singleDir.getPath());
+	setsync::config::Configuration batchConfig(config_);
+	batchConfig.setPath(batchDir.getPath());
+	setsync::Set single(singleConfig);
+	setsync::Set batch(batchConfig);
+	double duration = runSingleInserts(single);
+	cout << "insert," << single.getSize() << "," << duration << ","
+			<< single.getSize() / duration << endl;
+	duration = runBatchInserts(batch);
+	cout << "insertAll," << batch.getSize() << "," << duration << ","
+			<< batch.getSize() / duration << endl;
+	cout << "equal tries: " << ((single == batch) ? "yes" : "no") << endl;
+	cout << "########################" << endl;
+}
+
+}
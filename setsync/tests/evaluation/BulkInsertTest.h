@@ -0,0 +1,57 @@
+/*
+ * BulkInsertTest.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef BULKINSERTTEST_H_
+#define BULKINSERTTEST_H_
+
+#include "Test.h"
+#include <setsync/Set.hpp>
+#include <setsync/config/Configuration.h>
+
+namespace evaluation {
+/**
+ * Compares the insertion rate of Set::insert, called once per key,
+ * with the batched Set::insertAll, which rehashes the trie only once
+ * per batch.
+ */
+class BulkInsertTest: public Test {
+private:
+	/// Configuration of both compared sets, the path is replaced
+	const setsync::config::Configuration& config_;
+	/// Number of elements to be inserted into each set
+	std::size_t elements_;
+	/// Number of keys passed to one insertAll call
+	std::size_t batchSize_;
+	std::string storage_;
+	/**
+	 * Creates the keys elements [start,start+count) into the given buffer
+	 */
+	void generate(const setsync::crypto::CryptoHash& hash,
+			unsigned char * buffer, const uint64_t start,
+			const std::size_t count);
+	/**
+	 * Inserts all elements by calling insert for each key
+	 *
+	 * \return the real time duration in seconds
+	 */
+	double runSingleInserts(setsync::Set& set);
+	/**
+	 * Inserts all elements by calling insertAll for each batch
+	 *
+	 * \return the real time duration in seconds
+	 */
+	double runBatchInserts(setsync::Set& set);
+public:
+	BulkInsertTest(const setsync::config::Configuration& c,
+			const std::size_t elements, const std::size_t batchSize =
+					ITEMS_PER_LOOPS);
+	virtual ~BulkInsertTest();
+	virtual void run();
+};
+
+}
+
+#endif /* BULKINSERTTEST_H_ */
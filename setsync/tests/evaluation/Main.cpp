@@ -5,10 +5,12 @@
  */
 #include "config.h"
 #include "BFTest.h"
+#include "BFBatchTest.h"
 #include "DBTest.h"
 #include "BDBInsertRemoveTest.h"
 #include "BDBTransactionsTest.h"
 #include "SetTest.h"
+#include "BulkInsertTest.h"
 #include "SetSync.h"
 #include "StopWatch.h"
 #include "SpeedTest.h"
@@ -20,13 +22,16 @@
 #include <set>
 #include <setsync/Set.hpp>
 #include <setsync/config/Configuration.h>
-#ifdef HAVE_DB_CXX_H
 #include <setsync/storage/MemStorage.h>
+#ifdef HAVE_DB_CXX_H
 #include <setsync/storage/BdbStorage.h>
 #endif
 #ifdef HAVE_LEVELDB
 #include <setsync/storage/LevelDbStorage.h>
 #endif
+#ifdef HAVE_LMDB
+#include <setsync/storage/LmdbStorage.h>
+#endif
 #ifdef HAVE_SQLITE
 #include "SQLiteTest.h"
 #endif
@@ -41,10 +46,12 @@ int main(int ac, char **av) {
 	if (!(args.find(std::string("--help")) == args.end())) {
 		std::cout << "Possible parameter tests are: " << std::endl;
 		std::cout << "--bf-test" << std::endl;
+		std::cout << "--bf-batch-test" << std::endl;
 		std::cout << "--bdb-test" << std::endl;
 		std::cout << "--bdb-insert-remove-test" << std::endl;
 		std::cout << "--bdb-transaction-test" << std::endl;
 		std::cout << "--set-tests" << std::endl;
+		std::cout << "--set-bulk-insert-test" << std::endl;
 #ifdef HAVE_SQLITE
 		std::cout << "--sql-test" << std::endl;
 #endif
@@ -65,12 +72,15 @@ int main(int ac, char **av) {
 			== args.end());
 	bool bdb = !(args.find(std::string("--bdb-test")) == args.end());
 	bool bf = !(args.find(std::string("--bf-test")) == args.end());
+	bool bfbatch = !(args.find(std::string("--bf-batch-test")) == args.end());
 	bool bdbinsert = !(args.find(std::string("--bdb-insert-remove-test"))
 			== args.end());
 	bool bdbtransaction = !(args.find(std::string("--bdb-transaction-test"))
 			== args.end());
 	bool all = !(args.find(std::string("--all-tests")) == args.end());
 	bool settest = !(args.find(std::string("--set-tests")) == args.end());
+	bool bulkinsert = !(args.find(std::string("--set-bulk-insert-test"))
+			== args.end());
 #ifdef HAVE_SQLITE
 	bool sqlite = !(args.find(std::string("--sql-test")) == args.end());
 #endif
@@ -96,6 +106,10 @@ int main(int ac, char **av) {
 		BFTest bftest;
 		bftest.run();
 	}
+	if (bfbatch || all) {
+		BFBatchTest bfbatchtest;
+		bfbatchtest.run();
+	}
 	if (bdbinsert || all) {
 		{
 			BDBInsertRemoveTest bdbtest(DB_HASH);
@@ -204,6 +218,7 @@ int main(int ac, char **av) {
 			evaluation::SetTest settest(c);
 			settest.run();
 		}
+#endif
 		cout << "MemDB" << endl;
 		{
 			SET_CONFIG cc = set_create_config();
@@ -214,7 +229,6 @@ int main(int ac, char **av) {
 			evaluation::SetTest settest(c);
 			settest.run();
 		}
-#endif
 #ifdef HAVE_LEVELDB
 		cout << "LevelDB default cache" << endl;
 		{
@@ -241,20 +255,68 @@ int main(int ac, char **av) {
 			evaluation::SetTest settest(c);
 			settest.run();
 		}
+#endif
+#ifdef HAVE_LMDB
+		cout << "LMDB" << endl;
+		{
+			setsync::utils::FileSystem::TemporaryDirectory tempdir("lmdb");
+			SET_CONFIG cc = set_create_config();
+			cc.bf_max_elements = elements;
+			cc.false_positive_rate = fpr;
+			cc.storage = LMDB;
+			setsync::config::Configuration c(cc);
+			c.setPath(tempdir.getPath());
+			evaluation::SetTest settest(c);
+			settest.run();
+		}
 #endif
 	}
 
-	if (speedtest || all) {
+	if (bulkinsert || all) {
+		size_t elements = 100000;
+		float fpr = ceil((float) (elements) * 0.000444595) / elements;
 #ifdef HAVE_DB_CXX_H
 		{
-			cout << "running MemDB Speed Test with 1 GB RAM" << endl;
-			size_t gbyte = 1;
-			size_t byte = 0;
-			setsync::storage::MemStorage storage(gbyte, byte);
+			SET_CONFIG cc = set_create_config();
+			cc.bf_max_elements = elements;
+			cc.false_positive_rate = fpr;
+			cc.storage = BERKELEY_DB;
+			setsync::config::Configuration c(cc);
+			evaluation::BulkInsertTest bulktest(c, elements);
+			bulktest.run();
+		}
+#endif
+		{
+			SET_CONFIG cc = set_create_config();
+			cc.bf_max_elements = elements;
+			cc.false_positive_rate = fpr;
+			cc.storage = IN_MEMORY_DB;
+			setsync::config::Configuration c(cc);
+			evaluation::BulkInsertTest bulktest(c, elements);
+			bulktest.run();
+		}
+#ifdef HAVE_LEVELDB
+		{
+			SET_CONFIG cc = set_create_config();
+			cc.bf_max_elements = elements;
+			cc.false_positive_rate = fpr;
+			cc.storage = LEVELDB;
+			setsync::config::Configuration c(cc);
+			evaluation::BulkInsertTest bulktest(c, elements);
+			bulktest.run();
+		}
+#endif
+	}
+
+	if (speedtest || all) {
+		{
+			cout << "running MemDB Speed Test" << endl;
+			setsync::storage::MemStorage storage;
 			evaluation::SpeedTest mem(storage);
 			mem.run();
 			cout << "######################################" << endl;
 		}
+#ifdef HAVE_DB_CXX_H
 		{
 			cout << "running Berkeley DB Speed Test with default RAM" << endl;
 			setsync::utils::FileSystem::TemporaryDirectory tempdir("bdbspeed");
@@ -306,6 +368,16 @@ int main(int ac, char **av) {
 			bdb.run();
 			cout << "######################################" << endl;
 		}
+#endif
+#ifdef HAVE_LMDB
+		{
+			cout << "running LMDB Speed Test" << endl;
+			setsync::utils::FileSystem::TemporaryDirectory tempdir("lmdbspeed");
+			setsync::storage::LmdbStorage storage(tempdir.getPath());
+			evaluation::SpeedTest lmdb(storage);
+			lmdb.run();
+			cout << "######################################" << endl;
+		}
 #endif
 	}
 }
@@ -22,7 +22,7 @@ void printUsage() {
 			<< endl;
 	cout << endl;
 	cout
-			<< "\t-s, --storage <levelDB|berkeleyDB|memDB> chooses a key value storage type,"
+			<< "\t-s, --storage <levelDB|berkeleyDB|memDB|lmdb> chooses a key value storage type,"
 			<< endl;
 	cout
 			<< "\t                                   default is the compiled default"
@@ -105,6 +105,8 @@ int main(int ac, char **av) {
 				config.storage = BERKELEY_DB;
 			} else if (*iter == "memDB") {
 				config.storage = IN_MEMORY_DB;
+			} else if (*iter == "lmdb") {
+				config.storage = LMDB;
 			} else {
 				printUsage();
 			}
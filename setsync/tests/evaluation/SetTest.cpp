@@ -26,6 +26,9 @@ SetTest::SetTest(const setsync::config::Configuration& c) :
 	case setsync::config::Configuration::StorageConfig::IN_MEMORY:
 		this->storage_ = "MEM_DB";
 		break;
+	case setsync::config::Configuration::StorageConfig::LMDB:
+		this->storage_ = "LMDB";
+		break;
 	}
 
 }
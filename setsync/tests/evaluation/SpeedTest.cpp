@@ -6,6 +6,7 @@
 
 #include "SpeedTest.h"
 #include <sstream>
+#include <vector>
 #include "StopWatch.h"
 
 namespace evaluation {
@@ -60,6 +61,64 @@ void SpeedTest::run() {
 		watch.reset();
 	}
 	duration.reset();
+	// Reads without allocation, like the lookups of a set
+	for (int iter = 0; iter < LOOP_ITERATIONS; iter++) {
+		size_t valuesize;
+		for (int i = 0; i < ITEMS_PER_LOOPS; i++) {
+			stringstream ss;
+			ss << "test" << iter * ITEMS_PER_LOOPS + i;
+			hash(buffer, ss.str());
+			duration.start();
+			watch.start();
+			storage_.getInto(buffer, hash.getHashSize(), value, 200, &valuesize);
+			watch.stop();
+			duration.stop();
+		}
+		cout << "getinto," << iter * ITEMS_PER_LOOPS + ITEMS_PER_LOOPS << ","
+				<< watch.getDuration() << "," << duration.getDuration() << endl;
+		watch.reset();
+	}
+	duration.reset();
+	// All keys of a loop are read at once
+	{
+		std::vector<unsigned char> keys(ITEMS_PER_LOOPS * hash.getHashSize());
+		std::vector<unsigned char> values(ITEMS_PER_LOOPS * 200);
+		std::vector<size_t> valueSizes(ITEMS_PER_LOOPS);
+		bool found[ITEMS_PER_LOOPS];
+		for (int iter = 0; iter < LOOP_ITERATIONS; iter++) {
+			for (int i = 0; i < ITEMS_PER_LOOPS; i++) {
+				stringstream ss;
+				ss << "test" << iter * ITEMS_PER_LOOPS + i;
+				hash(&keys[i * hash.getHashSize()], ss.str());
+			}
+			duration.start();
+			watch.start();
+			storage_.multiGet(&keys[0], hash.getHashSize(), ITEMS_PER_LOOPS,
+					&values[0], 200, &valueSizes[0], found);
+			watch.stop();
+			duration.stop();
+			cout << "multiget," << iter * ITEMS_PER_LOOPS + ITEMS_PER_LOOPS
+					<< "," << watch.getDuration() << ","
+					<< duration.getDuration() << endl;
+			watch.reset();
+		}
+	}
+	duration.reset();
+	// Full scan reading keys and values by the iterator
+	watch.start();
+	AbstractKeyValueIterator * it = storage_.createIterator();
+	std::size_t scanned = 0;
+	for (; it->valid(); it->next()) {
+		if (it->valueSize() <= 200) {
+			it->value(value);
+		}
+		scanned++;
+	}
+	delete it;
+	watch.stop();
+	cout << "scan," << scanned << "," << watch.getDuration() << ","
+			<< watch.getDuration() << endl;
+	watch.reset();
 	for (int iter = 0; iter < LOOP_ITERATIONS; iter++) {
 		for (int i = 0; i < ITEMS_PER_LOOPS; i++) {
 			stringstream ss;
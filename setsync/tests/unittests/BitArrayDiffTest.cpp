@@ -0,0 +1,100 @@
+///
+/// @file        BitArrayDiffTest.cpp
+/// @brief       CPPUnit-Tests for class BitArrayDiff
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+#include "BitArrayDiffTest.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace setsync {
+namespace bloom {
+
+/**
+ * Compares the given scan implementation with a byte by byte search
+ * on arrays with a few local only bits at different positions
+ */
+void BitArrayDiffTest::checkImplementation(BitArrayDiff::ScanFunction scan) {
+	const std::size_t length = 1000;
+	unsigned char local[length];
+	unsigned char remote[length];
+	srand(42);
+	for (std::size_t round = 0; round < 50; round++) {
+		for (std::size_t i = 0; i < length; i++) {
+			remote[i] = rand() % 256;
+			local[i] = remote[i] & (rand() % 256);
+		}
+		// Set some bits, which are not set remotely
+		for (std::size_t i = 0; i < round % 5; i++) {
+			std::size_t pos = rand() % length;
+			unsigned char bit = 1 << (rand() % 8);
+			remote[pos] &= ~bit;
+			local[pos] |= bit;
+		}
+		// Bits, which are set in both arrays or only remotely, are ignored
+		std::size_t start = round % 70;
+		std::size_t expected = start;
+		while (expected < length && (local[expected] & ~remote[expected]) == 0)
+			expected++;
+		CPPUNIT_ASSERT_EQUAL(expected, scan(local, remote, start, length));
+		if (expected < length) {
+			CPPUNIT_ASSERT_EQUAL(expected, scan(local, remote, expected, length));
+			std::size_t next = expected + 1;
+			while (next < length && (local[next] & ~remote[next]) == 0)
+				next++;
+			CPPUNIT_ASSERT_EQUAL(next, scan(local, remote, expected + 1, length));
+		}
+		// Shorter lengths must not read behind the end
+		CPPUNIT_ASSERT(scan(local, remote, start, start + round % 33)
+				<= start + round % 33);
+	}
+	memset(local, 0xFF, length);
+	memset(remote, 0xFF, length);
+	CPPUNIT_ASSERT_EQUAL(length, scan(local, remote, 0, length));
+	CPPUNIT_ASSERT_EQUAL(length, scan(local, remote, length, length));
+	remote[length - 1] = 0x7F;
+	CPPUNIT_ASSERT_EQUAL(length - 1, scan(local, remote, 0, length));
+	// The difference is behind the end, so nothing is found
+	CPPUNIT_ASSERT_EQUAL(length - 2, scan(local, remote, 0, length - 2));
+	remote[0] = 0xFE;
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, scan(local, remote, 0, length));
+}
+
+/*=== BEGIN tests for class 'BitArrayDiff' ===*/
+void BitArrayDiffTest::testScalar() {
+	checkImplementation(BitArrayDiff::nextDifferenceScalar);
+}
+
+void BitArrayDiffTest::testSSE2() {
+	checkImplementation(BitArrayDiff::nextDifferenceSSE2);
+}
+
+void BitArrayDiffTest::testAVX2() {
+	checkImplementation(BitArrayDiff::nextDifferenceAVX2);
+}
+
+void BitArrayDiffTest::testNextDifference() {
+	checkImplementation(BitArrayDiff::nextDifference);
+	CPPUNIT_ASSERT(BitArrayDiff::getImplementation() != NULL);
+}
+
+void BitArrayDiffTest::testLowestBit() {
+	for (unsigned int i = 1; i < 256; i++) {
+		unsigned int bit = BitArrayDiff::lowestBit(i);
+		CPPUNIT_ASSERT(bit < 8);
+		CPPUNIT_ASSERT((i & (1 << bit)) != 0);
+		CPPUNIT_ASSERT((i & ((1 << bit) - 1)) == 0);
+	}
+}
+
+/*=== END   tests for class 'BitArrayDiff' ===*/
+
+void BitArrayDiffTest::setUp() {
+}
+
+void BitArrayDiffTest::tearDown() {
+}
+
+}
+}
@@ -0,0 +1,41 @@
+///
+/// @brief       CPPUnit-Tests for class BitArrayDiff
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <setsync/bloom/BitArrayDiff.h>
+
+#ifndef BITARRAYDIFFTEST_H
+#define BITARRAYDIFFTEST_H
+namespace setsync {
+namespace bloom {
+class BitArrayDiffTest: public CppUnit::TestFixture {
+private:
+	void checkImplementation(BitArrayDiff::ScanFunction scan);
+public:
+	/*=== BEGIN tests for class 'BitArrayDiff' ===*/
+	void testScalar();
+	void testSSE2();
+	void testAVX2();
+	void testNextDifference();
+	void testLowestBit();
+	/*=== END   tests for class 'BitArrayDiff' ===*/
+
+	void setUp();
+	void tearDown();
+
+CPPUNIT_TEST_SUITE(BitArrayDiffTest);
+		CPPUNIT_TEST(testScalar);
+		CPPUNIT_TEST(testSSE2);
+		CPPUNIT_TEST(testAVX2);
+		CPPUNIT_TEST(testNextDifference);
+		CPPUNIT_TEST(testLowestBit);
+	CPPUNIT_TEST_SUITE_END();
+};
+CPPUNIT_TEST_SUITE_REGISTRATION( BitArrayDiffTest);
+}
+}
+#endif /* BITARRAYDIFFTEST_H */
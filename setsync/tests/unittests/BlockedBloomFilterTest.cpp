@@ -0,0 +1,99 @@
+///
+/// @file        BlockedBloomFilterTest.cpp
+/// @brief       CPPUnit-Tests for class BlockedBloomFilter
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+#include "BlockedBloomFilterTest.h"
+#include <setsync/bloom/BlockedBloomFilter.h>
+#include <sstream>
+#include <string.h>
+
+namespace setsync {
+namespace bloom {
+
+/*=== BEGIN tests for class 'BlockedBloomFilter' ===*/
+void BlockedBloomFilterTest::testLoad() {
+	bloom::BlockedBloomFilter Filter1(hash, 10, false, 0.01);
+	bloom::BlockedBloomFilter Filter2(hash, 10, false, 0.01);
+	Filter1.AbstractBloomFilter::add("hello");
+	CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("hello"));
+	CPPUNIT_ASSERT(!Filter2.AbstractBloomFilter::contains("hello"));
+	std::stringstream buf;
+	Filter1.save(buf);
+	Filter2.load(buf, Filter1.numberOfElements());
+	CPPUNIT_ASSERT_EQUAL(Filter1.numberOfElements(), Filter2.numberOfElements());
+	CPPUNIT_ASSERT(Filter1 == Filter2);
+	CPPUNIT_ASSERT(Filter2.AbstractBloomFilter::contains("hello"));
+}
+
+void BlockedBloomFilterTest::testInsert() {
+	bloom::BlockedBloomFilter Filter1(hash, 1000);
+	// The filter consists of whole blocks
+	CPPUNIT_ASSERT(Filter1.size() % BlockedBloomFilter::BLOCK_SIZE == 0);
+	unsigned char cad1[hash.getHashSize()];
+	hash(cad1, "ejemplo");
+	CPPUNIT_ASSERT(!Filter1.contains(cad1));
+	Filter1.add(cad1);
+	CPPUNIT_ASSERT(Filter1.contains(cad1));
+	CPPUNIT_ASSERT(Filter1.numberOfElements() == 1);
+	Filter1.clear();
+	CPPUNIT_ASSERT(!Filter1.contains(cad1));
+	CPPUNIT_ASSERT(Filter1.numberOfElements() == 0);
+}
+
+void BlockedBloomFilterTest::testContainsAll() {
+	bloom::BlockedBloomFilter Filter1(hash, 1000);
+	unsigned char hashes[100 * hash.getHashSize()];
+	for (int i = 0; i < 100; i++) {
+		hash(hashes + i * hash.getHashSize(), (unsigned char *) &i, sizeof(i));
+	}
+	CPPUNIT_ASSERT(Filter1.containsAll(hashes, 100) == 0);
+	Filter1.addAll(hashes, 50);
+	CPPUNIT_ASSERT(Filter1.containsAll(hashes, 50) == 50);
+	CPPUNIT_ASSERT(Filter1.containsAll(hashes, 100) >= 50);
+	Filter1.addAll(hashes + 50 * hash.getHashSize(), 50);
+	CPPUNIT_ASSERT(Filter1.containsAll(hashes, 100) == 100);
+}
+
+void BlockedBloomFilterTest::testFalsePositiveRate() {
+	const int elements = 10000;
+	bloom::BlockedBloomFilter Filter1(hash, elements, false, 0.01);
+	unsigned char key[hash.getHashSize()];
+	for (int i = 0; i < elements; i++) {
+		hash(key, (unsigned char *) &i, sizeof(i));
+		Filter1.add(key);
+	}
+	int falsePositives = 0;
+	for (int i = elements; i < 2 * elements; i++) {
+		hash(key, (unsigned char *) &i, sizeof(i));
+		if (Filter1.contains(key))
+			falsePositives++;
+	}
+	// Blocking costs some accuracy, but it must stay in the same range
+	CPPUNIT_ASSERT(falsePositives < elements * 0.01 * 3);
+}
+
+void BlockedBloomFilterTest::testOperators() {
+	bloom::BlockedBloomFilter Filter1(hash, 100);
+	bloom::BlockedBloomFilter Filter2(hash, 100);
+	Filter1.AbstractBloomFilter::add("hello");
+	Filter2.AbstractBloomFilter::add("bye");
+	CPPUNIT_ASSERT(Filter1 != Filter2);
+	Filter1 |= Filter2;
+	CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("hello"));
+	CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bye"));
+	Filter1 &= Filter2;
+	CPPUNIT_ASSERT(Filter1 == Filter2);
+	Filter1 ^= Filter2;
+	CPPUNIT_ASSERT(!Filter1.AbstractBloomFilter::contains("bye"));
+}
+
+void BlockedBloomFilterTest::setUp() {
+}
+
+void BlockedBloomFilterTest::tearDown() {
+}
+
+}
+}
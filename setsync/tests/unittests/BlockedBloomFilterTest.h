@@ -0,0 +1,41 @@
+///
+/// @brief       CPPUnit-Tests for class BlockedBloomFilter
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <setsync/crypto/CryptoHash.h>
+
+#ifndef BLOCKEDBLOOMFILTERTEST_H
+#define BLOCKEDBLOOMFILTERTEST_H
+namespace setsync {
+namespace bloom {
+class BlockedBloomFilterTest: public CppUnit::TestFixture {
+private:
+	crypto::CryptoHash hash;
+public:
+	/*=== BEGIN tests for class 'BlockedBloomFilter' ===*/
+	void testLoad();
+	void testInsert();
+	void testContainsAll();
+	void testFalsePositiveRate();
+	void testOperators();
+	/*=== END   tests for class 'BlockedBloomFilter' ===*/
+
+	void setUp();
+	void tearDown();
+
+CPPUNIT_TEST_SUITE(BlockedBloomFilterTest);
+		CPPUNIT_TEST(testLoad);
+		CPPUNIT_TEST(testInsert);
+		CPPUNIT_TEST(testContainsAll);
+		CPPUNIT_TEST(testFalsePositiveRate);
+		CPPUNIT_TEST(testOperators);
+	CPPUNIT_TEST_SUITE_END();
+};
+CPPUNIT_TEST_SUITE_REGISTRATION( BlockedBloomFilterTest);
+}
+}
+#endif /* BLOCKEDBLOOMFILTERTEST_H */
@@ -0,0 +1,188 @@
+///
+/// @file        BloomFilterChunkCodecTest.cpp
+/// @brief       CPPUnit-Tests for class BloomFilterChunkCodec
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+#include "BloomFilterChunkCodecTest.h"
+#include <stdlib.h>
+#include <string.h>
+
+namespace setsync {
+namespace bloom {
+
+/**
+ * Copies the decoded windows into a bit array
+ */
+class CopyWindowHandler: public BloomFilterChunkCodec::WindowHandler {
+public:
+	std::vector<unsigned char>& bits;
+	std::size_t maxWindow;
+	CopyWindowHandler(std::vector<unsigned char>& b) :
+		bits(b), maxWindow(0) {
+	}
+	virtual void handle(const unsigned char * window, const std::size_t length,
+			const std::size_t offset) {
+		CPPUNIT_ASSERT(offset + length <= bits.size());
+		memcpy(&bits[offset], window, length);
+		if (length > maxWindow)
+			maxWindow = length;
+	}
+};
+
+std::size_t BloomFilterChunkCodecTest::transfer(
+		const std::vector<unsigned char>& bits,
+		std::vector<unsigned char>& result, const std::size_t chunkSize,
+		const std::size_t windowSize) {
+	std::vector<unsigned char> chunk(chunkSize);
+	result.assign(bits.size(), 0xAA);
+	CopyWindowHandler handler(result);
+	unsigned int parameter = 0;
+	std::size_t setBits = 0;
+	for (std::size_t i = 0; i < bits.size() * 8; i++) {
+		if (bits[i / 8] & (1 << (i % 8)))
+			setBits++;
+	}
+	parameter = BloomFilterChunkCodec::optimalParameter(setBits,
+			bits.size() * 8);
+	std::size_t offset = 0;
+	std::size_t transfered = 0;
+	while (offset < bits.size()) {
+		std::size_t covered;
+		std::size_t written = BloomFilterChunkCodec::encode(&bits[0],
+				bits.size(), offset, parameter, &chunk[0], chunkSize, &covered);
+		CPPUNIT_ASSERT(written <= chunkSize);
+		CPPUNIT_ASSERT(covered > 0);
+		CPPUNIT_ASSERT_EQUAL(offset + covered,
+				BloomFilterChunkCodec::decode(&chunk[0], written, handler,
+						windowSize));
+		offset += covered;
+		transfered += written;
+	}
+	CPPUNIT_ASSERT(handler.maxWindow <= std::max(windowSize, chunkSize));
+	return transfered;
+}
+
+/*=== BEGIN tests for class 'BloomFilterChunkCodec' ===*/
+void BloomFilterChunkCodecTest::testOptimalParameter() {
+	CPPUNIT_ASSERT_EQUAL(0u, BloomFilterChunkCodec::optimalParameter(0, 1000));
+	CPPUNIT_ASSERT_EQUAL(0u, BloomFilterChunkCodec::optimalParameter(500, 1000));
+	// mean gap of 1000 bits
+	CPPUNIT_ASSERT_EQUAL(9u, BloomFilterChunkCodec::optimalParameter(1000,
+			1000000));
+}
+
+void BloomFilterChunkCodecTest::testSparse() {
+	std::vector<unsigned char> bits(100000, 0);
+	srand(1);
+	for (std::size_t i = 0; i < 2000; i++) {
+		std::size_t pos = rand() % (bits.size() * 8);
+		bits[pos / 8] |= 1 << (pos % 8);
+	}
+	bits[0] |= 0x01;
+	bits[bits.size() - 1] |= 0x80;
+	std::vector<unsigned char> result;
+	std::size_t transfered = transfer(bits, result, 1024, 4096);
+	CPPUNIT_ASSERT(bits == result);
+	// About 9 bits per set bit instead of 400 bits
+	CPPUNIT_ASSERT(transfered < bits.size() / 10);
+	// Small chunks and windows
+	transfered = transfer(bits, result, BloomFilterChunkCodec::MIN_CHUNK_SIZE,
+			1);
+	CPPUNIT_ASSERT(bits == result);
+}
+
+void BloomFilterChunkCodecTest::testDense() {
+	std::vector<unsigned char> bits(10000);
+	srand(2);
+	for (std::size_t i = 0; i < bits.size(); i++) {
+		bits[i] = rand() % 256;
+	}
+	std::vector<unsigned char> result;
+	std::size_t transfered = transfer(bits, result, 1000, 100);
+	CPPUNIT_ASSERT(bits == result);
+	// Raw chunks are used, if the coding doesn't pay off
+	std::size_t chunks = (bits.size() + 1000
+			- BloomFilterChunkCodec::HEADER_SIZE - 1) / (1000
+			- BloomFilterChunkCodec::HEADER_SIZE);
+	CPPUNIT_ASSERT_EQUAL(bits.size() + chunks
+			* BloomFilterChunkCodec::HEADER_SIZE, transfered);
+}
+
+void BloomFilterChunkCodecTest::testEmpty() {
+	std::vector<unsigned char> bits(1000000, 0);
+	std::vector<unsigned char> result;
+	// A single header covers the whole filter
+	CPPUNIT_ASSERT_EQUAL(BloomFilterChunkCodec::HEADER_SIZE,
+			transfer(bits, result, 100, 1000));
+	CPPUNIT_ASSERT(bits == result);
+	unsigned char chunk[BloomFilterChunkCodec::MIN_CHUNK_SIZE];
+	std::size_t covered = 1;
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, BloomFilterChunkCodec::encode(
+			&bits[0], bits.size(), bits.size(), 0, chunk, sizeof(chunk),
+			&covered));
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, covered);
+}
+
+void BloomFilterChunkCodecTest::testMalformed() {
+	std::vector<unsigned char> bits(100, 0);
+	bits[50] = 0x10;
+	unsigned char chunk[100];
+	std::size_t covered;
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::encode(&bits[0], bits.size(),
+			0, 0, chunk, BloomFilterChunkCodec::HEADER_SIZE, &covered),
+			std::exception);
+	std::size_t written = BloomFilterChunkCodec::encode(&bits[0], bits.size(),
+			0, 8, chunk, sizeof(chunk), &covered);
+	std::vector<unsigned char> result(bits.size());
+	CopyWindowHandler handler(result);
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(chunk,
+			BloomFilterChunkCodec::HEADER_SIZE - 1, handler), std::exception);
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(chunk,
+			BloomFilterChunkCodec::HEADER_SIZE, handler), std::exception);
+	chunk[0] = 7;
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(chunk, written, handler),
+			std::exception);
+	// A gap of 2^64 - 8000 wraps the position around to the first bit,
+	// which is in front of the covered bytes
+	unsigned char crafted[64];
+	memset(crafted, 0, sizeof(crafted));
+	crafted[0] = BloomFilterChunkCodec::RICE;
+	crafted[1] = 62;
+	const uint64_t offset = 1000;
+	for (std::size_t i = 0; i < 8; i++)
+		crafted[2 + i] = (unsigned char) (offset >> (8 * i));
+	crafted[10] = 100;
+	crafted[14] = 1;
+	unsigned char * payload = crafted + BloomFilterChunkCodec::HEADER_SIZE;
+	// Quotient 3, then the remainder 2^62 - 8000 in 62 bits
+	payload[0] = 0x07;
+	const uint64_t remainder = (((uint64_t) 1) << 62) - offset * 8;
+	for (std::size_t i = 0; i < 62; i++) {
+		if ((remainder >> i) & 1)
+			payload[(4 + i) / 8] |= (unsigned char) (1 << ((4 + i) % 8));
+	}
+	std::vector<unsigned char> large(2000);
+	CopyWindowHandler largeHandler(large);
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(crafted,
+			sizeof(crafted), largeHandler), std::exception);
+	// Quotient 4 overflows, when it is shifted by 62 bits
+	payload[0] = 0x0F;
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(crafted,
+			sizeof(crafted), largeHandler), std::exception);
+	// The offset and the number of covered bytes must not wrap either
+	memset(crafted + 2, 0xFF, 8);
+	CPPUNIT_ASSERT_THROW(BloomFilterChunkCodec::decode(crafted,
+			sizeof(crafted), largeHandler), std::exception);
+}
+
+/*=== END   tests for class 'BloomFilterChunkCodec' ===*/
+
+void BloomFilterChunkCodecTest::setUp() {
+}
+
+void BloomFilterChunkCodecTest::tearDown() {
+}
+
+}
+}
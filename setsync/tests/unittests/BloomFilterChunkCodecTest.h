@@ -0,0 +1,49 @@
+///
+/// @brief       CPPUnit-Tests for class BloomFilterChunkCodec
+/// @author      Till Lorentzen (lorentze@ibr.cs.tu-bs.de)
+///
+
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <setsync/bloom/BloomFilterChunkCodec.h>
+#include <vector>
+
+#ifndef BLOOMFILTERCHUNKCODECTEST_H
+#define BLOOMFILTERCHUNKCODECTEST_H
+namespace setsync {
+namespace bloom {
+class BloomFilterChunkCodecTest: public CppUnit::TestFixture {
+private:
+	/**
+	 * Encodes the given bit array chunk by chunk and decodes it again
+	 *
+	 * \return the number of bytes of all chunks
+	 */
+	std::size_t transfer(const std::vector<unsigned char>& bits,
+			std::vector<unsigned char>& result, const std::size_t chunkSize,
+			const std::size_t windowSize);
+public:
+	/*=== BEGIN tests for class 'BloomFilterChunkCodec' ===*/
+	void testOptimalParameter();
+	void testSparse();
+	void testDense();
+	void testEmpty();
+	void testMalformed();
+	/*=== END   tests for class 'BloomFilterChunkCodec' ===*/
+
+	void setUp();
+	void tearDown();
+
+CPPUNIT_TEST_SUITE(BloomFilterChunkCodecTest);
+		CPPUNIT_TEST(testOptimalParameter);
+		CPPUNIT_TEST(testSparse);
+		CPPUNIT_TEST(testDense);
+		CPPUNIT_TEST(testEmpty);
+		CPPUNIT_TEST(testMalformed);
+	CPPUNIT_TEST_SUITE_END();
+};
+CPPUNIT_TEST_SUITE_REGISTRATION( BloomFilterChunkCodecTest);
+}
+}
+#endif /* BLOOMFILTERCHUNKCODECTEST_H */
@@ -13,6 +13,8 @@
 #include <math.h>
 #include <list>
 #include <stdlib.h>
+#include <stdio.h>
+#include <sstream>
 
 using namespace std;
 namespace setsync {
@@ -109,6 +111,30 @@ void FSBloomFilterTest::testContainsAll() {
 	}
 	Filter2.containsAll(hashes, 100);
 	CPPUNIT_ASSERT(Filter2.containsAll(hashes, 100));
+	CPPUNIT_ASSERT(Filter2.containsAll(hashes, 100) == 100);
+	// The first missing key is returned
+	bloom::FSBloomFilter Filter3(hash, NULL, 8196);
+	CPPUNIT_ASSERT(Filter3.containsAll(hashes, 100) == 0);
+	Filter3.addAll(hashes, 50);
+	CPPUNIT_ASSERT(Filter3.containsAll(hashes, 100) >= 50);
+}
+
+void FSBloomFilterTest::testAddAll() {
+	bloom::FSBloomFilter Filter1(hash, NULL, 8196);
+	bloom::FSBloomFilter Filter2(hash, NULL, 8196);
+	unsigned char hashes[1000 * hash.getHashSize()];
+	for (int j = 0; j < 1000; j++) {
+		hash(hashes + hash.getHashSize() * j, (unsigned char *) &j, sizeof(j));
+	}
+	for (int i = 0; i < 1000; i++) {
+		Filter1.add(hashes + i * hash.getHashSize());
+	}
+	Filter2.addAll(hashes, 1000);
+	CPPUNIT_ASSERT(Filter1 == Filter2);
+	CPPUNIT_ASSERT(Filter1.numberOfElements() == Filter2.numberOfElements());
+	for (int i = 0; i < 1000; i++) {
+		CPPUNIT_ASSERT(Filter2.contains(hashes + i * hash.getHashSize()));
+	}
 }
 
 void FSBloomFilterTest::testOperatorAndAndAssign() {
@@ -198,6 +224,40 @@ void FSBloomFilterTest::testOperatorXorAndAssign() {
 }
 
 /*=== END   tests for class 'BloomFilter' ===*/
+void FSBloomFilterTest::testSegments() {
+	const std::string file("segments.filter");
+	std::size_t segments;
+	{
+		bloom::FSBloomFilter Filter1(hash, file.c_str(), 100000, false, 0.01,
+				4096, true);
+		segments = Filter1.numberOfSegments();
+		CPPUNIT_ASSERT(segments > 1);
+		// Bits in all segments are reachable
+		for (int i = 0; i < 1000; i++) {
+			std::stringstream ss;
+			ss << "segment" << i;
+			Filter1.AbstractBloomFilter::add(ss.str());
+		}
+	}
+	{
+		bloom::FSBloomFilter Filter2(hash, file.c_str(), 100000, false, 0.01,
+				4096);
+		CPPUNIT_ASSERT(Filter2.isFileLoaded());
+		CPPUNIT_ASSERT_EQUAL(segments, Filter2.numberOfSegments());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 1000, Filter2.numberOfElements());
+		for (int i = 0; i < 1000; i++) {
+			std::stringstream ss;
+			ss << "segment" << i;
+			CPPUNIT_ASSERT(Filter2.AbstractBloomFilter::contains(ss.str()));
+		}
+	}
+	remove(file.c_str());
+	for (std::size_t i = 1; i < segments; i++) {
+		std::stringstream ss;
+		ss << file << "." << i;
+		remove(ss.str().c_str());
+	}
+}
 
 void FSBloomFilterTest::setUp() {
 }
@@ -21,10 +21,12 @@ public:
 	void testInsert();
 	void testContains();
 	void testContainsAll();
+	void testAddAll();
 	void testOperatorAndAndAssign();
 	void testOperatorInclusiveOrAndAssign();
 	void testOperatorXorAndAssign();
 	void testFilterSize();
+	void testSegments();
 	/*=== END   tests for class 'FSBloomFilter' ===*/
 
 	void setUp();
@@ -35,10 +37,12 @@ CPPUNIT_TEST_SUITE(FSBloomFilterTest);
 		CPPUNIT_TEST(testInsert);
 		CPPUNIT_TEST(testContains);
 		CPPUNIT_TEST(testContainsAll);
+		CPPUNIT_TEST(testAddAll);
 		CPPUNIT_TEST(testOperatorAndAndAssign);
 		CPPUNIT_TEST(testOperatorInclusiveOrAndAssign);
 		CPPUNIT_TEST(testOperatorXorAndAssign);
 		CPPUNIT_TEST(testFilterSize);
+		CPPUNIT_TEST(testSegments);
 	CPPUNIT_TEST_SUITE_END();
 };
 CPPUNIT_TEST_SUITE_REGISTRATION( FSBloomFilterTest);
@@ -7,7 +7,11 @@
 #include "KeyValueCountingBloomFilterTest.h"
 #include <setsync/utils/FileSystem.h>
 #include <setsync/storage/BdbStorage.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sstream>
+#include <vector>
 #include <setsync/DiffHandler.h>
 
 using namespace std;
@@ -188,6 +192,86 @@ void KeyValueCountingBloomFilterTest::testRemove() {
 	CPPUNIT_ASSERT(Filter3.CountingBloomFilter::remove("bla2"));
 	CPPUNIT_ASSERT(Filter3.CountingBloomFilter::remove("bla3"));
 }
+void KeyValueCountingBloomFilterTest::testAddAll() {
+	bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1, "",
+			1000, false, 0.01);
+	bloom::KeyValueCountingBloomFilter Filter2(hashFunction_, *storage2, "",
+			1000, false, 0.01);
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	const std::size_t count = 500;
+	unsigned char keys[(count + 1) * hashSize];
+	for (std::size_t i = 0; i < count; i++) {
+		std::stringstream ss;
+		ss << "key" << i;
+		hashFunction_(keys + i * hashSize, ss.str());
+		Filter1.add(keys + i * hashSize);
+	}
+	// A duplicate within the same batch is only added once
+	memcpy(keys + count * hashSize, keys, hashSize);
+	Filter2.addAll(keys, count + 1);
+	CPPUNIT_ASSERT(Filter1 == Filter2);
+	CPPUNIT_ASSERT_EQUAL(count, Filter2.containsAll(keys, count));
+	CPPUNIT_ASSERT_EQUAL(Filter1.numberOfElements(), Filter2.numberOfElements());
+	// Adding them again changes nothing
+	Filter2.addAll(keys, count);
+	CPPUNIT_ASSERT_EQUAL(Filter1.numberOfElements(), Filter2.numberOfElements());
+	bloom::KeyValueCountingBloomFilter Filter3(hashFunction_, *storage3, "",
+			1000, false, 0.01);
+	for (std::size_t i = 0; i < count; i++) {
+		CPPUNIT_ASSERT(Filter2.remove(keys + i * hashSize));
+	}
+	CPPUNIT_ASSERT(Filter2 == Filter3);
+}
+void KeyValueCountingBloomFilterTest::testRemoveAll() {
+	bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1, "",
+			1000, false, 0.01);
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	const std::size_t count = 500;
+	unsigned char keys[count * hashSize];
+	for (std::size_t i = 0; i < count; i++) {
+		std::stringstream ss;
+		ss << "key" << i;
+		hashFunction_(keys + i * hashSize, ss.str());
+	}
+	Filter1.addAll(keys, count / 2);
+	CPPUNIT_ASSERT_EQUAL(count / 2, Filter1.removeAll(keys, count));
+	for (std::size_t i = 0; i < count; i++) {
+		CPPUNIT_ASSERT(!Filter1.contains(keys + i * hashSize));
+	}
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, Filter1.removeAll(keys, count));
+	bloom::KeyValueCountingBloomFilter Filter2(hashFunction_, *storage2, "",
+			1000, false, 0.01);
+	CPPUNIT_ASSERT(Filter1 == Filter2);
+}
+void KeyValueCountingBloomFilterTest::testUpgrade() {
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	unsigned char key[hashSize];
+	hashFunction_(key, "upgrade");
+	std::vector<uint64_t> positions;
+	{
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage2,
+				"", 10, false, 0.01);
+		positions.resize(Filter1.functionCount_);
+		Filter1.doubleHashing_->positions(key, Filter1.functionCount_,
+				Filter1.filterSize_, &positions[0]);
+	}
+	// Layout version 1: one record per position without a version record
+	for (std::size_t i = 0; i < positions.size(); i++) {
+		storage1->put((unsigned char *) &positions[i], sizeof(uint64_t), key,
+				hashSize);
+	}
+	bloom::KeyValueCountingBloomFilter Filter2(hashFunction_, *storage1, "",
+			10, false, 0.01);
+	CPPUNIT_ASSERT(Filter2.contains(key));
+	unsigned char * value;
+	std::size_t valueSize;
+	for (std::size_t i = 0; i < positions.size(); i++) {
+		CPPUNIT_ASSERT(!storage1->get((unsigned char *) &positions[i],
+						sizeof(uint64_t), &value, &valueSize));
+	}
+	CPPUNIT_ASSERT(Filter2.remove(key));
+	CPPUNIT_ASSERT(!Filter2.contains(key));
+}
 void KeyValueCountingBloomFilterTest::testContains() {
 	/* test signature (const std::string& key) const */
 	/* test signature (const char* data, const std::size_t& length) const */
@@ -295,5 +379,109 @@ void KeyValueCountingBloomFilterTest::testSize() {
 		CPPUNIT_ASSERT(size == Filter1.numberOfElements());
 	}
 }
+
+void KeyValueCountingBloomFilterTest::testRestart() {
+	const std::string file("bloom1.filter");
+	remove(file.c_str());
+	{
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, 10, false, 0.01);
+		CPPUNIT_ASSERT(!Filter1.isFileLoaded());
+		Filter1.AbstractBloomFilter::add("bla1");
+		Filter1.AbstractBloomFilter::add("bla2");
+	}
+	// The properly closed file is used without reading the storage
+	{
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, 10, false, 0.01);
+		CPPUNIT_ASSERT(Filter1.isFileLoaded());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 2, Filter1.numberOfElements());
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla1"));
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla2"));
+	}
+	// A file of another storage isn't trusted
+	{
+		bloom::KeyValueCountingBloomFilter Filter2(hashFunction_, *storage2,
+				file, 10, false, 0.01);
+		CPPUNIT_ASSERT(!Filter2.AbstractBloomFilter::contains("bla1"));
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 0, Filter2.numberOfElements());
+	}
+	// The file has been written with the generation of storage2
+	{
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, 10, false, 0.01);
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla1"));
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla2"));
+	}
+	remove(file.c_str());
+}
+
+void KeyValueCountingBloomFilterTest::testRecovery() {
+	const std::string file("bloom1.filter");
+	remove(file.c_str());
+	// The filter isn't closed before the next opening, like after a crash
+	bloom::KeyValueCountingBloomFilter * crashed =
+			new bloom::KeyValueCountingBloomFilter(hashFunction_, *storage1,
+					file, 10, false, 0.01);
+	crashed->AbstractBloomFilter::add("bla1");
+	crashed->checkpoint();
+	crashed->AbstractBloomFilter::add("bla2");
+	crashed->AbstractBloomFilter::add("bla3");
+	crashed->CountingBloomFilter::remove("bla3");
+	{
+		// The checkpointed bits are kept and the journal is replayed
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, 10, false, 0.01);
+		CPPUNIT_ASSERT(!Filter1.isFileLoaded());
+		CPPUNIT_ASSERT(Filter1.isFileCheckpointed());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 2, Filter1.numberOfElements());
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla1"));
+		CPPUNIT_ASSERT(Filter1.AbstractBloomFilter::contains("bla2"));
+		CPPUNIT_ASSERT(!Filter1.AbstractBloomFilter::contains("bla3"));
+	}
+	delete crashed;
+	remove(file.c_str());
+}
+
+void KeyValueCountingBloomFilterTest::testParallelRebuild() {
+	const std::string file("bloom1.filter");
+	remove(file.c_str());
+	// Large enough for PARALLEL_REBUILD_BUCKETS, more than 2^20 bits
+	const uint64_t maxElements = 120000;
+	const std::size_t count = 5000;
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	std::vector<unsigned char> keys(count * hashSize);
+	for (std::size_t i = 0; i < count; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		hashFunction_(&keys[i * hashSize], ss.str());
+	}
+	std::vector<unsigned char> written;
+	{
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, maxElements, false, 0.01);
+		CPPUNIT_ASSERT(Filter1.size() * 8 >= (1 << 20));
+		Filter1.addAll(&keys[0], count);
+		written.resize(Filter1.size());
+		CPPUNIT_ASSERT_EQUAL(written.size(), Filter1.getChunk(&written[0],
+						written.size(), 0));
+	}
+	// Without the file, the bits are rebuilt from the storage. With
+	// LevelDB, the second filter is rebuilt by four threads, even on a
+	// single core.
+	const std::size_t threads[] = { 1, 4 };
+	for (std::size_t t = 0; t < 2; t++) {
+		remove(file.c_str());
+		bloom::KeyValueCountingBloomFilter Filter1(hashFunction_, *storage1,
+				file, maxElements, false, 0.01, 0, 0, false, false, threads[t]);
+		CPPUNIT_ASSERT(!Filter1.isFileLoaded());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) count, Filter1.numberOfElements());
+		std::vector<unsigned char> rebuilt(Filter1.size());
+		CPPUNIT_ASSERT_EQUAL(rebuilt.size(), Filter1.getChunk(&rebuilt[0],
+						rebuilt.size(), 0));
+		CPPUNIT_ASSERT(written == rebuilt);
+	}
+	remove(file.c_str());
+}
 }
 }
@@ -25,11 +25,17 @@ CPPUNIT_TEST_SUITE(KeyValueCountingBloomFilterTest);
 		CPPUNIT_TEST(testLoad);
 		CPPUNIT_TEST(testInsert);
 		CPPUNIT_TEST(testRemove);
+		CPPUNIT_TEST(testAddAll);
+		CPPUNIT_TEST(testRemoveAll);
+		CPPUNIT_TEST(testUpgrade);
 		CPPUNIT_TEST(testContains);
 		CPPUNIT_TEST(testContainsAll);
 		CPPUNIT_TEST(testDiff);
 		CPPUNIT_TEST(testToString);
 		CPPUNIT_TEST(testSize);
+		CPPUNIT_TEST(testRestart);
+		CPPUNIT_TEST(testRecovery);
+		CPPUNIT_TEST(testParallelRebuild);
 	CPPUNIT_TEST_SUITE_END();
 
 private:
@@ -53,11 +59,17 @@ public:
 	void testLoad();
 	void testInsert();
 	void testRemove();
+	void testAddAll();
+	void testRemoveAll();
+	void testUpgrade();
 	void testContains();
 	void testContainsAll();
 	void testDiff();
 	void testToString();
 	void testSize();
+	void testRestart();
+	void testRecovery();
+	void testParallelRebuild();
 
 	void setUp();
 	void tearDown();
@@ -6,7 +6,8 @@
 
 #include "KeyValueStorageTest.h"
 #include <setsync/utils/FileSystem.h>
-#include <setsync/storage/MemStorage.h>
+#include <setsync/storage/StorageException.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -14,6 +15,25 @@ namespace setsync {
 
 namespace storage {
 
+/**
+ * A MemStorage, whose batches fail after a given number of written ones
+ */
+class FailingStorage: public MemStorage {
+public:
+	std::size_t batches;
+	FailingStorage() :
+		batches(0) {
+	}
+protected:
+	virtual void writeBatch(const Batch& batch) {
+		if (batches == 0) {
+			throw StorageException("Batch failed");
+		}
+		batches--;
+		MemStorage::writeBatch(batch);
+	}
+};
+
 void KeyValueStorageTest::setUp(void) {
 #ifdef HAVE_LEVELDB
 	levelpath = "temp-leveldb-unittest";
@@ -27,7 +47,12 @@ void KeyValueStorageTest::setUp(void) {
 	BdbStorage * bdb = new BdbStorage(this->db);
 	stores.push_back(bdb);
 #endif
-	MemStorage * mem = new MemStorage(1,0);
+#ifdef HAVE_LMDB
+	lmdbpath = "temp-lmdb-unittest";
+	LmdbStorage * lmdb = new LmdbStorage(lmdbpath);
+	stores.push_back(lmdb);
+#endif
+	MemStorage * mem = new MemStorage();
 	stores.push_back(mem);
 }
 void KeyValueStorageTest::tearDown(void) {
@@ -45,6 +70,11 @@ void KeyValueStorageTest::tearDown(void) {
 	this->db = new Db(NULL, 0);
 	this->db->remove(bdbpath.c_str(), NULL, 0);
 	delete this->db;
+#endif
+#ifdef HAVE_LMDB
+	delete stores.front();
+	stores.pop_front();
+	utils::FileSystem::rmDirRecursive(lmdbpath);
 #endif
 	delete stores.front();
 	stores.pop_front();
@@ -177,6 +207,118 @@ void KeyValueStorageTest::testIterator() {
 		p++;
 	}
 }
+void KeyValueStorageTest::testRangeIterator() {
+	std::list<AbstractKeyValueStorage *>::iterator p = stores.begin();
+	while (p != stores.end()) {
+		AbstractKeyValueStorage * storage = *p;
+		for (int i = 0; i < 50; i++) {
+			char key[4];
+			sprintf(key, "k%02d", i);
+			storage->put((unsigned char *) key, 3, (unsigned char *) &i,
+					sizeof(int));
+			key[0] = 'x';
+			storage->put((unsigned char *) key, 3, (unsigned char *) &i,
+					sizeof(int));
+		}
+		// All keys starting with "k1", their values are read by the iterator
+		AbstractKeyValueIterator * iterator = storage->createPrefixIterator(
+				(const unsigned char *) "k1", 2);
+		std::size_t count = 0;
+		unsigned char key[3];
+		unsigned char last[3];
+		while (iterator->valid()) {
+			CPPUNIT_ASSERT_EQUAL((size_t) 3, iterator->keySize());
+			iterator->key(key);
+			CPPUNIT_ASSERT(memcmp(key, "k1", 2) == 0);
+			if (iterator->isOrdered() && count > 0) {
+				CPPUNIT_ASSERT(memcmp(last, key, 3) < 0);
+			}
+			memcpy(last, key, 3);
+			int value;
+			CPPUNIT_ASSERT_EQUAL(sizeof(int), iterator->valueSize());
+			iterator->value((unsigned char *) &value);
+			CPPUNIT_ASSERT_EQUAL((key[1] - '0') * 10 + key[2] - '0', value);
+			count++;
+			iterator->next();
+		}
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 10, count);
+		// Seeking inside the prefix skips the smaller keys on ordered storages
+		iterator->seek((const unsigned char *) "k15", 3);
+		CPPUNIT_ASSERT(iterator->valid());
+		if (iterator->isOrdered()) {
+			iterator->key(key);
+			CPPUNIT_ASSERT(memcmp(key, "k15", 3) == 0);
+		}
+		delete iterator;
+		// Range from "k45" to the limit "x02"
+		iterator = storage->createRangeIterator((const unsigned char *) "k45",
+				3, (const unsigned char *) "x02", 3);
+		count = 0;
+		for (; iterator->valid(); iterator->next()) {
+			count++;
+		}
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 7, count);
+		delete iterator;
+		iterator = storage->createPrefixIterator((const unsigned char *) "y", 1);
+		CPPUNIT_ASSERT(!iterator->valid());
+		delete iterator;
+		p++;
+	}
+}
+
+void KeyValueStorageTest::testMultiGet() {
+	std::list<AbstractKeyValueStorage *>::iterator p = stores.begin();
+	while (p != stores.end()) {
+		AbstractKeyValueStorage * storage = *p;
+		PrefixStorage prefixed(*storage, 'p');
+		AbstractKeyValueStorage * targets[] = { storage, &prefixed };
+		for (std::size_t t = 0; t < 2; t++) {
+			AbstractKeyValueStorage * target = targets[t];
+			const std::size_t count = 50;
+			unsigned char keys[count * hash.getHashSize()];
+			for (std::size_t i = 0; i < count; i++) {
+				hash(keys + i * hash.getHashSize(), (unsigned char *) &i,
+						sizeof(std::size_t));
+				// Odd keys are missing, every 10th value is too large
+				if (i % 2 == 0) {
+					std::string value(i % 10 == 0 ? 20 : 4, (char) i);
+					target->put(keys + i * hash.getHashSize(),
+							hash.getHashSize(), (unsigned char *) value.data(),
+							value.size());
+				}
+			}
+			// Changes of a running batch are found too
+			target->beginBatch();
+			target->del(keys, hash.getHashSize());
+			target->put(keys + hash.getHashSize(), hash.getHashSize(),
+					(unsigned char *) "abcd", 4);
+			unsigned char values[count * 8];
+			std::size_t valueSizes[count];
+			bool found[count];
+			std::size_t result = target->multiGet(keys, hash.getHashSize(),
+					count, values, 8, valueSizes, found);
+			target->abortBatch();
+			CPPUNIT_ASSERT_EQUAL(count / 2, result);
+			CPPUNIT_ASSERT(!found[0]);
+			CPPUNIT_ASSERT(found[1]);
+			CPPUNIT_ASSERT(memcmp(values + 8, "abcd", 4) == 0);
+			for (std::size_t i = 2; i < count; i++) {
+				CPPUNIT_ASSERT_EQUAL(i % 2 == 0, found[i]);
+				if (!found[i]) {
+					CPPUNIT_ASSERT_EQUAL((std::size_t) 0, valueSizes[i]);
+				} else if (i % 10 == 0) {
+					CPPUNIT_ASSERT_EQUAL((std::size_t) 20, valueSizes[i]);
+				} else {
+					CPPUNIT_ASSERT_EQUAL((std::size_t) 4, valueSizes[i]);
+					std::string value(4, (char) i);
+					CPPUNIT_ASSERT(memcmp(values + i * 8, value.data(), 4) == 0);
+				}
+			}
+		}
+		p++;
+	}
+}
+
 void KeyValueStorageTest::testClear() {
 
 	std::list<AbstractKeyValueStorage *>::iterator p = stores.begin();
@@ -205,6 +347,451 @@ void KeyValueStorageTest::testClear() {
 	}
 
 }
+void KeyValueStorageTest::testBatch() {
+	std::list<AbstractKeyValueStorage *>::iterator p = stores.begin();
+	while (p != stores.end()) {
+		AbstractKeyValueStorage * storage = *p;
+		std::size_t valueSize = 10;
+		unsigned char valuebuffer[10];
+		memset(valuebuffer, 1, valueSize);
+		unsigned char key1[hash.getHashSize()];
+		unsigned char key2[hash.getHashSize()];
+		hash(key1, "bla1");
+		hash(key2, "bla2");
+		std::size_t resultSize;
+		unsigned char * result;
+		storage->put(key1, hash.getHashSize(), valuebuffer, valueSize);
+		// Aborted changes are discarded
+		storage->beginBatch();
+		CPPUNIT_ASSERT(storage->isBatchRunning());
+		storage->del(key1, hash.getHashSize());
+		storage->put(key2, hash.getHashSize(), valuebuffer, valueSize);
+		CPPUNIT_ASSERT(!storage->get(key1, hash.getHashSize(), &result, &resultSize));
+		CPPUNIT_ASSERT(storage->get(key2, hash.getHashSize(), &result, &resultSize));
+		free(result);
+		storage->abortBatch();
+		CPPUNIT_ASSERT(!storage->isBatchRunning());
+		CPPUNIT_ASSERT(storage->get(key1, hash.getHashSize(), &result, &resultSize));
+		free(result);
+		CPPUNIT_ASSERT(!storage->get(key2, hash.getHashSize(), &result, &resultSize));
+		// Nested batches are written by the outermost commit
+		storage->beginBatch();
+		storage->beginBatch();
+		storage->put(key2, hash.getHashSize(), valuebuffer, valueSize);
+		storage->del(key2, hash.getHashSize());
+		storage->put(key2, hash.getHashSize(), valuebuffer, 5);
+		storage->del(key1, hash.getHashSize());
+		storage->commitBatch();
+		CPPUNIT_ASSERT(storage->isBatchRunning());
+		storage->commitBatch();
+		CPPUNIT_ASSERT(!storage->isBatchRunning());
+		CPPUNIT_ASSERT(!storage->get(key1, hash.getHashSize(), &result, &resultSize));
+		CPPUNIT_ASSERT(storage->get(key2, hash.getHashSize(), &result, &resultSize));
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 5, resultSize);
+		free(result);
+		CPPUNIT_ASSERT_THROW(storage->commitBatch(), StorageException);
+		// A key, which is only put and deleted by the batch
+		{
+			StorageBatch batch(*storage);
+			storage->put(key1, hash.getHashSize(), valuebuffer, valueSize);
+			storage->del(key1, hash.getHashSize());
+			batch.commit();
+		}
+		CPPUNIT_ASSERT(!storage->get(key1, hash.getHashSize(), &result, &resultSize));
+		// A batch left without commit is aborted
+		{
+			StorageBatch batch(*storage);
+			storage->del(key2, hash.getHashSize());
+		}
+		CPPUNIT_ASSERT(storage->get(key2, hash.getHashSize(), &result, &resultSize));
+		free(result);
+		p++;
+	}
+}
+
+void KeyValueStorageTest::testGetInto() {
+	std::list<AbstractKeyValueStorage *>::iterator p = stores.begin();
+	while (p != stores.end()) {
+		AbstractKeyValueStorage * storage = *p;
+		std::size_t valueSize = 10;
+		unsigned char valuebuffer[10];
+		for (std::size_t i = 0; i < valueSize; i++) {
+			valuebuffer[i] = (unsigned char) i;
+		}
+		unsigned char key1[hash.getHashSize()];
+		unsigned char key2[hash.getHashSize()];
+		hash(key1, "bla1");
+		hash(key2, "bla2");
+		unsigned char result[20];
+		std::size_t resultSize;
+		storage->put(key1, hash.getHashSize(), valuebuffer, valueSize);
+		CPPUNIT_ASSERT(storage->getInto(key1, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT_EQUAL(valueSize, resultSize);
+		CPPUNIT_ASSERT(memcmp(valuebuffer, result, valueSize) == 0);
+		CPPUNIT_ASSERT(!storage->getInto(key2, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 0, resultSize);
+		// A buffer, which is too small, only returns the size
+		memset(result, 0xFF, sizeof(result));
+		CPPUNIT_ASSERT(storage->getInto(key1, hash.getHashSize(), result, 5,
+				&resultSize));
+		CPPUNIT_ASSERT_EQUAL(valueSize, resultSize);
+		CPPUNIT_ASSERT(result[0] == 0xFF);
+		CPPUNIT_ASSERT(storage->getInto(key1, hash.getHashSize(), NULL, 0,
+				&resultSize));
+		CPPUNIT_ASSERT_EQUAL(valueSize, resultSize);
+		// Changes of a running batch are visible
+		storage->beginBatch();
+		storage->put(key2, hash.getHashSize(), valuebuffer, 5);
+		storage->del(key1, hash.getHashSize());
+		CPPUNIT_ASSERT(storage->getInto(key2, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 5, resultSize);
+		CPPUNIT_ASSERT(memcmp(valuebuffer, result, 5) == 0);
+		CPPUNIT_ASSERT(!storage->getInto(key1, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		storage->abortBatch();
+		p++;
+	}
+}
+
+void KeyValueStorageTest::testMemStorage() {
+	// Small inline size, so the values are partly stored in the arena
+	MemStorage storage(16);
+	const std::size_t count = 5000;
+	unsigned char key[hash.getHashSize()];
+	unsigned char value[100];
+	unsigned char result[100];
+	std::size_t resultSize;
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		memset(value, (unsigned char) i, sizeof(value));
+		storage.put(key, hash.getHashSize(), value, i % sizeof(value));
+	}
+	CPPUNIT_ASSERT_EQUAL(count, storage.size());
+	// Delete every second entry and change the size of the others
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		if (i % 2 == 0) {
+			storage.del(key, hash.getHashSize());
+		} else {
+			memset(value, (unsigned char) (i + 1), sizeof(value));
+			storage.put(key, hash.getHashSize(), value, (i * 7) % sizeof(value));
+		}
+	}
+	CPPUNIT_ASSERT_EQUAL(count / 2, storage.size());
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		bool found = storage.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize);
+		CPPUNIT_ASSERT_EQUAL(i % 2 == 1, found);
+		if (found) {
+			CPPUNIT_ASSERT_EQUAL((i * 7) % sizeof(value), resultSize);
+			memset(value, (unsigned char) (i + 1), sizeof(value));
+			CPPUNIT_ASSERT(memcmp(value, result, resultSize) == 0);
+		}
+	}
+	std::size_t iterated = 0;
+	AbstractKeyValueIterator * it = storage.createIterator();
+	for (it->seekToFirst(); it->valid(); it->next()) {
+		CPPUNIT_ASSERT_EQUAL(hash.getHashSize(), it->keySize());
+		iterated++;
+	}
+	delete it;
+	CPPUNIT_ASSERT_EQUAL(count / 2, iterated);
+	storage.clear();
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, storage.size());
+	CPPUNIT_ASSERT(!storage.getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+}
+
+void KeyValueStorageTest::testPrefixStorage() {
+	MemStorage shared;
+	PrefixStorage first(shared, 'a');
+	PrefixStorage second(shared, 'b');
+	const std::size_t count = 100;
+	unsigned char key[hash.getHashSize()];
+	unsigned char result[sizeof(std::size_t)];
+	std::size_t resultSize;
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		first.put(key, hash.getHashSize(), (unsigned char *) &i,
+				sizeof(std::size_t));
+		if (i % 2 == 0) {
+			std::size_t other = i + count;
+			second.put(key, hash.getHashSize(), (unsigned char *) &other,
+					sizeof(std::size_t));
+		}
+	}
+	CPPUNIT_ASSERT_EQUAL(count + count / 2, shared.size());
+	// The same key has different values in both keyspaces
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		CPPUNIT_ASSERT(first.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT(memcmp(result, &i, sizeof(std::size_t)) == 0);
+		bool found = second.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize);
+		CPPUNIT_ASSERT_EQUAL(i % 2 == 0, found);
+		if (found) {
+			std::size_t other = i + count;
+			CPPUNIT_ASSERT(memcmp(result, &other, sizeof(std::size_t)) == 0);
+		}
+	}
+	// Iterators only pass the keys of their keyspace, without the prefix
+	std::size_t iterated = 0;
+	AbstractKeyValueIterator * it = second.createIterator();
+	for (it->seekToFirst(); it->valid(); it->next()) {
+		CPPUNIT_ASSERT_EQUAL(hash.getHashSize(), it->keySize());
+		it->key(key);
+		CPPUNIT_ASSERT(second.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		iterated++;
+	}
+	delete it;
+	CPPUNIT_ASSERT_EQUAL(count / 2, iterated);
+	// Batches are written to the shared storage
+	std::size_t i = count;
+	hash(key, (unsigned char *) &i, sizeof(std::size_t));
+	first.beginBatch();
+	first.put(key, hash.getHashSize(), (unsigned char *) &i,
+			sizeof(std::size_t));
+	CPPUNIT_ASSERT(shared.isBatchRunning());
+	first.abortBatch();
+	CPPUNIT_ASSERT(!shared.isBatchRunning());
+	CPPUNIT_ASSERT(!first.getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	// Clearing a keyspace keeps the other one
+	second.clear();
+	CPPUNIT_ASSERT_EQUAL(count, shared.size());
+	it = second.createIterator();
+	CPPUNIT_ASSERT(!it->valid());
+	delete it;
+	i = 0;
+	hash(key, (unsigned char *) &i, sizeof(std::size_t));
+	CPPUNIT_ASSERT(first.getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+}
+
+void KeyValueStorageTest::testEpochStorage() {
+	MemStorage backing;
+	const std::size_t count = 100;
+	unsigned char key[hash.getHashSize()];
+	unsigned char result[sizeof(std::size_t)];
+	std::size_t resultSize;
+	// Entries written without epochs are moved into the first one
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		backing.put(key, hash.getHashSize(), (unsigned char *) &i,
+				sizeof(std::size_t));
+	}
+	EpochStorage * storage = new EpochStorage(backing);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0, storage->getEpoch());
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		CPPUNIT_ASSERT(storage->getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT(memcmp(result, &i, sizeof(std::size_t)) == 0);
+	}
+	// Clearing hides the entries, but doesn't delete them
+	storage->clear();
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 1, storage->getEpoch());
+	CPPUNIT_ASSERT_EQUAL(count + 1, backing.size());
+	std::size_t i = 0;
+	hash(key, (unsigned char *) &i, sizeof(std::size_t));
+	CPPUNIT_ASSERT(!storage->getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	AbstractKeyValueIterator * it = storage->createIterator();
+	CPPUNIT_ASSERT(!it->valid());
+	delete it;
+	storage->put(key, hash.getHashSize(), (unsigned char *) &i,
+			sizeof(std::size_t));
+	CPPUNIT_ASSERT(storage->getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	// The old entries are deleted step by step
+	CPPUNIT_ASSERT(!storage->reclaim(count / 2));
+	CPPUNIT_ASSERT_EQUAL(count / 2 + 2, backing.size());
+	CPPUNIT_ASSERT(storage->reclaim(count));
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 2, backing.size());
+	// The epoch is kept by the backing storage
+	storage->clear();
+	delete storage;
+	storage = new EpochStorage(backing);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 2, storage->getEpoch());
+	CPPUNIT_ASSERT(!storage->getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	// Writes reclaim the old entries incrementally
+	for (i = 0; i < EpochStorage::RECLAIM_INTERVAL; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		storage->put(key, hash.getHashSize(), (unsigned char *) &i,
+				sizeof(std::size_t));
+	}
+	CPPUNIT_ASSERT_EQUAL(EpochStorage::RECLAIM_INTERVAL + 1, backing.size());
+	CPPUNIT_ASSERT(storage->reclaim());
+	// An aborted clear keeps the epoch
+	storage->beginBatch();
+	storage->clear();
+	storage->abortBatch();
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 2, storage->getEpoch());
+	CPPUNIT_ASSERT(storage->getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	delete storage;
+	// Keyspaces of a shared storage have their own epochs
+	MemStorage shared;
+	EpochStorage first(shared, "a");
+	EpochStorage second(shared, "b");
+	first.put(key, hash.getHashSize(), (unsigned char *) &i,
+			sizeof(std::size_t));
+	second.put(key, hash.getHashSize(), (unsigned char *) &i,
+			sizeof(std::size_t));
+	second.clear();
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0, first.getEpoch());
+	CPPUNIT_ASSERT(first.getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+	CPPUNIT_ASSERT(!second.getInto(key, hash.getHashSize(), result,
+			sizeof(result), &resultSize));
+}
+
+void KeyValueStorageTest::testEpochStorageUpgrade() {
+	// More entries than a single step of the upgrade moves
+	const std::size_t count = 2 * EpochStorage::UPGRADE_STEP + 10;
+	FailingStorage backing;
+	unsigned char key[hash.getHashSize()];
+	unsigned char result[sizeof(std::size_t)];
+	std::size_t resultSize;
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		backing.put(key, hash.getHashSize(), (unsigned char *) &i,
+				sizeof(std::size_t));
+	}
+	// The second step fails, the entries of the first one stay moved
+	backing.batches = 1;
+	CPPUNIT_ASSERT_THROW(delete new EpochStorage(backing), StorageException);
+	CPPUNIT_ASSERT_EQUAL(count + 1, backing.size());
+	// The upgrade resumes after the last moved entry
+	backing.batches = count;
+	EpochStorage storage(backing);
+	CPPUNIT_ASSERT_EQUAL((uint32_t) 0, storage.getEpoch());
+	CPPUNIT_ASSERT_EQUAL(count + 1, backing.size());
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		CPPUNIT_ASSERT(storage.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+		CPPUNIT_ASSERT(memcmp(result, &i, sizeof(std::size_t)) == 0);
+		CPPUNIT_ASSERT(!backing.getInto(key, hash.getHashSize(), result,
+				sizeof(result), &resultSize));
+	}
+}
+
+void KeyValueStorageTest::testInstrumentedStorage() {
+	MemStorage backing;
+	InstrumentedStorage storage(backing);
+	const std::size_t count = 100;
+	unsigned char key[hash.getHashSize()];
+	unsigned char result[sizeof(std::size_t)];
+	std::size_t resultSize;
+	for (std::size_t i = 0; i < count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		storage.put(key, hash.getHashSize(), (unsigned char *) &i,
+				sizeof(std::size_t));
+	}
+	for (std::size_t i = 0; i < 2 * count; i++) {
+		hash(key, (unsigned char *) &i, sizeof(std::size_t));
+		storage.getInto(key, hash.getHashSize(), result, sizeof(result),
+				&resultSize);
+	}
+	std::size_t first = 0;
+	hash(key, (unsigned char *) &first, sizeof(std::size_t));
+	storage.del(key, hash.getHashSize());
+	const StorageStatistics& statistics = storage.getStatistics();
+	CPPUNIT_ASSERT_EQUAL((uint64_t) count, statistics.puts);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 1, statistics.dels);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) (2 * count), statistics.gets);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) count, statistics.hits);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) (count * sizeof(std::size_t)),
+			statistics.bytesRead);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) ((count + 1) * hash.getHashSize() + count
+			* sizeof(std::size_t)), statistics.bytesWritten);
+	// Only every n-th operation is timed
+	uint64_t reads = 0;
+	uint64_t writes = 0;
+	for (std::size_t i = 0; i < StorageStatistics::LATENCY_BUCKETS; i++) {
+		reads += statistics.readLatency[i];
+		writes += statistics.writeLatency[i];
+	}
+	CPPUNIT_ASSERT_EQUAL((uint64_t) (2 * count
+			/ InstrumentedStorage::LATENCY_SAMPLE_INTERVAL), reads);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) ((count + 1)
+			/ InstrumentedStorage::LATENCY_SAMPLE_INTERVAL), writes);
+	// Batches are passed through and the commit is counted
+	storage.beginBatch();
+	storage.put(key, hash.getHashSize(), (unsigned char *) &count,
+			sizeof(std::size_t));
+	CPPUNIT_ASSERT(backing.isBatchRunning());
+	storage.commitBatch();
+	CPPUNIT_ASSERT(!backing.isBatchRunning());
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 1, statistics.commits);
+	// Iterators count the entries and values read
+	storage.resetStatistics();
+	AbstractKeyValueIterator * it = storage.createIterator();
+	std::size_t iterated = 0;
+	for (; it->valid(); it->next()) {
+		it->value(result);
+		iterated++;
+	}
+	delete it;
+	CPPUNIT_ASSERT_EQUAL(count, iterated);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 1, statistics.scans);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) count, statistics.scannedEntries);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) (count * sizeof(std::size_t)),
+			statistics.bytesRead);
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0, statistics.puts);
+	// The capabilities of the instrumented storage are passed through
+	CPPUNIT_ASSERT_EQUAL(backing.isConcurrentlyReadable(),
+			storage.isConcurrentlyReadable());
+}
+
+#ifdef HAVE_LEVELDB
+void KeyValueStorageTest::testLevelDbFilterPolicy() {
+	// The storage of setUp() gets the default filter
+	LevelDbStorage * level = dynamic_cast<LevelDbStorage *> (stores.front());
+	CPPUNIT_ASSERT(level->filterPolicy_ != NULL);
+	CPPUNIT_ASSERT(level->options_.filter_policy == level->filterPolicy_);
+	const std::string path("temp-leveldb-filter-unittest");
+	const int bits[] = { LevelDbStorage::DEFAULT_BLOOM_BITS, 0 };
+	unsigned char keybuffer[hash.getHashSize()];
+	unsigned char valuebuffer[10];
+	memset(valuebuffer, 1, sizeof(valuebuffer));
+	for (std::size_t b = 0; b < 2; b++) {
+		{
+			LevelDbStorage storage(path, 1024 * 1024, bits[b]);
+			// 0 bits per key disables the filter
+			CPPUNIT_ASSERT((bits[b] > 0) == (storage.filterPolicy_ != NULL));
+			CPPUNIT_ASSERT(storage.options_.filter_policy
+					== storage.filterPolicy_);
+			for (int i = 0; i < 100; i++) {
+				std::stringstream ss;
+				ss << "bla" << i;
+				hash(keybuffer, ss.str());
+				storage.put(keybuffer, hash.getHashSize(), valuebuffer,
+						sizeof(valuebuffer));
+			}
+			// Hits and misses are answered the same with or without filter
+			for (int i = 0; i < 200; i++) {
+				std::stringstream ss;
+				ss << "bla" << i;
+				hash(keybuffer, ss.str());
+				std::size_t valueSize;
+				CPPUNIT_ASSERT_EQUAL(i < 100, storage.getInto(keybuffer,
+								hash.getHashSize(), valuebuffer,
+								sizeof(valuebuffer), &valueSize));
+			}
+		}
+		utils::FileSystem::rmDirRecursive(path);
+	}
+}
+#endif
 
 }
 
@@ -8,13 +8,19 @@
 #define KEYVALUESTORAGETEST_H_
 #include <cppunit/extensions/HelperMacros.h>
 #include <setsync/storage/KeyValueStorage.h>
+#include <setsync/storage/MemStorage.h>
+#include <setsync/storage/PrefixStorage.h>
+#include <setsync/storage/EpochStorage.h>
+#include <setsync/storage/InstrumentedStorage.h>
 #include <list>
 #ifdef HAVE_LEVELDB
 #include <setsync/storage/LevelDbStorage.h>
 #endif
 #ifdef HAVE_DB_CXX_H
 #include <setsync/storage/BdbStorage.h>
-#include <setsync/storage/MemStorage.h>
+#endif
+#ifdef HAVE_LMDB
+#include <setsync/storage/LmdbStorage.h>
 #endif
 #ifdef HAVE_SQLITE
 //#include <setsync/storage/SqliteStorage.h>
@@ -31,6 +37,18 @@ CPPUNIT_TEST_SUITE( KeyValueStorageTest);
 		CPPUNIT_TEST( testDelete);
 		CPPUNIT_TEST( testIterator);
 		CPPUNIT_TEST( testClear);
+		CPPUNIT_TEST( testBatch);
+		CPPUNIT_TEST( testGetInto);
+		CPPUNIT_TEST( testMemStorage);
+		CPPUNIT_TEST( testPrefixStorage);
+		CPPUNIT_TEST( testRangeIterator);
+		CPPUNIT_TEST( testMultiGet);
+		CPPUNIT_TEST( testEpochStorage);
+		CPPUNIT_TEST( testEpochStorageUpgrade);
+		CPPUNIT_TEST( testInstrumentedStorage);
+#ifdef HAVE_LEVELDB
+		CPPUNIT_TEST( testLevelDbFilterPolicy);
+#endif
 	CPPUNIT_TEST_SUITE_END();
 private:
 	std::list<AbstractKeyValueStorage *> stores;
@@ -42,6 +60,9 @@ private:
 	std::string bdbpath;
 	Db * db;
 #endif
+#ifdef HAVE_LMDB
+	std::string lmdbpath;
+#endif
 public:
 	void setUp(void);
 	void tearDown(void);
@@ -51,6 +72,18 @@ protected:
 	void testDelete();
 	void testIterator();
 	void testClear();
+	void testBatch();
+	void testGetInto();
+	void testMemStorage();
+	void testPrefixStorage();
+	void testRangeIterator();
+	void testMultiGet();
+	void testEpochStorage();
+	void testEpochStorageUpgrade();
+	void testInstrumentedStorage();
+#ifdef HAVE_LEVELDB
+	void testLevelDbFilterPolicy();
+#endif
 };
 CPPUNIT_TEST_SUITE_REGISTRATION(KeyValueStorageTest);
 }
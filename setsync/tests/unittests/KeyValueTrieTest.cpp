@@ -8,6 +8,7 @@
 #include <sstream>
 #include <setsync/utils/OutputFunctions.h>
 #include <stdlib.h>
+#include <string.h>
 #include <setsync/DiffHandler.h>
 
 using namespace std;
@@ -105,6 +106,50 @@ void KeyValueTrieTest::testContains() {
 	CPPUNIT_ASSERT(trie.contains(root) == INNER_NODE);
 	CPPUNIT_ASSERT(trie.Trie::remove("bla1"));
 	CPPUNIT_ASSERT(!trie.Trie::contains("bla1"));
+	// A miss is answered without a TrieNodeNotFoundException
+	CPPUNIT_ASSERT(trie.Trie::contains("bla3") == NOT_FOUND);
+	CPPUNIT_ASSERT(trie.Trie::contains("bla2") == LEAF_NODE);
+	// Records of another size, like the size of the trie, aren't nodes,
+	// even if they are stored under a key of the hash size
+	unsigned char other[hash.getHashSize()];
+	hash(other, "triesize");
+	const size_t size = trie.getSize();
+	storage1->put(other, hash.getHashSize(), (const unsigned char *) &size,
+			sizeof(size_t));
+	CPPUNIT_ASSERT(trie.contains(other) == NOT_FOUND);
+	TrieNodeType type;
+	trie.containsAll(other, 1, &type);
+	CPPUNIT_ASSERT_EQUAL(NOT_FOUND, type);
+}
+
+void KeyValueTrieTest::testContainsAll() {
+	// With and without the node cache
+	for (std::size_t cacheSize = 0; cacheSize <= 4096; cacheSize += 4096) {
+		trie::KeyValueTrie trie(hash, *storage1, cacheSize);
+		const std::size_t count = 600;
+		unsigned char hashes[count * hash.getHashSize()];
+		for (std::size_t i = 0; i < count; i++) {
+			stringstream ss;
+			ss << "bla" << i;
+			hash(hashes + i * hash.getHashSize(), ss.str());
+			if (i % 3 != 0) {
+				CPPUNIT_ASSERT(trie.add(hashes + i * hash.getHashSize()));
+			}
+		}
+		unsigned char root[hash.getHashSize()];
+		CPPUNIT_ASSERT(trie.getRoot(root));
+		memcpy(hashes, root, hash.getHashSize());
+		TrieNodeType types[count];
+		trie.containsAll(hashes, count, types);
+		for (std::size_t i = 0; i < count; i++) {
+			CPPUNIT_ASSERT_EQUAL(trie.contains(hashes + i * hash.getHashSize()),
+					types[i]);
+		}
+		CPPUNIT_ASSERT_EQUAL(INNER_NODE, types[0]);
+		CPPUNIT_ASSERT_EQUAL(NOT_FOUND, types[3]);
+		CPPUNIT_ASSERT_EQUAL(LEAF_NODE, types[4]);
+		trie.clear();
+	}
 }
 
 void KeyValueTrieTest::testSize() {
@@ -168,6 +213,40 @@ void KeyValueTrieTest::testSize() {
 			CPPUNIT_ASSERT(trie.getSize() == i - 1);
 		}
 	}
+	{
+		trie::KeyValueTrie trie(hash, *storage1);
+		CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+		CPPUNIT_ASSERT(trie.Trie::add("bla2"));
+		CPPUNIT_ASSERT(trie.Trie::remove("bla1"));
+		// The size is stored with each change, not only on closing
+		trie::KeyValueTrie opened(hash, *storage1);
+		CPPUNIT_ASSERT(opened.getSize() == 1);
+	}
+	{
+		// The cached trie isn't closed before the next opening, like after
+		// a crash, so the cache is never flushed
+		trie::KeyValueTrie * crashed = new trie::KeyValueTrie(hash, *storage1,
+				1 << 20);
+		crashed->clear();
+		CPPUNIT_ASSERT(crashed->Trie::add("bla1"));
+		CPPUNIT_ASSERT(crashed->Trie::add("bla2"));
+		CPPUNIT_ASSERT(crashed->Trie::add("bla3"));
+		CPPUNIT_ASSERT(crashed->Trie::remove("bla1"));
+		{
+			trie::KeyValueTrie opened(hash, *storage1);
+			CPPUNIT_ASSERT(opened.getSize() == 2);
+			CPPUNIT_ASSERT(opened.Trie::contains("bla1") == NOT_FOUND);
+			CPPUNIT_ASSERT(opened.Trie::contains("bla2") == LEAF_NODE);
+			CPPUNIT_ASSERT(opened.Trie::contains("bla3") == LEAF_NODE);
+			unsigned char crashedRoot[hash.getHashSize()];
+			unsigned char openedRoot[hash.getHashSize()];
+			CPPUNIT_ASSERT(crashed->getRoot(crashedRoot));
+			CPPUNIT_ASSERT(opened.getRoot(openedRoot));
+			CPPUNIT_ASSERT(
+					memcmp(crashedRoot, openedRoot, hash.getHashSize()) == 0);
+		}
+		delete crashed;
+	}
 }
 
 void KeyValueTrieTest::testEquals() {
@@ -193,6 +272,146 @@ void KeyValueTrieTest::testEquals() {
 	CPPUNIT_ASSERT(trie1 == trie2);
 }
 
+void KeyValueTrieTest::testPerformHashing() {
+	trie::KeyValueTrie trie1(hash, *storage1);
+	trie::KeyValueTrie trie2(hash, *storage2);
+	for (int i = 0; i < 100; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(trie1.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(trie2.Trie::add(ss.str(), false));
+	}
+	CPPUNIT_ASSERT(trie1.getSize() == trie2.getSize());
+	trie2.performHashing();
+	CPPUNIT_ASSERT(trie1 == trie2);
+	for (int i = 0; i < 100; i += 3) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(trie1.Trie::remove(ss.str()));
+		CPPUNIT_ASSERT(trie2.Trie::remove(ss.str(), false));
+	}
+	trie2.performHashing();
+	CPPUNIT_ASSERT(trie1 == trie2);
+	unsigned char root1[hash.getHashSize()];
+	unsigned char root2[hash.getHashSize()];
+	CPPUNIT_ASSERT(trie1.Trie::add("bla100"));
+	CPPUNIT_ASSERT(trie2.Trie::add("bla100", false));
+	// getRoot has to rehash the dirty nodes by itself
+	CPPUNIT_ASSERT(trie1.getRoot(root1));
+	CPPUNIT_ASSERT(trie2.getRoot(root2));
+	CPPUNIT_ASSERT(memcmp(root1, root2, hash.getHashSize()) == 0);
+	// Removing a key without hashing gives its dirty parents their old
+	// hashes back, so the rewritten nodes have the keys of replaced ones
+	trie1.clear();
+	trie2.clear();
+	for (int i = 0; i < 3; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(trie1.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(trie2.Trie::add(ss.str()));
+	}
+	CPPUNIT_ASSERT(trie2.Trie::add("bla3", false));
+	CPPUNIT_ASSERT(trie2.Trie::remove("bla3", false));
+	trie2.performHashing();
+	CPPUNIT_ASSERT(trie1 == trie2);
+	CPPUNIT_ASSERT(trie2.Trie::add("bla3", false));
+	CPPUNIT_ASSERT(trie2.Trie::add("bla4", false));
+	CPPUNIT_ASSERT(trie2.Trie::remove("bla4", false));
+	CPPUNIT_ASSERT(trie1.Trie::add("bla3"));
+	CPPUNIT_ASSERT(trie1.getRoot(root1));
+	CPPUNIT_ASSERT(trie2.getRoot(root2));
+	CPPUNIT_ASSERT(memcmp(root1, root2, hash.getHashSize()) == 0);
+	CPPUNIT_ASSERT(trie1.getSize() == trie2.getSize());
+}
+
+void KeyValueTrieTest::testNodeCache() {
+	unsigned char root1[hash.getHashSize()];
+	unsigned char root2[hash.getHashSize()];
+	trie::KeyValueTrie trie1(hash, *storage1);
+	{
+		// A small cache forces evictions during the inserts
+		trie::KeyValueTrie trie2(hash, *storage2, 2000);
+		for (int i = 0; i < 200; i++) {
+			std::stringstream ss;
+			ss << "bla" << i;
+			CPPUNIT_ASSERT(trie1.Trie::add(ss.str()));
+			CPPUNIT_ASSERT(trie2.Trie::add(ss.str()));
+		}
+		for (int i = 0; i < 200; i += 3) {
+			std::stringstream ss;
+			ss << "bla" << i;
+			CPPUNIT_ASSERT(trie1.Trie::remove(ss.str()));
+			CPPUNIT_ASSERT(trie2.Trie::remove(ss.str()));
+		}
+		CPPUNIT_ASSERT(trie1 == trie2);
+		CPPUNIT_ASSERT(trie2.Trie::contains("bla1") == LEAF_NODE);
+		CPPUNIT_ASSERT(trie2.Trie::contains("bla3") == NOT_FOUND);
+		CPPUNIT_ASSERT(trie2.getCacheHits() > 0);
+		CPPUNIT_ASSERT(trie2.getCacheMisses() > 0);
+		CPPUNIT_ASSERT(trie1.getCacheHits() == 0);
+		CPPUNIT_ASSERT(trie1.getCacheMisses() == 0);
+	}
+	// All changes must have been written back on destruction
+	trie::KeyValueTrie trie2(hash, *storage2);
+	CPPUNIT_ASSERT(trie1.getSize() == trie2.getSize());
+	CPPUNIT_ASSERT(trie1.getRoot(root1));
+	CPPUNIT_ASSERT(trie2.getRoot(root2));
+	CPPUNIT_ASSERT(memcmp(root1, root2, hash.getHashSize()) == 0);
+	CPPUNIT_ASSERT(trie2.Trie::contains("bla1") == LEAF_NODE);
+	CPPUNIT_ASSERT(trie2.Trie::contains("bla3") == NOT_FOUND);
+}
+
+void KeyValueTrieTest::testNodeCacheBatch() {
+	unsigned char value1[50];
+	unsigned char value2[50];
+	memset(value1, 1, sizeof(value1));
+	memset(value2, 2, sizeof(value2));
+	unsigned char * result;
+	std::size_t resultSize;
+	// A small cache forces evictions during the batch
+	TrieNodeCache cache(*storage1, 400);
+	for (int i = 0; i < 40; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		cache.put((const unsigned char *) ss.str().data(), ss.str().size(),
+				value1, sizeof(value1));
+	}
+	cache.beginBatch();
+	for (int i = 0; i < 40; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		if (i % 2 == 0) {
+			cache.put((const unsigned char *) ss.str().data(),
+					ss.str().size(), value2, sizeof(value2));
+		} else {
+			cache.del((const unsigned char *) ss.str().data(), ss.str().size());
+		}
+	}
+	cache.abortBatch();
+	cache.flush();
+	for (int i = 0; i < 40; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(storage1->get((const unsigned char *) ss.str().data(),
+						ss.str().size(), &result, &resultSize));
+		CPPUNIT_ASSERT(memcmp(result, value1, sizeof(value1)) == 0);
+		free(result);
+	}
+	// Committed batches and changes outside of a batch reach the storage
+	// without a flush, even if nothing is evicted
+	TrieNodeCache large(*storage1, 1 << 20);
+	large.beginBatch();
+	large.put((const unsigned char *) "bla0", 4, value2, sizeof(value2));
+	large.commitBatch();
+	large.del((const unsigned char *) "bla1", 4);
+	CPPUNIT_ASSERT(storage1->get((const unsigned char *) "bla0", 4, &result,
+					&resultSize));
+	CPPUNIT_ASSERT(memcmp(result, value2, sizeof(value2)) == 0);
+	free(result);
+	CPPUNIT_ASSERT(!storage1->get((const unsigned char *) "bla1", 4, &result,
+					&resultSize));
+}
+
 void KeyValueTrieTest::testSavingAndLoading() {
 	Db * dbcopy = new Db(NULL, 0);
 	dbcopy->open(NULL, "trieCopy.db", "trie", DB_HASH, DB_CREATE, 0);
@@ -20,8 +20,12 @@ CPPUNIT_TEST_SUITE( KeyValueTrieTest);
 		CPPUNIT_TEST( testAddingAndCleaningElements);
 		CPPUNIT_TEST( testAdding);
 		CPPUNIT_TEST( testContains);
+		CPPUNIT_TEST( testContainsAll);
 		CPPUNIT_TEST( testSize);
 		CPPUNIT_TEST( testEquals);
+		CPPUNIT_TEST( testPerformHashing);
+		CPPUNIT_TEST( testNodeCache);
+		CPPUNIT_TEST( testNodeCacheBatch);
 		CPPUNIT_TEST( testSavingAndLoading);
 		CPPUNIT_TEST( testToString);
 		CPPUNIT_TEST( testSubTrie);
@@ -44,8 +48,12 @@ protected:
 	void testAddingAndErasingElements();
 	void testAddingAndCleaningElements();
 	void testContains();
+	void testContainsAll();
 	void testSize();
 	void testEquals();
+	void testPerformHashing();
+	void testNodeCache();
+	void testNodeCacheBatch();
 	void testSavingAndLoading();
 	void testToString();
 	void testSubTrie();
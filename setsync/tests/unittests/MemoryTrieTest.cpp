@@ -0,0 +1,146 @@
+/*
+ * MemoryTrieTest.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "MemoryTrieTest.h"
+#include <sstream>
+
+using namespace std;
+namespace setsync {
+namespace trie {
+
+void MemoryTrieTest::setUp(void) {
+	this->db = new Db(NULL, 0);
+	db->open(NULL, NULL, "trie", DB_HASH, DB_CREATE, 0);
+	this->storage = new setsync::storage::BdbStorage(this->db);
+}
+
+void MemoryTrieTest::tearDown(void) {
+	delete this->storage;
+	db->close(0);
+	delete this->db;
+}
+
+void MemoryTrieTest::testAdding() {
+	MemoryTrie trie(hash);
+	CPPUNIT_ASSERT(trie.getSize() == 0);
+	CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(trie.getSize() == 1);
+	CPPUNIT_ASSERT(!trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(!trie.Trie::add(std::string("bla1")));
+	CPPUNIT_ASSERT(trie.getSize() == 1);
+	CPPUNIT_ASSERT(trie.Trie::add("bla2"));
+	CPPUNIT_ASSERT(trie.getSize() == 2);
+	trie.clear();
+	CPPUNIT_ASSERT(trie.getSize() == 0);
+	CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(trie.getSize() == 1);
+}
+
+void MemoryTrieTest::testAddingAndErasingElements() {
+	MemoryTrie trie(hash);
+	CPPUNIT_ASSERT(!trie.Trie::remove("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::remove("bla1"));
+	CPPUNIT_ASSERT(trie.getSize() == 0);
+	CPPUNIT_ASSERT(!trie.Trie::remove("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::add("bla2"));
+	CPPUNIT_ASSERT(trie.Trie::add("bla3"));
+	CPPUNIT_ASSERT(trie.getSize() == 3);
+	CPPUNIT_ASSERT(trie.Trie::remove("bla2"));
+	CPPUNIT_ASSERT(!trie.Trie::remove("bla2"));
+	CPPUNIT_ASSERT(trie.getSize() == 2);
+	unsigned char root[hash.getHashSize()];
+	CPPUNIT_ASSERT(trie.getRoot(root));
+	// Inner nodes can't be removed
+	CPPUNIT_ASSERT(!trie.remove(root));
+	CPPUNIT_ASSERT(trie.Trie::remove("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::remove("bla3"));
+	CPPUNIT_ASSERT(trie.getSize() == 0);
+	CPPUNIT_ASSERT(!trie.getRoot(root));
+}
+
+void MemoryTrieTest::testContains() {
+	MemoryTrie trie(hash);
+	CPPUNIT_ASSERT(trie.Trie::contains("bla1") == NOT_FOUND);
+	CPPUNIT_ASSERT(trie.Trie::add("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::contains("bla1") == LEAF_NODE);
+	CPPUNIT_ASSERT(trie.Trie::add("bla2"));
+	unsigned char root[hash.getHashSize()];
+	CPPUNIT_ASSERT(trie.getRoot(root));
+	CPPUNIT_ASSERT(trie.contains(root) == INNER_NODE);
+	CPPUNIT_ASSERT(trie.Trie::remove("bla1"));
+	CPPUNIT_ASSERT(trie.Trie::contains("bla1") == NOT_FOUND);
+	CPPUNIT_ASSERT(trie.contains(root) == NOT_FOUND);
+}
+
+void MemoryTrieTest::testPerformHashing() {
+	MemoryTrie trie1(hash);
+	MemoryTrie trie2(hash);
+	for (int i = 0; i < 1000; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(trie1.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(trie2.Trie::add(ss.str(), false));
+	}
+	trie2.performHashing();
+	CPPUNIT_ASSERT(trie1 == trie2);
+	for (int i = 0; i < 1000; i += 3) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(trie1.Trie::remove(ss.str()));
+		CPPUNIT_ASSERT(trie2.Trie::remove(ss.str(), false));
+	}
+	CPPUNIT_ASSERT(trie1 == trie2);
+}
+
+void MemoryTrieTest::testEqualToKeyValueTrie() {
+	MemoryTrie memtrie(hash);
+	KeyValueTrie kvtrie(hash, *storage);
+	CPPUNIT_ASSERT(memtrie == kvtrie);
+	CPPUNIT_ASSERT(kvtrie == memtrie);
+	for (int i = 0; i < 500; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(memtrie.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(kvtrie.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(memtrie == kvtrie);
+	}
+	CPPUNIT_ASSERT(kvtrie == memtrie);
+	for (int i = 0; i < 500; i += 2) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(memtrie.Trie::remove(ss.str()));
+		CPPUNIT_ASSERT(kvtrie.Trie::remove(ss.str()));
+		CPPUNIT_ASSERT(memtrie == kvtrie);
+	}
+	CPPUNIT_ASSERT(memtrie.toDotString() == kvtrie.toDotString());
+}
+
+void MemoryTrieTest::testSubTrie() {
+	MemoryTrie memtrie(hash);
+	KeyValueTrie kvtrie(hash, *storage);
+	for (int i = 0; i < 100; i++) {
+		std::stringstream ss;
+		ss << "bla" << i;
+		CPPUNIT_ASSERT(memtrie.Trie::add(ss.str()));
+		CPPUNIT_ASSERT(kvtrie.Trie::add(ss.str()));
+	}
+	unsigned char root[hash.getHashSize()];
+	CPPUNIT_ASSERT(memtrie.getRoot(root));
+	for (std::size_t n = 2; n < 20; n++) {
+		std::size_t buffersize = n * hash.getHashSize();
+		unsigned char membuffer[buffersize];
+		unsigned char kvbuffer[buffersize];
+		std::size_t memsize = memtrie.getSubTrie(root, membuffer, buffersize);
+		std::size_t kvsize = kvtrie.getSubTrie(root, kvbuffer, buffersize);
+		CPPUNIT_ASSERT(memsize == kvsize);
+		CPPUNIT_ASSERT(memcmp(membuffer, kvbuffer, memsize) == 0);
+	}
+}
+
+}
+}
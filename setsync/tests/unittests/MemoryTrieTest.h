@@ -0,0 +1,46 @@
+/*
+ * MemoryTrieTest.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef MEMORYTRIETEST_H_
+#define MEMORYTRIETEST_H_
+#include <cppunit/extensions/HelperMacros.h>
+#include <setsync/trie/MemoryTrie.h>
+#include <setsync/trie/KeyValueTrie.h>
+#include <setsync/crypto/CryptoHash.h>
+#include <setsync/storage/BdbStorage.h>
+namespace setsync {
+namespace trie {
+
+class MemoryTrieTest: public CPPUNIT_NS::TestCase {
+CPPUNIT_TEST_SUITE( MemoryTrieTest);
+		CPPUNIT_TEST( testAdding);
+		CPPUNIT_TEST( testAddingAndErasingElements);
+		CPPUNIT_TEST( testContains);
+		CPPUNIT_TEST( testPerformHashing);
+		CPPUNIT_TEST( testEqualToKeyValueTrie);
+		CPPUNIT_TEST( testSubTrie);
+	CPPUNIT_TEST_SUITE_END();
+
+public:
+	void setUp(void);
+	void tearDown(void);
+private:
+	Db * db;
+	setsync::storage::BdbStorage * storage;
+	crypto::CryptoHash hash;
+protected:
+	void testAdding();
+	void testAddingAndErasingElements();
+	void testContains();
+	void testPerformHashing();
+	void testEqualToKeyValueTrie();
+	void testSubTrie();
+};
+CPPUNIT_TEST_SUITE_REGISTRATION(MemoryTrieTest);
+
+}
+}
+#endif /* MEMORYTRIETEST_H_ */
@@ -0,0 +1,159 @@
+/*
+ * ScalableBloomFilterTest.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "ScalableBloomFilterTest.h"
+#include <setsync/DiffHandler.h>
+#include <stdio.h>
+#include <string.h>
+#include <sstream>
+#include <vector>
+
+namespace setsync {
+namespace bloom {
+
+void ScalableBloomFilterTest::setUp() {
+	this->storage1 = new setsync::storage::MemStorage();
+	this->storage2 = new setsync::storage::MemStorage();
+}
+
+void ScalableBloomFilterTest::tearDown() {
+	delete this->storage1;
+	delete this->storage2;
+}
+
+void ScalableBloomFilterTest::createKeys(unsigned char * keys,
+		const std::size_t first, const std::size_t count) {
+	for (std::size_t i = 0; i < count; i++) {
+		std::stringstream key;
+		key << "key" << (first + i);
+		hashFunction_(keys + i * hashFunction_.getHashSize(), key.str());
+	}
+}
+
+void ScalableBloomFilterTest::testGrowth() {
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	unsigned char keys[250 * hashSize];
+	createKeys(keys, 0, 250);
+	bloom::ScalableBloomFilter filter(hashFunction_, *storage1, "", 100,
+			false, 0.01);
+	const std::size_t firstSize = filter.size();
+	filter.addAll(keys, 50);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 1, filter.numberOfSlices());
+	for (std::size_t i = 50; i < 100; i++) {
+		filter.add(keys + i * hashSize);
+	}
+	// The full slice is only replaced, when more keys are added
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 1, filter.numberOfSlices());
+	filter.addAll(keys + 100 * hashSize, 150);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 2, filter.numberOfSlices());
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 250, filter.numberOfElements());
+	CPPUNIT_ASSERT(filter.size() > 3 * firstSize);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 250, filter.containsAll(keys, 250));
+	// Without scaling, the first slice is overfilled
+	bloom::ScalableBloomFilter fixed(hashFunction_, *storage2, "", 100,
+			false, 0.01, false);
+	fixed.addAll(keys, 250);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 1, fixed.numberOfSlices());
+	CPPUNIT_ASSERT_EQUAL(firstSize, fixed.size());
+	// Clearing removes the added slices
+	filter.clear();
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 1, filter.numberOfSlices());
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 0, filter.numberOfElements());
+	CPPUNIT_ASSERT(!filter.contains(keys + 200 * hashSize));
+}
+
+void ScalableBloomFilterTest::testRemove() {
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	unsigned char keys[150 * hashSize];
+	createKeys(keys, 0, 150);
+	bloom::ScalableBloomFilter filter(hashFunction_, *storage1, "", 100,
+			false, 0.01);
+	filter.addAll(keys, 150);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 2, filter.numberOfSlices());
+	// One key of each slice
+	CPPUNIT_ASSERT(filter.remove(keys));
+	CPPUNIT_ASSERT(filter.remove(keys + 120 * hashSize));
+	CPPUNIT_ASSERT(!filter.remove(keys));
+	// The range covers both slices and the already removed key
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 49,
+			filter.removeAll(keys + 80 * hashSize, 50));
+	CPPUNIT_ASSERT_EQUAL((uint64_t) 99, filter.numberOfElements());
+	ListDiffHandler handler;
+	filter.getAll(handler);
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 99, handler.size());
+}
+
+void ScalableBloomFilterTest::testRestart() {
+	const std::string file("scalable.filter");
+	const std::string sliceFile("scalable.filter.slice1");
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	unsigned char keys[150 * hashSize];
+	createKeys(keys, 0, 150);
+	remove(file.c_str());
+	remove(sliceFile.c_str());
+	std::size_t size;
+	{
+		bloom::ScalableBloomFilter filter(hashFunction_, *storage1, file,
+				100, false, 0.01);
+		filter.addAll(keys, 150);
+		size = filter.size();
+	}
+	// Slices are opened, even if no new ones are added
+	{
+		bloom::ScalableBloomFilter filter(hashFunction_, *storage1, file,
+				100, false, 0.01, false);
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 2, filter.numberOfSlices());
+		CPPUNIT_ASSERT_EQUAL(size, filter.size());
+		CPPUNIT_ASSERT_EQUAL((uint64_t) 150, filter.numberOfElements());
+		CPPUNIT_ASSERT_EQUAL((std::size_t) 150, filter.containsAll(keys, 150));
+	}
+	remove(file.c_str());
+	remove(sliceFile.c_str());
+}
+
+void ScalableBloomFilterTest::testDiff() {
+	const std::size_t hashSize = hashFunction_.getHashSize();
+	unsigned char keys[200 * hashSize];
+	createKeys(keys, 0, 200);
+	bloom::ScalableBloomFilter filterA(hashFunction_, *storage1, "", 100,
+			false, 0.01);
+	bloom::ScalableBloomFilter filterB(hashFunction_, *storage2, "", 100,
+			false, 0.01);
+	filterA.addAll(keys, 200);
+	filterB.addAll(keys, 150);
+	CPPUNIT_ASSERT_EQUAL(filterA.size(), filterB.size());
+	// The bits of B are passed in small chunks, which cross the slices
+	std::vector<unsigned char> buffer(filterB.size());
+	std::size_t length = 0;
+	while (length < buffer.size()) {
+		length += filterB.getChunk(&buffer[length], 100, length);
+	}
+	CPPUNIT_ASSERT_EQUAL((std::size_t) 0, filterB.getChunk(&buffer[0], 100,
+			length));
+	ListDiffHandler handler;
+	for (std::size_t offset = 0; offset < length; offset += 100) {
+		filterA.diff(&buffer[offset], std::min((std::size_t) 100, length
+				- offset), offset, handler);
+	}
+	CPPUNIT_ASSERT(handler.size() >= 45 && handler.size() <= 50);
+	for (std::size_t i = 0; i < handler.size(); i++) {
+		CPPUNIT_ASSERT(!filterB.contains(handler[i].first));
+	}
+	// The compressed chunks carry the offsets of both slices
+	ListDiffHandler compressedHandler;
+	unsigned char chunk[256];
+	std::size_t offset = 0;
+	while (offset < filterB.size()) {
+		std::size_t covered;
+		std::size_t written = filterB.getCompressedChunk(chunk, sizeof(chunk),
+				offset, &covered);
+		offset = filterA.diffCompressed(chunk, written, compressedHandler);
+	}
+	CPPUNIT_ASSERT_EQUAL(handler.size(), compressedHandler.size());
+}
+
+}
+}
@@ -0,0 +1,49 @@
+/*
+ * ScalableBloomFilterTest.h
+ *
+ *      Author: Till Lorentzen
+ */
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+#include <setsync/bloom/ScalableBloomFilter.h>
+#include <setsync/crypto/CryptoHash.h>
+#include <setsync/storage/MemStorage.h>
+
+#ifndef SCALABLEBLOOMFILTERTEST_H_
+#define SCALABLEBLOOMFILTERTEST_H_
+namespace setsync {
+namespace bloom {
+
+class ScalableBloomFilterTest: public CppUnit::TestFixture {
+
+CPPUNIT_TEST_SUITE(ScalableBloomFilterTest);
+		CPPUNIT_TEST(testGrowth);
+		CPPUNIT_TEST(testRemove);
+		CPPUNIT_TEST(testRestart);
+		CPPUNIT_TEST(testDiff);
+	CPPUNIT_TEST_SUITE_END();
+
+private:
+	setsync::storage::MemStorage * storage1;
+	setsync::storage::MemStorage * storage2;
+	crypto::CryptoHash hashFunction_;
+	/**
+	 * Writes the hashes of the strings "key<first>" to "key<first+count-1>"
+	 * into the buffer
+	 */
+	void createKeys(unsigned char * keys, const std::size_t first,
+			const std::size_t count);
+public:
+	void testGrowth();
+	void testRemove();
+	void testRestart();
+	void testDiff();
+
+	void setUp();
+	void tearDown();
+};
+CPPUNIT_TEST_SUITE_REGISTRATION( ScalableBloomFilterTest);
+}
+}
+
+#endif /* SCALABLEBLOOMFILTERTEST_H_ */
@@ -5,6 +5,8 @@
  */
 
 #include "SetTest.h"
+#include <setsync/bloom/BloomFilterChunkCodec.h>
+#include <sstream>
 
 using namespace std;
 
@@ -79,6 +81,36 @@ void SetTest::testMaximum() {
 	CPPUNIT_ASSERT(set.getSize() == 5);
 }
 
+void SetTest::testInsertAll() {
+	setsync::Set single(config);
+	setsync::Set batch(config2);
+	std::size_t hashsize = single.getHashFunction().getHashSize();
+	std::size_t count = 100;
+	unsigned char keys[count * hashsize];
+	for (uint64_t i = 0; i < count; i++) {
+		single.getHashFunction()(keys + i * hashsize, (unsigned char *) &i,
+				sizeof(uint64_t));
+		CPPUNIT_ASSERT(single.insert(keys + i * hashsize));
+	}
+	CPPUNIT_ASSERT(batch.insertAll(keys, count) == count);
+	CPPUNIT_ASSERT(batch.getSize() == count);
+	CPPUNIT_ASSERT(single == batch);
+	for (std::size_t i = 0; i < count; i++) {
+		CPPUNIT_ASSERT(batch.find(keys + i * hashsize));
+	}
+	// Already inserted keys are skipped
+	CPPUNIT_ASSERT(batch.insertAll(keys, count) == 0);
+	CPPUNIT_ASSERT(batch.getSize() == count);
+
+	config::Configuration::BloomFilterConfig bfconfig;
+	bfconfig.setHardMaximum(true);
+	bfconfig.setMaxElements(5);
+	config::Configuration maxConfig(bfconfig);
+	setsync::Set maxset(maxConfig);
+	CPPUNIT_ASSERT(maxset.insertAll(keys, count) == 5);
+	CPPUNIT_ASSERT(maxset.getSize() == 5);
+}
+
 void SetTest::testSync() {
 	setsync::Set localset(config);
 	setsync::Set remoteset(config2);
@@ -333,6 +365,68 @@ void SetTest::testStrictSync() {
 	delete remoteprocess;
 }
 
+void SetTest::testCompressedSync() {
+	config::Configuration::BloomFilterConfig bfconfig;
+	bfconfig.setType(config::Configuration::BloomFilterConfig::COMPRESSED);
+	config::Configuration compressedConfig(bfconfig);
+	setsync::Set localset(compressedConfig);
+	setsync::Set remoteset(compressedConfig);
+	setsync::Set normalset(config);
+	for (int i = 0; i < 100; i++) {
+		std::stringstream ss;
+		ss << "hallo" << i;
+		CPPUNIT_ASSERT(localset.insert(ss.str()));
+		if (i % 10 != 0) {
+			CPPUNIT_ASSERT(remoteset.insert(ss.str()));
+		}
+	}
+	CPPUNIT_ASSERT(remoteset.insert("remote"));
+	SynchronizationProcess * localprocess = localset.createSyncProcess();
+	SynchronizationProcess * remoteprocess = remoteset.createSyncProcess();
+	SynchronizationProcess * normalprocess = normalset.createSyncProcess();
+	// Both sides have to propose the compressed transfer
+	CPPUNIT_ASSERT(normalprocess->negotiateBloomFilterTransferType(
+			localprocess->getBloomFilterTransferType())
+			== config::Configuration::BloomFilterConfig::NORMAL);
+	CPPUNIT_ASSERT(localprocess->negotiateBloomFilterTransferType(
+			remoteprocess->getBloomFilterTransferType())
+			== config::Configuration::BloomFilterConfig::COMPRESSED);
+	CPPUNIT_ASSERT(remoteprocess->negotiateBloomFilterTransferType(
+			localprocess->getBloomFilterTransferType())
+			== config::Configuration::BloomFilterConfig::COMPRESSED);
+	CPPUNIT_ASSERT(localprocess->getMinBFBuffer()
+			== bloom::BloomFilterChunkCodec::MIN_CHUNK_SIZE);
+	setsync::ListDiffHandler localDiffHandler;
+	setsync::ListDiffHandler remoteDiffHandler;
+	std::size_t buffersize = localprocess->getMinBuffer();
+	unsigned char buffer[buffersize];
+	std::size_t sending;
+	while (localprocess->isBloomFilterOutputAvail()) {
+		sending = localprocess->readNextBloomFilterChunk(buffer, buffersize);
+		remoteprocess->processBloomFilterChunk(buffer, sending,
+				remoteDiffHandler);
+	}
+	while (remoteprocess->isBloomFilterOutputAvail()) {
+		sending = remoteprocess->readNextBloomFilterChunk(buffer, buffersize);
+		localprocess->processBloomFilterChunk(buffer, sending, localDiffHandler);
+	}
+	// The sparse filters are much smaller than the raw ones
+	CPPUNIT_ASSERT(localprocess->getSentBytes() < localset.bf_->size() / 4);
+	CPPUNIT_ASSERT_THROW(localprocess->setBloomFilterTransferType(
+			config::Configuration::BloomFilterConfig::NORMAL), std::exception);
+	for (size_t i = 0; i < localDiffHandler.size(); i++) {
+		remoteset.insert(localDiffHandler[i].first);
+	}
+	for (size_t i = 0; i < remoteDiffHandler.size(); i++) {
+		localset.insert(remoteDiffHandler[i].first);
+	}
+	CPPUNIT_ASSERT(localset.getSize() == 101);
+	CPPUNIT_ASSERT(localset == remoteset);
+	delete localprocess;
+	delete remoteprocess;
+	delete normalprocess;
+}
+
 void SetTest::testCAPI() {
 	SET localset;
 	SET remoteset;
@@ -20,10 +20,12 @@ CPPUNIT_TEST_SUITE( SetTest);
 	CPPUNIT_TEST( testClear);
 	CPPUNIT_TEST( testFind);
 	CPPUNIT_TEST( testMaximum);
+	CPPUNIT_TEST( testInsertAll);
 	CPPUNIT_TEST( testStartSync);
 	CPPUNIT_TEST( testLooseSync);
 	CPPUNIT_TEST( testStrictSync);
 	CPPUNIT_TEST( testSync);
+	CPPUNIT_TEST( testCompressedSync);
 	CPPUNIT_TEST( testCAPI);
 CPPUNIT_TEST_SUITE_END();
 
@@ -41,10 +43,12 @@ protected:
 	void testClear();
 	void testFind();
 	void testMaximum();
+	void testInsertAll();
 	void testStartSync();
 	void testLooseSync();
 	void testStrictSync();
 	void testSync();
+	void testCompressedSync();
 	void testCAPI();
 };
 CPPUNIT_TEST_SUITE_REGISTRATION( SetTest);
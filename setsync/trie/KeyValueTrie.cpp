@@ -18,6 +18,7 @@ namespace trie {
 const uint8_t TrieNode::HAS_PARENT = 0x01;
 const uint8_t TrieNode::HAS_CHILDREN = 0x02;
 const uint8_t TrieNode::DIRTY = 0x04;
+const std::size_t KeyValueTrie::MULTI_GET_SIZE;
 
 std::size_t TrieNode::getMarshallBufferSize(const TrieNode& node) {
 	return 4 * node.hashfunction_.getHashSize() + 2 * sizeof(uint8_t);
@@ -45,17 +46,15 @@ KeyValueRootNode::KeyValueRootNode(const KeyValueTrie& trie,
 }
 
 TrieNode KeyValueRootNode::get() const {
-	unsigned char * rootHash;
+	unsigned char rootHash[TrieNode::MAX_HASH_SIZE];
 	size_t resultSize;
-	if (this->storage_.get((unsigned char *) root_name, strlen(root_name),
-			&rootHash, &resultSize)) {
+	if (this->storage_.getInto((unsigned char *) root_name, strlen(root_name),
+			rootHash, TrieNode::MAX_HASH_SIZE, &resultSize)) {
 		if (resultSize != hashfunction_.getHashSize()) {
 			throw TrieException("wrong root key size");
 		}
-		TrieNode rootNode = TrieNode(this->trie_, this->hashfunction_,
-				this->storage_, rootHash);
-		free(rootHash);
-		return rootNode;
+		return TrieNode(this->trie_, this->hashfunction_, this->storage_,
+				rootHash);
 	} else {
 		throw TrieRootNotFoundException();
 	}
@@ -92,11 +91,10 @@ TrieNode::TrieNode(const KeyValueTrie& trie,
 		setsync::storage::AbstractKeyValueStorage& storage,
 		const unsigned char * hash, bool newone) :
 	storage_(storage), hashfunction_(hashfunction), trie_(trie) {
-	this->hash = (unsigned char*) malloc(hashfunction_.getHashSize() * 5);
-	this->smaller = this->hash + hashfunction_.getHashSize();
-	this->larger = this->smaller + hashfunction_.getHashSize();
-	this->parent = this->larger + hashfunction_.getHashSize();
-	this->prefix = this->parent + hashfunction_.getHashSize();
+	if (hashfunction_.getHashSize() > MAX_HASH_SIZE) {
+		throw TrieException("Hash size is not supported by the trie");
+	}
+	initBuffer();
 	memcpy(this->hash, hash, hashfunction_.getHashSize());
 	if (newone) {
 		this->hasChildren_ = false;
@@ -105,21 +103,29 @@ TrieNode::TrieNode(const KeyValueTrie& trie,
 		this->prefix_mask = 8 * hashfunction_.getHashSize();
 		this->dirty_ = false;
 	} else {
-		unsigned char * result;
+		unsigned char result[4 * MAX_HASH_SIZE + 2 * sizeof(uint8_t)];
 		size_t resultSize;
-		if (this->storage_.get(hash, hashfunction_.getHashSize(), &result,
-				&resultSize)) {
+		if (this->storage_.getInto(hash, hashfunction_.getHashSize(), result,
+				sizeof(result), &resultSize)) {
+			if (resultSize != getMarshallBufferSize(*this)) {
+				throw TrieException("wrong node size");
+			}
 			unmarshall(*this, result, resultSize);
-			free(result);
 		} else {
-			free(this->hash);
 			throw TrieNodeNotFoundException();
 		}
 	}
 }
 
 TrieNode::~TrieNode() {
-	free(this->hash);
+}
+
+void TrieNode::initBuffer() {
+	this->hash = this->buffer_;
+	this->smaller = this->hash + hashfunction_.getHashSize();
+	this->larger = this->smaller + hashfunction_.getHashSize();
+	this->parent = this->larger + hashfunction_.getHashSize();
+	this->prefix = this->parent + hashfunction_.getHashSize();
 }
 
 void TrieNode::unmarshall(TrieNode& target, const unsigned char * loadedValue,
@@ -250,6 +256,10 @@ bool TrieNode::insert(TrieNode& node, bool performHash) {
 		throw DbTrieException("ERROR");
 	}
 	intermediate.updateHash();
+	// The hash of a dirty child is not valid, so the new parent stays dirty
+	if (oldnode.dirty_) {
+		intermediate.dirty_ = true;
+	}
 	node.setParent(intermediate);
 	node.toDb();
 	oldnode.setParent(intermediate);
@@ -261,6 +271,8 @@ bool TrieNode::insert(TrieNode& node, bool performHash) {
 		// Update the parent and their direct children
 		// All no more needed nodes of the DB
 		std::vector<TrieNode> toBeDeleted;
+		// New parents, which could have got the hash of a deleted one
+		std::vector<TrieNode> written;
 		// Child before change
 		TrieNode oldchild = *this;
 		// Child after change
@@ -303,6 +315,7 @@ bool TrieNode::insert(TrieNode& node, bool performHash) {
 			}
 			// Save the new parent
 			parent.toDb();
+			written.push_back(parent);
 			// Set the old parent as the old child
 			oldchild = oldparent;
 			// Set the new parent as new child
@@ -314,14 +327,11 @@ bool TrieNode::insert(TrieNode& node, bool performHash) {
 		// Set the new root of the trie
 		this->trie_.root_->set(roothash);
 		// Now delete all old and replaced parents
-		std::vector<TrieNode>::const_iterator iter;
-		for (iter = toBeDeleted.begin(); iter != toBeDeleted.end(); iter++) {
-			TrieNode d = *iter;
-			d.deleteFromDb();
-		}
+		deleteReplaced(toBeDeleted, written);
 	} else {
 		if (intermediate.hasParent_) {
 			TrieNode parent = intermediate.getParent();
+			bool parentWasDirty = parent.dirty_;
 			parent.dirty_ = true;
 			if (parent.isEqualToSmaller(oldnode)) {
 				parent.setSmaller(intermediate);
@@ -331,6 +341,9 @@ bool TrieNode::insert(TrieNode& node, bool performHash) {
 				throw DbTrieException("Old Node hasn't been correct child");
 			}
 			parent.toDb();
+			if (!parentWasDirty) {
+				parent.setParentsDirty();
+			}
 		} else {
 			this->trie_.root_->set(intermediate.hash);
 		}
@@ -405,16 +418,8 @@ TrieNode::TrieNode(const TrieNode& other) :
 			hasParent_(other.hasParent_), prefix_mask(other.prefix_mask),
 			dirty_(other.dirty_), hashfunction_(other.hashfunction_),
 			trie_(other.trie_) {
-	this->hash = (unsigned char*) malloc(hashfunction_.getHashSize() * 5);
-	this->smaller = this->hash + hashfunction_.getHashSize();
-	this->larger = this->smaller + hashfunction_.getHashSize();
-	this->parent = this->larger + hashfunction_.getHashSize();
-	this->prefix = this->parent + hashfunction_.getHashSize();
-	memcpy(this->hash, other.hash, hashfunction_.getHashSize());
-	memcpy(this->parent, other.parent, hashfunction_.getHashSize());
-	memcpy(this->prefix, other.prefix, hashfunction_.getHashSize());
-	memcpy(this->smaller, other.smaller, hashfunction_.getHashSize());
-	memcpy(this->larger, other.larger, hashfunction_.getHashSize());
+	initBuffer();
+	memcpy(this->buffer_, other.buffer_, 5 * hashfunction_.getHashSize());
 }
 
 TrieNode& TrieNode::operator=(const TrieNode& rhs) {
@@ -423,15 +428,9 @@ TrieNode& TrieNode::operator=(const TrieNode& rhs) {
 	this->hasChildren_ = rhs.hasChildren_;
 	this->hasParent_ = rhs.hasParent_;
 	this->prefix_mask = rhs.prefix_mask;
-	this->smaller = this->hash + hashfunction_.getHashSize();
-	this->larger = this->smaller + hashfunction_.getHashSize();
-	this->parent = this->larger + hashfunction_.getHashSize();
-	this->prefix = this->parent + hashfunction_.getHashSize();
-	memcpy(this->hash, rhs.hash, hashfunction_.getHashSize());
-	memcpy(this->parent, rhs.parent, hashfunction_.getHashSize());
-	memcpy(this->prefix, rhs.prefix, hashfunction_.getHashSize());
-	memcpy(this->smaller, rhs.smaller, hashfunction_.getHashSize());
-	memcpy(this->larger, rhs.larger, hashfunction_.getHashSize());
+	if (this != &rhs) {
+		memcpy(this->buffer_, rhs.buffer_, 5 * hashfunction_.getHashSize());
+	}
 	return *this;
 }
 
@@ -502,6 +501,8 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 				TrieNode childOfParent(*this);
 				// All old nodes will be deleted after successful execution
 				std::vector<TrieNode> oldnodes;
+				// Rehashed nodes, which could have got the hash of an old one
+				std::vector<TrieNode> written;
 				if (parent.isEqualToLarger(toBeDeleted)) {
 					childOfParent = parent.getSmaller();
 				} else if (parent.isEqualToSmaller(toBeDeleted)) {
@@ -520,9 +521,13 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 					throw DbTrieException("Grandparent has wrong children");
 				}
 				newgrandparent.updateHash();
+				if (childOfParent.dirty_ || childOfGrandParent.dirty_) {
+					newgrandparent.dirty_ = true;
+				}
 				childOfParent.setParent(newgrandparent);
 				childOfGrandParent.setParent(newgrandparent);
 				newgrandparent.toDb();
+				written.push_back(newgrandparent);
 				childOfParent.toDb();
 				childOfGrandParent.toDb();
 				oldnodes.push_back(parent);
@@ -552,6 +557,7 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 							}
 							newgrandgrandparent.updateHash();
 							newgrandgrandparent.toDb();
+							written.push_back(newgrandgrandparent);
 							newgrandparent.setParent(newgrandgrandparent);
 							newgrandparent.toDb();
 							otherchild.setParent(newgrandgrandparent);
@@ -564,6 +570,7 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 					} else {
 						TrieNode oldgrandgrandparent =
 								oldgrandparent.getParent();
+						bool wasDirty = oldgrandgrandparent.dirty_;
 						if (oldgrandgrandparent.isEqualToLarger(oldgrandparent)) {
 							oldgrandgrandparent.setLarger(newgrandparent);
 						} else if (oldgrandgrandparent.isEqualToSmaller(
@@ -575,14 +582,13 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 						}
 						oldnodes.push_back(oldgrandparent);
 						oldgrandgrandparent.toDb();
+						if (!wasDirty) {
+							oldgrandgrandparent.setParentsDirty();
+						}
 					}
 				}
 
-				std::vector<TrieNode>::const_iterator iter;
-				for (iter = oldnodes.begin(); iter != oldnodes.end(); iter++) {
-					TrieNode d = *iter;
-					d.deleteFromDb();
-				}
+				deleteReplaced(oldnodes, written);
 			}
 		}
 	} catch (TrieNodeNotFoundException e) {
@@ -591,6 +597,23 @@ bool TrieNode::erase(const unsigned char * hash, bool performHash) {
 	return true;
 }
 
+void TrieNode::deleteReplaced(const std::vector<TrieNode>& replaced,
+		const std::vector<TrieNode>& written) const {
+	const std::size_t hashSize = this->hashfunction_.getHashSize();
+	std::vector<TrieNode>::const_iterator iter;
+	for (iter = replaced.begin(); iter != replaced.end(); iter++) {
+		bool rewritten = false;
+		std::vector<TrieNode>::const_iterator w;
+		for (w = written.begin(); w != written.end() && !rewritten; w++) {
+			rewritten = memcmp(iter->hash, w->hash, hashSize) == 0;
+		}
+		if (!rewritten) {
+			TrieNode d = *iter;
+			d.deleteFromDb();
+		}
+	}
+}
+
 void TrieNode::updateHash(void) {
 	if (hasChildren_) {
 		memcpy(trie_.hashscratch, this->smaller,
@@ -603,6 +626,52 @@ void TrieNode::updateHash(void) {
 	}
 }
 
+void TrieNode::setParentsDirty() {
+	TrieNode node = *this;
+	while (node.hasParent_) {
+		TrieNode parent = node.getParent();
+		if (parent.dirty_)
+			break;
+		parent.dirty_ = true;
+		parent.toDb();
+		node = parent;
+	}
+}
+
+void TrieNode::rehash() {
+	if (!this->hasChildren_)
+		return;
+	size_t hashsize = this->hashfunction_.getHashSize();
+	TrieNode smaller = this->getSmaller();
+	TrieNode larger = this->getLarger();
+	// Only dirty children have to be visited, all others are up to date
+	bool smallerChanged = smaller.dirty_;
+	bool largerChanged = larger.dirty_;
+	if (smallerChanged) {
+		smaller.rehash();
+		memcpy(this->smaller, smaller.hash, hashsize);
+	}
+	if (largerChanged) {
+		larger.rehash();
+		memcpy(this->larger, larger.hash, hashsize);
+	}
+	unsigned char oldhash[hashsize];
+	memcpy(oldhash, this->hash, hashsize);
+	updateHash();
+	bool changed = memcmp(oldhash, this->hash, hashsize) != 0;
+	if (changed) {
+		this->storage_.del(oldhash, hashsize);
+	}
+	if (changed || smallerChanged) {
+		smaller.setParent(*this);
+		smaller.toDb();
+	}
+	if (changed || largerChanged) {
+		larger.setParent(*this);
+		larger.toDb();
+	}
+}
+
 bool TrieNode::hasParent() const {
 	return this->hasParent_;
 }
@@ -690,52 +759,90 @@ uint8_t TrieNode::getFlags() const {
 }
 
 KeyValueTrie::KeyValueTrie(const crypto::CryptoHash& hash,
-		setsync::storage::AbstractKeyValueStorage& storage) :
-	Trie(hash), storage_(storage) {
+		setsync::storage::AbstractKeyValueStorage& storage,
+		const std::size_t cacheSize) :
+	Trie(hash), cache_(
+			cacheSize > 0 ? new TrieNodeCache(storage, cacheSize) : NULL),
+			storage_(cache_ != NULL ? *cache_ : storage) {
 	this->root_ = new KeyValueRootNode(*this, hash, storage_);
-	size_t * sp;
+	size_t size;
 	size_t valuesize;
-	if (this->storage_.get((unsigned char *) sizeKey, strlen(sizeKey),
-			(unsigned char **) &sp, &valuesize)) {
+	if (this->storage_.getInto((unsigned char *) sizeKey, strlen(sizeKey),
+			(unsigned char *) &size, sizeof(size_t), &valuesize)) {
 		if (valuesize == sizeof(size_t)) {
-			this->setSize(*sp);
+			this->setSize(size);
 		}
-		delete sp;
 	}
 }
 
 KeyValueTrie::~KeyValueTrie() {
-	if (this->getSize() > 0) {
-		size_t size = getSize();
-		this->storage_.put((unsigned char *) sizeKey, strlen(sizeKey),
-				(unsigned char*) &size, sizeof(size_t));
-	}
 	delete this->root_;
+	if (this->cache_ != NULL) {
+		delete this->cache_;
+	}
+}
+
+void KeyValueTrie::storeSize(const size_t size) {
+	this->storage_.put((unsigned char *) sizeKey, strlen(sizeKey),
+			(unsigned char*) &size, sizeof(size_t));
 }
 
 bool KeyValueTrie::add(const unsigned char * hash, bool performhash) {
+	if (performhash && isHashPerformingNedded()) {
+		performHashing();
+	}
+	// All changes of an insert are written at once
+	setsync::storage::StorageBatch batch(this->storage_);
+	bool inserted;
 	try {
 		TrieNode root = this->root_->get();
-		bool inserted = root.insert(hash, performhash);
-		if (inserted)
-			incSize();
-		return inserted;
+		inserted = root.insert(hash, performhash);
 	} catch (...) {
+		// Discard the changes of the failed insert
+		this->storage_.abortBatch();
+		this->storage_.beginBatch();
 		// Create a new node
 		TrieNode root(*this, this->hash_, this->storage_, hash, true);
 		root.toDb();
 		this->root_->set(hash);
+		storeSize(getSize() + 1);
+		batch.commit();
 		incSize();
 		return true;
 	}
+	if (inserted) {
+		storeSize(getSize() + 1);
+	}
+	batch.commit();
+	if (inserted) {
+		incSize();
+		if (!performhash)
+			setHashPerformingNeeded();
+	}
+	return inserted;
 }
 
 bool KeyValueTrie::remove(const unsigned char * hash, bool performhash) {
+	if (performhash && isHashPerformingNedded()) {
+		performHashing();
+	}
 	try {
-		TrieNode root = this->root_->get();
-		bool removed = root.erase(hash, performhash);
-		if (removed)
+		bool removed;
+		{
+			// All changes of an erase are written at once
+			setsync::storage::StorageBatch batch(this->storage_);
+			TrieNode root = this->root_->get();
+			removed = root.erase(hash, performhash);
+			if (removed) {
+				storeSize(getSize() - 1);
+			}
+			batch.commit();
+		}
+		if (removed) {
 			decSize();
+			if (!performhash)
+				setHashPerformingNeeded();
+		}
 		if (getSize() == 0) {
 			this->clear();
 		}
@@ -746,22 +853,73 @@ bool KeyValueTrie::remove(const unsigned char * hash, bool performhash) {
 }
 
 TrieNodeType KeyValueTrie::contains(const unsigned char * hash) const {
+	const std::size_t hashSize = this->hash_.getHashSize();
+	unsigned char record[4 * TrieNode::MAX_HASH_SIZE + 2 * sizeof(uint8_t)];
+	std::size_t recordSize;
+	if (!this->storage_.getInto(hash, hashSize, record, sizeof(record),
+			&recordSize)) {
+		return NOT_FOUND;
+	}
+	return nodeType(record, recordSize);
+}
+
+TrieNodeType KeyValueTrie::nodeType(const unsigned char * record,
+		const std::size_t recordSize) const {
+	const std::size_t hashSize = this->hash_.getHashSize();
+	// A record of the wrong size isn't a node
+	if (recordSize != 4 * hashSize + 2 * sizeof(uint8_t)) {
+		return NOT_FOUND;
+	}
+	uint8_t flags = record[4 * hashSize + 1];
+	if ((flags & TrieNode::HAS_CHILDREN) == TrieNode::HAS_CHILDREN) {
+		return INNER_NODE;
+	}
+	return LEAF_NODE;
+}
+
+void KeyValueTrie::containsAll(const unsigned char * hashes,
+		const std::size_t count, TrieNodeType * result) const {
+	const std::size_t hashSize = this->hash_.getHashSize();
+	const std::size_t nodeSize = 4 * hashSize + 2 * sizeof(uint8_t);
+	std::vector<unsigned char> values(MULTI_GET_SIZE * nodeSize);
+	std::size_t valueSizes[MULTI_GET_SIZE];
+	bool found[MULTI_GET_SIZE];
+	for (std::size_t offset = 0; offset < count; offset += MULTI_GET_SIZE) {
+		const std::size_t n = std::min(count - offset, MULTI_GET_SIZE);
+		this->storage_.multiGet(hashes + offset * hashSize, hashSize, n,
+				&values[0], nodeSize, valueSizes, found);
+		for (std::size_t i = 0; i < n; i++) {
+			if (found[i]) {
+				result[offset + i] = nodeType(&values[i * nodeSize],
+						valueSizes[i]);
+			} else {
+				result[offset + i] = NOT_FOUND;
+			}
+		}
+	}
+}
+
+void KeyValueTrie::performHashing() {
 	try {
-		TrieNode node(*this, this->hash_, this->storage_, hash, false);
-		if (node.hasChildren_) {
-			return INNER_NODE;
-		} else {
-			return LEAF_NODE;
+		TrieNode root = this->root_->get();
+		if (root.dirty_) {
+			// All rehashed nodes are written at once
+			setsync::storage::StorageBatch batch(this->storage_);
+			root.rehash();
+			root.toDb();
+			this->root_->set(root.hash);
+			batch.commit();
 		}
-	} catch (...) {
-		return NOT_FOUND;
+	} catch (TrieRootNotFoundException e) {
+		// An empty trie has nothing to be rehashed
 	}
-	return NOT_FOUND;
+	setHashingPerformed();
 }
 
 void KeyValueTrie::clear(void) {
 	this->storage_.clear();
 	this->setSize(0);
+	setHashingPerformed();
 }
 
 bool KeyValueTrie::operator ==(const Trie& other) const {
@@ -786,7 +944,19 @@ bool KeyValueTrie::operator ==(const Trie& other) const {
 		TrieNode othernode = other_.root_->get();
 		return mynode == othernode;
 	} catch (const std::bad_cast& e) {
-		return false;
+		// Other implementations are compared by their root hashes
+		std::size_t hashsize = this->hash_.getHashSize();
+		if (other.getHash().getHashSize() != hashsize) {
+			return false;
+		}
+		unsigned char myroot[hashsize];
+		unsigned char otherroot[hashsize];
+		bool hasRoot = const_cast<KeyValueTrie *> (this)->getRoot(myroot);
+		bool otherHasRoot = const_cast<Trie&> (other).getRoot(otherroot);
+		if (hasRoot != otherHasRoot) {
+			return false;
+		}
+		return !hasRoot || memcmp(myroot, otherroot, hashsize) == 0;
 	}
 }
 
@@ -870,6 +1040,8 @@ size_t KeyValueTrie::getSubTrie(const unsigned char * hash, void * buffer,
 bool KeyValueTrie::getRoot(unsigned char * hash) {
 	if (this->getSize() == 0)
 		return false;
+	if (isHashPerformingNedded())
+		performHashing();
 	try {
 		TrieNode root = this->root_->get();
 		memcpy(hash, root.hash, this->hash_.getHashSize());
@@ -882,12 +1054,37 @@ bool KeyValueTrie::getRoot(unsigned char * hash) {
 void KeyValueTrie::diff(const void * subtrie, const std::size_t length,
 		setsync::AbstractDiffHandler& handler) const {
 	unsigned char * subtrie_ = (unsigned char *) subtrie;
-	for (std::size_t i = 0; i < length / hash_.getHashSize(); i++) {
-		if (!contains(subtrie_ + i * hash_.getHashSize())) {
+	const std::size_t count = length / hash_.getHashSize();
+	std::vector<TrieNodeType> types(count);
+	if (count > 0) {
+		containsAll(subtrie_, count, &types[0]);
+	}
+	for (std::size_t i = 0; i < count; i++) {
+		if (types[i] == NOT_FOUND) {
 			handler(subtrie_ + i * hash_.getHashSize(), hash_.getHashSize(),
 					false);
 		}
 	}
 }
+void KeyValueTrie::flush() {
+	if (this->cache_ != NULL) {
+		this->cache_->flush();
+	}
+}
+
+uint64_t KeyValueTrie::getCacheHits() const {
+	if (this->cache_ == NULL) {
+		return 0;
+	}
+	return this->cache_->getHits();
+}
+
+uint64_t KeyValueTrie::getCacheMisses() const {
+	if (this->cache_ == NULL) {
+		return 0;
+	}
+	return this->cache_->getMisses();
+}
+
 }
 }
@@ -10,6 +10,7 @@
 #include <setsync/trie/Trie.h>
 #include <setsync/storage/KeyValueStorage.h>
 #include <setsync/trie/TrieException.h>
+#include <setsync/trie/TrieNodeCache.h>
 #include <setsync/sync/Synchronization.h>
 #include <setsync/DiffHandler.h>
 #include <exception>
@@ -53,6 +54,23 @@ private:
 	 * \return common bits
 	 */
 	uint8_t commonPrefixSize(const TrieNode& other) const;
+	/**
+	 * Maximum supported size of a hash in bytes, which is the size of
+	 * the largest digest of the supported hash functions (SHA-512)
+	 */
+	static const std::size_t MAX_HASH_SIZE = 64;
+	/**
+	 * Memory for the hash, the children, the parent and the prefix of
+	 * this node. It is a part of the node itself, so creating and copying
+	 * a node doesn't need an allocation. Only the first 5 * hashsize
+	 * bytes are used.
+	 */
+	unsigned char buffer_[5 * MAX_HASH_SIZE];
+	/**
+	 * Points the hash, smaller, larger, parent and prefix members to
+	 * their positions in the buffer of this node
+	 */
+	void initBuffer();
 	/// The hash of this node
 	unsigned char * hash;
 	/// The hash of the parent of this node
@@ -159,11 +177,36 @@ private:
 	 * Calculates a new hash, based on the hashes of the children hashes
 	 */
 	void updateHash();
+	/**
+	 * Marks all parents of this node as dirty and saves them. The walk
+	 * stops at the first parent, which is already dirty, because all
+	 * of its parents are dirty, too.
+	 */
+	void setParentsDirty();
+	/**
+	 * Recalculates the hashes of this node and all of its dirty children
+	 * bottom-up. The children are saved with the new hash of this node
+	 * as parent and the entry with the old hash of this node is deleted.
+	 * This node itself is not saved, so the caller has to call toDb()
+	 * and has to update the link of its parent.
+	 */
+	void rehash();
 	/**
 	 * Deletes the entry of the DB with the hash of this node
 	 * \return true if it has been deleted successfully
 	 */
 	bool deleteFromDb();
+	/**
+	 * Deletes the entries of the replaced nodes. A dirty node is stored
+	 * under its outdated hash, so a node rehashed by the same operation
+	 * could have got the hash of a replaced one and overwritten its
+	 * entry. Such entries are kept.
+	 *
+	 * \param replaced nodes, whose entries are no longer needed
+	 * \param written nodes saved by the same operation
+	 */
+	void deleteReplaced(const std::vector<TrieNode>& replaced,
+			const std::vector<TrieNode>& written) const;
 	/**
 	 * \return true if the given node has the same hash as it is saved for the smaller child
 	 */
@@ -346,10 +389,31 @@ class KeyValueTrie: public trie::Trie {
 private:
 	/// Instance of root node methods
 	KeyValueRootNode * root_;
-	/// Reference to the used key value storage
+	/// Write-back cache of the node records, NULL if caching is disabled
+	TrieNodeCache * cache_;
+	/// Reference to the used key value storage, which is the cache if enabled
 	setsync::storage::AbstractKeyValueStorage& storage_;
 	/// The key of the <key,value> pair in the DB, where the size is saved as value
 	static const char sizeKey[];
+	/// Maximum number of nodes read by a single multiGet() of the storage
+	static const std::size_t MULTI_GET_SIZE = 256;
+	/**
+	 * Reads the type of a node from its stored record, without
+	 * unmarshalling the node
+	 *
+	 * \param record of the node
+	 * \param recordSize of the record
+	 * \return NOT_FOUND, if the record isn't a node
+	 */
+	TrieNodeType nodeType(const unsigned char * record,
+			const std::size_t recordSize) const;
+	/**
+	 * Writes the size of the trie. It is called inside the batch of each
+	 * insert and erase, so the stored size always matches the stored nodes.
+	 *
+	 * \param size to be written
+	 */
+	void storeSize(const size_t size);
 	/**
 	 * Adds a cut through the subtree of the given root node.
 	 * The numberOfNodes is the maximum number of nodes, to be
@@ -366,8 +430,14 @@ private:
 					std::vector<TrieNode>& innerNodes,
 					std::vector<TrieNode>& leafNodes);
 public:
+	/**
+	 * \param hash function, which is used for the inner nodes
+	 * \param storage where the nodes of the trie are saved
+	 * \param cacheSize maximum number of bytes of the node cache, 0 disables the cache
+	 */
 	KeyValueTrie(const crypto::CryptoHash& hash,
-			setsync::storage::AbstractKeyValueStorage& storage);
+			setsync::storage::AbstractKeyValueStorage& storage,
+			const std::size_t cacheSize = 0);
 	virtual ~KeyValueTrie();
 	/**
 	 * \param hash to be added
@@ -382,10 +452,24 @@ public:
 	 */
 	virtual bool remove(const unsigned char * hash, bool performhash = true);
 	/**
+	 * Reads only the record of the node into a buffer on the stack and
+	 * checks its flags, a missing node doesn't throw an exception
+	 *
 	 * \param hash to be checked
-	 * \return true if the hash is available
+	 * \return the type of the node, NOT_FOUND if the hash isn't available
 	 */
 	virtual enum TrieNodeType contains(const unsigned char * hash) const;
+	/**
+	 * Reads the nodes of the hashes with one multiGet() of the storage
+	 * for each MULTI_GET_SIZE hashes
+	 */
+	virtual void containsAll(const unsigned char * hashes,
+			const std::size_t count, enum TrieNodeType * result) const;
+	/**
+	 * Rehashes all dirty nodes, starting at the root of the trie
+	 * and saves the new root hash.
+	 */
+	virtual void performHashing();
 	/**
 	 * Clears the complete Trie
 	 */
@@ -443,7 +527,18 @@ public:
 	 */
 	virtual void diff(const void * subtrie, const std::size_t length,
 			setsync::AbstractDiffHandler& handler) const;
-
+	/**
+	 * Writes all changed nodes of the node cache to the storage
+	 */
+	void flush();
+	/**
+	 * \return the number of nodes, which have been loaded from the node cache
+	 */
+	uint64_t getCacheHits() const;
+	/**
+	 * \return the number of nodes, which had to be loaded from the storage
+	 */
+	uint64_t getCacheMisses() const;
 };
 }
 }
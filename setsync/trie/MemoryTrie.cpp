@@ -0,0 +1,521 @@
+/*
+ * MemoryTrie.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "MemoryTrie.h"
+#include <setsync/utils/bitset.h>
+#include <setsync/utils/OutputFunctions.h>
+#include <stdlib.h>
+#include <typeinfo>
+
+namespace setsync {
+namespace trie {
+
+const std::size_t MemoryTrie::NODES_PER_BLOCK = 4096;
+
+MemoryTrie::MemoryTrie(const crypto::CryptoHash& hash) :
+	Trie(hash), root_(NULL), blockUsage_(NODES_PER_BLOCK), freeNodes_(NULL),
+			indexCapacity_(1024), indexSize_(0) {
+	// Keep all nodes in a block aligned to pointer size
+	this->nodeSize_ = sizeof(MemoryTrieNode) + 2 * hash.getHashSize();
+	if (this->nodeSize_ % sizeof(void *) != 0) {
+		this->nodeSize_ += sizeof(void *) - this->nodeSize_ % sizeof(void *);
+	}
+	this->index_ = (MemoryTrieNode **) calloc(indexCapacity_,
+			sizeof(MemoryTrieNode *));
+	if (this->index_ == NULL) {
+		throw TrieException("not enough memory to create the trie index");
+	}
+}
+
+MemoryTrie::~MemoryTrie() {
+	std::vector<unsigned char *>::iterator iter;
+	for (iter = blocks_.begin(); iter != blocks_.end(); iter++) {
+		free(*iter);
+	}
+	free(this->index_);
+}
+
+MemoryTrieNode * MemoryTrie::allocateNode() {
+	MemoryTrieNode * node;
+	if (this->freeNodes_ != NULL) {
+		node = this->freeNodes_;
+		this->freeNodes_ = node->parent;
+	} else {
+		if (this->blockUsage_ == NODES_PER_BLOCK) {
+			unsigned char * block = (unsigned char *) malloc(
+					NODES_PER_BLOCK * this->nodeSize_);
+			if (block == NULL) {
+				throw TrieException("not enough memory to add a trie node");
+			}
+			this->blocks_.push_back(block);
+			this->blockUsage_ = 0;
+		}
+		node = (MemoryTrieNode *) (this->blocks_.back() + this->blockUsage_
+				* this->nodeSize_);
+		this->blockUsage_++;
+	}
+	return node;
+}
+
+void MemoryTrie::freeNode(MemoryTrieNode * node) {
+	node->parent = this->freeNodes_;
+	this->freeNodes_ = node;
+}
+
+MemoryTrieNode * MemoryTrie::createLeaf(const unsigned char * hash) {
+	std::size_t hashsize = this->hash_.getHashSize();
+	MemoryTrieNode * leaf = allocateNode();
+	leaf->parent = NULL;
+	leaf->smaller = NULL;
+	leaf->larger = NULL;
+	leaf->prefix_mask = 8 * hashsize;
+	leaf->dirty = false;
+	memcpy(leaf->hash(), hash, hashsize);
+	memcpy(leaf->prefix(hashsize), hash, hashsize);
+	return leaf;
+}
+
+std::size_t MemoryTrie::getHomeSlot(const unsigned char * hash) const {
+	// Cryptographic hashes are uniformly distributed, so the first bytes
+	// can be used as hash table position
+	std::size_t slot;
+	memcpy(&slot, hash, sizeof(std::size_t));
+	return slot & (this->indexCapacity_ - 1);
+}
+
+MemoryTrieNode * MemoryTrie::find(const unsigned char * hash) const {
+	std::size_t hashsize = this->hash_.getHashSize();
+	std::size_t slot = getHomeSlot(hash);
+	while (this->index_[slot] != NULL) {
+		if (memcmp(this->index_[slot]->hash(), hash, hashsize) == 0) {
+			return this->index_[slot];
+		}
+		slot = (slot + 1) & (this->indexCapacity_ - 1);
+	}
+	return NULL;
+}
+
+void MemoryTrie::indexInsert(MemoryTrieNode * node) {
+	if (2 * (this->indexSize_ + 1) > this->indexCapacity_) {
+		growIndex();
+	}
+	std::size_t slot = getHomeSlot(node->hash());
+	while (this->index_[slot] != NULL) {
+		slot = (slot + 1) & (this->indexCapacity_ - 1);
+	}
+	this->index_[slot] = node;
+	this->indexSize_++;
+}
+
+void MemoryTrie::indexRemove(MemoryTrieNode * node) {
+	std::size_t mask = this->indexCapacity_ - 1;
+	std::size_t slot = getHomeSlot(node->hash());
+	while (this->index_[slot] != node) {
+		if (this->index_[slot] == NULL) {
+			throw TrieException("trie node is missing in the index");
+		}
+		slot = (slot + 1) & mask;
+	}
+	// Backward shift deletion, so no tombstones are needed
+	std::size_t next = slot;
+	while (true) {
+		next = (next + 1) & mask;
+		if (this->index_[next] == NULL)
+			break;
+		std::size_t home = getHomeSlot(this->index_[next]->hash());
+		bool movable;
+		if (next > slot) {
+			movable = home <= slot || home > next;
+		} else {
+			movable = home <= slot && home > next;
+		}
+		if (movable) {
+			this->index_[slot] = this->index_[next];
+			slot = next;
+		}
+	}
+	this->index_[slot] = NULL;
+	this->indexSize_--;
+}
+
+void MemoryTrie::growIndex() {
+	MemoryTrieNode ** old = this->index_;
+	std::size_t oldCapacity = this->indexCapacity_;
+	MemoryTrieNode ** grown = (MemoryTrieNode **) calloc(2 * oldCapacity,
+			sizeof(MemoryTrieNode *));
+	if (grown == NULL) {
+		throw TrieException("not enough memory to grow the trie index");
+	}
+	this->index_ = grown;
+	this->indexCapacity_ = 2 * oldCapacity;
+	this->indexSize_ = 0;
+	for (std::size_t i = 0; i < oldCapacity; i++) {
+		if (old[i] != NULL) {
+			std::size_t slot = getHomeSlot(old[i]->hash());
+			while (this->index_[slot] != NULL) {
+				slot = (slot + 1) & (this->indexCapacity_ - 1);
+			}
+			this->index_[slot] = old[i];
+			this->indexSize_++;
+		}
+	}
+	free(old);
+}
+
+void MemoryTrie::computeHash(MemoryTrieNode * node) {
+	std::size_t hashsize = this->hash_.getHashSize();
+	memcpy(this->hashscratch, node->smaller->hash(), hashsize);
+	memcpy(this->hashscratch + hashsize, node->larger->hash(), hashsize);
+	this->hash_(node->hash(), this->hashscratch, 2 * hashsize);
+	node->dirty = false;
+}
+
+void MemoryTrie::updateHash(MemoryTrieNode * node) {
+	indexRemove(node);
+	computeHash(node);
+	indexInsert(node);
+}
+
+void MemoryTrie::updateParents(MemoryTrieNode * node) {
+	while (node != NULL) {
+		updateHash(node);
+		node = node->parent;
+	}
+}
+
+void MemoryTrie::setDirty(MemoryTrieNode * node) {
+	while (node != NULL && !node->dirty) {
+		node->dirty = true;
+		node = node->parent;
+	}
+}
+
+void MemoryTrie::rehash(MemoryTrieNode * node) {
+	if (node->smaller->dirty)
+		rehash(node->smaller);
+	if (node->larger->dirty)
+		rehash(node->larger);
+	updateHash(node);
+}
+
+void MemoryTrie::replaceChild(MemoryTrieNode * parent,
+		MemoryTrieNode * oldchild, MemoryTrieNode * newchild) {
+	newchild->parent = parent;
+	if (parent == NULL) {
+		this->root_ = newchild;
+	} else if (parent->smaller == oldchild) {
+		parent->smaller = newchild;
+	} else if (parent->larger == oldchild) {
+		parent->larger = newchild;
+	} else {
+		throw DbTrieException("Child hasn't been correct child of parent");
+	}
+}
+
+bool MemoryTrie::add(const unsigned char * hash, bool performhash) {
+	if (performhash && isHashPerformingNedded()) {
+		performHashing();
+	}
+	std::size_t hashsize = this->hash_.getHashSize();
+	uint16_t bits = 8 * hashsize;
+	if (this->root_ == NULL) {
+		this->root_ = createLeaf(hash);
+		indexInsert(this->root_);
+		incSize();
+		return true;
+	}
+	// Walk down, while the prefix of the node is a prefix of the hash
+	MemoryTrieNode * node = this->root_;
+	uint16_t common = 0;
+	while (true) {
+		const unsigned char * prefix = node->prefix(hashsize);
+		while (common < node->prefix_mask && BITTEST(prefix, common)
+				== BITTEST(hash, common)) {
+			common++;
+		}
+		if (common < node->prefix_mask) {
+			break;
+		}
+		if (node->prefix_mask == bits) {
+			// Duplicated key
+			return false;
+		}
+		if (BITTEST(hash, node->prefix_mask)) {
+			node = node->larger;
+		} else {
+			node = node->smaller;
+		}
+	}
+	// Split: a new inner node with the common prefix gets the found
+	// node and the new leaf as children
+	MemoryTrieNode * leaf = createLeaf(hash);
+	MemoryTrieNode * intermediate = allocateNode();
+	memcpy(intermediate->prefix(hashsize), node->prefix(hashsize), hashsize);
+	intermediate->prefix_mask = common;
+	intermediate->dirty = false;
+	replaceChild(node->parent, node, intermediate);
+	if (BITTEST(hash, common)) {
+		intermediate->smaller = node;
+		intermediate->larger = leaf;
+	} else {
+		intermediate->smaller = leaf;
+		intermediate->larger = node;
+	}
+	node->parent = intermediate;
+	leaf->parent = intermediate;
+	indexInsert(leaf);
+	computeHash(intermediate);
+	indexInsert(intermediate);
+	// The hash of a dirty child is not valid, so the new parent stays dirty
+	if (node->dirty) {
+		intermediate->dirty = true;
+	}
+	if (performhash) {
+		updateParents(intermediate->parent);
+	} else {
+		setDirty(intermediate->parent);
+		setHashPerformingNeeded();
+	}
+	incSize();
+	return true;
+}
+
+bool MemoryTrie::remove(const unsigned char * hash, bool performhash) {
+	if (performhash && isHashPerformingNedded()) {
+		performHashing();
+	}
+	MemoryTrieNode * leaf = find(hash);
+	if (leaf == NULL || leaf->hasChildren()) {
+		return false;
+	}
+	MemoryTrieNode * parent = leaf->parent;
+	indexRemove(leaf);
+	freeNode(leaf);
+	decSize();
+	if (parent == NULL) {
+		this->root_ = NULL;
+	} else {
+		// The other child takes the place of the parent
+		MemoryTrieNode * sibling =
+				(parent->smaller == leaf) ? parent->larger : parent->smaller;
+		MemoryTrieNode * grandparent = parent->parent;
+		replaceChild(grandparent, parent, sibling);
+		indexRemove(parent);
+		freeNode(parent);
+		if (grandparent != NULL) {
+			if (performhash) {
+				updateParents(grandparent);
+			} else {
+				setDirty(grandparent);
+				setHashPerformingNeeded();
+			}
+		}
+	}
+	if (getSize() == 0) {
+		this->clear();
+	}
+	return true;
+}
+
+TrieNodeType MemoryTrie::contains(const unsigned char * hash) const {
+	MemoryTrieNode * node = find(hash);
+	if (node == NULL) {
+		return NOT_FOUND;
+	} else if (node->hasChildren()) {
+		return INNER_NODE;
+	} else {
+		return LEAF_NODE;
+	}
+}
+
+void MemoryTrie::performHashing() {
+	if (this->root_ != NULL && this->root_->dirty) {
+		rehash(this->root_);
+	}
+	setHashingPerformed();
+}
+
+void MemoryTrie::clear(void) {
+	std::vector<unsigned char *>::iterator iter;
+	for (iter = blocks_.begin(); iter != blocks_.end(); iter++) {
+		free(*iter);
+	}
+	this->blocks_.clear();
+	this->blockUsage_ = NODES_PER_BLOCK;
+	this->freeNodes_ = NULL;
+	this->root_ = NULL;
+	memset(this->index_, 0, this->indexCapacity_ * sizeof(MemoryTrieNode *));
+	this->indexSize_ = 0;
+	this->setSize(0);
+	setHashingPerformed();
+}
+
+bool MemoryTrie::operator ==(const Trie& other) const {
+	std::size_t hashsize = this->hash_.getHashSize();
+	if (other.getHash().getHashSize() != hashsize) {
+		return false;
+	}
+	unsigned char myroot[hashsize];
+	unsigned char otherroot[hashsize];
+	bool hasRoot = const_cast<MemoryTrie *> (this)->getRoot(myroot);
+	bool otherHasRoot = const_cast<Trie&> (other).getRoot(otherroot);
+	if (hasRoot != otherHasRoot) {
+		return false;
+	}
+	if (!hasRoot) {
+		return true;
+	}
+	return memcmp(myroot, otherroot, hashsize) == 0;
+}
+
+size_t MemoryTrie::getSubTrie(MemoryTrieNode * root,
+		const size_t numberOfNodes, std::vector<MemoryTrieNode *>& inner_nodes,
+		std::vector<MemoryTrieNode *>& child_nodes) {
+	if (root->hasChildren() && numberOfNodes >= 2) {
+		size_t smallercount = numberOfNodes / 2;
+		smallercount = getSubTrie(root->smaller, smallercount, inner_nodes,
+				child_nodes);
+		size_t largercount = numberOfNodes - smallercount;
+		largercount = getSubTrie(root->larger, largercount, inner_nodes,
+				child_nodes);
+		size_t sum = smallercount + largercount;
+		while (sum < numberOfNodes && inner_nodes.size() > 0) {
+			MemoryTrieNode * innerNode = inner_nodes.back();
+			inner_nodes.pop_back();
+			sum--;
+			sum += getSubTrie(innerNode, numberOfNodes - sum, inner_nodes,
+					child_nodes);
+		}
+		return sum;
+	} else {
+		if (root->hasChildren()) {
+			inner_nodes.push_back(root);
+		} else {
+			child_nodes.push_back(root);
+		}
+		return 1;
+	}
+}
+
+size_t MemoryTrie::getSubTrie(const unsigned char * hash, void * buffer,
+		const size_t buffersize) {
+	std::size_t hashsize = this->hash_.getHashSize();
+	size_t maxNumberOfHashes = buffersize / hashsize;
+	if (maxNumberOfHashes < 2) {
+		throw "buffer is too small!";
+	}
+	if (isHashPerformingNedded()) {
+		performHashing();
+	}
+	MemoryTrieNode * root = find(hash);
+	if (root == NULL) {
+		throw TrieNodeNotFoundException();
+	}
+	std::vector<MemoryTrieNode *> inner_nodes;
+	std::vector<MemoryTrieNode *> child_nodes;
+	size_t subtriesize = getSubTrie(root, maxNumberOfHashes, inner_nodes,
+			child_nodes);
+	unsigned char * pos = (unsigned char *) buffer;
+	while (inner_nodes.size() > 0) {
+		memcpy(pos, inner_nodes.back()->hash(), hashsize);
+		pos += hashsize;
+		inner_nodes.pop_back();
+	}
+	while (child_nodes.size() > 0) {
+		memcpy(pos, child_nodes.back()->hash(), hashsize);
+		pos += hashsize;
+		child_nodes.pop_back();
+	}
+	return subtriesize * hashsize;
+}
+
+bool MemoryTrie::getRoot(unsigned char * hash) {
+	if (this->getSize() == 0 || this->root_ == NULL)
+		return false;
+	if (isHashPerformingNedded())
+		performHashing();
+	memcpy(hash, this->root_->hash(), this->hash_.getHashSize());
+	return true;
+}
+
+void MemoryTrie::nodeToDotString(std::stringstream& ss,
+		MemoryTrieNode * node, const std::string& nodePrefix) const {
+	std::size_t hashsize = this->hash_.getHashSize();
+	std::string name = utils::OutputFunctions::CryptoHashtoString(
+			node->hash());
+	ss << nodePrefix << name << " [";
+	ss << "label=\"";
+	if (node->hasChildren())
+		ss << "{{";
+	ss << "hash: 0x" << utils::OutputFunctions::CryptoHashtoString(
+			node->hash(), 3);
+	ss << "...";
+	if (!node->hasChildren()) {
+		ss << "\\n0b" << utils::OutputFunctions::ArrayToBitString(
+				node->hash(), 8) << "...";
+	} else {
+		ss << "}|{prefix(" << (int) node->prefix_mask << "): ";
+		ss << utils::OutputFunctions::ArrayToBitString(
+				node->prefix(hashsize), node->prefix_mask);
+		ss << "}}";
+	}
+	ss << "\"";
+	if (node->hasChildren()) {
+		ss << ", shape=record";
+	}
+	if (node->dirty) {
+		ss << ", color=red";
+	}
+	ss << "];" << std::endl;
+	if (node->parent != NULL) {
+		ss << nodePrefix << name << " -> " << nodePrefix
+				<< utils::OutputFunctions::CryptoHashtoString(
+						node->parent->hash());
+		ss << " [style=dotted];" << std::endl;
+	}
+	if (node->hasChildren()) {
+		ss << nodePrefix << name << " -> " << nodePrefix
+				<< utils::OutputFunctions::CryptoHashtoString(
+						node->smaller->hash()) << " [label=\"smaller\"];"
+				<< std::endl;
+		ss << nodePrefix << name << " -> " << nodePrefix
+				<< utils::OutputFunctions::CryptoHashtoString(
+						node->larger->hash()) << " [label=\"larger\"];"
+				<< std::endl;
+		nodeToDotString(ss, node->smaller, nodePrefix);
+		nodeToDotString(ss, node->larger, nodePrefix);
+	}
+}
+
+std::string MemoryTrie::toDotString(const std::string nodePrefix) const {
+	std::stringstream ss;
+	if (this->root_ == NULL) {
+		ss << nodePrefix << "ROOT [label=\"ROOT\";shape=plaintext];"
+				<< std::endl;
+	} else {
+		ss << nodePrefix << "ROOT [label=\"ROOT\"];" << std::endl;
+		ss << nodePrefix << "ROOT -> " << nodePrefix
+				<< utils::OutputFunctions::CryptoHashtoString(
+						this->root_->hash());
+		ss << " [shape=plaintext];" << std::endl;
+		nodeToDotString(ss, this->root_, nodePrefix);
+	}
+	return ss.str();
+}
+
+void MemoryTrie::diff(const void * subtrie, const std::size_t length,
+		setsync::AbstractDiffHandler& handler) const {
+	unsigned char * subtrie_ = (unsigned char *) subtrie;
+	std::size_t hashsize = this->hash_.getHashSize();
+	for (std::size_t i = 0; i < length / hashsize; i++) {
+		if (!contains(subtrie_ + i * hashsize)) {
+			handler(subtrie_ + i * hashsize, hashsize, false);
+		}
+	}
+}
+
+}
+}
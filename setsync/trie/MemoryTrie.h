@@ -0,0 +1,249 @@
+/*
+ * MemoryTrie.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef MEMORYTRIE_H_
+#define MEMORYTRIE_H_
+
+#include <setsync/trie/Trie.h>
+#include <setsync/trie/TrieException.h>
+#include <setsync/DiffHandler.h>
+#include <vector>
+#include <sstream>
+#include <stdint.h>
+
+namespace setsync {
+namespace trie {
+
+/**
+ * A node of the MemoryTrie. The hash and the prefix of the node are
+ * saved directly behind the node in the same memory block, so a node
+ * has got a size of sizeof(MemoryTrieNode) + 2 * hashsize.
+ */
+struct MemoryTrieNode {
+	/// The parent of this node, NULL if this node is the root
+	MemoryTrieNode * parent;
+	/// The smaller child of this node, NULL if this node is a leaf
+	MemoryTrieNode * smaller;
+	/// The larger child of this node, NULL if this node is a leaf
+	MemoryTrieNode * larger;
+	/// The number of valid bits of the prefix
+	uint16_t prefix_mask;
+	/// true, if the hash of this node hasn't been updated since a child has changed
+	bool dirty;
+	/**
+	 * \return the hash of this node
+	 */
+	unsigned char * hash() {
+		return (unsigned char *) (this + 1);
+	}
+	/**
+	 * \return the prefix of this node, which is directly behind its hash
+	 */
+	unsigned char * prefix(const std::size_t hashsize) {
+		return hash() + hashsize;
+	}
+	/**
+	 * \return true if node has children, otherwise false
+	 */
+	bool hasChildren() const {
+		return this->smaller != NULL;
+	}
+};
+
+/**
+ * Trie implementation, which keeps all nodes in main memory. The nodes
+ * are allocated in large blocks and are linked by pointers, so no node
+ * has to be loaded or saved on a traversal. The inner nodes are hashed
+ * in the same way as by the KeyValueTrie, so both produce the same root
+ * hashes and sub tries for the same set of hashes and can be synchronized
+ * against each other. The content of a MemoryTrie is not persistent.
+ */
+class MemoryTrie: public trie::Trie {
+	friend class MemoryTrieTest;
+private:
+	/// Number of nodes, which are allocated at once
+	static const std::size_t NODES_PER_BLOCK;
+	/// The root node of the trie, NULL if the trie is empty
+	MemoryTrieNode * root_;
+	/// Size of a node including its hash and prefix in bytes
+	std::size_t nodeSize_;
+	/// All allocated node blocks
+	std::vector<unsigned char *> blocks_;
+	/// Number of used nodes in the last block
+	std::size_t blockUsage_;
+	/// Single linked list of freed nodes, linked by their parent pointers
+	MemoryTrieNode * freeNodes_;
+	/// Open addressing hash table to find any node by its hash
+	MemoryTrieNode ** index_;
+	/// Number of slots in the index, always a power of two
+	std::size_t indexCapacity_;
+	/// Number of nodes in the index
+	std::size_t indexSize_;
+	/**
+	 * \return a new uninitialized node
+	 */
+	MemoryTrieNode * allocateNode();
+	/**
+	 * Puts the given node back to the list of free nodes
+	 *
+	 * \param node to be freed
+	 */
+	void freeNode(MemoryTrieNode * node);
+	/**
+	 * Creates a new leaf for the given hash, which is not yet indexed
+	 *
+	 * \param hash of the leaf
+	 * \return the new leaf
+	 */
+	MemoryTrieNode * createLeaf(const unsigned char * hash);
+	/**
+	 * \return the index slot, where a hash has to be searched first
+	 */
+	std::size_t getHomeSlot(const unsigned char * hash) const;
+	/**
+	 * Searches the node with the given hash in the index
+	 *
+	 * \param hash of the requested node
+	 * \return the found node, or NULL if no node has got this hash
+	 */
+	MemoryTrieNode * find(const unsigned char * hash) const;
+	/**
+	 * Adds the given node with its actual hash to the index
+	 */
+	void indexInsert(MemoryTrieNode * node);
+	/**
+	 * Removes the given node from the index
+	 */
+	void indexRemove(MemoryTrieNode * node);
+	/**
+	 * Doubles the capacity of the index
+	 */
+	void growIndex();
+	/**
+	 * Calculates the hash of the given inner node by hashing the
+	 * hashes of its children. The index is not updated.
+	 *
+	 * \param node to be hashed
+	 */
+	void computeHash(MemoryTrieNode * node);
+	/**
+	 * Calculates the hash of the given inner node by hashing the
+	 * hashes of its children and updates the index.
+	 *
+	 * \param node to be hashed
+	 */
+	void updateHash(MemoryTrieNode * node);
+	/**
+	 * Recalculates the hashes of all parents of the given node
+	 */
+	void updateParents(MemoryTrieNode * node);
+	/**
+	 * Marks the given node and all parents as dirty. The walk stops
+	 * at the first node, which is already dirty.
+	 */
+	void setDirty(MemoryTrieNode * node);
+	/**
+	 * Recalculates the hashes of the given node and all of its dirty
+	 * children bottom-up.
+	 */
+	void rehash(MemoryTrieNode * node);
+	/**
+	 * Replaces the child oldchild of the given parent with newchild. If
+	 * parent is NULL, newchild becomes the root of the trie.
+	 */
+	void replaceChild(MemoryTrieNode * parent, MemoryTrieNode * oldchild,
+			MemoryTrieNode * newchild);
+	/**
+	 * Adds a cut through the subtree of the given root node.
+	 * The numberOfNodes is the maximum number of nodes, to be
+	 * added to the cut.
+	 *
+	 * \param root node of the requested subtree
+	 * \param numberOfNodes to be added to the subtree
+	 * \param innerNodes is a vector to save an inner node to the cut
+	 * \param leafNodes is a vector to save leaf nodes to the cut
+	 * \return the number of found nodes in the subtree
+	 */
+	size_t getSubTrie(MemoryTrieNode * root, const size_t numberOfNodes,
+			std::vector<MemoryTrieNode *>& innerNodes,
+			std::vector<MemoryTrieNode *>& leafNodes);
+	/**
+	 * Writes the given node and all of its children as dot nodes
+	 */
+	void nodeToDotString(std::stringstream& ss, MemoryTrieNode * node,
+			const std::string& nodePrefix) const;
+public:
+	MemoryTrie(const crypto::CryptoHash& hash);
+	virtual ~MemoryTrie();
+	/**
+	 * \param hash to be added
+	 * \param performhash if false, the parents are only marked as dirty
+	 * \return true on success
+	 */
+	virtual bool add(const unsigned char * hash, bool performhash = true);
+	/**
+	 * \param hash to be removed
+	 * \param performhash if false, the parents are only marked as dirty
+	 * \return true on success
+	 */
+	virtual bool remove(const unsigned char * hash, bool performhash = true);
+	/**
+	 * \param hash to be checked
+	 * \return the type of the node with the given hash
+	 */
+	virtual enum TrieNodeType contains(const unsigned char * hash) const;
+	/**
+	 * Rehashes all dirty nodes, starting at the root of the trie
+	 */
+	virtual void performHashing();
+	/**
+	 * Frees all nodes of the Trie
+	 */
+	virtual void clear(void);
+	/**
+	 * \return true if both root elements hashes are equal
+	 */
+	virtual bool operator ==(const Trie& other) const;
+	/**
+	 * Copies a subtrie into the given buffer with a maximum size
+	 * of buffersize. The output is the same as the output of
+	 * KeyValueTrie::getSubTrie for the same set of hashes.
+	 *
+	 * \param hash of the root of the requested subtrie
+	 * \param buffer where the subtrie will by copied to
+	 * \param buffersize for the subtrie
+	 * \return used buffer size in bytes
+	 */
+	virtual size_t getSubTrie(const unsigned char * hash, void * buffer,
+			const size_t buffersize);
+	/**
+	 * Copies the root of the trie into the given memory
+	 *
+	 * \param hash memory space, where the root should be copied to
+	 * \return true if a root is available, false otherwise
+	 */
+	virtual bool getRoot(unsigned char * hash);
+	/**
+	 * \param nodePrefix of the dot nodes
+	 * \return dot string containing the whole trie
+	 */
+	virtual std::string toDotString(const std::string nodePrefix = "N") const;
+	/**
+	 * Calls the handler for each hash of the given subtrie, which
+	 * is not available in this trie.
+	 *
+	 * \param subtrie list of hashes
+	 * \param length of the subtrie in bytes
+	 * \param handler to be called for missing hashes
+	 */
+	virtual void diff(const void * subtrie, const std::size_t length,
+			setsync::AbstractDiffHandler& handler) const;
+};
+
+}
+}
+
+#endif /* MEMORYTRIE_H_ */
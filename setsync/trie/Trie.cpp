@@ -11,6 +11,7 @@ namespace trie {
 Trie::Trie(const crypto::CryptoHash& hash) :
 	hash_(hash) {
 	this->size = 0;
+	this->needsHashPerforming = false;
 	this->hashscratch = new unsigned char[this->hash_.getHashSize() * 2];
 }
 
@@ -46,6 +47,10 @@ void Trie::setHashingPerformed() {
 	this->needsHashPerforming = false;
 }
 
+void Trie::setHashPerformingNeeded() {
+	this->needsHashPerforming = true;
+}
+
 bool Trie::add(const unsigned char * hash) {
 	return add(hash, true);
 }
@@ -106,6 +111,13 @@ TrieNodeType Trie::contains(const std::string& str) const {
 	return contains(c);
 }
 
+void Trie::containsAll(const unsigned char * hashes, const std::size_t count,
+		TrieNodeType * result) const {
+	for (std::size_t i = 0; i < count; i++) {
+		result[i] = contains(hashes + i * this->hash_.getHashSize());
+	}
+}
+
 std::string Trie::toDotString() const {
 	return toDotString("N");
 }
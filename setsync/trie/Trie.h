@@ -63,6 +63,11 @@ protected:
 	 * clean state, so no node is marked as dirty.
 	 */
 	void setHashingPerformed();
+	/**
+	 * This method should be called after an insert or remove
+	 * has been executed without rehashing all parents.
+	 */
+	void setHashPerformingNeeded();
 public:
 	Trie(const crypto::CryptoHash& hash);
 	/**
@@ -125,9 +130,26 @@ public:
 	virtual bool remove(const std::string& str, bool performhash);
 	virtual bool remove(const unsigned char * hash);
 	virtual bool remove(const unsigned char * hash, bool performhash) = 0;
+	/**
+	 * Recalculates the hashes of all nodes, which have been marked as
+	 * dirty by calling add or remove with performhash set to false.
+	 * After this call the root hash of the Trie is valid again.
+	 */
+	virtual void performHashing() = 0;
 	virtual enum TrieNodeType contains(const char * str) const;
 	virtual enum TrieNodeType contains(const std::string& str) const;
 	virtual enum TrieNodeType contains(const unsigned char * hash) const = 0;
+	/**
+	 * Checks several hashes at once. Tries on a storage are able to read
+	 * the nodes with fewer accesses than single contains() calls. The
+	 * default implementation calls contains() for each hash.
+	 *
+	 * \param hashes to be checked, one after another
+	 * \param count number of hashes
+	 * \param result array of count node types, one for each hash
+	 */
+	virtual void containsAll(const unsigned char * hashes,
+			const std::size_t count, enum TrieNodeType * result) const;
 	/**
 	 * Deletes all nodes from the Trie, this can be different in
 	 * various ways of implementations, if the underlying technology
@@ -0,0 +1,363 @@
+/*
+ * TrieNodeCache.cpp
+ *
+ *      Author: Till Lorentzen
+ */
+
+#include "TrieNodeCache.h"
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+namespace setsync {
+namespace trie {
+
+const std::size_t TrieNodeCache::ENTRY_OVERHEAD = sizeof(CacheEntry)
+		+ sizeof(std::string) + 4 * sizeof(void *);
+
+TrieNodeCache::TrieNodeCache(
+		setsync::storage::AbstractKeyValueStorage& storage,
+		const std::size_t capacity) :
+	storage_(storage), capacity_(capacity), usedBytes_(0), hits_(0),
+			misses_(0) {
+}
+
+TrieNodeCache::~TrieNodeCache() {
+	try {
+		flush();
+	} catch (...) {
+		// Nothing can be done about it in a destructor
+	}
+}
+
+std::size_t TrieNodeCache::entrySize(const std::string& key,
+		const CacheEntry& entry) {
+	return key.size() + entry.value.size() + ENTRY_OVERHEAD;
+}
+
+void TrieNodeCache::touch(CacheEntry& entry) const {
+	this->lru_.splice(this->lru_.begin(), this->lru_, entry.lru);
+}
+
+TrieNodeCache::CacheEntry& TrieNodeCache::insert(const std::string& key) const {
+	CacheEntry& entry = this->entries_[key];
+	entry.deleted = false;
+	entry.dirty = false;
+	entry.lru = this->lru_.insert(this->lru_.begin(), key);
+	this->usedBytes_ += entrySize(key, entry);
+	return entry;
+}
+
+void TrieNodeCache::erase(EntryMap::iterator it) const {
+	this->usedBytes_ -= entrySize(it->first, it->second);
+	this->lru_.erase(it->second.lru);
+	this->entries_.erase(it);
+}
+
+void TrieNodeCache::writeBack(const std::string& key, CacheEntry& entry) const {
+	if (!entry.dirty) {
+		return;
+	}
+	// A record written back by a batch is lost, if the batch is aborted
+	save(key);
+	if (entry.deleted) {
+		this->storage_.del((const unsigned char *) key.data(), key.size());
+	} else {
+		this->storage_.put((const unsigned char *) key.data(), key.size(),
+				(const unsigned char *) entry.value.data(), entry.value.size());
+	}
+	entry.dirty = false;
+}
+
+void TrieNodeCache::evict() const {
+	while (this->usedBytes_ > this->capacity_ && !this->lru_.empty()) {
+		EntryMap::iterator it = this->entries_.find(this->lru_.back());
+		writeBack(it->first, it->second);
+		erase(it);
+	}
+}
+
+bool TrieNodeCache::get(const unsigned char * key, const std::size_t length,
+		unsigned char ** value, std::size_t * valueSize) const {
+	std::string k((const char *) key, length);
+	EntryMap::iterator it = this->entries_.find(k);
+	if (it != this->entries_.end()) {
+		this->hits_++;
+		touch(it->second);
+		if (it->second.deleted) {
+			*value = NULL;
+			*valueSize = 0;
+			return false;
+		}
+		*valueSize = it->second.value.size();
+		*value = (unsigned char *) malloc(*valueSize);
+		memcpy(*value, it->second.value.data(), *valueSize);
+		return true;
+	}
+	this->misses_++;
+	if (!this->storage_.get(key, length, value, valueSize)) {
+		return false;
+	}
+	CacheEntry& entry = insert(k);
+	entry.value.assign((const char *) *value, *valueSize);
+	this->usedBytes_ += *valueSize;
+	evict();
+	return true;
+}
+
+bool TrieNodeCache::getInto(const unsigned char * key,
+		const std::size_t length, unsigned char * buffer,
+		const std::size_t bufferSize, std::size_t * valueSize) const {
+	std::string k((const char *) key, length);
+	EntryMap::iterator it = this->entries_.find(k);
+	if (it != this->entries_.end()) {
+		this->hits_++;
+		touch(it->second);
+		if (it->second.deleted) {
+			*valueSize = 0;
+			return false;
+		}
+		*valueSize = it->second.value.size();
+		if (*valueSize <= bufferSize) {
+			memcpy(buffer, it->second.value.data(), *valueSize);
+		}
+		return true;
+	}
+	this->misses_++;
+	if (!this->storage_.getInto(key, length, buffer, bufferSize, valueSize)) {
+		return false;
+	}
+	if (*valueSize <= bufferSize) {
+		CacheEntry& entry = insert(k);
+		entry.value.assign((const char *) buffer, *valueSize);
+		this->usedBytes_ += *valueSize;
+		evict();
+	}
+	return true;
+}
+
+std::size_t TrieNodeCache::multiGet(const unsigned char * keys,
+		const std::size_t keyLength, const std::size_t count,
+		unsigned char * values, const std::size_t valueStride,
+		std::size_t * valueSizes, bool * found) const {
+	std::size_t result = 0;
+	std::vector<std::size_t> missing;
+	std::string k;
+	for (std::size_t i = 0; i < count; i++) {
+		k.assign((const char *) keys + i * keyLength, keyLength);
+		EntryMap::iterator it = this->entries_.find(k);
+		if (it == this->entries_.end()) {
+			missing.push_back(i);
+			continue;
+		}
+		this->hits_++;
+		touch(it->second);
+		found[i] = !it->second.deleted;
+		valueSizes[i] = found[i] ? it->second.value.size() : 0;
+		if (found[i] && valueSizes[i] <= valueStride) {
+			memcpy(values + i * valueStride, it->second.value.data(),
+					valueSizes[i]);
+		}
+		if (found[i]) {
+			result++;
+		}
+	}
+	if (missing.empty()) {
+		return result;
+	}
+	this->misses_ += missing.size();
+	std::vector<unsigned char> missingKeys(missing.size() * keyLength);
+	for (std::size_t i = 0; i < missing.size(); i++) {
+		memcpy(&missingKeys[i * keyLength], keys + missing[i] * keyLength,
+				keyLength);
+	}
+	std::vector<unsigned char> missingValues(missing.size() * valueStride);
+	std::vector<std::size_t> missingSizes(missing.size());
+	bool missingFound[missing.size()];
+	this->storage_.multiGet(&missingKeys[0], keyLength, missing.size(),
+			missingValues.empty() ? NULL : &missingValues[0], valueStride,
+			&missingSizes[0], missingFound);
+	for (std::size_t i = 0; i < missing.size(); i++) {
+		const std::size_t index = missing[i];
+		found[index] = missingFound[i];
+		valueSizes[index] = missingSizes[i];
+		if (found[index]) {
+			result++;
+		}
+		if (!found[index] || valueSizes[index] > valueStride) {
+			continue;
+		}
+		const unsigned char * value = &missingValues[i * valueStride];
+		memcpy(values + index * valueStride, value, valueSizes[index]);
+		k.assign((const char *) keys + index * keyLength, keyLength);
+		CacheEntry& entry = insert(k);
+		entry.value.assign((const char *) value, valueSizes[index]);
+		this->usedBytes_ += valueSizes[index];
+	}
+	evict();
+	return result;
+}
+
+void TrieNodeCache::put(const unsigned char * key, const std::size_t keySize,
+		const unsigned char * value, const std::size_t valueSize) {
+	std::string k((const char *) key, keySize);
+	save(k);
+	EntryMap::iterator it = this->entries_.find(k);
+	if (it == this->entries_.end()) {
+		insert(k);
+		it = this->entries_.find(k);
+	} else {
+		touch(it->second);
+	}
+	CacheEntry& entry = it->second;
+	this->usedBytes_ -= entry.value.size();
+	entry.value.assign((const char *) value, valueSize);
+	this->usedBytes_ += entry.value.size();
+	entry.deleted = false;
+	entry.dirty = true;
+	if (!isBatchRunning()) {
+		writeBack(k, entry);
+	}
+	evict();
+}
+
+void TrieNodeCache::del(const unsigned char * key, const std::size_t keySize) {
+	std::string k((const char *) key, keySize);
+	save(k);
+	EntryMap::iterator it = this->entries_.find(k);
+	if (it == this->entries_.end()) {
+		insert(k);
+		it = this->entries_.find(k);
+	} else {
+		touch(it->second);
+	}
+	CacheEntry& entry = it->second;
+	this->usedBytes_ -= entry.value.size();
+	entry.value.clear();
+	entry.deleted = true;
+	entry.dirty = true;
+	if (!isBatchRunning()) {
+		writeBack(k, entry);
+	}
+	evict();
+}
+
+void TrieNodeCache::clear(void) {
+	this->saved_.clear();
+	this->entries_.clear();
+	this->lru_.clear();
+	this->usedBytes_ = 0;
+	this->storage_.clear();
+}
+
+void TrieNodeCache::save(const std::string& key) const {
+	if (!isBatchRunning() || this->saved_.find(key) != this->saved_.end()) {
+		return;
+	}
+	SavedEntry& saved = this->saved_[key];
+	EntryMap::const_iterator it = this->entries_.find(key);
+	saved.cached = it != this->entries_.end();
+	if (saved.cached) {
+		saved.value = it->second.value;
+		saved.deleted = it->second.deleted;
+		saved.dirty = it->second.dirty;
+	}
+}
+
+void TrieNodeCache::restore() {
+	SavedEntryMap::const_iterator s;
+	for (s = this->saved_.begin(); s != this->saved_.end(); s++) {
+		EntryMap::iterator it = this->entries_.find(s->first);
+		if (!s->second.cached) {
+			if (it != this->entries_.end())
+				erase(it);
+			continue;
+		}
+		if (it == this->entries_.end()) {
+			insert(s->first);
+			it = this->entries_.find(s->first);
+		}
+		CacheEntry& entry = it->second;
+		this->usedBytes_ -= entry.value.size();
+		entry.value = s->second.value;
+		this->usedBytes_ += entry.value.size();
+		entry.deleted = s->second.deleted;
+		entry.dirty = s->second.dirty;
+	}
+	this->saved_.clear();
+}
+
+void TrieNodeCache::beginBatch() {
+	this->storage_.beginBatch();
+	AbstractKeyValueStorage::beginBatch();
+}
+
+void TrieNodeCache::writeBackBatch() const {
+	SavedEntryMap::const_iterator s;
+	for (s = this->saved_.begin(); s != this->saved_.end(); s++) {
+		EntryMap::iterator it = this->entries_.find(s->first);
+		if (it == this->entries_.end()) {
+			// Evicted entries have already been written into the batch
+			continue;
+		}
+		writeBack(it->first, it->second);
+		if (it->second.deleted) {
+			erase(it);
+		}
+	}
+}
+
+void TrieNodeCache::commitBatch() {
+	if (this->batchDepth_ == 1) {
+		// The storage gets the whole batch, so it never holds a part of it
+		writeBackBatch();
+	}
+	// The storage is committed first, so a failed commit could be aborted
+	this->storage_.commitBatch();
+	AbstractKeyValueStorage::commitBatch();
+	if (!isBatchRunning()) {
+		this->saved_.clear();
+	}
+}
+
+void TrieNodeCache::abortBatch() {
+	this->storage_.abortBatch();
+	AbstractKeyValueStorage::abortBatch();
+	restore();
+	evict();
+}
+
+setsync::storage::AbstractKeyValueIterator * TrieNodeCache::createIterator() {
+	flush();
+	return this->storage_.createIterator();
+}
+
+void TrieNodeCache::flush() {
+	EntryMap::iterator it = this->entries_.begin();
+	while (it != this->entries_.end()) {
+		EntryMap::iterator current = it++;
+		writeBack(current->first, current->second);
+		if (current->second.deleted) {
+			erase(current);
+		}
+	}
+}
+
+std::size_t TrieNodeCache::getCapacity() const {
+	return this->capacity_;
+}
+
+std::size_t TrieNodeCache::getUsedBytes() const {
+	return this->usedBytes_;
+}
+
+uint64_t TrieNodeCache::getHits() const {
+	return this->hits_;
+}
+
+uint64_t TrieNodeCache::getMisses() const {
+	return this->misses_;
+}
+
+}
+}
@@ -0,0 +1,205 @@
+/*
+ * TrieNodeCache.h
+ *
+ *      Author: Till Lorentzen
+ */
+
+#ifndef TRIENODECACHE_H_
+#define TRIENODECACHE_H_
+
+#include <setsync/storage/KeyValueStorage.h>
+#include <string>
+#include <list>
+#include <map>
+#include <stdint.h>
+
+namespace setsync {
+namespace trie {
+
+/**
+ * Write-back cache for the node records of a KeyValueTrie. It is put
+ * between the trie and its key value storage and keeps the most recently
+ * used records in memory. Records changed by a batch are written to the
+ * underlying storage with the commit of the outermost batch, so a record,
+ * which is saved multiple times or saved and deleted again by the same
+ * batch, is written only once. Changes outside of a batch are written
+ * through. The storage never holds a part of a batch, so the cache is as
+ * crash-safe as the storage itself.
+ *
+ * Batches are passed to the storage. Aborting a batch restores the cached
+ * records, which have been changed since the batch has been started.
+ */
+class TrieNodeCache: public setsync::storage::AbstractKeyValueStorage {
+private:
+	/// Estimated memory overhead of a single cache entry in bytes
+	static const std::size_t ENTRY_OVERHEAD;
+	/// Least recently used list of keys, the most recent key is in front
+	typedef std::list<std::string> LruList;
+	/**
+	 * A cached record, or the mark that a record has been deleted
+	 */
+	struct CacheEntry {
+		/// The value of the record, empty if deleted is set
+		std::string value;
+		/// true, if the record has been deleted
+		bool deleted;
+		/// true, if the record has to be written to the storage
+		bool dirty;
+		/// Position of the key in the LRU list
+		LruList::iterator lru;
+	};
+	typedef std::map<std::string, CacheEntry> EntryMap;
+	/**
+	 * State of a record before its first change in the running batch
+	 */
+	struct SavedEntry {
+		/// false, if the record hasn't been cached
+		bool cached;
+		std::string value;
+		bool deleted;
+		bool dirty;
+	};
+	typedef std::map<std::string, SavedEntry> SavedEntryMap;
+	/// The storage, which is cached
+	setsync::storage::AbstractKeyValueStorage& storage_;
+	/// Maximum number of bytes used by the cached entries
+	std::size_t capacity_;
+	/// Number of bytes used by the cached entries
+	mutable std::size_t usedBytes_;
+	/// All cached entries
+	mutable EntryMap entries_;
+	/// Least recently used order of the cached entries
+	mutable LruList lru_;
+	/// Number of get calls, which have been answered from the cache
+	mutable uint64_t hits_;
+	/// Number of get calls, which had to ask the storage
+	mutable uint64_t misses_;
+	/// Records changed or written back during the running batch
+	mutable SavedEntryMap saved_;
+	/**
+	 * \return the number of bytes, used by the given entry
+	 */
+	static std::size_t entrySize(const std::string& key,
+			const CacheEntry& entry);
+	/**
+	 * Marks the given entry as most recently used
+	 */
+	void touch(CacheEntry& entry) const;
+	/**
+	 * Creates a new entry for the given key and puts it in front of
+	 * the LRU list
+	 *
+	 * \return the new entry
+	 */
+	CacheEntry& insert(const std::string& key) const;
+	/**
+	 * Removes the entry at the given position from the cache without
+	 * writing it to the storage
+	 */
+	void erase(EntryMap::iterator it) const;
+	/**
+	 * Writes the given entry to the storage, if it is dirty
+	 */
+	void writeBack(const std::string& key, CacheEntry& entry) const;
+	/**
+	 * Evicts the least recently used entries until the used bytes
+	 * fit into the capacity again.
+	 */
+	void evict() const;
+	/**
+	 * Saves the state of the given record, if a batch is running and
+	 * the record hasn't been saved by it before
+	 */
+	void save(const std::string& key) const;
+	/**
+	 * Writes the records changed by the running batch into the batch of
+	 * the storage
+	 */
+	void writeBackBatch() const;
+	/**
+	 * Restores all records saved by the running batch
+	 */
+	void restore();
+public:
+	/**
+	 * \param storage to be cached
+	 * \param capacity maximum number of bytes used by the cache
+	 */
+	TrieNodeCache(setsync::storage::AbstractKeyValueStorage& storage,
+			const std::size_t capacity);
+	/**
+	 * Writes all changed records to the storage
+	 */
+	virtual ~TrieNodeCache();
+	virtual bool get(const unsigned char * key, const std::size_t length,
+			unsigned char ** value, std::size_t * valueSize) const;
+	/**
+	 * Copies a cached value into the given buffer. A missing record is
+	 * read with getInto() of the storage and cached, if it fits into the
+	 * buffer.
+	 */
+	virtual bool getInto(const unsigned char * key, const std::size_t length,
+			unsigned char * buffer, const std::size_t bufferSize,
+			std::size_t * valueSize) const;
+	/**
+	 * Answers the cached records and reads the missing ones with a single
+	 * multiGet() of the storage
+	 */
+	virtual std::size_t multiGet(const unsigned char * keys,
+			const std::size_t keyLength, const std::size_t count,
+			unsigned char * values, const std::size_t valueStride,
+			std::size_t * valueSizes, bool * found) const;
+	virtual void put(const unsigned char * key, const std::size_t keySize,
+			const unsigned char * value, const std::size_t valueSize);
+	virtual void del(const unsigned char * key, const std::size_t keySize);
+	/**
+	 * Drops all cached entries and clears the storage
+	 */
+	virtual void clear(void);
+	/**
+	 * Starts a batch on the cache and the storage
+	 */
+	virtual void beginBatch();
+	/**
+	 * Commits the batch of the storage. The outermost batch writes all
+	 * records changed by it into the batch of the storage before, so they
+	 * are written at once with the evicted ones.
+	 */
+	virtual void commitBatch();
+	/**
+	 * Aborts the batch of the storage and restores the cached records
+	 */
+	virtual void abortBatch();
+	/**
+	 * Flushes the cache and returns an iterator of the storage
+	 *
+	 * \return a new iterator
+	 */
+	virtual setsync::storage::AbstractKeyValueIterator * createIterator();
+	/**
+	 * Writes all changed and deleted records to the storage. The
+	 * changed records remain in the cache, the deleted are dropped.
+	 */
+	void flush();
+	/**
+	 * \return the maximum number of bytes used by the cache
+	 */
+	std::size_t getCapacity() const;
+	/**
+	 * \return the number of bytes actually used by the cache
+	 */
+	std::size_t getUsedBytes() const;
+	/**
+	 * \return the number of records, which have been found in the cache
+	 */
+	uint64_t getHits() const;
+	/**
+	 * \return the number of records, which have been requested from the storage
+	 */
+	uint64_t getMisses() const;
+};
+
+}
+}
+
+#endif /* TRIENODECACHE_H_ */